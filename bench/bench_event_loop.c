@@ -0,0 +1,361 @@
+/**
+ * Event Loop Task Queue Benchmark
+ *
+ * Many producer threads post tasks to one event loop thread, the way
+ * workers hand results to an application with application_post():
+ *
+ *   post_task    event_loop_post_task() with preallocated intrusive nodes
+ *   post         event_loop_post(), one malloc'd node per task
+ *   mutex        mutex-protected list plus one eventfd write per task,
+ *                the design the lock-free queue replaced
+ *
+ * Every 16th enqueue is timed for the latency percentiles (the call only,
+ * not the time until the task runs). Throughput counts from the moment the
+ * first producer starts until the loop thread has run every task. Each task
+ * carries its producer's sequence number, so the loop thread also checks
+ * that every task ran exactly once and in per-producer order.
+ *
+ * Usage: bench_event_loop [options]
+ *   -p COUNT   Producer threads (default 16)
+ *   -n COUNT   Tasks per producer (default 200000)
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include "event_loop.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#define SAMPLE_EVERY 16
+
+typedef enum {
+    MODE_POST_TASK = 0,
+    MODE_POST,
+    MODE_MUTEX
+} MODE;
+
+/* One task; node is only used by post_task */
+typedef struct {
+    EVENT_LOOP_TASK node;
+    uint32_t producer;
+    uint32_t seq;
+} BENCH_TASK;
+
+/* Baseline queue */
+typedef struct _mutex_task_ {
+    struct _mutex_task_ *next;
+    BENCH_TASK *task;
+} MUTEX_TASK;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    MUTEX_TASK *head;
+    MUTEX_TASK *tail;
+    int event_fd;
+} MUTEX_QUEUE;
+
+/* Shared run state */
+typedef struct {
+    MODE mode;
+    EVENT_LOOP *loop;
+    MUTEX_QUEUE mutex_queue;
+    size_t producers;
+    size_t per_producer;
+    
+    pthread_barrier_t start;    /* Producers and the loop thread start together */
+    
+    /* Loop thread only */
+    uint32_t *next_seq;
+    size_t executed;
+    size_t errors;
+    uint64_t end;
+} RUN;
+
+typedef struct {
+    RUN *run;
+    uint32_t id;
+    BENCH_TASK *tasks;
+    uint64_t *samples;
+    size_t sample_count;
+    uint64_t start;
+} PRODUCER;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+/* ==================== Consumer ==================== */
+
+/* Runs on the loop thread for every task */
+static void consume(RUN *run, BENCH_TASK *task)
+{
+    if (task->seq != run->next_seq[task->producer]) {
+        run->errors++;
+    }
+    run->next_seq[task->producer] = task->seq + 1;
+    
+    if (++run->executed == run->producers * run->per_producer) {
+        run->end = now_ns();
+        if (run->mode != MODE_MUTEX) {
+            event_loop_stop(run->loop);
+        }
+    }
+}
+
+static RUN *g_run;
+
+static void on_task(void *arg)
+{
+    consume(g_run, (BENCH_TASK*)arg);
+}
+
+/* Baseline consumer: wait on the eventfd, take the whole list, run it */
+static void mutex_consumer(RUN *run)
+{
+    MUTEX_QUEUE *queue = &run->mutex_queue;
+    size_t total = run->producers * run->per_producer;
+    
+    while (run->executed < total) {
+        uint64_t count;
+        if (read(queue->event_fd, &count, sizeof(count)) != sizeof(count)) {
+            continue;
+        }
+        
+        pthread_mutex_lock(&queue->mutex);
+        MUTEX_TASK *item = queue->head;
+        queue->head = NULL;
+        queue->tail = NULL;
+        pthread_mutex_unlock(&queue->mutex);
+        
+        while (item) {
+            MUTEX_TASK *next = item->next;
+            consume(run, item->task);
+            free(item);
+            item = next;
+        }
+    }
+}
+
+/* ==================== Producers ==================== */
+
+static int mutex_post(MUTEX_QUEUE *queue, BENCH_TASK *task)
+{
+    MUTEX_TASK *item = (MUTEX_TASK*)malloc(sizeof(MUTEX_TASK));
+    if (!item) {
+        return -1;
+    }
+    item->next = NULL;
+    item->task = task;
+    
+    pthread_mutex_lock(&queue->mutex);
+    if (queue->tail) {
+        queue->tail->next = item;
+    } else {
+        queue->head = item;
+    }
+    queue->tail = item;
+    pthread_mutex_unlock(&queue->mutex);
+    
+    uint64_t one = 1;
+    ssize_t written = write(queue->event_fd, &one, sizeof(one));
+    (void)written;
+    return 0;
+}
+
+static int post(RUN *run, BENCH_TASK *task)
+{
+    switch (run->mode) {
+        case MODE_POST_TASK: return event_loop_post_task(run->loop, &task->node);
+        case MODE_POST: return event_loop_post(run->loop, on_task, task);
+        case MODE_MUTEX: return mutex_post(&run->mutex_queue, task);
+    }
+    return -1;
+}
+
+static void* producer_thread(void *arg)
+{
+    PRODUCER *producer = (PRODUCER*)arg;
+    RUN *run = producer->run;
+    
+    pthread_barrier_wait(&run->start);
+    producer->start = now_ns();
+    
+    for (size_t i = 0; i < run->per_producer; i++) {
+        BENCH_TASK *task = &producer->tasks[i];
+        
+        if (i % SAMPLE_EVERY == 0) {
+            uint64_t start = now_ns();
+            while (post(run, task) != 0) { }
+            producer->samples[producer->sample_count++] = now_ns() - start;
+        } else {
+            while (post(run, task) != 0) { }
+        }
+    }
+    return NULL;
+}
+
+/* ==================== Runs ==================== */
+
+static const char* mode_name(MODE mode)
+{
+    switch (mode) {
+        case MODE_POST_TASK: return "event_loop_post_task";
+        case MODE_POST: return "event_loop_post";
+        case MODE_MUTEX: return "mutex + eventfd";
+    }
+    return "";
+}
+
+static int bench_mode(MODE mode, size_t producer_count, size_t per_producer)
+{
+    RUN run;
+    memset(&run, 0, sizeof(run));
+    run.mode = mode;
+    run.producers = producer_count;
+    run.per_producer = per_producer;
+    g_run = &run;
+    pthread_barrier_init(&run.start, NULL, (unsigned)producer_count + 1);
+    
+    if (mode == MODE_MUTEX) {
+        pthread_mutex_init(&run.mutex_queue.mutex, NULL);
+        run.mutex_queue.event_fd = eventfd(0, EFD_CLOEXEC);
+    } else {
+        run.loop = event_loop_create();
+    }
+    
+    PRODUCER *producers = (PRODUCER*)calloc(producer_count, sizeof(PRODUCER));
+    pthread_t *threads = (pthread_t*)calloc(producer_count, sizeof(pthread_t));
+    run.next_seq = (uint32_t*)calloc(producer_count, sizeof(uint32_t));
+    if (!producers || !threads || !run.next_seq ||
+        (mode == MODE_MUTEX ? run.mutex_queue.event_fd < 0 : !run.loop)) {
+        fprintf(stderr, "Setup failed\n");
+        return -1;
+    }
+    
+    for (size_t p = 0; p < producer_count; p++) {
+        PRODUCER *producer = &producers[p];
+        producer->run = &run;
+        producer->id = (uint32_t)p;
+        producer->tasks = (BENCH_TASK*)malloc(per_producer * sizeof(BENCH_TASK));
+        producer->samples = (uint64_t*)malloc((per_producer / SAMPLE_EVERY + 1) * sizeof(uint64_t));
+        if (!producer->tasks || !producer->samples) {
+            fprintf(stderr, "Out of memory\n");
+            return -1;
+        }
+        for (size_t i = 0; i < per_producer; i++) {
+            BENCH_TASK *task = &producer->tasks[i];
+            task->node.fn = on_task;
+            task->node.arg = task;
+            task->producer = (uint32_t)p;
+            task->seq = (uint32_t)i;
+        }
+        pthread_create(&threads[p], NULL, producer_thread, producer);
+    }
+    
+    pthread_barrier_wait(&run.start);
+    
+    if (mode == MODE_MUTEX) {
+        mutex_consumer(&run);
+    } else {
+        event_loop_run(run.loop);
+    }
+    
+    for (size_t p = 0; p < producer_count; p++) {
+        pthread_join(threads[p], NULL);
+    }
+    
+    /* Clock starts when the first producer does */
+    uint64_t start = producers[0].start;
+    size_t sample_total = 0;
+    for (size_t p = 0; p < producer_count; p++) {
+        if (producers[p].start < start) {
+            start = producers[p].start;
+        }
+        sample_total += producers[p].sample_count;
+    }
+    
+    /* Latency percentiles over all producers */
+    uint64_t *samples = (uint64_t*)malloc(sample_total * sizeof(uint64_t));
+    size_t offset = 0;
+    for (size_t p = 0; p < producer_count; p++) {
+        memcpy(samples + offset, producers[p].samples, producers[p].sample_count * sizeof(uint64_t));
+        offset += producers[p].sample_count;
+        free(producers[p].samples);
+        free(producers[p].tasks);
+    }
+    qsort(samples, sample_total, sizeof(uint64_t), compare_u64);
+    
+    size_t total = producer_count * per_producer;
+    double seconds = (double)(run.end - start) / 1e9;
+    printf("  %-22s %7.2f Mtasks/s  %6.1f ns/task   enqueue p50 %5llu  p99 %6llu  p99.9 %7llu  max %8llu ns\n",
+           mode_name(mode), (double)total / seconds / 1e6, seconds * 1e9 / (double)total,
+           (unsigned long long)samples[sample_total / 2],
+           (unsigned long long)samples[sample_total * 99 / 100],
+           (unsigned long long)samples[sample_total * 999 / 1000],
+           (unsigned long long)samples[sample_total - 1]);
+    
+    int errors = run.executed != total || run.errors != 0;
+    if (errors) {
+        printf("  ORDER/COUNT ERRORS: %zu out of order, %zu of %zu run\n", run.errors, run.executed, total);
+    }
+    
+    free(samples);
+    pthread_barrier_destroy(&run.start);
+    free(run.next_seq);
+    free(threads);
+    free(producers);
+    if (mode == MODE_MUTEX) {
+        close(run.mutex_queue.event_fd);
+        pthread_mutex_destroy(&run.mutex_queue.mutex);
+    } else {
+        event_loop_destroy(run.loop);
+    }
+    return errors ? -1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t producer_count = 16;
+    size_t per_producer = 200000;
+    int opt;
+    
+    while ((opt = getopt(argc, argv, "p:n:")) != -1) {
+        switch (opt) {
+            case 'p': producer_count = (size_t)strtoull(optarg, NULL, 10); break;
+            case 'n': per_producer = (size_t)strtoull(optarg, NULL, 10); break;
+            default:
+                fprintf(stderr, "Usage: %s [-p producers] [-n tasks-per-producer]\n", argv[0]);
+                return 1;
+        }
+    }
+    
+    if (producer_count == 0 || per_producer == 0 || per_producer > UINT32_MAX) {
+        fprintf(stderr, "Producer and task counts must be positive\n");
+        return 1;
+    }
+    
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    printf("%zu producers x %zu tasks -> 1 loop thread (%ld CPUs)\n",
+           producer_count, per_producer, cpus);
+    
+    int failed = 0;
+    failed |= bench_mode(MODE_POST_TASK, producer_count, per_producer) != 0;
+    failed |= bench_mode(MODE_POST, producer_count, per_producer) != 0;
+    failed |= bench_mode(MODE_MUTEX, producer_count, per_producer) != 0;
+    return failed ? 1 : 0;
+}
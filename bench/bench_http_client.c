@@ -0,0 +1,463 @@
+/**
+ * HTTP Client Benchmark
+ *
+ * Starts in-process mock upstreams built on HTTP_SERVER and drives them
+ * with the HTTP client. Each upstream runs its own event loop thread and
+ * injects latency, response size and errors from configurable
+ * distributions, so no external service is needed.
+ *
+ * Modes:
+ *   closed loop - each worker sends its next request when the previous
+ *                 one completes (measures capacity)
+ *   open loop   - requests are scheduled at a constant rate and latency is
+ *                 measured from the scheduled start, so stalls are not
+ *                 hidden by coordinated omission
+ *
+ * Latency is recorded in a log-linear (HDR-style) histogram with about
+ * 1.5% precision.
+ *
+ * Usage: bench_http_client [options]
+ *   -n COUNT   Requests to send (default 10000)
+ *   -c COUNT   Client worker threads (default 8)
+ *   -r RATE    Open loop at RATE requests/sec (default 0 = closed loop)
+ *   -s COUNT   Mock upstream instances (default = workers)
+ *   -p PORT    First upstream port (default 19080)
+ *   -l DIST    Upstream latency in microseconds (default none)
+ *   -b DIST    Response body size in bytes (default fixed:128)
+ *   -e RATE    Fraction of responses that are 500 errors (default 0)
+ *   -S SEED    Random seed (default 1)
+ *
+ * DIST is one of: none, fixed:V, uniform:LO:HI, exp:MEAN
+ *
+ * A mock upstream handles one request at a time, so use at least as
+ * many upstreams as workers when injecting latency.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include "framework.h"
+#include "http_server.h"
+#include "http_client.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define MAX_BODY_SIZE (16 * 1024 * 1024)
+
+/* ==================== Distributions ==================== */
+
+typedef enum {
+    DIST_NONE,
+    DIST_FIXED,
+    DIST_UNIFORM,
+    DIST_EXPONENTIAL
+} DIST_KIND;
+
+typedef struct {
+    DIST_KIND kind;
+    double a;
+    double b;
+} DISTRIBUTION;
+
+static int parse_distribution(const char *spec, DISTRIBUTION *dist)
+{
+    memset(dist, 0, sizeof(DISTRIBUTION));
+    
+    if (strcmp(spec, "none") == 0) {
+        dist->kind = DIST_NONE;
+        return 0;
+    }
+    if (sscanf(spec, "fixed:%lf", &dist->a) == 1) {
+        dist->kind = DIST_FIXED;
+        return 0;
+    }
+    if (sscanf(spec, "uniform:%lf:%lf", &dist->a, &dist->b) == 2 && dist->b >= dist->a) {
+        dist->kind = DIST_UNIFORM;
+        return 0;
+    }
+    if (sscanf(spec, "exp:%lf", &dist->a) == 1) {
+        dist->kind = DIST_EXPONENTIAL;
+        return 0;
+    }
+    
+    return -1;
+}
+
+/* xorshift64* */
+static uint64_t next_random(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+/* Uniform in (0, 1] */
+static double next_unit(uint64_t *state)
+{
+    return ((next_random(state) >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+static double sample(const DISTRIBUTION *dist, uint64_t *state)
+{
+    switch (dist->kind) {
+        case DIST_FIXED: return dist->a;
+        case DIST_UNIFORM: return dist->a + (dist->b - dist->a) * next_unit(state);
+        case DIST_EXPONENTIAL: return -dist->a * log(next_unit(state));
+        default: return 0;
+    }
+}
+
+/* ==================== Histogram ==================== */
+
+/* Values below 2^SUB_BITS are exact; above, each power of two is split into 2^(SUB_BITS-1) buckets */
+#define SUB_BITS 7
+#define HALF_SUB (1 << (SUB_BITS - 1))
+#define HISTOGRAM_BUCKETS ((64 - SUB_BITS + 1) * HALF_SUB + HALF_SUB)
+
+typedef struct {
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t total;
+    uint64_t max;
+    double sum;
+} HISTOGRAM;
+
+static size_t histogram_index(uint64_t value)
+{
+    if (value < (1u << SUB_BITS)) {
+        return (size_t)value;
+    }
+    
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - (SUB_BITS - 1);
+    return (size_t)shift * HALF_SUB + (size_t)(value >> shift);
+}
+
+/* Highest value that maps to the same bucket */
+static uint64_t histogram_value(size_t index)
+{
+    if (index < (1u << SUB_BITS)) {
+        return index;
+    }
+    
+    size_t shift = index / HALF_SUB - 1;
+    uint64_t mantissa = index % HALF_SUB + HALF_SUB;
+    return (mantissa << shift) + ((uint64_t)1 << shift) - 1;
+}
+
+static void histogram_record(HISTOGRAM *histogram, uint64_t value)
+{
+    histogram->counts[histogram_index(value)]++;
+    histogram->total++;
+    histogram->sum += (double)value;
+    if (value > histogram->max) {
+        histogram->max = value;
+    }
+}
+
+static void histogram_merge(HISTOGRAM *into, const HISTOGRAM *from)
+{
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        into->counts[i] += from->counts[i];
+    }
+    into->total += from->total;
+    into->sum += from->sum;
+    if (from->max > into->max) {
+        into->max = from->max;
+    }
+}
+
+static uint64_t histogram_percentile(const HISTOGRAM *histogram, double percentile)
+{
+    if (histogram->total == 0) {
+        return 0;
+    }
+    
+    uint64_t rank = (uint64_t)ceil(percentile / 100.0 * (double)histogram->total);
+    if (rank == 0) rank = 1;
+    
+    uint64_t seen = 0;
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->counts[i];
+        if (seen >= rank) {
+            uint64_t value = histogram_value(i);
+            return value < histogram->max ? value : histogram->max;
+        }
+    }
+    
+    return histogram->max;
+}
+
+/* ==================== Mock Upstream ==================== */
+
+typedef struct {
+    HTTP_SERVER *server;
+    pthread_t thread;
+    uint64_t rng;
+} UPSTREAM;
+
+static DISTRIBUTION g_latency;
+static DISTRIBUTION g_body_size;
+static double g_error_rate = 0;
+static char *g_payload = NULL;
+
+static void handle_mock(HTTP_REQUEST *request, HTTP_RESPONSE *response, void *user_data)
+{
+    (void)request;
+    UPSTREAM *upstream = (UPSTREAM*)user_data;
+    
+    double latency_us = sample(&g_latency, &upstream->rng);
+    if (latency_us >= 1) {
+        struct timespec ts;
+        ts.tv_sec = (time_t)(latency_us / 1000000);
+        ts.tv_nsec = (long)(latency_us - (double)ts.tv_sec * 1000000) * 1000L;
+        nanosleep(&ts, NULL);
+    }
+    
+    size_t size = (size_t)sample(&g_body_size, &upstream->rng);
+    if (size > MAX_BODY_SIZE) {
+        size = MAX_BODY_SIZE;
+    }
+    
+    int failed = g_error_rate > 0 && next_unit(&upstream->rng) <= g_error_rate;
+    http_response_set_status(response, failed ? HTTP_STATUS_INTERNAL_ERROR : HTTP_STATUS_OK);
+    http_response_add_header(response, "Content-Type", "application/octet-stream");
+    http_response_set_body(response, g_payload, size);
+}
+
+static void* upstream_thread(void *arg)
+{
+    UPSTREAM *upstream = (UPSTREAM*)arg;
+    http_server_run(upstream->server);
+    return NULL;
+}
+
+static int upstream_start(UPSTREAM *upstream, int port, uint64_t seed)
+{
+    upstream->rng = seed;
+    upstream->server = http_server_create("127.0.0.1", port);
+    if (!upstream->server) {
+        return -1;
+    }
+    
+    http_server_get(upstream->server, "/bench", handle_mock, upstream);
+    
+    if (http_server_start(upstream->server) != FRAMEWORK_SUCCESS) {
+        return -1;
+    }
+    
+    return pthread_create(&upstream->thread, NULL, upstream_thread, upstream) == 0 ? 0 : -1;
+}
+
+/* ==================== Load Generator ==================== */
+
+typedef struct {
+    pthread_mutex_t mutex;
+    long next_index;
+    long total;
+    
+    double rate;                /* 0 = closed loop */
+    uint64_t start_ns;
+    int base_port;
+    int upstream_count;
+} LOAD_PLAN;
+
+typedef struct {
+    LOAD_PLAN *plan;
+    HISTOGRAM histogram;
+    long completed;
+    long errors;
+} WORKER;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void sleep_until(uint64_t deadline_ns)
+{
+    uint64_t now = now_ns();
+    if (deadline_ns <= now) {
+        return;
+    }
+    
+    uint64_t wait = deadline_ns - now;
+    struct timespec ts;
+    ts.tv_sec = (time_t)(wait / 1000000000ULL);
+    ts.tv_nsec = (long)(wait % 1000000000ULL);
+    nanosleep(&ts, NULL);
+}
+
+static long claim_index(LOAD_PLAN *plan)
+{
+    pthread_mutex_lock(&plan->mutex);
+    long index = plan->next_index < plan->total ? plan->next_index++ : -1;
+    pthread_mutex_unlock(&plan->mutex);
+    return index;
+}
+
+static void* worker_thread(void *arg)
+{
+    WORKER *worker = (WORKER*)arg;
+    LOAD_PLAN *plan = worker->plan;
+    char url[128];
+    
+    long index;
+    while ((index = claim_index(plan)) >= 0) {
+        uint64_t started;
+        
+        if (plan->rate > 0) {
+            /* Latency counts from when the request should have been sent */
+            started = plan->start_ns + (uint64_t)((double)index * 1e9 / plan->rate);
+            sleep_until(started);
+        } else {
+            started = now_ns();
+        }
+        
+        snprintf(url, sizeof(url), "http://127.0.0.1:%d/bench",
+                plan->base_port + (int)(index % plan->upstream_count));
+        
+        HTTP_CLIENT_REQUEST *request = http_client_request_create("GET", url);
+        HTTP_CLIENT_RESPONSE *response = request ? http_client_execute(request) : NULL;
+        uint64_t finished = now_ns();
+        
+        if (!response || response->error_message || response->status_code >= 500) {
+            worker->errors++;
+        }
+        
+        histogram_record(&worker->histogram, (finished - started) / 1000);
+        worker->completed++;
+        
+        http_client_response_destroy(response);
+        http_client_request_destroy(request);
+    }
+    
+    return NULL;
+}
+
+/* ==================== Main ==================== */
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [-n requests] [-c workers] [-r rate] [-s upstreams] [-p port]\n"
+            "          [-l latency_dist] [-b size_dist] [-e error_rate] [-S seed]\n"
+            "DIST: none | fixed:V | uniform:LO:HI | exp:MEAN (latency in us, size in bytes)\n",
+            program);
+}
+
+int main(int argc, char *argv[])
+{
+    long total = 10000;
+    int workers = 8;
+    double rate = 0;
+    int upstream_count = 0;
+    int base_port = 19080;
+    uint64_t seed = 1;
+    const char *latency_spec = "none";
+    const char *size_spec = "fixed:128";
+    
+    int opt;
+    while ((opt = getopt(argc, argv, "n:c:r:s:p:l:b:e:S:h")) != -1) {
+        switch (opt) {
+            case 'n': total = atol(optarg); break;
+            case 'c': workers = atoi(optarg); break;
+            case 'r': rate = atof(optarg); break;
+            case 's': upstream_count = atoi(optarg); break;
+            case 'p': base_port = atoi(optarg); break;
+            case 'l': latency_spec = optarg; break;
+            case 'b': size_spec = optarg; break;
+            case 'e': g_error_rate = atof(optarg); break;
+            case 'S': seed = strtoull(optarg, NULL, 10); break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    
+    if (upstream_count <= 0) {
+        upstream_count = workers;
+    }
+    
+    if (total <= 0 || workers <= 0 || rate < 0 ||
+        parse_distribution(latency_spec, &g_latency) != 0 ||
+        parse_distribution(size_spec, &g_body_size) != 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    
+    framework_set_log_level(LOG_LEVEL_ERROR);
+    
+    g_payload = (char*)malloc(MAX_BODY_SIZE);
+    UPSTREAM *upstreams = (UPSTREAM*)calloc((size_t)upstream_count, sizeof(UPSTREAM));
+    WORKER *worker_state = (WORKER*)calloc((size_t)workers, sizeof(WORKER));
+    pthread_t *threads = (pthread_t*)calloc((size_t)workers, sizeof(pthread_t));
+    if (!g_payload || !upstreams || !worker_state || !threads) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    memset(g_payload, 'x', MAX_BODY_SIZE);
+    
+    for (int i = 0; i < upstream_count; i++) {
+        if (upstream_start(&upstreams[i], base_port + i, seed + (uint64_t)i * 0x9E3779B97F4A7C15ULL) != 0) {
+            fprintf(stderr, "Failed to start upstream on port %d\n", base_port + i);
+            return 1;
+        }
+    }
+    
+    LOAD_PLAN plan;
+    memset(&plan, 0, sizeof(plan));
+    pthread_mutex_init(&plan.mutex, NULL);
+    plan.total = total;
+    plan.rate = rate;
+    plan.base_port = base_port;
+    plan.upstream_count = upstream_count;
+    
+    printf("HTTP client benchmark: %ld requests, %d workers, %d upstreams, %s",
+           total, workers, upstream_count, rate > 0 ? "open loop" : "closed loop");
+    if (rate > 0) {
+        printf(" at %.0f req/s", rate);
+    }
+    printf("\nlatency=%s size=%s errors=%.3f\n\n", latency_spec, size_spec, g_error_rate);
+    
+    plan.start_ns = now_ns();
+    for (int i = 0; i < workers; i++) {
+        worker_state[i].plan = &plan;
+        pthread_create(&threads[i], NULL, worker_thread, &worker_state[i]);
+    }
+    
+    HISTOGRAM *histogram = (HISTOGRAM*)calloc(1, sizeof(HISTOGRAM));
+    long errors = 0;
+    for (int i = 0; i < workers; i++) {
+        pthread_join(threads[i], NULL);
+        histogram_merge(histogram, &worker_state[i].histogram);
+        errors += worker_state[i].errors;
+    }
+    double elapsed = (double)(now_ns() - plan.start_ns) / 1e9;
+    
+    printf("Completed:   %llu requests in %.3f s (%ld errors)\n",
+           (unsigned long long)histogram->total, elapsed, errors);
+    printf("Throughput:  %.1f req/s\n", (double)histogram->total / elapsed);
+    printf("Latency (us):\n");
+    printf("  mean     %10.1f\n", histogram->total ? histogram->sum / (double)histogram->total : 0.0);
+    
+    const double percentiles[] = { 50, 90, 99, 99.9, 99.99 };
+    for (size_t i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++) {
+        printf("  p%-7g %10llu\n", percentiles[i],
+               (unsigned long long)histogram_percentile(histogram, percentiles[i]));
+    }
+    printf("  max      %10llu\n", (unsigned long long)histogram->max);
+    
+    /* Upstream event loops are torn down with the process */
+    free(histogram);
+    free(threads);
+    free(worker_state);
+    
+    return errors > 0 && g_error_rate == 0 ? 2 : 0;
+}
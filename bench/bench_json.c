@@ -0,0 +1,1047 @@
+/**
+ * JSON Parser and Builder Benchmark
+ *
+ * Runs the JSON API over the three standard parser corpora plus a stream
+ * of small Kafka-style messages:
+ *
+ *   twitter    search results: nested objects, UTF-8 text, many short strings
+ *   canada     GeoJSON polygon: arrays of full-precision doubles
+ *   citm       event catalog: pretty-printed, integer-keyed maps, small ints
+ *   kafka      order events of ~450 bytes, parsed one message at a time
+ *
+ * For each corpus it measures json_parse (+ json_free), json_parse_interned
+ * (keys from a shared pool), json_parse_arena,
+ * json_get_path, json_write_builder, and where a schema applies
+ * json_parse_with_schema, json_serialize and hand-written JSON_BUILDER
+ * code. Every row reports throughput and heap allocations per document;
+ * each corpus runs in its own process so its peak RSS can be reported.
+ *
+ * The corpora are synthesized with the shape, key names and value mix of
+ * twitter.json, canada.json and citm_catalog.json. To measure the
+ * originals, put them in a directory and pass -d.
+ *
+ * Allocations are counted by wrapping malloc, calloc, realloc and strdup
+ * at link time (see the bench_json rule in the Makefile).
+ *
+ * Usage: bench_json [options]
+ *   -d DIR     Load twitter.json, canada.json and citm_catalog.json from DIR
+ *   -c NAME    Run one corpus (twitter, canada, citm, kafka)
+ *   -m MB      Input processed per measurement (default 200)
+ *   -n COUNT   Kafka messages (default 20000)
+ *   -S SEED    Random seed (default 1)
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include "json_parser.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+/* ==================== Allocation Counting ==================== */
+
+static size_t g_allocations;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void *ptr, size_t size);
+char* __real_strdup(const char *s);
+void* __wrap_malloc(size_t size);
+void* __wrap_calloc(size_t count, size_t size);
+void* __wrap_realloc(void *ptr, size_t size);
+char* __wrap_strdup(const char *s);
+
+void* __wrap_malloc(size_t size)
+{
+    g_allocations++;
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size)
+{
+    g_allocations++;
+    return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void *ptr, size_t size)
+{
+    g_allocations++;
+    return __real_realloc(ptr, size);
+}
+
+char* __wrap_strdup(const char *s)
+{
+    g_allocations++;
+    return __real_strdup(s);
+}
+
+/* ==================== Schemas ==================== */
+
+typedef struct {
+    int64_t id;
+    char name[64];
+    char screen_name[32];
+    char location[64];
+    int followers_count;
+    int friends_count;
+    int verified;
+} TWEET_USER;
+
+typedef struct {
+    int64_t id;
+    char id_str[24];
+    char created_at[32];
+    char text[512];
+    char lang[8];
+    int retweet_count;
+    int favorite_count;
+    int favorited;
+    TWEET_USER user;
+} TWEET;
+
+typedef struct {
+    double completed_in;
+    int64_t max_id;
+    char query[64];
+    int count;
+} SEARCH_METADATA;
+
+typedef struct {
+    TWEET statuses[100];
+    size_t status_count;
+    SEARCH_METADATA search_metadata;
+} TWITTER;
+
+JSON_SCHEMA_DEFINE(tweet_user_schema, TWEET_USER,
+    JSON_SCHEMA_FIELD_INT64(TWEET_USER, id, 0),
+    JSON_SCHEMA_FIELD_STRING(TWEET_USER, name, 64, 0),
+    JSON_SCHEMA_FIELD_STRING(TWEET_USER, screen_name, 32, 0),
+    JSON_SCHEMA_FIELD_STRING(TWEET_USER, location, 64, 0),
+    JSON_SCHEMA_FIELD_INT(TWEET_USER, followers_count, 0),
+    JSON_SCHEMA_FIELD_INT(TWEET_USER, friends_count, 0),
+    JSON_SCHEMA_FIELD_BOOL(TWEET_USER, verified, 0)
+);
+
+JSON_SCHEMA_DEFINE(tweet_schema, TWEET,
+    JSON_SCHEMA_FIELD_INT64(TWEET, id, SCHEMA_FLAG_REQUIRED),
+    JSON_SCHEMA_FIELD_STRING(TWEET, id_str, 24, 0),
+    JSON_SCHEMA_FIELD_STRING(TWEET, created_at, 32, 0),
+    JSON_SCHEMA_FIELD_STRING(TWEET, text, 512, 0),
+    JSON_SCHEMA_FIELD_STRING(TWEET, lang, 8, 0),
+    JSON_SCHEMA_FIELD_INT(TWEET, retweet_count, 0),
+    JSON_SCHEMA_FIELD_INT(TWEET, favorite_count, 0),
+    JSON_SCHEMA_FIELD_BOOL(TWEET, favorited, 0),
+    JSON_SCHEMA_FIELD_OBJECT(TWEET, user, &tweet_user_schema, 0)
+);
+
+JSON_SCHEMA_DEFINE(search_metadata_schema, SEARCH_METADATA,
+    JSON_SCHEMA_FIELD_DOUBLE(SEARCH_METADATA, completed_in, 0),
+    JSON_SCHEMA_FIELD_INT64(SEARCH_METADATA, max_id, 0),
+    JSON_SCHEMA_FIELD_STRING(SEARCH_METADATA, query, 64, 0),
+    JSON_SCHEMA_FIELD_INT(SEARCH_METADATA, count, 0)
+);
+
+JSON_SCHEMA_DEFINE(twitter_schema, TWITTER,
+    JSON_SCHEMA_FIELD_OBJECT_ARRAY(TWITTER, statuses, &tweet_schema, status_count, 0),
+    JSON_SCHEMA_FIELD_OBJECT(TWITTER, search_metadata, &search_metadata_schema, 0)
+);
+
+typedef struct {
+    char sku[16];
+    int quantity;
+    double price;
+} ORDER_ITEM;
+
+typedef struct {
+    int64_t order_id;
+    int customer_id;
+    char currency[4];
+    double total;
+    ORDER_ITEM items[8];
+    size_t item_count;
+    int express;
+} ORDER_PAYLOAD;
+
+/* One Kafka message */
+typedef struct {
+    int64_t event_id;
+    char type[24];
+    int64_t timestamp;
+    char source[24];
+    char trace_id[36];
+    ORDER_PAYLOAD payload;
+} ORDER_EVENT;
+
+JSON_SCHEMA_DEFINE(order_item_schema, ORDER_ITEM,
+    JSON_SCHEMA_FIELD_STRING(ORDER_ITEM, sku, 16, 0),
+    JSON_SCHEMA_FIELD_INT(ORDER_ITEM, quantity, 0),
+    JSON_SCHEMA_FIELD_DOUBLE(ORDER_ITEM, price, 0)
+);
+
+JSON_SCHEMA_DEFINE(order_payload_schema, ORDER_PAYLOAD,
+    JSON_SCHEMA_FIELD_INT64(ORDER_PAYLOAD, order_id, SCHEMA_FLAG_REQUIRED),
+    JSON_SCHEMA_FIELD_INT(ORDER_PAYLOAD, customer_id, 0),
+    JSON_SCHEMA_FIELD_STRING(ORDER_PAYLOAD, currency, 4, 0),
+    JSON_SCHEMA_FIELD_DOUBLE(ORDER_PAYLOAD, total, 0),
+    JSON_SCHEMA_FIELD_OBJECT_ARRAY(ORDER_PAYLOAD, items, &order_item_schema, item_count, 0),
+    JSON_SCHEMA_FIELD_BOOL(ORDER_PAYLOAD, express, 0)
+);
+
+JSON_SCHEMA_DEFINE(order_event_schema, ORDER_EVENT,
+    JSON_SCHEMA_FIELD_INT64(ORDER_EVENT, event_id, SCHEMA_FLAG_REQUIRED),
+    JSON_SCHEMA_FIELD_STRING(ORDER_EVENT, type, 24, 0),
+    JSON_SCHEMA_FIELD_INT64(ORDER_EVENT, timestamp, 0),
+    JSON_SCHEMA_FIELD_STRING(ORDER_EVENT, source, 24, 0),
+    JSON_SCHEMA_FIELD_STRING(ORDER_EVENT, trace_id, 36, 0),
+    JSON_SCHEMA_FIELD_OBJECT(ORDER_EVENT, payload, &order_payload_schema, 0)
+);
+
+/* ==================== Helpers ==================== */
+
+/* Growable text buffer for the generators */
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+} TEXT;
+
+/* Defeats dead-code elimination of benchmark loops */
+static volatile uint64_t g_sink;
+
+/* xorshift64* */
+static uint64_t next_random(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+/* Uniform in [0, 1) */
+static double next_unit(uint64_t *state)
+{
+    return (next_random(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void text_reserve(TEXT *text, size_t length)
+{
+    if (text->length + length + 1 <= text->capacity) {
+        return;
+    }
+    
+    size_t capacity = text->capacity ? text->capacity : 65536;
+    while (capacity < text->length + length + 1) {
+        capacity *= 2;
+    }
+    char *data = (char*)realloc(text->data, capacity);
+    if (!data) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    text->data = data;
+    text->capacity = capacity;
+}
+
+static void text_append(TEXT *text, const char *str, size_t length)
+{
+    text_reserve(text, length);
+    memcpy(text->data + text->length, str, length);
+    text->length += length;
+    text->data[text->length] = '\0';
+}
+
+static void text_puts(TEXT *text, const char *str)
+{
+    text_append(text, str, strlen(str));
+}
+
+static void text_printf(TEXT *text, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    
+    text_reserve(text, (size_t)length);
+    va_start(args, format);
+    vsnprintf(text->data + text->length, (size_t)length + 1, format, args);
+    va_end(args);
+    text->length += (size_t)length;
+}
+
+static void text_indent(TEXT *text, size_t depth)
+{
+    text_puts(text, "\n");
+    for (size_t i = 0; i < depth; i++) {
+        text_puts(text, "    ");
+    }
+}
+
+/* Re-indent compact JSON four spaces per level, as citm_catalog.json is */
+static void pretty_print(TEXT *out, const char *json, size_t length)
+{
+    size_t depth = 0;
+    
+    for (size_t i = 0; i < length; i++) {
+        char c = json[i];
+        
+        if (c == '"') {
+            size_t end = i + 1;
+            while (json[end] != '"') {
+                end += json[end] == '\\' ? 2 : 1;
+            }
+            text_append(out, json + i, end - i + 1);
+            i = end;
+        } else if (c == '{' || c == '[') {
+            if (json[i + 1] == (c == '{' ? '}' : ']')) {
+                text_append(out, json + i, 2);
+                i++;
+            } else {
+                text_append(out, &c, 1);
+                text_indent(out, ++depth);
+            }
+        } else if (c == '}' || c == ']') {
+            text_indent(out, --depth);
+            text_append(out, &c, 1);
+        } else if (c == ',') {
+            text_puts(out, ",");
+            text_indent(out, depth);
+        } else if (c == ':') {
+            text_puts(out, ": ");
+        } else {
+            text_append(out, &c, 1);
+        }
+    }
+}
+
+/* ==================== Corpora ==================== */
+
+static const char *g_words[] = {
+    "kafka", "stream", "latency", "deploy", "release", "coffee", "morning", "train",
+    "東京", "ラーメン", "今日", "ありがとう", "café", "naïve", "über", "日本語",
+    "\\u3042\\u3044", "\\\"quoted\\\"", "line\\nbreak", "@equinox", "#json", "http://t.co/x1y2z3"
+};
+
+static void emit_words(TEXT *text, uint64_t *state, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        const char *word = g_words[next_random(state) % (sizeof(g_words) / sizeof(g_words[0]))];
+        text_printf(text, "%s%s", i ? " " : "", word);
+    }
+}
+
+static void emit_user(TEXT *text, uint64_t *state)
+{
+    uint64_t id = next_random(state) % 3000000000ULL;
+    
+    text_printf(text, "{\"id\":%llu,\"id_str\":\"%llu\",\"name\":\"", (unsigned long long)id, (unsigned long long)id);
+    emit_words(text, state, 2);
+    text_printf(text, "\",\"screen_name\":\"user_%llx\",\"location\":\"", (unsigned long long)(id & 0xFFFFFF));
+    emit_words(text, state, 1);
+    text_puts(text, "\",\"description\":\"");
+    emit_words(text, state, 40 + next_random(state) % 80);
+    text_printf(text, "\",\"url\":null,\"entities\":{\"description\":{\"urls\":[]}},\"protected\":false,"
+                "\"followers_count\":%d,\"friends_count\":%d,\"listed_count\":%d,"
+                "\"created_at\":\"Sun Jul 29 05:46:10 +0000 2012\",\"favourites_count\":%d,"
+                "\"utc_offset\":null,\"time_zone\":null,\"geo_enabled\":false,\"verified\":%s,"
+                "\"statuses_count\":%d,\"lang\":\"ja\",\"contributors_enabled\":false,"
+                "\"profile_background_color\":\"C0DEED\","
+                "\"profile_image_url\":\"http://pbs.twimg.com/profile_images/%llu/abc_normal.jpeg\","
+                "\"profile_text_color\":\"333333\",\"default_profile\":true,\"following\":false}",
+                (int)(next_random(state) % 100000), (int)(next_random(state) % 5000),
+                (int)(next_random(state) % 100), (int)(next_random(state) % 10000),
+                next_random(state) % 50 ? "false" : "true", (int)(next_random(state) % 200000),
+                (unsigned long long)(next_random(state) % 1000000000ULL));
+}
+
+static void emit_tweet(TEXT *text, uint64_t *state, int allow_retweet)
+{
+    uint64_t id = 505874924095815681ULL + next_random(state) % 1000000;
+    
+    text_printf(text, "{\"metadata\":{\"result_type\":\"recent\",\"iso_language_code\":\"ja\"},"
+                "\"created_at\":\"Sun Aug 31 00:%02d:%02d +0000 2014\",\"id\":%llu,\"id_str\":\"%llu\",\"text\":\"",
+                (int)(next_random(state) % 60), (int)(next_random(state) % 60),
+                (unsigned long long)id, (unsigned long long)id);
+    emit_words(text, state, 16 + next_random(state) % 40);
+    text_puts(text, "\",\"source\":\"<a href=\\\"http://twitter.com/download/iphone\\\" rel=\\\"nofollow\\\">"
+                "Twitter for iPhone</a>\",\"truncated\":false,\"in_reply_to_status_id\":null,"
+                "\"in_reply_to_user_id\":null,\"in_reply_to_screen_name\":null,\"user\":");
+    emit_user(text, state);
+    text_puts(text, ",\"geo\":null,\"coordinates\":null,\"place\":null,\"contributors\":null,");
+    
+    if (allow_retweet && next_random(state) % 2 == 0) {
+        text_puts(text, "\"retweeted_status\":");
+        emit_tweet(text, state, 0);
+        text_puts(text, ",");
+    }
+    
+    text_printf(text, "\"retweet_count\":%d,\"favorite_count\":%d,\"entities\":{\"hashtags\":[",
+                (int)(next_random(state) % 500), (int)(next_random(state) % 500));
+    size_t hashtags = next_random(state) % 3;
+    for (size_t i = 0; i < hashtags; i++) {
+        text_printf(text, "%s{\"text\":\"tag%d\",\"indices\":[%d,%d]}", i ? "," : "",
+                    (int)(next_random(state) % 100), (int)(i * 10), (int)(i * 10 + 6));
+    }
+    text_puts(text, "],\"symbols\":[],\"urls\":[],\"user_mentions\":[");
+    size_t mentions = next_random(state) % 3;
+    for (size_t i = 0; i < mentions; i++) {
+        uint64_t user = next_random(state) % 3000000000ULL;
+        text_printf(text, "%s{\"screen_name\":\"user_%llx\",\"name\":\"", i ? "," : "",
+                    (unsigned long long)(user & 0xFFFFFF));
+        emit_words(text, state, 2);
+        text_printf(text, "\",\"id\":%llu,\"id_str\":\"%llu\",\"indices\":[3,%d]}",
+                    (unsigned long long)user, (unsigned long long)user, (int)(12 + i));
+    }
+    text_printf(text, "]},\"favorited\":false,\"retweeted\":false,\"lang\":\"ja\"}");
+}
+
+static void generate_twitter(TEXT *text, uint64_t *state)
+{
+    text_puts(text, "{\"statuses\":[");
+    for (int i = 0; i < 100; i++) {
+        if (i) text_puts(text, ",");
+        emit_tweet(text, state, 1);
+    }
+    text_puts(text, "],\"search_metadata\":{\"completed_in\":0.087,\"max_id\":505874924095815681,"
+                "\"max_id_str\":\"505874924095815681\","
+                "\"next_results\":\"?max_id=505874847260352512&q=%E4%B8%80&count=100&include_entities=1\","
+                "\"query\":\"%E4%B8%80\",\"refresh_url\":\"?since_id=505874924095815681&q=%E4%B8%80&include_entities=1\","
+                "\"count\":100,\"since_id\":0,\"since_id_str\":\"0\"}}");
+}
+
+static void generate_canada(TEXT *text, uint64_t *state)
+{
+    text_puts(text, "{\"type\":\"FeatureCollection\",\"features\":[{\"type\":\"Feature\","
+                "\"properties\":{\"name\":\"Canada\"},\"geometry\":{\"type\":\"Polygon\",\"coordinates\":[");
+    
+    /* 480 rings, ~56k points in all, printed at full double precision */
+    for (int ring = 0; ring < 480; ring++) {
+        double longitude = -141.0 + next_unit(state) * 88.0;
+        double latitude = 42.0 + next_unit(state) * 41.0;
+        size_t points = 20 + next_random(state) % 192;
+        
+        text_puts(text, ring ? ",[" : "[");
+        for (size_t i = 0; i < points; i++) {
+            longitude += (next_unit(state) - 0.5) * 0.01;
+            latitude += (next_unit(state) - 0.5) * 0.01;
+            text_printf(text, "%s[%.17g,%.17g]", i ? "," : "", longitude, latitude);
+        }
+        text_puts(text, "]");
+    }
+    text_puts(text, "]}}]}");
+}
+
+static void emit_name_map(TEXT *text, uint64_t *state, const char *key, size_t count, int64_t base)
+{
+    text_printf(text, "\"%s\":{", key);
+    for (size_t i = 0; i < count; i++) {
+        text_printf(text, "%s\"%lld\":\"", i ? "," : "", (long long)(base + (int64_t)i * 7));
+        emit_words(text, state, 1 + next_random(state) % 3);
+        text_puts(text, "\"");
+    }
+    text_puts(text, "},");
+}
+
+static void generate_citm(TEXT *text, uint64_t *state)
+{
+    TEXT compact = { NULL, 0, 0 };
+    
+    text_puts(&compact, "{");
+    emit_name_map(&compact, state, "areaNames", 17, 205705993);
+    emit_name_map(&compact, state, "audienceSubCategoryNames", 1, 337100890);
+    text_puts(&compact, "\"blockNames\":{},\"events\":{");
+    for (int i = 0; i < 184; i++) {
+        int64_t id = 138586341 + i * 13;
+        text_printf(&compact, "%s\"%lld\":{\"description\":null,\"id\":%lld,\"logo\":%s,\"name\":\"",
+                    i ? "," : "", (long long)id, (long long)id,
+                    i % 3 ? "null" : "\"/images/UE0AAAAACEKo6QAAAAZDSVRN\"");
+        emit_words(&compact, state, 2 + next_random(state) % 4);
+        text_printf(&compact, "\",\"subTopicIds\":[337184269,337184283,%d],\"subjectCode\":null,"
+                    "\"subtitle\":null,\"topicIds\":[324846099,%d]}",
+                    337184262 + (int)(next_random(state) % 30), 107888604 + (int)(next_random(state) % 4));
+    }
+    text_puts(&compact, "},\"performances\":[");
+    for (int i = 0; i < 243; i++) {
+        text_printf(&compact, "%s{\"eventId\":%d,\"id\":%d,\"logo\":null,\"name\":null,\"prices\":[",
+                    i ? "," : "", 138586341 + (int)(next_random(state) % 184) * 13, 339887544 + i);
+        size_t prices = 1 + next_random(state) % 6;
+        for (size_t p = 0; p < prices; p++) {
+            text_printf(&compact, "%s{\"amount\":%d,\"audienceSubCategoryId\":337100890,\"seatCategoryId\":%d}",
+                        p ? "," : "", 9000 + (int)(next_random(state) % 900) * 250, 338937295 + (int)p);
+        }
+        text_puts(&compact, "],\"seatCategories\":[");
+        for (size_t p = 0; p < prices; p++) {
+            text_puts(&compact, p ? ",{\"areas\":[" : "{\"areas\":[");
+            size_t areas = 2 + next_random(state) % 19;
+            for (size_t a = 0; a < areas; a++) {
+                text_printf(&compact, "%s{\"areaId\":%d,\"blockIds\":[]}", a ? "," : "", 205705993 + (int)a * 7);
+            }
+            text_printf(&compact, "],\"seatCategoryId\":%d}", 338937295 + (int)p);
+        }
+        text_printf(&compact, "],\"seatMapImage\":null,\"start\":%lld,\"venueCode\":\"PLEYEL_PLEYEL\"}",
+                    1372701600000LL + (long long)(next_random(state) % 300) * 86400000LL);
+    }
+    text_puts(&compact, "],");
+    emit_name_map(&compact, state, "seatCategoryNames", 64, 338937235);
+    emit_name_map(&compact, state, "subTopicNames", 19, 337184262);
+    text_puts(&compact, "\"subjectNames\":{},");
+    emit_name_map(&compact, state, "topicNames", 4, 107888604);
+    text_puts(&compact, "\"topicSubTopics\":{\"107888604\":[337184280,337184263],\"324846098\":[337184269],"
+                "\"324846099\":[337184283,337184284]},\"venueNames\":{\"PLEYEL_PLEYEL\":\"Salle Pleyel\"}}");
+    
+    pretty_print(text, compact.data, compact.length);
+    free(compact.data);
+}
+
+static void generate_orders(ORDER_EVENT *events, size_t count, uint64_t *state)
+{
+    static const char *types[] = { "order.created", "order.paid", "order.shipped", "order.cancelled" };
+    static const char *currencies[] = { "EUR", "USD", "GBP", "JPY" };
+    
+    memset(events, 0, count * sizeof(ORDER_EVENT));
+    for (size_t i = 0; i < count; i++) {
+        ORDER_EVENT *event = &events[i];
+        ORDER_PAYLOAD *payload = &event->payload;
+        
+        event->event_id = 9000000000LL + (int64_t)i;
+        snprintf(event->type, sizeof(event->type), "%s", types[next_random(state) % 4]);
+        event->timestamp = 1700000000000LL + (int64_t)i * 37;
+        snprintf(event->source, sizeof(event->source), "checkout-service");
+        snprintf(event->trace_id, sizeof(event->trace_id), "%016llx%016llx",
+                 (unsigned long long)next_random(state), (unsigned long long)next_random(state));
+        
+        payload->order_id = 50000000LL + (int64_t)(next_random(state) % 10000000);
+        payload->customer_id = (int)(next_random(state) % 1000000);
+        snprintf(payload->currency, sizeof(payload->currency), "%s", currencies[next_random(state) % 4]);
+        payload->item_count = 1 + next_random(state) % 4;
+        for (size_t j = 0; j < payload->item_count; j++) {
+            ORDER_ITEM *item = &payload->items[j];
+            snprintf(item->sku, sizeof(item->sku), "SKU-%05u", (unsigned)(next_random(state) % 100000));
+            item->quantity = 1 + (int)(next_random(state) % 5);
+            item->price = (double)(99 + next_random(state) % 20000) / 100.0;
+            payload->total += item->price * item->quantity;
+        }
+        payload->express = next_random(state) % 10 == 0;
+    }
+}
+
+/* Format an event with builder calls, as a handler without a schema would */
+static void build_order(JSON_BUILDER *builder, const ORDER_EVENT *event)
+{
+    const ORDER_PAYLOAD *payload = &event->payload;
+    
+    json_builder_start_object(builder);
+    json_builder_add_int64(builder, "event_id", event->event_id);
+    json_builder_add_string(builder, "type", event->type);
+    json_builder_add_int64(builder, "timestamp", event->timestamp);
+    json_builder_add_string(builder, "source", event->source);
+    json_builder_add_string(builder, "trace_id", event->trace_id);
+    json_builder_add_key(builder, "payload");
+    json_builder_start_object(builder);
+    json_builder_add_int64(builder, "order_id", payload->order_id);
+    json_builder_add_int(builder, "customer_id", payload->customer_id);
+    json_builder_add_string(builder, "currency", payload->currency);
+    json_builder_add_double(builder, "total", payload->total);
+    json_builder_add_key(builder, "items");
+    json_builder_start_array(builder);
+    for (size_t i = 0; i < payload->item_count; i++) {
+        json_builder_start_object(builder);
+        json_builder_add_string(builder, "sku", payload->items[i].sku);
+        json_builder_add_int(builder, "quantity", payload->items[i].quantity);
+        json_builder_add_double(builder, "price", payload->items[i].price);
+        json_builder_end_object(builder);
+    }
+    json_builder_end_array(builder);
+    json_builder_add_bool(builder, "express", payload->express);
+    json_builder_end_object(builder);
+    json_builder_add_key(builder, "headers");
+    json_builder_start_object(builder);
+    json_builder_add_string(builder, "content-type", "application/json");
+    json_builder_add_int(builder, "retries", 0);
+    json_builder_end_object(builder);
+    json_builder_end_object(builder);
+}
+
+/* Read a corpus file; NULL if it does not exist */
+static char* load_file(const char *dir, const char *name, size_t *length)
+{
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+    
+    TEXT text = { NULL, 0, 0 };
+    char chunk[65536];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        text_append(&text, chunk, n);
+    }
+    fclose(file);
+    
+    *length = text.length;
+    return text.data;
+}
+
+/* ==================== Measurements ==================== */
+
+/* Corpus under test: one document, or messages separated by their terminators */
+typedef struct {
+    const char *name;
+    char *data;
+    size_t *offsets;            /* count + 1 entries */
+    size_t count;
+    size_t bytes;               /* Total JSON bytes, excluding terminators */
+    const JSON_SCHEMA *schema;
+    size_t struct_size;
+    const char *paths[4];
+    int passes;                 /* Passes over the corpus per measurement */
+} CORPUS;
+
+static const char* document(const CORPUS *corpus, size_t i, size_t *length)
+{
+    *length = corpus->offsets[i + 1] - corpus->offsets[i] - 1;
+    return corpus->data + corpus->offsets[i];
+}
+
+static void report_rate(const char *name, size_t bytes, double seconds, size_t allocations, size_t documents)
+{
+    printf("  %-26s %9.1f MB/s  %10.1f allocs/doc\n", name, (double)bytes / seconds / 1e6,
+           (double)allocations / (double)documents);
+}
+
+static void bench_parse(const CORPUS *corpus)
+{
+    size_t documents = corpus->count * (size_t)corpus->passes;
+    uint64_t sum = 0;
+    
+    size_t allocations = g_allocations;
+    double start = now_seconds();
+    for (int pass = 0; pass < corpus->passes; pass++) {
+        for (size_t i = 0; i < corpus->count; i++) {
+            size_t length;
+            JSON_VALUE *value = json_parse(document(corpus, i, &length));
+            sum += value ? value->type : 0;
+            json_free(value);
+        }
+    }
+    double seconds = now_seconds() - start;
+    report_rate("json_parse + json_free", corpus->bytes * (size_t)corpus->passes, seconds,
+                g_allocations - allocations, documents);
+    
+    /* The pool fills on the first document, as it would in a long-running consumer */
+    JSON_INTERN *pool = json_intern_create(0);
+    if (pool) {
+        size_t length;
+        const char *json = document(corpus, 0, &length);
+        json_free(json_parse_interned(json, length, pool));
+        
+        allocations = g_allocations;
+        start = now_seconds();
+        for (int pass = 0; pass < corpus->passes; pass++) {
+            for (size_t i = 0; i < corpus->count; i++) {
+                json = document(corpus, i, &length);
+                JSON_VALUE *value = json_parse_interned(json, length, pool);
+                sum += value ? value->type : 0;
+                json_free(value);
+            }
+        }
+        seconds = now_seconds() - start;
+        report_rate("json_parse_interned", corpus->bytes * (size_t)corpus->passes, seconds,
+                    g_allocations - allocations, documents);
+        json_intern_destroy(pool);
+    }
+    
+    JSON_ARENA *arena = json_arena_create(0);
+    if (!arena) return;
+    
+    /* One untimed pass sizes the arena's blocks */
+    for (size_t i = 0; i < corpus->count; i++) {
+        size_t length;
+        const char *json = document(corpus, i, &length);
+        json_parse_arena(json, length, arena);
+        json_arena_reset(arena);
+    }
+    
+    allocations = g_allocations;
+    start = now_seconds();
+    for (int pass = 0; pass < corpus->passes; pass++) {
+        for (size_t i = 0; i < corpus->count; i++) {
+            size_t length;
+            const char *json = document(corpus, i, &length);
+            JSON_VALUE *value = json_parse_arena(json, length, arena);
+            sum += value ? value->type : 0;
+            json_arena_reset(arena);
+        }
+    }
+    seconds = now_seconds() - start;
+    report_rate("json_parse_arena", corpus->bytes * (size_t)corpus->passes, seconds,
+                g_allocations - allocations, documents);
+    
+    json_arena_destroy(arena);
+    g_sink = sum;
+}
+
+/* Path lookups and tree serialization on parsed trees */
+static int bench_tree(const CORPUS *corpus, JSON_BUILDER *builder)
+{
+    JSON_VALUE **trees = (JSON_VALUE**)malloc(corpus->count * sizeof(JSON_VALUE*));
+    if (!trees) return -1;
+    
+    for (size_t i = 0; i < corpus->count; i++) {
+        size_t length;
+        trees[i] = json_parse(document(corpus, i, &length));
+        if (!trees[i]) {
+            fprintf(stderr, "%s: document %zu does not parse\n", corpus->name, i);
+            return -1;
+        }
+    }
+    
+    size_t path_count = 0;
+    while (path_count < 4 && corpus->paths[path_count]) {
+        path_count++;
+    }
+    
+    /* Untimed pass builds the lazy object indexes and checks the paths exist */
+    for (size_t p = 0; p < path_count; p++) {
+        if (!json_get_path(trees[0], corpus->paths[p])) {
+            printf("  (path %s not found)\n", corpus->paths[p]);
+        }
+    }
+    
+    uint64_t sum = 0;
+    size_t lookups = 0;
+    int rounds = corpus->count == 1 ? corpus->passes * 100 : corpus->passes;
+    size_t allocations = g_allocations;
+    double start = now_seconds();
+    for (int round = 0; round < rounds; round++) {
+        for (size_t i = 0; i < corpus->count; i++) {
+            for (size_t p = 0; p < path_count; p++) {
+                sum += (uintptr_t)json_get_path(trees[i], corpus->paths[p]);
+            }
+        }
+        lookups += corpus->count * path_count;
+    }
+    double seconds = now_seconds() - start;
+    if (lookups) {
+        printf("  %-26s %9.1f ns/path %10.1f allocs/doc\n", "json_get_path", seconds * 1e9 / (double)lookups,
+               (double)(g_allocations - allocations) / (double)(corpus->count * (size_t)rounds));
+    }
+    
+    size_t output = 0;
+    allocations = g_allocations;
+    start = now_seconds();
+    for (int pass = 0; pass < corpus->passes; pass++) {
+        for (size_t i = 0; i < corpus->count; i++) {
+            json_builder_reset(builder);
+            json_write_builder(trees[i], builder);
+            output += builder->position;
+        }
+    }
+    seconds = now_seconds() - start;
+    report_rate("json_write_builder", output, seconds, g_allocations - allocations,
+                corpus->count * (size_t)corpus->passes);
+    
+    for (size_t i = 0; i < corpus->count; i++) {
+        json_free(trees[i]);
+    }
+    free(trees);
+    g_sink = sum;
+    return 0;
+}
+
+/* Schema parsing into structs and serialization back out */
+static int bench_schema(const CORPUS *corpus, JSON_BUILDER *builder)
+{
+    char *structs = (char*)calloc(corpus->count, corpus->struct_size);
+    char *buffer = (char*)malloc(1 << 20);
+    if (!structs || !buffer) {
+        free(structs);
+        free(buffer);
+        return -1;
+    }
+    
+    size_t documents = corpus->count * (size_t)corpus->passes;
+    size_t allocations = g_allocations;
+    double start = now_seconds();
+    for (int pass = 0; pass < corpus->passes; pass++) {
+        for (size_t i = 0; i < corpus->count; i++) {
+            size_t length;
+            if (json_parse_with_schema(document(corpus, i, &length), corpus->schema,
+                                       structs + i * corpus->struct_size) != 0) {
+                fprintf(stderr, "%s: document %zu does not match its schema\n", corpus->name, i);
+                free(structs);
+                free(buffer);
+                return -1;
+            }
+        }
+    }
+    double seconds = now_seconds() - start;
+    report_rate("json_parse_with_schema", corpus->bytes * (size_t)corpus->passes, seconds,
+                g_allocations - allocations, documents);
+    
+    size_t output = 0;
+    allocations = g_allocations;
+    start = now_seconds();
+    for (int pass = 0; pass < corpus->passes; pass++) {
+        for (size_t i = 0; i < corpus->count; i++) {
+            int length = json_serialize(structs + i * corpus->struct_size, corpus->schema, buffer, 1 << 20);
+            output += length > 0 ? (size_t)length : 0;
+        }
+    }
+    seconds = now_seconds() - start;
+    report_rate("json_serialize", output, seconds, g_allocations - allocations, documents);
+    
+    /* Hand-written builder code for the Kafka events */
+    if (corpus->schema == &order_event_schema) {
+        const ORDER_EVENT *events = (const ORDER_EVENT*)structs;
+        output = 0;
+        allocations = g_allocations;
+        start = now_seconds();
+        for (int pass = 0; pass < corpus->passes; pass++) {
+            for (size_t i = 0; i < corpus->count; i++) {
+                json_builder_reset(builder);
+                build_order(builder, &events[i]);
+                output += builder->position;
+            }
+        }
+        seconds = now_seconds() - start;
+        report_rate("JSON_BUILDER", output, seconds, g_allocations - allocations, documents);
+    }
+    
+    free(structs);
+    free(buffer);
+    return 0;
+}
+
+/* Parse, write, parse and write again: both outputs must be identical */
+static int verify(const CORPUS *corpus)
+{
+    JSON_BUILDER *first = json_builder_create(0);
+    JSON_BUILDER *second = json_builder_create(0);
+    int rc = first && second ? 0 : -1;
+    
+    for (size_t i = 0; rc == 0 && i < corpus->count; i++) {
+        size_t length;
+        JSON_VALUE *value = json_parse(document(corpus, i, &length));
+        rc = json_write_builder(value, first);
+        json_free(value);
+        
+        value = rc == 0 ? json_parse(json_builder_get_string(first)) : NULL;
+        rc = json_write_builder(value, second);
+        json_free(value);
+        
+        if (rc == 0 && (first->position != second->position ||
+                        memcmp(first->buffer, second->buffer, first->position) != 0)) {
+            rc = -1;
+        }
+        json_builder_reset(first);
+        json_builder_reset(second);
+    }
+    
+    json_builder_destroy(first);
+    json_builder_destroy(second);
+    return rc;
+}
+
+static int run_corpus(CORPUS *corpus, size_t target_bytes)
+{
+    corpus->passes = (int)(target_bytes / corpus->bytes);
+    if (corpus->passes < 3) {
+        corpus->passes = 3;
+    }
+    
+    printf("%s: %zu document%s, %.1f KB%s\n", corpus->name, corpus->count, corpus->count == 1 ? "" : "s",
+           (double)corpus->bytes / 1e3,
+           corpus->count > 1 ? " in all" : "");
+    
+    JSON_BUILDER *builder = json_builder_create(0);
+    if (!builder) return -1;
+    
+    int rc = verify(corpus);
+    if (rc != 0) {
+        printf("  ROUND TRIP MISMATCH\n");
+    }
+    
+    bench_parse(corpus);
+    if (rc == 0) {
+        rc = bench_tree(corpus, builder);
+    }
+    if (rc == 0 && corpus->schema) {
+        rc = bench_schema(corpus, builder);
+    }
+    json_builder_destroy(builder);
+    
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    printf("  %-26s %9.1f MB\n\n", "peak RSS", (double)usage.ru_maxrss / 1024.0);
+    return rc;
+}
+
+/* Build (or load) one corpus and measure it */
+static int bench_corpus(const char *name, const char *dir, size_t message_count, size_t target_bytes,
+                        uint64_t seed)
+{
+    static const char *files[] = { "twitter.json", "canada.json", "citm_catalog.json" };
+    uint64_t state = seed;
+    CORPUS corpus;
+    TEXT text = { NULL, 0, 0 };
+    size_t single[2];
+    
+    memset(&corpus, 0, sizeof(corpus));
+    corpus.name = name;
+    corpus.offsets = single;
+    corpus.count = 1;
+    
+    int which = strcmp(name, "twitter") == 0 ? 0 : strcmp(name, "canada") == 0 ? 1 :
+                strcmp(name, "citm") == 0 ? 2 : 3;
+    if (which < 3 && dir) {
+        text.data = load_file(dir, files[which], &text.length);
+        if (!text.data) {
+            fprintf(stderr, "%s/%s not found, using the synthetic corpus\n", dir, files[which]);
+        }
+    }
+    
+    if (which == 0) {
+        if (!text.data) generate_twitter(&text, &state);
+        corpus.schema = &twitter_schema;
+        corpus.struct_size = sizeof(TWITTER);
+        corpus.paths[0] = "search_metadata.count";
+        corpus.paths[1] = "statuses[0].user.screen_name";
+        corpus.paths[2] = "statuses[50].entities.hashtags";
+        corpus.paths[3] = "statuses[99].id";
+    } else if (which == 1) {
+        if (!text.data) generate_canada(&text, &state);
+        corpus.paths[0] = "type";
+        corpus.paths[1] = "features[0].properties.name";
+        corpus.paths[2] = "features[0].geometry.coordinates[0][0][1]";
+        corpus.paths[3] = "features[0].geometry.coordinates[479][0]";
+    } else if (which == 2) {
+        if (!text.data) generate_citm(&text, &state);
+        corpus.paths[0] = "venueNames.PLEYEL_PLEYEL";
+        corpus.paths[1] = "events.138586341.name";
+        corpus.paths[2] = "performances[100].prices[0].amount";
+        corpus.paths[3] = "topicSubTopics.324846099[1]";
+    } else {
+        ORDER_EVENT *events = (ORDER_EVENT*)malloc(message_count * sizeof(ORDER_EVENT));
+        corpus.offsets = (size_t*)malloc((message_count + 1) * sizeof(size_t));
+        JSON_BUILDER *builder = json_builder_create(0);
+        if (!events || !corpus.offsets || !builder) {
+            fprintf(stderr, "Out of memory\n");
+            return -1;
+        }
+        generate_orders(events, message_count, &state);
+        
+        /* Messages back to back, each NUL-terminated */
+        for (size_t i = 0; i < message_count; i++) {
+            corpus.offsets[i] = text.length;
+            json_builder_reset(builder);
+            build_order(builder, &events[i]);
+            text_append(&text, builder->buffer, builder->position + 1);
+        }
+        corpus.offsets[message_count] = text.length;
+        corpus.count = message_count;
+        corpus.bytes = text.length - message_count;
+        corpus.schema = &order_event_schema;
+        corpus.struct_size = sizeof(ORDER_EVENT);
+        corpus.paths[0] = "event_id";
+        corpus.paths[1] = "payload.currency";
+        corpus.paths[2] = "payload.items[0].sku";
+        corpus.paths[3] = "headers.retries";
+        json_builder_destroy(builder);
+        free(events);
+    }
+    
+    if (corpus.count == 1) {
+        single[0] = 0;
+        single[1] = text.length + 1;
+        corpus.bytes = text.length;
+    }
+    corpus.data = text.data;
+    
+    int rc = run_corpus(&corpus, target_bytes);
+    
+    if (corpus.offsets != single) {
+        free(corpus.offsets);
+    }
+    free(text.data);
+    return rc;
+}
+
+int main(int argc, char *argv[])
+{
+    static const char *names[] = { "twitter", "canada", "citm", "kafka" };
+    const char *dir = NULL;
+    const char *only = NULL;
+    size_t target_mb = 200;
+    size_t message_count = 20000;
+    uint64_t seed = 1;
+    int opt;
+    
+    while ((opt = getopt(argc, argv, "d:c:m:n:S:")) != -1) {
+        switch (opt) {
+            case 'd': dir = optarg; break;
+            case 'c': only = optarg; break;
+            case 'm': target_mb = (size_t)strtoull(optarg, NULL, 10); break;
+            case 'n': message_count = (size_t)strtoull(optarg, NULL, 10); break;
+            case 'S': seed = strtoull(optarg, NULL, 10); break;
+            default:
+                fprintf(stderr, "Usage: %s [-d corpus_dir] [-c corpus] [-m MB] [-n messages] [-S seed]\n", argv[0]);
+                return 1;
+        }
+    }
+    
+    if (target_mb == 0 || message_count == 0 || seed == 0) {
+        fprintf(stderr, "Sizes, counts and seed must be positive\n");
+        return 1;
+    }
+    
+    int failures = 0;
+    int ran = 0;
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (only && strcmp(only, names[i]) != 0) {
+            continue;
+        }
+        ran++;
+        
+        /* A process per corpus, so peak RSS is that corpus's own */
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0) {
+            int rc = bench_corpus(names[i], dir, message_count, target_mb * 1000000, seed);
+            fflush(stdout);
+            _exit(rc == 0 ? 0 : 1);
+        }
+        
+        int status = 0;
+        if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            failures++;
+        }
+    }
+    
+    if (!ran) {
+        fprintf(stderr, "Unknown corpus: %s\n", only);
+        return 1;
+    }
+    if (failures) {
+        printf("FAILURES: %d\n", failures);
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,428 @@
+/**
+ * JSON vs MessagePack Benchmark
+ *
+ * Encodes and decodes synthesized order events, one message per record
+ * as a Kafka producer and consumer would, through the same JSON_SCHEMA in
+ * both wire formats:
+ *
+ *   size      average message bytes
+ *   encode    json_serialize_builder vs json_msgpack_write_schema
+ *   decode    json_parse_schema_buffer vs json_msgpack_parse_schema
+ *   tree      json_parse_arena vs json_msgpack_parse into an arena
+ *
+ * Every record decoded from either format is re-encoded and compared with
+ * the original MessagePack bytes.
+ *
+ * Usage: bench_json_msgpack [options]
+ *   -n COUNT   Records (default 20000)
+ *   -i COUNT   Iterations per measurement (default 10)
+ *   -S SEED    Random seed (default 1)
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include "json_parser.h"
+#include "json_msgpack.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct {
+    char street[48];
+    char city[32];
+    char country[4];
+    double latitude;
+    double longitude;
+} ADDRESS;
+
+/* One order event */
+typedef struct {
+    int64_t order_id;
+    int64_t created_at;
+    int customer_id;
+    char status[16];
+    char sku[24];
+    int quantity;
+    double unit_price;
+    double total;
+    int express;
+    ADDRESS shipping;
+} ORDER;
+
+JSON_SCHEMA_DEFINE(address_schema, ADDRESS,
+    JSON_SCHEMA_FIELD_STRING(ADDRESS, street, 48, 0),
+    JSON_SCHEMA_FIELD_STRING(ADDRESS, city, 32, 0),
+    JSON_SCHEMA_FIELD_STRING(ADDRESS, country, 4, 0),
+    JSON_SCHEMA_FIELD_DOUBLE(ADDRESS, latitude, 0),
+    JSON_SCHEMA_FIELD_DOUBLE(ADDRESS, longitude, 0)
+);
+
+JSON_SCHEMA_DEFINE(order_schema, ORDER,
+    JSON_SCHEMA_FIELD_INT64(ORDER, order_id, SCHEMA_FLAG_REQUIRED),
+    JSON_SCHEMA_FIELD_INT64(ORDER, created_at, 0),
+    JSON_SCHEMA_FIELD_INT(ORDER, customer_id, 0),
+    JSON_SCHEMA_FIELD_STRING(ORDER, status, 16, 0),
+    JSON_SCHEMA_FIELD_STRING(ORDER, sku, 24, 0),
+    JSON_SCHEMA_FIELD_INT(ORDER, quantity, 0),
+    JSON_SCHEMA_FIELD_DOUBLE(ORDER, unit_price, 0),
+    JSON_SCHEMA_FIELD_DOUBLE(ORDER, total, 0),
+    JSON_SCHEMA_FIELD_BOOL(ORDER, express, 0),
+    JSON_SCHEMA_FIELD_OBJECT(ORDER, shipping, &address_schema, 0)
+);
+
+/* Messages of one format, back to back */
+typedef struct {
+    char *data;
+    size_t *offsets;            /* count + 1 entries */
+    size_t count;
+} CORPUS;
+
+/* Defeats dead-code elimination of benchmark loops */
+static volatile uint64_t g_sink;
+
+/* xorshift64* */
+static uint64_t next_random(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+/* Uniform in [0, 1) */
+static double next_unit(uint64_t *state)
+{
+    return (next_random(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* ==================== Corpus ==================== */
+
+static void generate_orders(ORDER *orders, size_t count, uint64_t seed)
+{
+    static const char *statuses[] = { "created", "paid", "packed", "shipped", "delivered" };
+    static const char *cities[] = { "Bangkok", "Chiang Mai", "Singapore", "Kuala Lumpur", "Jakarta" };
+    static const char *countries[] = { "TH", "TH", "SG", "MY", "ID" };
+    static const char *streets[] = { "Sukhumvit Road", "Orchard Road", "Jalan Bukit Bintang", "Jalan Sudirman" };
+    
+    uint64_t state = seed ? seed : 1;
+    int64_t timestamp = 1700000000000LL;
+    
+    memset(orders, 0, count * sizeof(ORDER));
+    for (size_t i = 0; i < count; i++) {
+        ORDER *order = &orders[i];
+        int city = (int)(next_random(&state) % 5);
+        
+        timestamp += 1 + (int64_t)(next_random(&state) % 1000);
+        order->order_id = 100000000 + (int64_t)i;
+        order->created_at = timestamp;
+        order->customer_id = (int)(next_random(&state) % 1000000);
+        snprintf(order->status, sizeof(order->status), "%s", statuses[next_random(&state) % 5]);
+        snprintf(order->sku, sizeof(order->sku), "SKU-%06u-%c", (unsigned)(next_random(&state) % 1000000),
+                 'A' + (int)(next_random(&state) % 26));
+        order->quantity = 1 + (int)(next_random(&state) % 20);
+        
+        /* Prices in cents */
+        order->unit_price = round(next_unit(&state) * 100000.0) / 100.0;
+        order->total = round(order->unit_price * order->quantity * 100.0) / 100.0;
+        order->express = (int)(next_random(&state) % 2);
+        
+        snprintf(order->shipping.street, sizeof(order->shipping.street), "%u %s",
+                 (unsigned)(1 + next_random(&state) % 999), streets[next_random(&state) % 4]);
+        snprintf(order->shipping.city, sizeof(order->shipping.city), "%s", cities[city]);
+        snprintf(order->shipping.country, sizeof(order->shipping.country), "%s", countries[city]);
+        order->shipping.latitude = -10.0 + 30.0 * next_unit(&state);
+        order->shipping.longitude = 95.0 + 30.0 * next_unit(&state);
+    }
+}
+
+static int corpus_add(CORPUS *corpus, size_t *capacity, const void *data, size_t length)
+{
+    size_t used = corpus->offsets[corpus->count];
+    if (used + length + 1 > *capacity) {
+        size_t new_capacity = (*capacity + length + 1) * 2;
+        char *grown = (char*)realloc(corpus->data, new_capacity);
+        if (!grown) return -1;
+        corpus->data = grown;
+        *capacity = new_capacity;
+    }
+    
+    memcpy(corpus->data + used, data, length);
+    corpus->data[used + length] = '\0';     /* JSON messages are also valid C strings */
+    corpus->offsets[++corpus->count] = used + length + 1;
+    return 0;
+}
+
+static int build_corpora(const ORDER *orders, size_t count, CORPUS *json, CORPUS *msgpack)
+{
+    size_t json_capacity = count * 256, msgpack_capacity = count * 192;
+    
+    json->data = (char*)malloc(json_capacity);
+    msgpack->data = (char*)malloc(msgpack_capacity);
+    json->offsets = (size_t*)calloc(count + 1, sizeof(size_t));
+    msgpack->offsets = (size_t*)calloc(count + 1, sizeof(size_t));
+    json->count = msgpack->count = 0;
+    
+    JSON_BUILDER *builder = json_builder_create(512);
+    JSON_MSGPACK_WRITER writer;
+    if (json_msgpack_writer_init(&writer, 512) != 0 || !builder ||
+        !json->data || !msgpack->data || !json->offsets || !msgpack->offsets) {
+        json_builder_destroy(builder);
+        return -1;
+    }
+    
+    int rc = 0;
+    for (size_t i = 0; i < count && rc == 0; i++) {
+        json_builder_reset(builder);
+        json_msgpack_writer_reset(&writer);
+        
+        if (json_serialize_builder(&orders[i], &order_schema, builder) != 0 ||
+            json_msgpack_write_schema(&writer, &orders[i], &order_schema) != 0 ||
+            corpus_add(json, &json_capacity, builder->buffer, builder->position) != 0 ||
+            corpus_add(msgpack, &msgpack_capacity, writer.data, writer.length) != 0) {
+            rc = -1;
+        }
+    }
+    
+    json_builder_destroy(builder);
+    json_msgpack_writer_free(&writer);
+    return rc;
+}
+
+static const char* message(const CORPUS *corpus, size_t i, size_t *length)
+{
+    *length = corpus->offsets[i + 1] - corpus->offsets[i] - 1;
+    return corpus->data + corpus->offsets[i];
+}
+
+/* ==================== Measurements ==================== */
+
+static void report(const char *name, size_t operations, double seconds, double baseline)
+{
+    double ns = seconds * 1e9 / (double)operations;
+    if (baseline > 0) {
+        printf("  %-34s %8.1f ns/msg  %7.2fx\n", name, ns, baseline / seconds);
+    } else {
+        printf("  %-34s %8.1f ns/msg\n", name, ns);
+    }
+}
+
+static void bench_encode(const ORDER *orders, size_t count, int iterations)
+{
+    JSON_BUILDER *builder = json_builder_create(512);
+    JSON_MSGPACK_WRITER writer;
+    if (!builder || json_msgpack_writer_init(&writer, 512) != 0) {
+        json_builder_destroy(builder);
+        return;
+    }
+    
+    uint64_t sum = 0;
+    double start = now_seconds();
+    for (int it = 0; it < iterations; it++) {
+        for (size_t i = 0; i < count; i++) {
+            json_builder_reset(builder);
+            json_serialize_builder(&orders[i], &order_schema, builder);
+            sum += builder->position;
+        }
+    }
+    double json = now_seconds() - start;
+    
+    start = now_seconds();
+    for (int it = 0; it < iterations; it++) {
+        for (size_t i = 0; i < count; i++) {
+            json_msgpack_writer_reset(&writer);
+            json_msgpack_write_schema(&writer, &orders[i], &order_schema);
+            sum += writer.length;
+        }
+    }
+    double msgpack = now_seconds() - start;
+    g_sink = sum;
+    
+    printf("Encode struct:\n");
+    report("json_serialize_builder", count * (size_t)iterations, json, 0);
+    report("json_msgpack_write_schema", count * (size_t)iterations, msgpack, json);
+    
+    json_builder_destroy(builder);
+    json_msgpack_writer_free(&writer);
+}
+
+static void bench_decode(const CORPUS *json, const CORPUS *msgpack, int iterations)
+{
+    ORDER order;
+    size_t length;
+    uint64_t sum = 0;
+    
+    double start = now_seconds();
+    for (int it = 0; it < iterations; it++) {
+        for (size_t i = 0; i < json->count; i++) {
+            const char *text = message(json, i, &length);
+            json_parse_schema_buffer(text, length, &order_schema, &order, NULL);
+            sum += (uint64_t)order.order_id;
+        }
+    }
+    double json_time = now_seconds() - start;
+    
+    start = now_seconds();
+    for (int it = 0; it < iterations; it++) {
+        for (size_t i = 0; i < msgpack->count; i++) {
+            const char *data = message(msgpack, i, &length);
+            json_msgpack_parse_schema(data, length, &order_schema, &order, NULL);
+            sum += (uint64_t)order.order_id;
+        }
+    }
+    double msgpack_time = now_seconds() - start;
+    g_sink = sum;
+    
+    printf("Decode struct:\n");
+    report("json_parse_schema_buffer", json->count * (size_t)iterations, json_time, 0);
+    report("json_msgpack_parse_schema", msgpack->count * (size_t)iterations, msgpack_time, json_time);
+}
+
+static void bench_tree(const CORPUS *json, const CORPUS *msgpack, int iterations)
+{
+    JSON_ARENA *arena = json_arena_create(0);
+    if (!arena) return;
+    
+    size_t length;
+    uint64_t sum = 0;
+    
+    double start = now_seconds();
+    for (int it = 0; it < iterations; it++) {
+        for (size_t i = 0; i < json->count; i++) {
+            const char *text = message(json, i, &length);
+            JSON_VALUE *root = json_parse_arena(text, length, arena);
+            sum += root ? root->data.object_value.count : 0;
+            json_arena_reset(arena);
+        }
+    }
+    double json_time = now_seconds() - start;
+    
+    start = now_seconds();
+    for (int it = 0; it < iterations; it++) {
+        for (size_t i = 0; i < msgpack->count; i++) {
+            const char *data = message(msgpack, i, &length);
+            JSON_VALUE *root = json_msgpack_parse(data, length, arena);
+            sum += root ? root->data.object_value.count : 0;
+            json_arena_reset(arena);
+        }
+    }
+    double msgpack_time = now_seconds() - start;
+    g_sink = sum;
+    
+    printf("Decode tree (arena):\n");
+    report("json_parse_arena", json->count * (size_t)iterations, json_time, 0);
+    report("json_msgpack_parse", msgpack->count * (size_t)iterations, msgpack_time, json_time);
+    
+    json_arena_destroy(arena);
+}
+
+/* Decode each message from both formats and re-encode it as MessagePack */
+static size_t verify(const CORPUS *json, const CORPUS *msgpack)
+{
+    JSON_MSGPACK_WRITER writer;
+    if (json_msgpack_writer_init(&writer, 512) != 0) {
+        return json->count;
+    }
+    
+    size_t mismatches = 0;
+    for (size_t i = 0; i < json->count; i++) {
+        size_t json_length, msgpack_length;
+        const char *text = message(json, i, &json_length);
+        const char *data = message(msgpack, i, &msgpack_length);
+        ORDER from_json, from_msgpack;
+        
+        if (json_parse_schema_buffer(text, json_length, &order_schema, &from_json, NULL) != 0 ||
+            json_msgpack_parse_schema(data, msgpack_length, &order_schema, &from_msgpack, NULL) != 0) {
+            mismatches++;
+            continue;
+        }
+        
+        json_msgpack_writer_reset(&writer);
+        json_msgpack_write_schema(&writer, &from_json, &order_schema);
+        int json_same = writer.length == msgpack_length && memcmp(writer.data, data, msgpack_length) == 0;
+        
+        json_msgpack_writer_reset(&writer);
+        json_msgpack_write_schema(&writer, &from_msgpack, &order_schema);
+        int msgpack_same = writer.length == msgpack_length && memcmp(writer.data, data, msgpack_length) == 0;
+        
+        if (!json_same || !msgpack_same) {
+            mismatches++;
+        }
+    }
+    
+    json_msgpack_writer_free(&writer);
+    return mismatches;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t record_count = 20000;
+    int iterations = 10;
+    uint64_t seed = 1;
+    int opt;
+    
+    while ((opt = getopt(argc, argv, "n:i:S:")) != -1) {
+        switch (opt) {
+            case 'n': record_count = (size_t)strtoull(optarg, NULL, 10); break;
+            case 'i': iterations = atoi(optarg); break;
+            case 'S': seed = strtoull(optarg, NULL, 10); break;
+            default:
+                fprintf(stderr, "Usage: %s [-n records] [-i iterations] [-S seed]\n", argv[0]);
+                return 1;
+        }
+    }
+    
+    if (record_count == 0 || iterations <= 0) {
+        fprintf(stderr, "Record and iteration counts must be positive\n");
+        return 1;
+    }
+    
+    ORDER *orders = (ORDER*)malloc(record_count * sizeof(ORDER));
+    if (!orders) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    generate_orders(orders, record_count, seed);
+    
+    CORPUS json, msgpack;
+    if (build_corpora(orders, record_count, &json, &msgpack) != 0) {
+        fprintf(stderr, "Failed to build order corpus\n");
+        return 1;
+    }
+    
+    size_t json_bytes = json.offsets[json.count] - json.count;
+    size_t msgpack_bytes = msgpack.offsets[msgpack.count] - msgpack.count;
+    
+    printf("Orders: %zu records, %d iterations\n\n", record_count, iterations);
+    printf("Message size:\n");
+    printf("  %-34s %8.1f bytes\n", "JSON", (double)json_bytes / (double)record_count);
+    printf("  %-34s %8.1f bytes  %6.1f%%\n", "MessagePack", (double)msgpack_bytes / (double)record_count,
+           100.0 * (double)msgpack_bytes / (double)json_bytes);
+    
+    bench_encode(orders, record_count, iterations);
+    bench_decode(&json, &msgpack, iterations);
+    bench_tree(&json, &msgpack, iterations);
+    
+    size_t mismatches = verify(&json, &msgpack);
+    if (mismatches) {
+        printf("ROUND TRIP MISMATCHES: %zu\n", mismatches);
+    }
+    
+    free(json.data);
+    free(json.offsets);
+    free(msgpack.data);
+    free(msgpack.offsets);
+    free(orders);
+    return mismatches ? 1 : 0;
+}
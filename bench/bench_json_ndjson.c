@@ -0,0 +1,311 @@
+/**
+ * NDJSON Batch Benchmark
+ *
+ * Writes synthesized click-stream events as NDJSON through
+ * JSON_NDJSON_WRITER, then reads the result back with JSON_NDJSON_READER:
+ *
+ *   write      records serialized into 1MB buffers handed to a sink
+ *   buffer     the whole file fed at once (as from mmap) with 1..N threads
+ *   chunked    the file fed in 64KB pieces (as from a streamed body)
+ *
+ * Every record read back is compared with the event it was written from,
+ * which also checks that records arrive in input order.
+ *
+ * Usage: bench_json_ndjson [options]
+ *   -n COUNT   Records (default 500000)
+ *   -t COUNT   Most decoding threads (default: online CPUs)
+ *   -c BYTES   Chunk size for the chunked run (default 65536)
+ *   -S SEED    Random seed (default 1)
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include "json_parser.h"
+#include "json_ndjson.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+/* One click-stream event */
+typedef struct {
+    int64_t event_id;
+    int64_t timestamp;
+    char user_id[24];
+    char session[40];
+    char type[16];
+    char page[64];
+    char referrer[64];
+    int duration_ms;
+    double score;
+    int converted;
+} EVENT;
+
+JSON_SCHEMA_DEFINE(event_schema, EVENT,
+    JSON_SCHEMA_FIELD_INT64(EVENT, event_id, SCHEMA_FLAG_REQUIRED),
+    JSON_SCHEMA_FIELD_INT64(EVENT, timestamp, 0),
+    JSON_SCHEMA_FIELD_STRING(EVENT, user_id, 24, 0),
+    JSON_SCHEMA_FIELD_STRING(EVENT, session, 40, 0),
+    JSON_SCHEMA_FIELD_STRING(EVENT, type, 16, 0),
+    JSON_SCHEMA_FIELD_STRING(EVENT, page, 64, 0),
+    JSON_SCHEMA_FIELD_STRING(EVENT, referrer, 64, 0),
+    JSON_SCHEMA_FIELD_INT(EVENT, duration_ms, 0),
+    JSON_SCHEMA_FIELD_DOUBLE(EVENT, score, 0),
+    JSON_SCHEMA_FIELD_BOOL(EVENT, converted, 0)
+);
+
+/* Sink that appends to one buffer, standing in for write() */
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+    size_t writes;
+} OUTPUT;
+
+/* Reader callback state */
+typedef struct {
+    const EVENT *events;
+    size_t count;
+    size_t mismatches;
+} CHECK;
+
+/* xorshift64* */
+static uint64_t next_random(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void generate_events(EVENT *events, size_t count, uint64_t seed)
+{
+    static const char *types[] = { "view", "click", "scroll", "purchase", "search" };
+    static const char *pages[] = { "/", "/products", "/products/42", "/cart", "/checkout", "/search?q=shoes" };
+    static const char *referrers[] = { "", "https://www.google.com/", "https://news.example.org/a/1", "direct" };
+    
+    uint64_t state = seed ? seed : 1;
+    int64_t timestamp = 1700000000000LL;
+    
+    memset(events, 0, count * sizeof(EVENT));
+    for (size_t i = 0; i < count; i++) {
+        EVENT *event = &events[i];
+        
+        timestamp += (int64_t)(next_random(&state) % 50);
+        event->event_id = (int64_t)i;
+        event->timestamp = timestamp;
+        snprintf(event->user_id, sizeof(event->user_id), "u%08u", (unsigned)(next_random(&state) % 10000000));
+        snprintf(event->session, sizeof(event->session), "%016llx-%08x",
+                 (unsigned long long)next_random(&state), (unsigned)next_random(&state));
+        snprintf(event->type, sizeof(event->type), "%s", types[next_random(&state) % 5]);
+        snprintf(event->page, sizeof(event->page), "%s", pages[next_random(&state) % 6]);
+        snprintf(event->referrer, sizeof(event->referrer), "%s", referrers[next_random(&state) % 4]);
+        event->duration_ms = (int)(next_random(&state) % 60000);
+        event->score = (double)(next_random(&state) % 10000) / 100.0;
+        event->converted = next_random(&state) % 20 == 0;
+    }
+}
+
+/* ==================== Write ==================== */
+
+static int output_sink(void *user_data, const char *data, size_t length)
+{
+    OUTPUT *output = (OUTPUT*)user_data;
+    
+    if (output->length + length > output->capacity) {
+        size_t capacity = output->capacity ? output->capacity * 2 : 1024 * 1024;
+        while (capacity < output->length + length) {
+            capacity *= 2;
+        }
+        char *grown = (char*)realloc(output->data, capacity);
+        if (!grown) {
+            return -1;
+        }
+        output->data = grown;
+        output->capacity = capacity;
+    }
+    
+    memcpy(output->data + output->length, data, length);
+    output->length += length;
+    output->writes++;
+    return 0;
+}
+
+static int bench_write(const EVENT *events, size_t count, OUTPUT *output)
+{
+    JSON_NDJSON_WRITER writer;
+    if (json_ndjson_writer_init(&writer, 0, output_sink, output) != 0) {
+        return -1;
+    }
+    
+    double start = now_seconds();
+    int rc = json_ndjson_write_batch(&writer, events, count, sizeof(EVENT), &event_schema);
+    if (rc == 0) {
+        rc = json_ndjson_writer_flush(&writer);
+    }
+    double seconds = now_seconds() - start;
+    json_ndjson_writer_free(&writer);
+    
+    if (rc != 0) {
+        return -1;
+    }
+    
+    printf("Write (%zu sink calls):\n", output->writes);
+    printf("  %-28s %8.1f ns/record  %7.1f MB/s\n", "json_ndjson_write_batch",
+           seconds * 1e9 / (double)count, (double)output->length / seconds / 1e6);
+    return 0;
+}
+
+/* ==================== Read ==================== */
+
+static int check_record(void *user_data, void *record, size_t line)
+{
+    CHECK *check = (CHECK*)user_data;
+    const EVENT *expected = &check->events[check->count++];
+    
+    if (line != check->count || memcmp(record, expected, sizeof(EVENT)) != 0) {
+        check->mismatches++;
+    }
+    return 0;
+}
+
+/* Feed the file in chunks of chunk_size (0: all at once); returns seconds, or -1 */
+static double read_file(const OUTPUT *output, const EVENT *events, size_t count,
+                        size_t threads, size_t chunk_size, size_t *mismatches)
+{
+    JSON_NDJSON_CONFIG config;
+    json_ndjson_config_init(&config);
+    config.threads = threads;
+    
+    CHECK check = { events, 0, 0 };
+    JSON_NDJSON_CALLBACKS callbacks = { check_record, NULL };
+    JSON_NDJSON_READER *reader = json_ndjson_reader_create(&config, &event_schema, sizeof(EVENT),
+                                                           &callbacks, &check);
+    if (!reader) {
+        return -1;
+    }
+    
+    double start = now_seconds();
+    int rc = 0;
+    if (chunk_size == 0) {
+        rc = json_ndjson_reader_feed(reader, output->data, output->length);
+    } else {
+        for (size_t offset = 0; rc == 0 && offset < output->length; offset += chunk_size) {
+            size_t length = output->length - offset < chunk_size ? output->length - offset : chunk_size;
+            rc = json_ndjson_reader_feed(reader, output->data + offset, length);
+        }
+    }
+    if (rc == 0) {
+        rc = json_ndjson_reader_finish(reader);
+    }
+    double seconds = now_seconds() - start;
+    
+    if (rc != 0) {
+        fprintf(stderr, "Read failed: %s\n", json_ndjson_reader_error(reader));
+    }
+    *mismatches += check.mismatches + (check.count == count ? 0 : 1);
+    
+    json_ndjson_reader_destroy(reader);
+    return rc == 0 ? seconds : -1;
+}
+
+static void report(const char *name, size_t count, size_t bytes, double seconds, double baseline)
+{
+    printf("  %-28s %8.1f ns/record  %7.1f MB/s  %6.2fx\n", name, seconds * 1e9 / (double)count,
+           (double)bytes / seconds / 1e6, baseline / seconds);
+}
+
+int main(int argc, char *argv[])
+{
+    size_t record_count = 500000;
+    size_t max_threads = 0;
+    size_t chunk_size = 65536;
+    uint64_t seed = 1;
+    int opt;
+    
+    while ((opt = getopt(argc, argv, "n:t:c:S:")) != -1) {
+        switch (opt) {
+            case 'n': record_count = (size_t)strtoull(optarg, NULL, 10); break;
+            case 't': max_threads = (size_t)strtoull(optarg, NULL, 10); break;
+            case 'c': chunk_size = (size_t)strtoull(optarg, NULL, 10); break;
+            case 'S': seed = strtoull(optarg, NULL, 10); break;
+            default:
+                fprintf(stderr, "Usage: %s [-n records] [-t threads] [-c chunk] [-S seed]\n", argv[0]);
+                return 1;
+        }
+    }
+    
+    if (record_count == 0 || chunk_size == 0) {
+        fprintf(stderr, "Record count and chunk size must be positive\n");
+        return 1;
+    }
+    if (max_threads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        max_threads = cpus > 0 ? (size_t)cpus : 1;
+    }
+    
+    EVENT *events = (EVENT*)malloc(record_count * sizeof(EVENT));
+    if (!events) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    generate_events(events, record_count, seed);
+    
+    OUTPUT output = { NULL, 0, 0, 0 };
+    if (bench_write(events, record_count, &output) != 0) {
+        fprintf(stderr, "Write failed\n");
+        return 1;
+    }
+    printf("  %zu records, %.1f MB, %.1f bytes/record\n\n", record_count, (double)output.length / 1e6,
+           (double)output.length / (double)record_count);
+    
+    size_t mismatches = 0;
+    double baseline = 0;
+    char name[64];
+    
+    printf("Read whole buffer:\n");
+    for (size_t threads = 1; ; threads *= 2) {
+        if (threads > max_threads) {
+            threads = max_threads;
+        }
+        
+        double seconds = read_file(&output, events, record_count, threads, 0, &mismatches);
+        if (seconds < 0) {
+            break;
+        }
+        if (threads == 1) {
+            baseline = seconds;
+        }
+        
+        snprintf(name, sizeof(name), "%zu thread%s", threads, threads == 1 ? "" : "s");
+        report(name, record_count, output.length, seconds, baseline);
+        if (threads == max_threads) {
+            break;
+        }
+    }
+    
+    printf("Read in %zu-byte chunks:\n", chunk_size);
+    double seconds = read_file(&output, events, record_count, max_threads, chunk_size, &mismatches);
+    if (seconds >= 0) {
+        snprintf(name, sizeof(name), "%zu thread%s", max_threads, max_threads == 1 ? "" : "s");
+        report(name, record_count, output.length, seconds, baseline);
+    }
+    
+    if (mismatches) {
+        printf("RECORD MISMATCHES: %zu\n", mismatches);
+    }
+    
+    free(output.data);
+    free(events);
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,447 @@
+/**
+ * JSON Number Benchmark
+ *
+ * Measures number conversion on synthesized telemetry: records of
+ * timestamps, counters, coordinates and sensor readings, where nearly
+ * every token is a number. Each conversion is timed against the libc
+ * routine it replaces, then whole documents are parsed and built.
+ *
+ *   parse     json_number_parse vs strtoll/strtod
+ *   format    json_number_format_double vs snprintf("%.17g") (the
+ *             shortest libc format that always round-trips) and
+ *             json_number_format_int64 vs snprintf("%lld")
+ *   document  json_parse and JSON_BUILDER over the telemetry payload
+ *
+ * Every formatted double is read back and checked for an exact round trip.
+ *
+ * Usage: bench_json_numbers [options]
+ *   -n COUNT   Telemetry records (default 20000)
+ *   -i COUNT   Iterations per measurement (default 10)
+ *   -S SEED    Random seed (default 1)
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include "json_parser.h"
+#include "json_number.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#define READINGS_PER_RECORD 8
+
+/* One telemetry record */
+typedef struct {
+    int64_t timestamp;
+    int device;
+    int64_t sequence;
+    double latitude;
+    double longitude;
+    double temperature;
+    double readings[READINGS_PER_RECORD];
+} RECORD;
+
+/* Numbers per record, in document order */
+#define NUMBERS_PER_RECORD (6 + READINGS_PER_RECORD)
+
+/* Defeats dead-code elimination of benchmark loops */
+static volatile uint64_t g_sink;
+
+/* xorshift64* */
+static uint64_t next_random(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+/* Uniform in [0, 1) */
+static double next_unit(uint64_t *state)
+{
+    return (next_random(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* ==================== Corpus ==================== */
+
+static void generate_records(RECORD *records, size_t count, uint64_t seed)
+{
+    uint64_t state = seed ? seed : 1;
+    int64_t timestamp = 1700000000000LL;
+    
+    for (size_t i = 0; i < count; i++) {
+        RECORD *record = &records[i];
+        
+        timestamp += 1 + (int64_t)(next_random(&state) % 50);
+        record->timestamp = timestamp;
+        record->device = (int)(next_random(&state) % 100000);
+        record->sequence = (int64_t)i * 7919;
+        record->latitude = -90.0 + 180.0 * next_unit(&state);
+        record->longitude = -180.0 + 360.0 * next_unit(&state);
+        
+        /* Sensors report a fixed number of decimals */
+        record->temperature = round((next_unit(&state) * 80.0 - 20.0) * 100.0) / 100.0;
+        
+        for (int j = 0; j < READINGS_PER_RECORD; j++) {
+            double reading = next_unit(&state);
+            switch (j % 4) {
+                case 0: record->readings[j] = reading * 1e6; break;
+                case 1: record->readings[j] = reading * 1e-3; break;
+                case 2: record->readings[j] = round(reading * 1000.0) / 10.0; break;
+                default: record->readings[j] = reading; break;
+            }
+        }
+    }
+}
+
+/* One record as a standalone object */
+static void build_record(JSON_BUILDER *builder, const RECORD *record)
+{
+    static const char *reading_keys[READINGS_PER_RECORD] = {
+        "r0", "r1", "r2", "r3", "r4", "r5", "r6", "r7"
+    };
+    
+    json_builder_reset(builder);
+    json_builder_start_object(builder);
+    json_builder_add_int64(builder, "ts", record->timestamp);
+    json_builder_add_int(builder, "device", record->device);
+    json_builder_add_int64(builder, "seq", record->sequence);
+    json_builder_add_double(builder, "lat", record->latitude);
+    json_builder_add_double(builder, "lon", record->longitude);
+    json_builder_add_double(builder, "temp", record->temperature);
+    for (int j = 0; j < READINGS_PER_RECORD; j++) {
+        json_builder_add_double(builder, reading_keys[j], record->readings[j]);
+    }
+    json_builder_end_object(builder);
+}
+
+/* Records joined into one array */
+static char* build_document(const RECORD *records, size_t count, size_t *length)
+{
+    JSON_BUILDER *builder = json_builder_create(512);
+    size_t capacity = count * 512 + 16;
+    char *document = (char*)malloc(capacity);
+    if (!builder || !document) {
+        json_builder_destroy(builder);
+        free(document);
+        return NULL;
+    }
+    
+    size_t used = 0;
+    document[used++] = '[';
+    for (size_t i = 0; i < count; i++) {
+        build_record(builder, &records[i]);
+        const char *text = json_builder_get_string(builder);
+        size_t text_length = text ? strlen(text) : 0;
+        if (!text || used + text_length + 2 > capacity) {
+            json_builder_destroy(builder);
+            free(document);
+            return NULL;
+        }
+        if (i > 0) {
+            document[used++] = ',';
+        }
+        memcpy(document + used, text, text_length);
+        used += text_length;
+    }
+    document[used++] = ']';
+    document[used] = '\0';
+    
+    json_builder_destroy(builder);
+    *length = used;
+    return document;
+}
+
+/* Number tokens of the document, each NUL-terminated for the libc routines */
+static char** extract_numbers(const char *document, size_t *count)
+{
+    size_t capacity = 1024, used = 0;
+    char **numbers = (char**)malloc(capacity * sizeof(char*));
+    if (!numbers) return NULL;
+    
+    const char *p = document;
+    while (*p) {
+        if (*p == '"') {
+            p = strchr(p + 1, '"');
+            if (!p) break;
+            p++;
+            continue;
+        }
+        if (*p != '-' && (*p < '0' || *p > '9')) {
+            p++;
+            continue;
+        }
+        
+        size_t length = strspn(p, "0123456789+-.eE");
+        if (used == capacity) {
+            capacity *= 2;
+            char **grown = (char**)realloc(numbers, capacity * sizeof(char*));
+            if (!grown) break;
+            numbers = grown;
+        }
+        numbers[used] = strndup(p, length);
+        if (!numbers[used]) break;
+        used++;
+        p += length;
+    }
+    
+    *count = used;
+    return numbers;
+}
+
+static int is_integer_token(const char *token)
+{
+    return strpbrk(token, ".eE") == NULL;
+}
+
+/* ==================== Measurements ==================== */
+
+static void report(const char *name, size_t operations, double seconds, double baseline)
+{
+    double ns = seconds * 1e9 / (double)operations;
+    if (baseline > 0) {
+        printf("  %-34s %8.1f ns/op  %7.2fx\n", name, ns, baseline / seconds);
+    } else {
+        printf("  %-34s %8.1f ns/op\n", name, ns);
+    }
+}
+
+static void bench_parse(char **numbers, size_t count, int iterations)
+{
+    uint64_t sum = 0;
+    
+    double start = now_seconds();
+    for (int it = 0; it < iterations; it++) {
+        for (size_t i = 0; i < count; i++) {
+            if (is_integer_token(numbers[i])) {
+                sum += (uint64_t)strtoll(numbers[i], NULL, 10);
+            } else {
+                double value = strtod(numbers[i], NULL);
+                uint64_t bits;
+                memcpy(&bits, &value, sizeof(bits));
+                sum += bits;
+            }
+        }
+    }
+    double libc = now_seconds() - start;
+    
+    start = now_seconds();
+    for (int it = 0; it < iterations; it++) {
+        for (size_t i = 0; i < count; i++) {
+            JSON_NUMBER number;
+            json_number_parse(numbers[i], strlen(numbers[i]), &number);
+            if (number.is_double) {
+                uint64_t bits;
+                memcpy(&bits, &number.real, sizeof(bits));
+                sum += bits;
+            } else {
+                sum += (uint64_t)number.integer;
+            }
+        }
+    }
+    double fast = now_seconds() - start;
+    g_sink = sum;
+    
+    /* Same values as libc, bit for bit */
+    size_t mismatches = 0;
+    for (size_t i = 0; i < count; i++) {
+        JSON_NUMBER number;
+        json_number_parse(numbers[i], strlen(numbers[i]), &number);
+        double expected = strtod(numbers[i], NULL);
+        if (number.real != expected) {
+            mismatches++;
+        }
+    }
+    
+    printf("Parse (%zu tokens):\n", count);
+    report("strtoll/strtod", count * (size_t)iterations, libc, 0);
+    report("json_number_parse", count * (size_t)iterations, fast, libc);
+    if (mismatches) {
+        printf("  MISMATCHES: %zu\n", mismatches);
+    }
+}
+
+static void bench_format(const RECORD *records, size_t count, int iterations)
+{
+    char buffer[64];
+    uint64_t sum = 0;
+    size_t doubles = count * (3 + READINGS_PER_RECORD);
+    size_t integers = count * 3;
+    
+    double start = now_seconds();
+    for (int it = 0; it < iterations; it++) {
+        for (size_t i = 0; i < count; i++) {
+            const RECORD *record = &records[i];
+            sum += (uint64_t)snprintf(buffer, sizeof(buffer), "%.17g", record->latitude);
+            sum += (uint64_t)snprintf(buffer, sizeof(buffer), "%.17g", record->longitude);
+            sum += (uint64_t)snprintf(buffer, sizeof(buffer), "%.17g", record->temperature);
+            for (int j = 0; j < READINGS_PER_RECORD; j++) {
+                sum += (uint64_t)snprintf(buffer, sizeof(buffer), "%.17g", record->readings[j]);
+            }
+        }
+    }
+    double libc_double = now_seconds() - start;
+    
+    start = now_seconds();
+    for (int it = 0; it < iterations; it++) {
+        for (size_t i = 0; i < count; i++) {
+            const RECORD *record = &records[i];
+            sum += json_number_format_double(record->latitude, buffer);
+            sum += json_number_format_double(record->longitude, buffer);
+            sum += json_number_format_double(record->temperature, buffer);
+            for (int j = 0; j < READINGS_PER_RECORD; j++) {
+                sum += json_number_format_double(record->readings[j], buffer);
+            }
+        }
+    }
+    double fast_double = now_seconds() - start;
+    
+    start = now_seconds();
+    for (int it = 0; it < iterations; it++) {
+        for (size_t i = 0; i < count; i++) {
+            const RECORD *record = &records[i];
+            sum += (uint64_t)snprintf(buffer, sizeof(buffer), "%lld", (long long)record->timestamp);
+            sum += (uint64_t)snprintf(buffer, sizeof(buffer), "%d", record->device);
+            sum += (uint64_t)snprintf(buffer, sizeof(buffer), "%lld", (long long)record->sequence);
+        }
+    }
+    double libc_integer = now_seconds() - start;
+    
+    start = now_seconds();
+    for (int it = 0; it < iterations; it++) {
+        for (size_t i = 0; i < count; i++) {
+            const RECORD *record = &records[i];
+            sum += json_number_format_int64(record->timestamp, buffer);
+            sum += json_number_format_int64(record->device, buffer);
+            sum += json_number_format_int64(record->sequence, buffer);
+        }
+    }
+    double fast_integer = now_seconds() - start;
+    g_sink = sum;
+    
+    /* Shortest output must still read back exactly */
+    size_t failures = 0;
+    size_t short_length = 0, libc_length = 0;
+    for (size_t i = 0; i < count; i++) {
+        for (int j = 0; j < READINGS_PER_RECORD; j++) {
+            double value = records[i].readings[j];
+            short_length += json_number_format_double(value, buffer);
+            if (strtod(buffer, NULL) != value) {
+                failures++;
+            }
+            libc_length += (size_t)snprintf(buffer, sizeof(buffer), "%.17g", value);
+        }
+    }
+    
+    printf("Format doubles (%zu values, %.1f vs %.1f chars):\n", doubles,
+           (double)short_length / (double)(count * READINGS_PER_RECORD),
+           (double)libc_length / (double)(count * READINGS_PER_RECORD));
+    report("snprintf %.17g", doubles * (size_t)iterations, libc_double, 0);
+    report("json_number_format_double", doubles * (size_t)iterations, fast_double, libc_double);
+    if (failures) {
+        printf("  ROUND TRIP FAILURES: %zu\n", failures);
+    }
+    
+    printf("Format integers (%zu values):\n", integers);
+    report("snprintf %lld", integers * (size_t)iterations, libc_integer, 0);
+    report("json_number_format_int64", integers * (size_t)iterations, fast_integer, libc_integer);
+}
+
+static void bench_document(const RECORD *records, size_t count, const char *document,
+                           size_t length, int iterations)
+{
+    JSON_BUILDER *builder = json_builder_create(512);
+    if (!builder) return;
+    
+    double start = now_seconds();
+    for (int it = 0; it < iterations; it++) {
+        for (size_t i = 0; i < count; i++) {
+            build_record(builder, &records[i]);
+        }
+    }
+    double build = now_seconds() - start;
+    json_builder_destroy(builder);
+    
+    start = now_seconds();
+    for (int it = 0; it < iterations; it++) {
+        JSON_VALUE *root = json_parse(document);
+        if (!root) {
+            printf("  Parse failed\n");
+            return;
+        }
+        g_sink = root->data.array_value.count;
+        json_free(root);
+    }
+    double parse = now_seconds() - start;
+    
+    printf("Document (%zu records, %.1f MB):\n", count, length / 1e6);
+    printf("  %-34s %8.1f MB/s\n", "json_parse", length * (double)iterations / parse / 1e6);
+    printf("  %-34s %8.1f MB/s\n", "JSON_BUILDER", length * (double)iterations / build / 1e6);
+}
+
+int main(int argc, char *argv[])
+{
+    size_t record_count = 20000;
+    int iterations = 10;
+    uint64_t seed = 1;
+    int opt;
+    
+    while ((opt = getopt(argc, argv, "n:i:S:")) != -1) {
+        switch (opt) {
+            case 'n': record_count = (size_t)strtoull(optarg, NULL, 10); break;
+            case 'i': iterations = atoi(optarg); break;
+            case 'S': seed = strtoull(optarg, NULL, 10); break;
+            default:
+                fprintf(stderr, "Usage: %s [-n records] [-i iterations] [-S seed]\n", argv[0]);
+                return 1;
+        }
+    }
+    
+    if (record_count == 0 || iterations <= 0) {
+        fprintf(stderr, "Record and iteration counts must be positive\n");
+        return 1;
+    }
+    
+    RECORD *records = (RECORD*)malloc(record_count * sizeof(RECORD));
+    if (!records) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    generate_records(records, record_count, seed);
+    
+    size_t length = 0;
+    char *document = build_document(records, record_count, &length);
+    size_t number_count = 0;
+    char **numbers = document ? extract_numbers(document, &number_count) : NULL;
+    if (!document || !numbers) {
+        fprintf(stderr, "Failed to build telemetry corpus\n");
+        return 1;
+    }
+    
+    printf("Telemetry: %zu records, %d numbers each, %d iterations\n\n",
+           record_count, NUMBERS_PER_RECORD, iterations);
+    
+    bench_parse(numbers, number_count, iterations);
+    bench_format(records, record_count, iterations);
+    bench_document(records, record_count, document, length, iterations);
+    
+    for (size_t i = 0; i < number_count; i++) {
+        free(numbers[i]);
+    }
+    free(numbers);
+    free(document);
+    free(records);
+    return 0;
+}
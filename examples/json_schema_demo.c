@@ -98,7 +98,7 @@ void handle_create_user(HTTP_REQUEST *request, HTTP_RESPONSE *response, void *us
         json_builder_end_object(builder);
         
         http_response_set_status(response, HTTP_STATUS_CREATED);
-        http_response_set_json(response, json_builder_get_string(builder));
+        http_response_set_json_builder(response, builder);
         
         json_builder_destroy(builder);
     } else {
@@ -7,6 +7,7 @@
 #include "framework.h"
 #include "http_server.h"
 #include "kafka_client.h"
+#include "event_loop.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -148,6 +149,17 @@ void handle_api_events(KAFKA_MESSAGE *message, void *user_data)
     }
 }
 
+/* ==================== Timers ==================== */
+
+/* Runs on the loop thread like the handlers above, so ctx needs no lock */
+void report_stats(void *user_data, int timer)
+{
+    (void)timer;
+    APP_CONTEXT *ctx = (APP_CONTEXT*)user_data;
+    
+    framework_log(LOG_LEVEL_INFO, "Kafka messages so far: %d", ctx->message_count);
+}
+
 /* ==================== Main Application ==================== */
 
 int main(int argc, char *argv[])
@@ -249,6 +261,9 @@ int main(int argc, char *argv[])
     application_set_http_server(app, http_server);
     application_set_kafka_client(app, kafka);
     
+    /* Periodic report on the same event loop */
+    event_loop_add_timer(application_get_loop(app), 30000, 30000, report_stats, ctx);
+    
     /* ==================== Run Unified Event Loop ==================== */
     
     printf("\n╔══════════════════════════════════════════════════════════╗\n");
@@ -4,12 +4,11 @@
 #include "framework.h"
 #include "http_server.h"
 #include "kafka_client.h"
+#include "event_loop.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <signal.h>
-#include <unistd.h>
-#include <pthread.h>
 
 #define INITIAL_CAPACITY 10
 
@@ -34,6 +33,7 @@ APPLICATION* application_create(const char *name, int version)
     app->context = NULL;
     app->http_server = NULL;
     app->kafka_client = NULL;
+    app->loop = NULL;
     
     app->init_list = NULL;
     app->cleanup_list = NULL;
@@ -104,6 +104,7 @@ void application_destroy(APPLICATION *app)
         free(app->services);
     }
     
+    event_loop_destroy(app->loop);
     free(app);
 }
 
@@ -306,10 +307,8 @@ static void application_signal_handler(int sig)
         framework_log(LOG_LEVEL_INFO, "Received shutdown signal");
         g_app->running = 0;
         
-        /* Stop HTTP server if running */
-        if (g_app->http_server) {
-            http_server_stop(g_app->http_server);
-        }
+        /* Servers are stopped by application_run once the loop returns */
+        event_loop_stop(g_app->loop);
     }
 }
 
@@ -327,7 +326,31 @@ void application_set_kafka_client(APPLICATION *app, KAFKA_CLIENT *kafka)
     }
 }
 
-/* Unified event loop - handles both HTTP and Kafka */
+EVENT_LOOP* application_get_loop(APPLICATION *app)
+{
+    if (!app) return NULL;
+    
+    if (!app->loop) {
+        /* Published for application_post() on other threads */
+        __atomic_store_n(&app->loop, event_loop_create(), __ATOMIC_RELEASE);
+    }
+    return app->loop;
+}
+
+int application_post(APPLICATION *app, void (*fn)(void *arg), void *arg)
+{
+    if (!app || !fn) {
+        return FRAMEWORK_ERROR_NULL_PTR;
+    }
+    
+    EVENT_LOOP *loop = __atomic_load_n(&app->loop, __ATOMIC_ACQUIRE);
+    if (!loop) {
+        return FRAMEWORK_ERROR_STATE;
+    }
+    return event_loop_post(loop, fn, arg);
+}
+
+/* Unified event loop - HTTP, Kafka, timers and posted tasks on the calling thread */
 int application_run(APPLICATION *app)
 {
     if (!app) {
@@ -339,6 +362,12 @@ int application_run(APPLICATION *app)
         return FRAMEWORK_ERROR_INVALID;
     }
     
+    EVENT_LOOP *loop = application_get_loop(app);
+    if (!loop) {
+        framework_log(LOG_LEVEL_ERROR, "Failed to create event loop");
+        return FRAMEWORK_ERROR_MEMORY;
+    }
+    
     /* Set up signal handlers */
     g_app = app;
     signal(SIGINT, application_signal_handler);
@@ -351,9 +380,12 @@ int application_run(APPLICATION *app)
     /* Start HTTP server if configured */
     if (app->http_server) {
         framework_log(LOG_LEVEL_INFO, "Starting HTTP server...");
-        if (http_server_start(app->http_server) != FRAMEWORK_SUCCESS) {
+        if (http_server_set_event_loop(app->http_server, loop) != FRAMEWORK_SUCCESS ||
+            http_server_start(app->http_server) != FRAMEWORK_SUCCESS) {
             framework_log(LOG_LEVEL_ERROR, "Failed to start HTTP server");
+            http_server_set_event_loop(app->http_server, NULL);
             app->running = 0;
+            g_app = NULL;
             return FRAMEWORK_ERROR_STATE;
         }
         framework_log(LOG_LEVEL_INFO, "HTTP server started successfully");
@@ -362,12 +394,19 @@ int application_run(APPLICATION *app)
     /* Start Kafka client if configured */
     if (app->kafka_client) {
         framework_log(LOG_LEVEL_INFO, "Starting Kafka client...");
-        if (kafka_client_start(app->kafka_client) != FRAMEWORK_SUCCESS) {
+        if (kafka_client_set_event_loop(app->kafka_client, loop) != FRAMEWORK_SUCCESS ||
+            kafka_client_start(app->kafka_client) != FRAMEWORK_SUCCESS) {
             framework_log(LOG_LEVEL_ERROR, "Failed to start Kafka client");
+            if (app->kafka_client->running) {
+                kafka_client_stop(app->kafka_client);
+            }
+            kafka_client_set_event_loop(app->kafka_client, NULL);
             app->running = 0;
             if (app->http_server) {
                 http_server_stop(app->http_server);
+                http_server_set_event_loop(app->http_server, NULL);
             }
+            g_app = NULL;
             return FRAMEWORK_ERROR_STATE;
         }
         framework_log(LOG_LEVEL_INFO, "Kafka client started successfully");
@@ -375,20 +414,8 @@ int application_run(APPLICATION *app)
     
     framework_log(LOG_LEVEL_INFO, "Application running - press Ctrl+C to stop");
     
-    /* Main event loop */
-    if (app->http_server && !app->kafka_client) {
-        /* HTTP only - use blocking http_server_run */
-        http_server_run(app->http_server);
-    } else if (!app->http_server && app->kafka_client) {
-        /* Kafka only - simple sleep loop */
-        while (app->running) {
-            sleep(1);
-        }
-    } else {
-        /* Both HTTP and Kafka - run HTTP in current thread */
-        /* Kafka consumers run in their own threads already */
-        http_server_run(app->http_server);
-    }
+    /* Main event loop: every handler runs on this thread */
+    int result = event_loop_run(loop);
     
     /* Cleanup */
     framework_log(LOG_LEVEL_INFO, "Stopping application '%s'", app->name);
@@ -396,16 +423,18 @@ int application_run(APPLICATION *app)
     if (app->kafka_client) {
         framework_log(LOG_LEVEL_INFO, "Stopping Kafka client...");
         kafka_client_stop(app->kafka_client);
+        kafka_client_set_event_loop(app->kafka_client, NULL);
     }
     
     if (app->http_server) {
         framework_log(LOG_LEVEL_INFO, "Stopping HTTP server...");
         http_server_stop(app->http_server);
+        http_server_set_event_loop(app->http_server, NULL);
     }
     
     app->running = 0;
     g_app = NULL;
     
     framework_log(LOG_LEVEL_INFO, "Application stopped successfully");
-    return FRAMEWORK_SUCCESS;
+    return result;
 }
@@ -0,0 +1,334 @@
+#define _POSIX_C_SOURCE 200809L
+#include "circuit_breaker.h"
+#include "framework.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#define DEFAULT_WINDOW_BUCKETS 10
+
+/* One slice of the rolling window */
+typedef struct {
+    uint64_t epoch;         /* Bucket number this slot currently holds */
+    size_t calls;
+    size_t failures;
+    size_t slow_calls;
+} WINDOW_BUCKET;
+
+struct _circuit_breaker_ {
+    CIRCUIT_BREAKER_CONFIG config;
+    uint64_t bucket_ms;
+    WINDOW_BUCKET *buckets;
+    
+    CIRCUIT_STATE state;
+    uint64_t opened_at;
+    size_t trial_in_flight;
+    size_t trial_successes;
+    
+    pthread_mutex_t mutex;
+};
+
+struct _retry_budget_ {
+    double ratio;
+    double max_tokens;
+    double tokens;
+    pthread_mutex_t mutex;
+};
+
+static uint64_t monotonic_ms(void *user_data)
+{
+    (void)user_data;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+/* ==================== Circuit Breaker ==================== */
+
+void circuit_breaker_config_init(CIRCUIT_BREAKER_CONFIG *config)
+{
+    if (!config) return;
+    
+    memset(config, 0, sizeof(CIRCUIT_BREAKER_CONFIG));
+    config->failure_rate_threshold = 0.5;
+    config->slow_call_rate_threshold = 1.0;
+    config->slow_call_duration_ms = 5000;
+    config->window_ms = 10000;
+    config->window_buckets = DEFAULT_WINDOW_BUCKETS;
+    config->minimum_calls = 20;
+    config->open_duration_ms = 5000;
+    config->half_open_max_calls = 3;
+}
+
+CIRCUIT_BREAKER* circuit_breaker_create(const CIRCUIT_BREAKER_CONFIG *config)
+{
+    CIRCUIT_BREAKER *breaker = (CIRCUIT_BREAKER*)calloc(1, sizeof(CIRCUIT_BREAKER));
+    if (!breaker) {
+        return NULL;
+    }
+    
+    if (config) {
+        breaker->config = *config;
+    } else {
+        circuit_breaker_config_init(&breaker->config);
+    }
+    
+    if (breaker->config.window_buckets == 0) {
+        breaker->config.window_buckets = DEFAULT_WINDOW_BUCKETS;
+    }
+    if (breaker->config.half_open_max_calls == 0) {
+        breaker->config.half_open_max_calls = 1;
+    }
+    if (!breaker->config.clock) {
+        breaker->config.clock = monotonic_ms;
+    }
+    
+    breaker->bucket_ms = breaker->config.window_ms / breaker->config.window_buckets;
+    if (breaker->bucket_ms == 0) {
+        breaker->bucket_ms = 1;
+    }
+    
+    breaker->buckets = (WINDOW_BUCKET*)calloc(breaker->config.window_buckets, sizeof(WINDOW_BUCKET));
+    if (!breaker->buckets) {
+        free(breaker);
+        return NULL;
+    }
+    
+    breaker->state = CIRCUIT_CLOSED;
+    pthread_mutex_init(&breaker->mutex, NULL);
+    
+    return breaker;
+}
+
+void circuit_breaker_destroy(CIRCUIT_BREAKER *breaker)
+{
+    if (!breaker) return;
+    
+    pthread_mutex_destroy(&breaker->mutex);
+    free(breaker->buckets);
+    free(breaker);
+}
+
+static void reset_window(CIRCUIT_BREAKER *breaker)
+{
+    memset(breaker->buckets, 0, breaker->config.window_buckets * sizeof(WINDOW_BUCKET));
+}
+
+static void transition(CIRCUIT_BREAKER *breaker, CIRCUIT_STATE state, uint64_t now)
+{
+    if (breaker->state == state) return;
+    
+    framework_log(LOG_LEVEL_DEBUG, "Circuit breaker %s -> %s",
+                 circuit_state_to_string(breaker->state), circuit_state_to_string(state));
+    
+    breaker->state = state;
+    breaker->trial_in_flight = 0;
+    breaker->trial_successes = 0;
+    
+    if (state == CIRCUIT_OPEN) {
+        breaker->opened_at = now;
+    } else if (state == CIRCUIT_CLOSED) {
+        reset_window(breaker);
+    }
+}
+
+/* Open periods end lazily when the breaker is next consulted */
+static void refresh_state(CIRCUIT_BREAKER *breaker, uint64_t now)
+{
+    if (breaker->state == CIRCUIT_OPEN &&
+        now - breaker->opened_at >= breaker->config.open_duration_ms) {
+        transition(breaker, CIRCUIT_HALF_OPEN, now);
+    }
+}
+
+CIRCUIT_PERMIT circuit_breaker_acquire(CIRCUIT_BREAKER *breaker)
+{
+    if (!breaker) {
+        return CIRCUIT_PERMIT_NORMAL;
+    }
+    
+    CIRCUIT_PERMIT permit = CIRCUIT_PERMIT_DENIED;
+    
+    pthread_mutex_lock(&breaker->mutex);
+    refresh_state(breaker, breaker->config.clock(breaker->config.clock_data));
+    
+    if (breaker->state == CIRCUIT_CLOSED) {
+        permit = CIRCUIT_PERMIT_NORMAL;
+    } else if (breaker->state == CIRCUIT_HALF_OPEN &&
+               breaker->trial_in_flight + breaker->trial_successes < breaker->config.half_open_max_calls) {
+        breaker->trial_in_flight++;
+        permit = CIRCUIT_PERMIT_TRIAL;
+    }
+    pthread_mutex_unlock(&breaker->mutex);
+    
+    return permit;
+}
+
+void circuit_breaker_record(CIRCUIT_BREAKER *breaker, CIRCUIT_PERMIT permit,
+                            int success, uint64_t duration_ms)
+{
+    if (!breaker || permit == CIRCUIT_PERMIT_DENIED) {
+        return;
+    }
+    
+    pthread_mutex_lock(&breaker->mutex);
+    
+    uint64_t now = breaker->config.clock(breaker->config.clock_data);
+    int slow = duration_ms >= breaker->config.slow_call_duration_ms;
+    
+    if (permit == CIRCUIT_PERMIT_TRIAL) {
+        /* Outcomes of trials from an earlier half-open period are stale */
+        if (breaker->state == CIRCUIT_HALF_OPEN && breaker->trial_in_flight > 0) {
+            breaker->trial_in_flight--;
+            
+            if (!success || slow) {
+                transition(breaker, CIRCUIT_OPEN, now);
+            } else if (++breaker->trial_successes >= breaker->config.half_open_max_calls) {
+                transition(breaker, CIRCUIT_CLOSED, now);
+            }
+        }
+    } else if (breaker->state == CIRCUIT_CLOSED) {
+        uint64_t epoch = now / breaker->bucket_ms;
+        WINDOW_BUCKET *bucket = &breaker->buckets[epoch % breaker->config.window_buckets];
+        if (bucket->epoch != epoch) {
+            memset(bucket, 0, sizeof(WINDOW_BUCKET));
+            bucket->epoch = epoch;
+        }
+        
+        bucket->calls++;
+        if (!success) bucket->failures++;
+        if (slow) bucket->slow_calls++;
+        
+        /* Totals over buckets still inside the window */
+        size_t calls = 0, failures = 0, slow_calls = 0;
+        for (size_t i = 0; i < breaker->config.window_buckets; i++) {
+            const WINDOW_BUCKET *b = &breaker->buckets[i];
+            if (b->calls > 0 && epoch - b->epoch < breaker->config.window_buckets) {
+                calls += b->calls;
+                failures += b->failures;
+                slow_calls += b->slow_calls;
+            }
+        }
+        
+        if (calls >= breaker->config.minimum_calls && calls > 0 &&
+            ((double)failures / calls >= breaker->config.failure_rate_threshold ||
+             (double)slow_calls / calls >= breaker->config.slow_call_rate_threshold)) {
+            transition(breaker, CIRCUIT_OPEN, now);
+        }
+    }
+    
+    pthread_mutex_unlock(&breaker->mutex);
+}
+
+CIRCUIT_STATE circuit_breaker_state(CIRCUIT_BREAKER *breaker)
+{
+    if (!breaker) {
+        return CIRCUIT_CLOSED;
+    }
+    
+    pthread_mutex_lock(&breaker->mutex);
+    refresh_state(breaker, breaker->config.clock(breaker->config.clock_data));
+    CIRCUIT_STATE state = breaker->state;
+    pthread_mutex_unlock(&breaker->mutex);
+    
+    return state;
+}
+
+const char* circuit_state_to_string(CIRCUIT_STATE state)
+{
+    switch (state) {
+        case CIRCUIT_CLOSED: return "closed";
+        case CIRCUIT_OPEN: return "open";
+        case CIRCUIT_HALF_OPEN: return "half-open";
+        default: return "unknown";
+    }
+}
+
+/* ==================== Retry Budget ==================== */
+
+RETRY_BUDGET* retry_budget_create(double ratio, double max_tokens)
+{
+    if (ratio < 0 || max_tokens < 0) {
+        return NULL;
+    }
+    
+    RETRY_BUDGET *budget = (RETRY_BUDGET*)calloc(1, sizeof(RETRY_BUDGET));
+    if (!budget) {
+        return NULL;
+    }
+    
+    budget->ratio = ratio;
+    budget->max_tokens = max_tokens;
+    budget->tokens = max_tokens;
+    pthread_mutex_init(&budget->mutex, NULL);
+    
+    return budget;
+}
+
+void retry_budget_destroy(RETRY_BUDGET *budget)
+{
+    if (!budget) return;
+    
+    pthread_mutex_destroy(&budget->mutex);
+    free(budget);
+}
+
+void retry_budget_deposit(RETRY_BUDGET *budget)
+{
+    if (!budget) return;
+    
+    pthread_mutex_lock(&budget->mutex);
+    budget->tokens += budget->ratio;
+    if (budget->tokens > budget->max_tokens) {
+        budget->tokens = budget->max_tokens;
+    }
+    pthread_mutex_unlock(&budget->mutex);
+}
+
+int retry_budget_withdraw(RETRY_BUDGET *budget)
+{
+    if (!budget) return 1;
+    
+    int allowed = 0;
+    
+    pthread_mutex_lock(&budget->mutex);
+    if (budget->tokens >= 1.0) {
+        budget->tokens -= 1.0;
+        allowed = 1;
+    }
+    pthread_mutex_unlock(&budget->mutex);
+    
+    return allowed;
+}
+
+/* ==================== Backoff ==================== */
+
+/* xorshift64*: small, fast and reproducible from a seed */
+static uint64_t next_random(uint64_t *state)
+{
+    uint64_t x = *state ? *state : 0x9E3779B97F4A7C15ULL;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+uint64_t circuit_backoff_delay(uint64_t *rng_state, unsigned attempt,
+                               uint64_t base_ms, uint64_t max_ms)
+{
+    uint64_t ceiling = base_ms;
+    for (unsigned i = 0; i < attempt && ceiling < max_ms; i++) {
+        ceiling *= 2;
+    }
+    if (ceiling > max_ms) {
+        ceiling = max_ms;
+    }
+    
+    if (ceiling == 0 || !rng_state) {
+        return ceiling;
+    }
+    
+    return next_random(rng_state) % (ceiling + 1);
+}
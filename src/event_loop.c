@@ -0,0 +1,503 @@
+#define _POSIX_C_SOURCE 200809L
+#include "event_loop.h"
+#include "framework.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#define MAX_LOOP_EVENTS 64
+#define INITIAL_WATCH_CAPACITY 256
+#define TASK_BATCH_LIMIT 1024       /* Tasks run per wakeup before other events get a turn */
+#define CACHE_LINE_SIZE 64
+
+/* Watch on one descriptor, indexed by fd */
+typedef struct {
+    EVENT_LOOP_FD_FN fd_fn;
+    EVENT_LOOP_TIMER_FN timer_fn;   /* Set for timers; fd is then a timerfd */
+    void *user_data;
+    int events;
+    int active;
+} WATCH;
+
+/* Node allocated by event_loop_post */
+typedef struct {
+    EVENT_LOOP_TASK node;
+    EVENT_LOOP_TASK_FN fn;
+    void *arg;
+} POSTED_TASK;
+
+struct _event_loop_ {
+    int epoll_fd;
+    int wake_fd;                    /* eventfd for posted tasks and stop requests */
+    
+    WATCH *watches;
+    size_t watch_capacity;
+    
+    int stop;                       /* Accessed atomically */
+    int running;
+    pthread_t thread;
+    
+    /*
+     * MPSC task queue (intrusive, Vyukov style): producers swap task_head,
+     * the loop thread pops from task_tail. The two ends live on separate
+     * cache lines so posting does not bounce the consumer's line.
+     */
+    char head_pad[CACHE_LINE_SIZE];
+    EVENT_LOOP_TASK *task_head;     /* Last node pushed; accessed atomically */
+    int wake_pending;               /* Wakeup written and not yet consumed; atomic */
+    char tail_pad[CACHE_LINE_SIZE];
+    EVENT_LOOP_TASK *task_tail;     /* Next node to pop; loop thread only */
+    EVENT_LOOP_TASK task_stub;
+};
+
+/* ==================== Helpers ==================== */
+
+static uint32_t to_epoll_events(int events)
+{
+    uint32_t epoll_events = 0;
+    if (events & EVENT_LOOP_READ) epoll_events |= EPOLLIN;
+    if (events & EVENT_LOOP_WRITE) epoll_events |= EPOLLOUT;
+    if (events & EVENT_LOOP_EDGE) epoll_events |= EPOLLET;
+    return epoll_events;
+}
+
+static int from_epoll_events(uint32_t epoll_events)
+{
+    int events = 0;
+    if (epoll_events & EPOLLIN) events |= EVENT_LOOP_READ;
+    if (epoll_events & EPOLLOUT) events |= EVENT_LOOP_WRITE;
+    if (epoll_events & (EPOLLERR | EPOLLHUP)) events |= EVENT_LOOP_ERROR;
+    return events;
+}
+
+/* Make watches[fd] addressable */
+static int reserve_watch(EVENT_LOOP *loop, int fd)
+{
+    if ((size_t)fd < loop->watch_capacity) {
+        return 0;
+    }
+    
+    size_t capacity = loop->watch_capacity ? loop->watch_capacity : INITIAL_WATCH_CAPACITY;
+    while (capacity <= (size_t)fd) {
+        capacity *= 2;
+    }
+    
+    WATCH *watches = (WATCH*)realloc(loop->watches, capacity * sizeof(WATCH));
+    if (!watches) {
+        return -1;
+    }
+    memset(watches + loop->watch_capacity, 0, (capacity - loop->watch_capacity) * sizeof(WATCH));
+    loop->watches = watches;
+    loop->watch_capacity = capacity;
+    return 0;
+}
+
+static int add_watch(EVENT_LOOP *loop, int fd, int events, EVENT_LOOP_FD_FN fd_fn,
+                     EVENT_LOOP_TIMER_FN timer_fn, void *user_data)
+{
+    if (fd < 0) {
+        return FRAMEWORK_ERROR_INVALID;
+    }
+    if (reserve_watch(loop, fd) != 0) {
+        return FRAMEWORK_ERROR_MEMORY;
+    }
+    if (loop->watches[fd].active) {
+        return FRAMEWORK_ERROR_EXISTS;
+    }
+    
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = to_epoll_events(events);
+    ev.data.fd = fd;
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        framework_log(LOG_LEVEL_ERROR, "Failed to add fd %d to event loop: %s", fd, strerror(errno));
+        return FRAMEWORK_ERROR_INVALID;
+    }
+    
+    WATCH *watch = &loop->watches[fd];
+    watch->fd_fn = fd_fn;
+    watch->timer_fn = timer_fn;
+    watch->user_data = user_data;
+    watch->events = events;
+    watch->active = 1;
+    return FRAMEWORK_SUCCESS;
+}
+
+static WATCH* find_watch(EVENT_LOOP *loop, int fd)
+{
+    if (fd < 0 || (size_t)fd >= loop->watch_capacity || !loop->watches[fd].active) {
+        return NULL;
+    }
+    return &loop->watches[fd];
+}
+
+/* ==================== Tasks ==================== */
+
+/* Link task at the head; wait-free for producers */
+static void task_push(EVENT_LOOP *loop, EVENT_LOOP_TASK *task)
+{
+    __atomic_store_n(&task->next, NULL, __ATOMIC_RELAXED);
+    EVENT_LOOP_TASK *prev = __atomic_exchange_n(&loop->task_head, task, __ATOMIC_SEQ_CST);
+    /* Until this store the consumer cannot see task or anything pushed after it */
+    __atomic_store_n(&prev->next, task, __ATOMIC_RELEASE);
+}
+
+/* Unlink the oldest task; NULL if empty or a producer is midway through task_push */
+static EVENT_LOOP_TASK* task_pop(EVENT_LOOP *loop)
+{
+    EVENT_LOOP_TASK *tail = loop->task_tail;
+    EVENT_LOOP_TASK *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    
+    if (tail == &loop->task_stub) {
+        if (!next) {
+            return NULL;
+        }
+        loop->task_tail = next;
+        tail = next;
+        next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    }
+    
+    if (next) {
+        loop->task_tail = next;
+        return tail;
+    }
+    
+    /* tail is the last linked node; if it is also the head, park the stub behind it */
+    if (tail != __atomic_load_n(&loop->task_head, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    task_push(loop, &loop->task_stub);
+    
+    next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (next) {
+        loop->task_tail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+/* Signal the eventfd unless a wakeup is already on its way */
+static void task_wake(EVENT_LOOP *loop)
+{
+    if (__atomic_exchange_n(&loop->wake_pending, 1, __ATOMIC_SEQ_CST)) {
+        return;
+    }
+    
+    uint64_t one = 1;
+    ssize_t written = write(loop->wake_fd, &one, sizeof(one));
+    (void)written;  /* EAGAIN: counter saturated, the loop is awake anyway */
+}
+
+int event_loop_post_task(EVENT_LOOP *loop, EVENT_LOOP_TASK *task)
+{
+    if (!loop || !task || !task->fn) {
+        return FRAMEWORK_ERROR_NULL_PTR;
+    }
+    
+    task_push(loop, task);
+    task_wake(loop);
+    return FRAMEWORK_SUCCESS;
+}
+
+/* Trampoline for nodes allocated by event_loop_post */
+static void run_posted(void *arg)
+{
+    POSTED_TASK *posted = (POSTED_TASK*)arg;
+    EVENT_LOOP_TASK_FN fn = posted->fn;
+    void *fn_arg = posted->arg;
+    
+    free(posted);
+    fn(fn_arg);
+}
+
+int event_loop_post(EVENT_LOOP *loop, EVENT_LOOP_TASK_FN fn, void *arg)
+{
+    if (!loop || !fn) {
+        return FRAMEWORK_ERROR_NULL_PTR;
+    }
+    
+    POSTED_TASK *posted = (POSTED_TASK*)malloc(sizeof(POSTED_TASK));
+    if (!posted) {
+        return FRAMEWORK_ERROR_MEMORY;
+    }
+    posted->node.fn = run_posted;
+    posted->node.arg = posted;
+    posted->fn = fn;
+    posted->arg = arg;
+    
+    task_push(loop, &posted->node);
+    task_wake(loop);
+    return FRAMEWORK_SUCCESS;
+}
+
+/* Run up to TASK_BATCH_LIMIT tasks */
+static void run_tasks(EVENT_LOOP *loop)
+{
+    /*
+     * Re-enable wakeups before draining: a push the drain misses finds
+     * wake_pending clear and signals again.
+     */
+    __atomic_store_n(&loop->wake_pending, 0, __ATOMIC_SEQ_CST);
+    
+    for (int i = 0; i < TASK_BATCH_LIMIT; i++) {
+        EVENT_LOOP_TASK *task = task_pop(loop);
+        if (!task) {
+            return;
+        }
+        /* The node is the task's own once popped; fn may free or repost it */
+        task->fn(task->arg);
+    }
+    
+    /* Budget spent with work left: come back after other events */
+    task_wake(loop);
+}
+
+static void on_wake(void *user_data, int fd, int events)
+{
+    (void)events;
+    EVENT_LOOP *loop = (EVENT_LOOP*)user_data;
+    
+    uint64_t count;
+    ssize_t bytes = read(fd, &count, sizeof(count));
+    (void)bytes;
+    run_tasks(loop);
+}
+
+/* ==================== Loop ==================== */
+
+EVENT_LOOP* event_loop_create(void)
+{
+    EVENT_LOOP *loop = (EVENT_LOOP*)calloc(1, sizeof(EVENT_LOOP));
+    if (!loop) {
+        framework_log(LOG_LEVEL_ERROR, "Failed to allocate event loop");
+        return NULL;
+    }
+    
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epoll_fd < 0) {
+        framework_log(LOG_LEVEL_ERROR, "Failed to create epoll: %s", strerror(errno));
+        free(loop);
+        return NULL;
+    }
+    
+    loop->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (loop->wake_fd < 0) {
+        framework_log(LOG_LEVEL_ERROR, "Failed to create eventfd: %s", strerror(errno));
+        close(loop->epoll_fd);
+        free(loop);
+        return NULL;
+    }
+    
+    loop->task_stub.next = NULL;
+    loop->task_head = &loop->task_stub;
+    loop->task_tail = &loop->task_stub;
+    
+    if (add_watch(loop, loop->wake_fd, EVENT_LOOP_READ, on_wake, NULL, loop) != FRAMEWORK_SUCCESS) {
+        event_loop_destroy(loop);
+        return NULL;
+    }
+    
+    return loop;
+}
+
+void event_loop_destroy(EVENT_LOOP *loop)
+{
+    if (!loop) return;
+    
+    /* Timers belong to the loop; other descriptors to whoever added them */
+    for (size_t fd = 0; fd < loop->watch_capacity; fd++) {
+        if (loop->watches[fd].active && loop->watches[fd].timer_fn) {
+            close((int)fd);
+        }
+    }
+    
+    /* Free nodes event_loop_post allocated; caller-owned nodes stay with the caller */
+    EVENT_LOOP_TASK *task;
+    while ((task = task_pop(loop)) != NULL) {
+        if (task->fn == run_posted) {
+            free(task->arg);
+        }
+    }
+    
+    close(loop->wake_fd);
+    close(loop->epoll_fd);
+    free(loop->watches);
+    free(loop);
+}
+
+int event_loop_run_once(EVENT_LOOP *loop, int timeout_ms)
+{
+    if (!loop) return -1;
+    
+    struct epoll_event events[MAX_LOOP_EVENTS];
+    int nfds = epoll_wait(loop->epoll_fd, events, MAX_LOOP_EVENTS, timeout_ms);
+    if (nfds < 0) {
+        if (errno == EINTR) {
+            return 0;  /* Interrupted by signal */
+        }
+        framework_log(LOG_LEVEL_ERROR, "epoll_wait failed: %s", strerror(errno));
+        return -1;
+    }
+    
+    int dispatched = 0;
+    for (int i = 0; i < nfds; i++) {
+        int fd = events[i].data.fd;
+        
+        /* An earlier callback in this batch may have removed the watch */
+        WATCH *watch = find_watch(loop, fd);
+        if (!watch) {
+            continue;
+        }
+        
+        if (watch->timer_fn) {
+            uint64_t expirations;
+            if (read(fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+                continue;  /* Spurious wakeup or timer re-armed */
+            }
+            watch->timer_fn(watch->user_data, fd);
+        } else {
+            watch->fd_fn(watch->user_data, fd, from_epoll_events(events[i].events));
+        }
+        dispatched++;
+    }
+    return dispatched;
+}
+
+int event_loop_run(EVENT_LOOP *loop)
+{
+    if (!loop) return FRAMEWORK_ERROR_NULL_PTR;
+    
+    loop->thread = pthread_self();
+    __atomic_store_n(&loop->running, 1, __ATOMIC_RELEASE);
+    
+    int result = FRAMEWORK_SUCCESS;
+    while (!__atomic_load_n(&loop->stop, __ATOMIC_ACQUIRE)) {
+        if (event_loop_run_once(loop, -1) < 0) {
+            result = FRAMEWORK_ERROR_STATE;
+            break;
+        }
+    }
+    
+    /* Leave the loop reusable; a stop that raced with this one is consumed too */
+    __atomic_store_n(&loop->stop, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&loop->running, 0, __ATOMIC_RELEASE);
+    return result;
+}
+
+void event_loop_stop(EVENT_LOOP *loop)
+{
+    if (!loop) return;
+    
+    /* Only async-signal-safe calls here */
+    __atomic_store_n(&loop->stop, 1, __ATOMIC_RELEASE);
+    uint64_t one = 1;
+    ssize_t written = write(loop->wake_fd, &one, sizeof(one));
+    (void)written;
+}
+
+int event_loop_in_loop_thread(const EVENT_LOOP *loop)
+{
+    if (!loop || !__atomic_load_n(&loop->running, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+    return pthread_equal(loop->thread, pthread_self()) ? 1 : 0;
+}
+
+/* ==================== File Descriptors ==================== */
+
+int event_loop_add_fd(EVENT_LOOP *loop, int fd, int events,
+                      EVENT_LOOP_FD_FN callback, void *user_data)
+{
+    if (!loop || !callback) {
+        return FRAMEWORK_ERROR_NULL_PTR;
+    }
+    return add_watch(loop, fd, events, callback, NULL, user_data);
+}
+
+int event_loop_modify_fd(EVENT_LOOP *loop, int fd, int events)
+{
+    if (!loop) return FRAMEWORK_ERROR_NULL_PTR;
+    
+    WATCH *watch = find_watch(loop, fd);
+    if (!watch || watch->timer_fn) {
+        return FRAMEWORK_ERROR_INVALID;
+    }
+    
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = to_epoll_events(events);
+    ev.data.fd = fd;
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_MOD, fd, &ev) < 0) {
+        framework_log(LOG_LEVEL_ERROR, "Failed to modify fd %d in event loop: %s", fd, strerror(errno));
+        return FRAMEWORK_ERROR_INVALID;
+    }
+    watch->events = events;
+    return FRAMEWORK_SUCCESS;
+}
+
+int event_loop_remove_fd(EVENT_LOOP *loop, int fd)
+{
+    if (!loop) return FRAMEWORK_ERROR_NULL_PTR;
+    
+    WATCH *watch = find_watch(loop, fd);
+    if (!watch) {
+        return FRAMEWORK_ERROR_INVALID;
+    }
+    
+    epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    memset(watch, 0, sizeof(WATCH));
+    return FRAMEWORK_SUCCESS;
+}
+
+/* ==================== Timers ==================== */
+
+static void ms_to_timespec(uint64_t ms, struct timespec *ts)
+{
+    ts->tv_sec = (time_t)(ms / 1000);
+    ts->tv_nsec = (long)(ms % 1000) * 1000000L;
+}
+
+int event_loop_add_timer(EVENT_LOOP *loop, uint64_t initial_ms, uint64_t interval_ms,
+                         EVENT_LOOP_TIMER_FN callback, void *user_data)
+{
+    if (!loop || !callback) {
+        return -1;
+    }
+    
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0) {
+        framework_log(LOG_LEVEL_ERROR, "Failed to create timerfd: %s", strerror(errno));
+        return -1;
+    }
+    
+    /* An all-zero it_value would disarm the timer */
+    struct itimerspec spec;
+    ms_to_timespec(initial_ms ? initial_ms : 1, &spec.it_value);
+    ms_to_timespec(interval_ms, &spec.it_interval);
+    
+    if (timerfd_settime(fd, 0, &spec, NULL) < 0 ||
+        add_watch(loop, fd, EVENT_LOOP_READ, NULL, callback, user_data) != FRAMEWORK_SUCCESS) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int event_loop_cancel_timer(EVENT_LOOP *loop, int timer)
+{
+    if (!loop) return FRAMEWORK_ERROR_NULL_PTR;
+    
+    WATCH *watch = find_watch(loop, timer);
+    if (!watch || !watch->timer_fn) {
+        return FRAMEWORK_ERROR_INVALID;
+    }
+    
+    event_loop_remove_fd(loop, timer);
+    close(timer);
+    return FRAMEWORK_SUCCESS;
+}
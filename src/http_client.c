@@ -1,6 +1,7 @@
 #define _POSIX_C_SOURCE 200809L
 #include "http_client.h"
 #include "framework.h"
+#include "circuit_breaker.h"
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
@@ -15,6 +16,10 @@
 #include <sys/time.h>
 #include <fcntl.h>
 #include <sys/select.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <poll.h>
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 #include <zlib.h>
@@ -23,6 +28,13 @@
 #define INITIAL_HEADER_CAPACITY 10
 #define INITIAL_BUFFER_SIZE 8192
 #define MAX_RESPONSE_SIZE (10 * 1024 * 1024) /* 10MB */
+#define MAX_HEADER_SIZE (64 * 1024)
+#define MAX_CHUNK_LINE 4096
+#define EXPECT_CONTINUE_THRESHOLD (1024 * 1024) /* 1MB */
+#define EXPECT_CONTINUE_TIMEOUT_MS 1000
+#define BODY_STREAM_BUFFER_SIZE (64 * 1024)
+#define COALESCE_BODY_LIMIT (16 * 1024) /* Small bodies share one TLS record with the head */
+#define CHUNK_PREFIX_SPACE 20
 #define DEFAULT_TIMEOUT 30
 #define DEFAULT_MAX_REDIRECTS 5
 
@@ -173,6 +185,7 @@ HTTP_CLIENT_REQUEST* http_client_request_create(const char *method, const char *
     request->follow_redirects = 1;
     request->max_redirects = DEFAULT_MAX_REDIRECTS;
     request->verify_ssl = 1;
+    request->body_fd = -1;
     
     return request;
 }
@@ -232,6 +245,18 @@ int http_client_request_add_header(HTTP_CLIENT_REQUEST *request,
     return FRAMEWORK_SUCCESS;
 }
 
+static void clear_body_source(HTTP_CLIENT_REQUEST *request)
+{
+    free(request->body);
+    request->body = NULL;
+    request->body_length = 0;
+    request->body_reader = NULL;
+    request->body_reader_data = NULL;
+    request->body_fd = -1;
+    request->body_offset = 0;
+    request->body_stream_length = 0;
+}
+
 int http_client_request_set_body(HTTP_CLIENT_REQUEST *request, 
                                   const char *body, 
                                   size_t length)
@@ -240,7 +265,7 @@ int http_client_request_set_body(HTTP_CLIENT_REQUEST *request,
         return FRAMEWORK_ERROR_NULL_PTR;
     }
     
-    free(request->body);
+    clear_body_source(request);
     
     if (length == 0) {
         length = strlen(body);
@@ -258,6 +283,70 @@ int http_client_request_set_body(HTTP_CLIENT_REQUEST *request,
     return FRAMEWORK_SUCCESS;
 }
 
+int http_client_request_set_body_callback(HTTP_CLIENT_REQUEST *request,
+                                          HTTP_CLIENT_BODY_READER reader,
+                                          void *user_data,
+                                          long long content_length)
+{
+    if (!request || !reader) {
+        return FRAMEWORK_ERROR_NULL_PTR;
+    }
+    
+    clear_body_source(request);
+    request->body_reader = reader;
+    request->body_reader_data = user_data;
+    request->body_stream_length = content_length < 0 ? -1 : content_length;
+    
+    return FRAMEWORK_SUCCESS;
+}
+
+int http_client_request_set_body_file(HTTP_CLIENT_REQUEST *request,
+                                      int fd,
+                                      off_t offset,
+                                      size_t length)
+{
+    if (!request) {
+        return FRAMEWORK_ERROR_NULL_PTR;
+    }
+    
+    if (fd < 0 || offset < 0) {
+        return FRAMEWORK_ERROR_INVALID;
+    }
+    
+    if (length == 0) {
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < offset) {
+            return FRAMEWORK_ERROR_INVALID;
+        }
+        length = (size_t)(st.st_size - offset);
+    }
+    
+    clear_body_source(request);
+    request->body_fd = fd;
+    request->body_offset = offset;
+    request->body_stream_length = (long long)length;
+    
+    return FRAMEWORK_SUCCESS;
+}
+
+int http_client_request_set_compression(HTTP_CLIENT_REQUEST *request,
+                                        const HTTP_CLIENT_CODEC *codec,
+                                        size_t min_size)
+{
+    if (!request) {
+        return FRAMEWORK_ERROR_NULL_PTR;
+    }
+    
+    if (codec && (!codec->name || !codec->create || !codec->compress || !codec->destroy)) {
+        return FRAMEWORK_ERROR_INVALID;
+    }
+    
+    request->codec = codec;
+    request->compress_min_size = min_size;
+    
+    return FRAMEWORK_SUCCESS;
+}
+
 void http_client_request_set_timeout(HTTP_CLIENT_REQUEST *request, int timeout_seconds)
 {
     if (request) {
@@ -402,49 +491,231 @@ static int connect_with_timeout(const char *host, int port, int timeout_seconds)
     return sockfd;
 }
 
-/* ==================== Chunked Transfer Encoding ==================== */
+/* ==================== Response Reading ==================== */
+
+/* Buffered reader over the connection so responses can be framed by their headers */
+typedef struct {
+    int sockfd;
+    SSL *ssl;
+    char *data;
+    size_t start;       /* First unconsumed byte */
+    size_t end;         /* One past the last buffered byte */
+    size_t capacity;
+    int timed_out;
+} RESPONSE_READER;
+
+/* Growable body storage, always leaves room for a terminating NUL */
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+} BODY_BUFFER;
 
-static char* parse_chunked_body(const char *chunked_data, size_t data_len, size_t *out_len)
+static int reader_init(RESPONSE_READER *reader, int sockfd, SSL *ssl)
 {
-    size_t output_capacity = INITIAL_BUFFER_SIZE;
-    char *output = (char*)malloc(output_capacity);
-    size_t output_len = 0;
+    memset(reader, 0, sizeof(RESPONSE_READER));
+    reader->sockfd = sockfd;
+    reader->ssl = ssl;
+    reader->capacity = INITIAL_BUFFER_SIZE;
+    reader->data = (char*)malloc(reader->capacity);
+    
+    return reader->data ? FRAMEWORK_SUCCESS : FRAMEWORK_ERROR_MEMORY;
+}
+
+static void reader_free(RESPONSE_READER *reader)
+{
+    free(reader->data);
+    reader->data = NULL;
+}
+
+static size_t reader_available(const RESPONSE_READER *reader)
+{
+    return reader->end - reader->start;
+}
+
+/* Pull more bytes from the socket. Returns bytes read, 0 on EOF, -1 on error */
+static ssize_t reader_fill(RESPONSE_READER *reader, size_t max_capacity)
+{
+    if (reader->start == reader->end) {
+        reader->start = 0;
+        reader->end = 0;
+    }
+    
+    if (reader->end == reader->capacity) {
+        if (reader->start > 0) {
+            /* Reclaim consumed space before growing */
+            memmove(reader->data, reader->data + reader->start, reader->end - reader->start);
+            reader->end -= reader->start;
+            reader->start = 0;
+        } else {
+            if (reader->capacity >= max_capacity) {
+                return -1;
+            }
+            size_t new_capacity = reader->capacity * 2;
+            char *new_data = (char*)realloc(reader->data, new_capacity);
+            if (!new_data) {
+                return -1;
+            }
+            reader->data = new_data;
+            reader->capacity = new_capacity;
+        }
+    }
+    
+    ssize_t bytes = socket_read(reader->sockfd, reader->ssl, reader->data + reader->end,
+                                reader->capacity - reader->end);
+    if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        reader->timed_out = 1;
+    }
+    if (bytes > 0) {
+        reader->end += bytes;
+    }
+    
+    return bytes;
+}
+
+/* Consume everything up to and including the next delimiter (CRLF or CRLFCRLF) */
+static int reader_read_until(RESPONSE_READER *reader, const char *delimiter, size_t max_length,
+                             const char **out, size_t *out_len)
+{
+    size_t delimiter_len = strlen(delimiter);
+    size_t scanned = 0;
+    
+    while (1) {
+        const char *data = reader->data + reader->start;
+        size_t available = reader_available(reader);
+        
+        for (size_t i = scanned; i + delimiter_len <= available; i++) {
+            if (data[i] == '\r' && memcmp(data + i, delimiter, delimiter_len) == 0) {
+                *out = data;
+                *out_len = i;
+                reader->start += i + delimiter_len;
+                return FRAMEWORK_SUCCESS;
+            }
+        }
+        
+        if (available >= max_length) {
+            return FRAMEWORK_ERROR_INVALID;
+        }
+        scanned = available >= delimiter_len ? available - delimiter_len + 1 : 0;
+        
+        if (reader_fill(reader, max_length + INITIAL_BUFFER_SIZE) <= 0) {
+            return FRAMEWORK_ERROR_STATE;
+        }
+    }
+}
+
+/* Read exactly length bytes, draining the buffer first and then reading straight into dest */
+static int reader_read_exact(RESPONSE_READER *reader, char *dest, size_t length)
+{
+    size_t take = reader_available(reader);
+    if (take > length) {
+        take = length;
+    }
+    
+    memcpy(dest, reader->data + reader->start, take);
+    reader->start += take;
+    
+    size_t done = take;
+    while (done < length) {
+        ssize_t bytes = socket_read(reader->sockfd, reader->ssl, dest + done, length - done);
+        if (bytes <= 0) {
+            if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                reader->timed_out = 1;
+            }
+            return FRAMEWORK_ERROR_STATE;
+        }
+        done += bytes;
+    }
+    
+    return FRAMEWORK_SUCCESS;
+}
+
+static int body_reserve(BODY_BUFFER *body, size_t extra)
+{
+    if (extra > MAX_RESPONSE_SIZE || body->length + extra > MAX_RESPONSE_SIZE) {
+        return FRAMEWORK_ERROR_INVALID;
+    }
+    
+    size_t needed = body->length + extra + 1;
+    if (needed <= body->capacity) {
+        return FRAMEWORK_SUCCESS;
+    }
+    
+    size_t new_capacity = body->capacity ? body->capacity : INITIAL_BUFFER_SIZE;
+    while (new_capacity < needed) {
+        new_capacity *= 2;
+    }
     
-    const char *ptr = chunked_data;
-    const char *end = chunked_data + data_len;
+    char *new_data = (char*)realloc(body->data, new_capacity);
+    if (!new_data) {
+        return FRAMEWORK_ERROR_MEMORY;
+    }
     
-    while (ptr < end) {
-        /* Parse chunk size (hex) */
-        char *line_end = strstr(ptr, "\r\n");
-        if (!line_end) break;
+    body->data = new_data;
+    body->capacity = new_capacity;
+    return FRAMEWORK_SUCCESS;
+}
+
+static int hex_digit_value(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/* ==================== Chunked Transfer Encoding ==================== */
+
+static const char* read_chunked_body(RESPONSE_READER *reader, BODY_BUFFER *body)
+{
+    while (1) {
+        const char *line;
+        size_t line_len;
         
-        unsigned long chunk_size = strtoul(ptr, NULL, 16);
-        ptr = line_end + 2;
+        if (reader_read_until(reader, "\r\n", MAX_CHUNK_LINE, &line, &line_len) != FRAMEWORK_SUCCESS) {
+            return "Truncated chunked body";
+        }
         
-        /* End of chunks */
-        if (chunk_size == 0) break;
+        /* Chunk size in hex, optionally followed by ;extensions */
+        size_t chunk_size = 0;
+        size_t digits = 0;
+        while (digits < line_len && hex_digit_value(line[digits]) >= 0) {
+            if (chunk_size > MAX_RESPONSE_SIZE) {
+                return "Response too large";
+            }
+            chunk_size = chunk_size * 16 + hex_digit_value(line[digits]);
+            digits++;
+        }
         
-        /* Read chunk data */
-        if (ptr + chunk_size > end) break;
+        if (digits == 0) {
+            return "Failed to parse chunked encoding";
+        }
         
-        /* Expand buffer if needed */
-        while (output_len + chunk_size > output_capacity) {
-            output_capacity *= 2;
-            output = (char*)realloc(output, output_capacity);
+        /* Last chunk: skip trailer fields up to the terminating blank line */
+        if (chunk_size == 0) {
+            do {
+                if (reader_read_until(reader, "\r\n", MAX_CHUNK_LINE, &line, &line_len) != FRAMEWORK_SUCCESS) {
+                    return "Truncated chunked body";
+                }
+            } while (line_len > 0);
+            return NULL;
+        }
+        
+        if (body_reserve(body, chunk_size) != FRAMEWORK_SUCCESS) {
+            return "Response too large";
         }
         
-        memcpy(output + output_len, ptr, chunk_size);
-        output_len += chunk_size;
-        ptr += chunk_size;
+        if (reader_read_exact(reader, body->data + body->length, chunk_size) != FRAMEWORK_SUCCESS) {
+            return "Truncated chunked body";
+        }
+        body->length += chunk_size;
         
-        /* Skip trailing \r\n */
-        if (ptr + 2 <= end && ptr[0] == '\r' && ptr[1] == '\n') {
-            ptr += 2;
+        /* Chunk data is followed by a bare CRLF */
+        if (reader_read_until(reader, "\r\n", MAX_CHUNK_LINE, &line, &line_len) != FRAMEWORK_SUCCESS ||
+            line_len != 0) {
+            return "Failed to parse chunked encoding";
         }
     }
-    
-    *out_len = output_len;
-    return output;
 }
 
 /* ==================== Compression Support ==================== */
@@ -539,215 +810,870 @@ static char* decompress_deflate(const char *data, size_t data_len, size_t *out_l
     }
 }
 
-/* ==================== HTTP Response Parsing ==================== */
+/* Request body compression: built-in gzip codec */
+
+#define GZIP_REQUEST_LEVEL 1   /* Favour throughput over ratio for large uploads */
 
-static HTTP_CLIENT_RESPONSE* parse_http_response(const char *response_data, size_t response_len)
+static void* gzip_codec_create(void)
 {
-    HTTP_CLIENT_RESPONSE *response = (HTTP_CLIENT_RESPONSE*)calloc(1, sizeof(HTTP_CLIENT_RESPONSE));
-    if (!response) {
+    z_stream *stream = (z_stream*)calloc(1, sizeof(z_stream));
+    if (!stream) {
         return NULL;
     }
     
-    /* Find end of headers */
-    const char *headers_end = strstr(response_data, "\r\n\r\n");
-    if (!headers_end) {
-        response->error_message = strdup("Invalid HTTP response");
-        return response;
+    /* 15 + 16 for a gzip wrapper */
+    if (deflateInit2(stream, GZIP_REQUEST_LEVEL, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        free(stream);
+        return NULL;
     }
     
-    /* Parse status line */
-    int major, minor;
-    if (sscanf(response_data, "HTTP/%d.%d %d", &major, &minor, &response->status_code) != 3) {
-        response->error_message = strdup("Failed to parse status line");
-        return response;
-    }
+    return stream;
+}
+
+static int gzip_codec_compress(void *state, const char *input, size_t input_length, size_t *consumed,
+                               char *output, size_t output_size, size_t *produced, int finish)
+{
+    z_stream *stream = (z_stream*)state;
     
-    /* Parse headers */
-    const char *line_start = response_data;
-    const char *line_end = strstr(line_start, "\r\n");
+    stream->next_in = (Bytef*)input;
+    stream->avail_in = (uInt)input_length;
+    stream->next_out = (Bytef*)output;
+    stream->avail_out = (uInt)output_size;
     
-    if (line_end) {
-        line_start = line_end + 2; /* Skip status line */
+    int ret = deflate(stream, finish ? Z_FINISH : Z_NO_FLUSH);
+    if (ret == Z_STREAM_ERROR) {
+        return -1;
     }
     
-    response->header_capacity = INITIAL_HEADER_CAPACITY;
-    response->header_names = (char**)calloc(response->header_capacity, sizeof(char*));
-    response->header_values = (char**)calloc(response->header_capacity, sizeof(char*));
+    *consumed = input_length - stream->avail_in;
+    *produced = output_size - stream->avail_out;
     
-    while (line_start < headers_end) {
-        line_end = strstr(line_start, "\r\n");
-        if (!line_end || line_end == line_start) break;
-        
-        const char *colon = strchr(line_start, ':');
-        if (colon && colon < line_end) {
-            size_t name_len = colon - line_start;
-            const char *value_start = colon + 1;
-            
-            /* Skip leading whitespace in value */
-            while (value_start < line_end && (*value_start == ' ' || *value_start == '\t')) {
-                value_start++;
-            }
-            
-            size_t value_len = line_end - value_start;
-            
-            if (response->header_count >= response->header_capacity) {
-                size_t new_capacity = response->header_capacity * 2;
-                response->header_names = (char**)realloc(response->header_names, 
-                                                         new_capacity * sizeof(char*));
-                response->header_values = (char**)realloc(response->header_values, 
-                                                          new_capacity * sizeof(char*));
-                response->header_capacity = new_capacity;
-            }
-            
-            response->header_names[response->header_count] = strndup(line_start, name_len);
-            response->header_values[response->header_count] = strndup(value_start, value_len);
-            response->header_count++;
+    return ret == Z_STREAM_END ? 1 : 0;
+}
+
+static void gzip_codec_destroy(void *state)
+{
+    z_stream *stream = (z_stream*)state;
+    deflateEnd(stream);
+    free(stream);
+}
+
+static const HTTP_CLIENT_CODEC g_gzip_codec = {
+    "gzip",
+    gzip_codec_create,
+    gzip_codec_compress,
+    gzip_codec_destroy
+};
+
+const HTTP_CLIENT_CODEC* http_client_codec_gzip(void)
+{
+    return &g_gzip_codec;
+}
+
+/* ==================== HTTP Response Parsing ==================== */
+
+static HTTP_CLIENT_RESPONSE* error_response(const char *message)
+{
+    HTTP_CLIENT_RESPONSE *response = (HTTP_CLIENT_RESPONSE*)calloc(1, sizeof(HTTP_CLIENT_RESPONSE));
+    if (response) {
+        response->error_message = strdup(message);
+    }
+    return response;
+}
+
+static int response_add_header(HTTP_CLIENT_RESPONSE *response,
+                               const char *name, size_t name_len,
+                               const char *value, size_t value_len)
+{
+    if (response->header_count >= response->header_capacity) {
+        size_t new_capacity = response->header_capacity ? response->header_capacity * 2 
+                                                        : INITIAL_HEADER_CAPACITY;
+        char **new_names = (char**)realloc(response->header_names, new_capacity * sizeof(char*));
+        if (!new_names) {
+            return FRAMEWORK_ERROR_MEMORY;
         }
+        response->header_names = new_names;
         
-        line_start = line_end + 2;
+        char **new_values = (char**)realloc(response->header_values, new_capacity * sizeof(char*));
+        if (!new_values) {
+            return FRAMEWORK_ERROR_MEMORY;
+        }
+        response->header_values = new_values;
+        response->header_capacity = new_capacity;
+    }
+    
+    char *header_name = strndup(name, name_len);
+    char *header_value = strndup(value, value_len);
+    if (!header_name || !header_value) {
+        free(header_name);
+        free(header_value);
+        return FRAMEWORK_ERROR_MEMORY;
     }
     
-    /* Extract body */
-    const char *body_start = headers_end + 4;
-    size_t body_len = response_len - (body_start - response_data);
+    response->header_names[response->header_count] = header_name;
+    response->header_values[response->header_count] = header_value;
+    response->header_count++;
     
-    if (body_len > 0) {
-        /* Check for chunked transfer encoding */
-        int is_chunked = 0;
-        const char *encoding = NULL;
-        const char *content_encoding = NULL;
+    return FRAMEWORK_SUCCESS;
+}
+
+/* Parse a response head (status line + headers, without the blank line) */
+static const char* parse_response_head(const char *head, size_t head_len, HTTP_CLIENT_RESPONSE *response)
+{
+    const char *end = head + head_len;
+    const char *line_end = memchr(head, '\r', head_len);
+    if (!line_end) {
+        line_end = end;
+    }
+    
+    /* Status line: HTTP/x.y NNN reason */
+    if (line_end - head < 12 || strncmp(head, "HTTP/", 5) != 0 || head[8] != ' ' ||
+        head[9] < '0' || head[9] > '9' || head[10] < '0' || head[10] > '9' ||
+        head[11] < '0' || head[11] > '9') {
+        return "Failed to parse status line";
+    }
+    response->status_code = (head[9] - '0') * 100 + (head[10] - '0') * 10 + (head[11] - '0');
+    
+    /* Header lines */
+    const char *line = line_end;
+    while (line < end) {
+        if (*line == '\r') line++;
+        if (line < end && *line == '\n') line++;
+        if (line >= end) break;
         
-        for (size_t i = 0; i < response->header_count; i++) {
-            if (strcasecmp(response->header_names[i], "Transfer-Encoding") == 0) {
-                if (strstr(response->header_values[i], "chunked") != NULL) {
-                    is_chunked = 1;
-                }
-                encoding = response->header_values[i];
-            }
-            if (strcasecmp(response->header_names[i], "Content-Encoding") == 0) {
-                content_encoding = response->header_values[i];
-            }
+        line_end = memchr(line, '\r', end - line);
+        if (!line_end) {
+            line_end = end;
         }
         
-        char *decoded_body = NULL;
-        size_t decoded_len = 0;
-        
-        /* Handle chunked encoding first */
-        if (is_chunked) {
-            decoded_body = parse_chunked_body(body_start, body_len, &decoded_len);
-            if (!decoded_body) {
-                response->error_message = strdup("Failed to parse chunked encoding");
-                return response;
+        const char *colon = memchr(line, ':', line_end - line);
+        if (colon) {
+            const char *value_start = colon + 1;
+            const char *value_end = line_end;
+            
+            /* Trim optional whitespace around the value */
+            while (value_start < value_end && (*value_start == ' ' || *value_start == '\t')) {
+                value_start++;
+            }
+            while (value_end > value_start && (value_end[-1] == ' ' || value_end[-1] == '\t')) {
+                value_end--;
             }
-        } else {
-            decoded_body = (char*)malloc(body_len);
-            memcpy(decoded_body, body_start, body_len);
-            decoded_len = body_len;
-        }
-        
-        /* Handle compression */
-        char *final_body = NULL;
-        size_t final_len = 0;
-        
-        if (content_encoding || (encoding && !is_chunked)) {
-            const char *enc = content_encoding ? content_encoding : encoding;
             
-            if (strstr(enc, "gzip") != NULL) {
-                final_body = decompress_gzip(decoded_body, decoded_len, &final_len);
-                free(decoded_body);
-                if (!final_body) {
-                    response->error_message = strdup("Failed to decompress gzip");
-                    return response;
-                }
-            } else if (strstr(enc, "deflate") != NULL) {
-                final_body = decompress_deflate(decoded_body, decoded_len, &final_len);
-                free(decoded_body);
-                if (!final_body) {
-                    response->error_message = strdup("Failed to decompress deflate");
-                    return response;
-                }
-            } else {
-                /* No compression or unknown encoding */
-                final_body = decoded_body;
-                final_len = decoded_len;
+            if (response_add_header(response, line, colon - line,
+                                    value_start, value_end - value_start) != FRAMEWORK_SUCCESS) {
+                return "Out of memory";
             }
-        } else {
-            final_body = decoded_body;
-            final_len = decoded_len;
-        }
-        
-        response->body = (char*)malloc(final_len + 1);
-        if (response->body) {
-            memcpy(response->body, final_body, final_len);
-            response->body[final_len] = '\0';
-            response->body_length = final_len;
         }
         
-        if (final_body != decoded_body) {
-            free(final_body);
-        }
+        line = line_end;
     }
     
-    return response;
+    return NULL;
 }
 
-/* ==================== Request Execution ==================== */
-
-HTTP_CLIENT_RESPONSE* http_client_execute(HTTP_CLIENT_REQUEST *request)
+/* Read one response head from the connection into a new response object */
+static HTTP_CLIENT_RESPONSE* read_response_head(RESPONSE_READER *reader)
 {
-    if (!request) {
-        return NULL;
+    const char *head;
+    size_t head_len;
+    
+    int result = reader_read_until(reader, "\r\n\r\n", MAX_HEADER_SIZE, &head, &head_len);
+    if (result != FRAMEWORK_SUCCESS) {
+        if (reader->timed_out) {
+            return error_response("Request timed out");
+        }
+        if (result == FRAMEWORK_ERROR_INVALID) {
+            return error_response("Response headers too large");
+        }
+        return error_response(reader->end == 0 ? "Empty response" : "Invalid HTTP response");
     }
     
-    /* Initialize OpenSSL if needed */
-    if (!g_ssl_initialized) {
-        init_openssl();
+    HTTP_CLIENT_RESPONSE *response = (HTTP_CLIENT_RESPONSE*)calloc(1, sizeof(HTTP_CLIENT_RESPONSE));
+    if (!response) {
+        return NULL;
     }
     
-    struct timeval start_time, end_time;
-    gettimeofday(&start_time, NULL);
+    const char *error = parse_response_head(head, head_len, response);
+    if (error) {
+        response->error_message = strdup(error);
+    }
     
-    /* Parse URL */
-    URL_PARTS url_parts;
-    if (parse_url(request->url, &url_parts) != FRAMEWORK_SUCCESS) {
-        HTTP_CLIENT_RESPONSE *response = (HTTP_CLIENT_RESPONSE*)calloc(1, sizeof(HTTP_CLIENT_RESPONSE));
-        response->error_message = strdup("Invalid URL");
-        return response;
+    return response;
+}
+
+/* Whether a response to this request can carry a message body */
+static int response_has_body(const HTTP_CLIENT_REQUEST *request, int status_code)
+{
+    if (strcasecmp(request->method, "HEAD") == 0) {
+        return 0;
+    }
+    if ((status_code >= 100 && status_code < 200) || status_code == 204 || status_code == 304) {
+        return 0;
     }
+    return 1;
+}
+
+/* Read the body as framed by Transfer-Encoding / Content-Length, or until close */
+static const char* read_response_body(RESPONSE_READER *reader, HTTP_CLIENT_RESPONSE *response,
+                                      BODY_BUFFER *body)
+{
+    const char *transfer_encoding = http_client_response_get_header(response, "Transfer-Encoding");
+    const char *content_length = http_client_response_get_header(response, "Content-Length");
     
-    /* Determine if HTTPS */
-    int use_ssl = (strcasecmp(url_parts.protocol, "https") == 0);
+    if (transfer_encoding && strstr(transfer_encoding, "chunked") != NULL) {
+        return read_chunked_body(reader, body);
+    }
     
-    /* Connect to server */
-    int sockfd = connect_with_timeout(url_parts.host, url_parts.port, request->timeout_seconds);
-    if (sockfd < 0) {
-        HTTP_CLIENT_RESPONSE *response = (HTTP_CLIENT_RESPONSE*)calloc(1, sizeof(HTTP_CLIENT_RESPONSE));
-        response->error_message = strdup("Connection failed");
-        return response;
+    if (content_length) {
+        char *end_ptr;
+        errno = 0;
+        unsigned long long length = strtoull(content_length, &end_ptr, 10);
+        if (errno != 0 || end_ptr == content_length || content_length[0] == '-') {
+            return "Invalid Content-Length";
+        }
+        if (length > MAX_RESPONSE_SIZE) {
+            return "Response too large";
+        }
+        if (body_reserve(body, (size_t)length) != FRAMEWORK_SUCCESS) {
+            return "Out of memory";
+        }
+        if (reader_read_exact(reader, body->data, (size_t)length) != FRAMEWORK_SUCCESS) {
+            return reader->timed_out ? "Request timed out" 
+                                     : "Connection closed before response completed";
+        }
+        body->length = (size_t)length;
+        return NULL;
     }
     
-    /* Setup SSL if needed */
-    SSL *ssl = NULL;
-    if (use_ssl) {
-        if (!g_ssl_ctx) {
-            close(sockfd);
-            HTTP_CLIENT_RESPONSE *response = (HTTP_CLIENT_RESPONSE*)calloc(1, sizeof(HTTP_CLIENT_RESPONSE));
-            response->error_message = strdup("SSL not initialized");
-            return response;
+    /* No framing information: the body is delimited by connection close */
+    while (1) {
+        if (body_reserve(body, INITIAL_BUFFER_SIZE) != FRAMEWORK_SUCCESS) {
+            return "Response too large";
         }
         
-        ssl = SSL_new(g_ssl_ctx);
-        if (!ssl) {
-            close(sockfd);
-            HTTP_CLIENT_RESPONSE *response = (HTTP_CLIENT_RESPONSE*)calloc(1, sizeof(HTTP_CLIENT_RESPONSE));
-            response->error_message = strdup("Failed to create SSL connection");
-            return response;
+        size_t available = reader_available(reader);
+        if (available > 0) {
+            size_t take = available < INITIAL_BUFFER_SIZE ? available : INITIAL_BUFFER_SIZE;
+            memcpy(body->data + body->length, reader->data + reader->start, take);
+            reader->start += take;
+            body->length += take;
+            continue;
         }
         
-        SSL_set_fd(ssl, sockfd);
-        
-        /* Set SNI hostname */
-        SSL_set_tlsext_host_name(ssl, url_parts.host);
+        ssize_t bytes = socket_read(reader->sockfd, reader->ssl, body->data + body->length,
+                                    INITIAL_BUFFER_SIZE);
+        if (bytes > 0) {
+            body->length += bytes;
+            continue;
+        }
+        
+        /* Only an orderly close ends the body; anything else means it was cut short */
+        if (reader->ssl ? SSL_get_error(reader->ssl, (int)bytes) == SSL_ERROR_ZERO_RETURN : bytes == 0) {
+            return NULL;
+        }
+        if (!reader->ssl && errno == EINTR) {
+            continue;
+        }
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? "Request timed out"
+                                                         : "Connection error before response completed";
+    }
+}
+
+/* Apply Content-Encoding and attach the final body to the response */
+static void finish_response_body(HTTP_CLIENT_RESPONSE *response, BODY_BUFFER *body)
+{
+    if (body->length == 0) {
+        free(body->data);
+        return;
+    }
+    
+    const char *encoding = http_client_response_get_header(response, "Content-Encoding");
+    if (!encoding) {
+        /* Legacy servers sometimes advertise compression through Transfer-Encoding */
+        const char *transfer_encoding = http_client_response_get_header(response, "Transfer-Encoding");
+        if (transfer_encoding && strstr(transfer_encoding, "chunked") == NULL) {
+            encoding = transfer_encoding;
+        }
+    }
+    
+    char *final_body = NULL;
+    size_t final_len = 0;
+    
+    if (encoding && strstr(encoding, "gzip") != NULL) {
+        final_body = decompress_gzip(body->data, body->length, &final_len);
+        if (!final_body) {
+            response->error_message = strdup("Failed to decompress gzip");
+        }
+    } else if (encoding && strstr(encoding, "deflate") != NULL) {
+        final_body = decompress_deflate(body->data, body->length, &final_len);
+        if (!final_body) {
+            response->error_message = strdup("Failed to decompress deflate");
+        }
+    } else {
+        /* Uncompressed: hand over the buffer without copying */
+        body->data[body->length] = '\0';
+        response->body = body->data;
+        response->body_length = body->length;
+        return;
+    }
+    
+    free(body->data);
+    
+    if (final_body) {
+        response->body = (char*)malloc(final_len + 1);
+        if (response->body) {
+            memcpy(response->body, final_body, final_len);
+            response->body[final_len] = '\0';
+            response->body_length = final_len;
+        }
+        free(final_body);
+    }
+}
+
+/* Wait until the connection has data to read; returns >0 if readable, 0 on timeout */
+static int wait_readable(int sockfd, SSL *ssl, int timeout_ms)
+{
+    if (ssl && SSL_pending(ssl) > 0) {
+        return 1;
+    }
+    
+    struct pollfd pfd;
+    pfd.fd = sockfd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    
+    int result;
+    do {
+        result = poll(&pfd, 1, timeout_ms);
+    } while (result < 0 && errno == EINTR);
+    
+    return result;
+}
+
+/* ==================== Request Emission ==================== */
+
+/* Dynamically sized request head; spare capacity can hold a small body */
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+    int error;
+} REQUEST_HEAD;
+
+static void head_append(REQUEST_HEAD *head, const char *text, size_t len)
+{
+    if (head->error) {
+        return;
+    }
+    
+    if (head->length + len > head->capacity) {
+        size_t new_capacity = head->capacity * 2;
+        while (new_capacity < head->length + len) {
+            new_capacity *= 2;
+        }
+        
+        char *new_data = (char*)realloc(head->data, new_capacity);
+        if (!new_data) {
+            head->error = 1;
+            return;
+        }
+        head->data = new_data;
+        head->capacity = new_capacity;
+    }
+    
+    memcpy(head->data + head->length, text, len);
+    head->length += len;
+}
+
+static void head_append_str(REQUEST_HEAD *head, const char *text)
+{
+    head_append(head, text, strlen(text));
+}
+
+static void head_append_header(REQUEST_HEAD *head, const char *name, const char *value)
+{
+    head_append_str(head, name);
+    head_append(head, ": ", 2);
+    head_append_str(head, value);
+    head_append(head, "\r\n", 2);
+}
+
+static int request_has_header(const HTTP_CLIENT_REQUEST *request, const char *name)
+{
+    for (size_t i = 0; i < request->header_count; i++) {
+        if (strcasecmp(request->header_names[i], name) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Build the request head; reserve leaves room behind it for a coalesced body */
+static int build_request_head(REQUEST_HEAD *head, const HTTP_CLIENT_REQUEST *request,
+                              const URL_PARTS *url_parts, int has_body, long long body_length,
+                              const char *content_encoding, int expect_continue, size_t reserve)
+{
+    /* Size the buffer from the actual header set so nothing is truncated */
+    size_t estimate = 256 + strlen(request->method) + strlen(url_parts->path) + strlen(url_parts->host);
+    for (size_t i = 0; i < request->header_count; i++) {
+        estimate += strlen(request->header_names[i]) + strlen(request->header_values[i]) + 4;
+    }
+    
+    head->length = 0;
+    head->capacity = estimate + reserve;
+    head->error = 0;
+    head->data = (char*)malloc(head->capacity);
+    if (!head->data) {
+        return FRAMEWORK_ERROR_MEMORY;
+    }
+    
+    head_append_str(head, request->method);
+    head_append(head, " ", 1);
+    head_append_str(head, url_parts->path);
+    head_append_str(head, " HTTP/1.1\r\n");
+    head_append_header(head, "Host", url_parts->host);
+    /* One connection per request: responses are framed, but there is no connection pool yet */
+    head_append_str(head, "User-Agent: Equinox-Framework/1.0\r\n"
+                          "Accept: */*\r\n"
+                          "Accept-Encoding: gzip, deflate\r\n"
+                          "Connection: close\r\n");
+    
+    /* Add custom headers */
+    for (size_t i = 0; i < request->header_count; i++) {
+        head_append_header(head, request->header_names[i], request->header_values[i]);
+    }
+    
+    if (has_body) {
+        if (body_length < 0) {
+            head_append_str(head, "Transfer-Encoding: chunked\r\n");
+        } else {
+            char length_str[32];
+            snprintf(length_str, sizeof(length_str), "%lld", body_length);
+            head_append_header(head, "Content-Length", length_str);
+        }
+    }
+    
+    if (content_encoding) {
+        head_append_header(head, "Content-Encoding", content_encoding);
+    }
+    
+    if (expect_continue) {
+        head_append_str(head, "Expect: 100-continue\r\n");
+    }
+    
+    head_append(head, "\r\n", 2);
+    
+    if (head->error) {
+        free(head->data);
+        head->data = NULL;
+        return FRAMEWORK_ERROR_MEMORY;
+    }
+    
+    return FRAMEWORK_SUCCESS;
+}
+
+static int socket_write_all(int sockfd, SSL *ssl, const char *data, size_t len)
+{
+    size_t sent = 0;
+    
+    while (sent < len) {
+        /* SSL_write takes an int length */
+        size_t part = len - sent;
+        if (part > (1u << 30)) {
+            part = 1u << 30;
+        }
+        
+        ssize_t bytes = socket_write(sockfd, ssl, data + sent, part);
+        if (bytes <= 0) {
+            if (bytes < 0 && !ssl && errno == EINTR) {
+                continue;
+            }
+            return FRAMEWORK_ERROR_STATE;
+        }
+        sent += bytes;
+    }
+    
+    return FRAMEWORK_SUCCESS;
+}
+
+static int socket_writev_all(int sockfd, struct iovec *iov, int iovcnt)
+{
+    while (iovcnt > 0) {
+        ssize_t bytes = writev(sockfd, iov, iovcnt);
+        if (bytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return FRAMEWORK_ERROR_STATE;
+        }
+        
+        /* Advance past whatever the kernel accepted */
+        while (iovcnt > 0 && (size_t)bytes >= iov->iov_len) {
+            bytes -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char*)iov->iov_base + bytes;
+            iov->iov_len -= bytes;
+        }
+    }
+    
+    return FRAMEWORK_SUCCESS;
+}
+
+/* Send the head, gathering an in-memory body into the same write when given */
+static const char* send_request_head(int sockfd, SSL *ssl, REQUEST_HEAD *head,
+                                     const char *body, size_t body_length)
+{
+    if (ssl) {
+        /* Small bodies are copied behind the head so both go out in one TLS record */
+        if (body && head->length + body_length <= head->capacity) {
+            memcpy(head->data + head->length, body, body_length);
+            head->length += body_length;
+            body = NULL;
+        }
+        
+        if (socket_write_all(sockfd, ssl, head->data, head->length) != FRAMEWORK_SUCCESS) {
+            return "Failed to send request";
+        }
+        if (body && socket_write_all(sockfd, ssl, body, body_length) != FRAMEWORK_SUCCESS) {
+            return "Failed to send body";
+        }
+        return NULL;
+    }
+    
+    struct iovec iov[2];
+    iov[0].iov_base = head->data;
+    iov[0].iov_len = head->length;
+    iov[1].iov_base = (void*)body;
+    iov[1].iov_len = body_length;
+    
+    if (socket_writev_all(sockfd, iov, body ? 2 : 1) != FRAMEWORK_SUCCESS) {
+        return "Failed to send request";
+    }
+    
+    return NULL;
+}
+
+/* Frame data already placed after CHUNK_PREFIX_SPACE bytes of headroom as one chunk */
+static int send_chunk(int sockfd, SSL *ssl, char *data, size_t length)
+{
+    char prefix[CHUNK_PREFIX_SPACE];
+    int prefix_len = snprintf(prefix, sizeof(prefix), "%zx\r\n", length);
+    
+    memcpy(data - prefix_len, prefix, prefix_len);
+    memcpy(data + length, "\r\n", 2);
+    
+    return socket_write_all(sockfd, ssl, data - prefix_len, prefix_len + length + 2);
+}
+
+/* Next slice of raw body bytes from whichever source is configured.
+   Memory bodies are returned in place; other sources are read into buffer. */
+static ssize_t read_body_source(HTTP_CLIENT_REQUEST *request, long long position,
+                                char *buffer, size_t size, const char **data)
+{
+    *data = buffer;
+    
+    if (request->body_reader) {
+        long long length = request->body_stream_length;
+        if (length >= 0 && length - position < (long long)size) {
+            size = (size_t)(length - position);
+        }
+        if (size == 0) {
+            return 0;
+        }
+        
+        ssize_t bytes = request->body_reader(request->body_reader_data, buffer, size);
+        return (bytes < 0 || (size_t)bytes > size) ? -1 : bytes;
+    }
+    
+    if (request->body_fd >= 0) {
+        long long length = request->body_stream_length;
+        if (length - position < (long long)size) {
+            size = (size_t)(length - position);
+        }
+        if (size == 0) {
+            return 0;
+        }
+        
+        ssize_t bytes;
+        do {
+            bytes = pread(request->body_fd, buffer, size, request->body_offset + position);
+        } while (bytes < 0 && errno == EINTR);
+        return bytes;
+    }
+    
+    size_t remaining = request->body_length - (size_t)position;
+    *data = request->body + position;
+    return remaining < size ? (ssize_t)remaining : (ssize_t)size;
+}
+
+/* Compress the body while streaming it; the encoded body is never held in full */
+static const char* send_body_compressed(int sockfd, SSL *ssl, HTTP_CLIENT_REQUEST *request)
+{
+    const HTTP_CLIENT_CODEC *codec = request->codec;
+    long long expected = (request->body_reader || request->body_fd >= 0) 
+                         ? request->body_stream_length : (long long)request->body_length;
+    
+    void *state = codec->create();
+    if (!state) {
+        return "Failed to initialize compression";
+    }
+    
+    char *input = (char*)malloc(BODY_STREAM_BUFFER_SIZE);
+    char *frame = (char*)malloc(CHUNK_PREFIX_SPACE + BODY_STREAM_BUFFER_SIZE + 2);
+    if (!input || !frame) {
+        free(input);
+        free(frame);
+        codec->destroy(state);
+        return "Out of memory";
+    }
+    
+    char *output = frame + CHUNK_PREFIX_SPACE;
+    size_t output_length = 0;
+    long long position = 0;
+    int finished = 0;
+    const char *error = NULL;
+    
+    while (!finished && !error) {
+        const char *data;
+        ssize_t bytes = read_body_source(request, position, input, BODY_STREAM_BUFFER_SIZE, &data);
+        if (bytes < 0) {
+            error = "Body reader failed";
+            break;
+        }
+        if (bytes == 0 && expected >= 0 && position < expected) {
+            error = "Body reader ended before Content-Length";
+            break;
+        }
+        position += bytes;
+        
+        int finish = (bytes == 0);
+        size_t offset = 0;
+        
+        do {
+            size_t consumed = 0;
+            size_t produced = 0;
+            int ret = codec->compress(state, data + offset, bytes - offset, &consumed,
+                                      output + output_length, BODY_STREAM_BUFFER_SIZE - output_length,
+                                      &produced, finish);
+            if (ret < 0) {
+                error = "Compression failed";
+                break;
+            }
+            
+            offset += consumed;
+            output_length += produced;
+            finished = (ret == 1);
+            
+            /* Emit full chunks as they fill, and whatever is left at the end */
+            if (output_length == BODY_STREAM_BUFFER_SIZE || (finished && output_length > 0)) {
+                if (send_chunk(sockfd, ssl, output, output_length) != FRAMEWORK_SUCCESS) {
+                    error = "Failed to send body";
+                    break;
+                }
+                output_length = 0;
+            }
+        } while (!finished && (offset < (size_t)bytes || finish));
+    }
+    
+    if (!error && socket_write_all(sockfd, ssl, "0\r\n\r\n", 5) != FRAMEWORK_SUCCESS) {
+        error = "Failed to send body";
+    }
+    
+    codec->destroy(state);
+    free(input);
+    free(frame);
+    return error;
+}
+
+static const char* send_body_callback(int sockfd, SSL *ssl, HTTP_CLIENT_REQUEST *request)
+{
+    long long remaining = request->body_stream_length;
+    int chunked = (remaining < 0);
+    
+    /* Room in front of the data for the chunk size line and behind it for CRLF */
+    char *buffer = (char*)malloc(CHUNK_PREFIX_SPACE + BODY_STREAM_BUFFER_SIZE + 2);
+    if (!buffer) {
+        return "Out of memory";
+    }
+    char *data = buffer + CHUNK_PREFIX_SPACE;
+    const char *error = NULL;
+    
+    while (chunked || remaining > 0) {
+        size_t want = BODY_STREAM_BUFFER_SIZE;
+        if (!chunked && remaining < (long long)want) {
+            want = (size_t)remaining;
+        }
+        
+        ssize_t bytes = request->body_reader(request->body_reader_data, data, want);
+        if (bytes < 0 || (size_t)bytes > want) {
+            error = "Body reader failed";
+            break;
+        }
+        if (bytes == 0) {
+            if (!chunked) {
+                error = "Body reader ended before Content-Length";
+            }
+            break;
+        }
+        
+        if (chunked) {
+            if (send_chunk(sockfd, ssl, data, bytes) != FRAMEWORK_SUCCESS) {
+                error = "Failed to send body";
+                break;
+            }
+        } else {
+            if (socket_write_all(sockfd, ssl, data, bytes) != FRAMEWORK_SUCCESS) {
+                error = "Failed to send body";
+                break;
+            }
+            remaining -= bytes;
+        }
+    }
+    
+    if (!error && chunked && socket_write_all(sockfd, ssl, "0\r\n\r\n", 5) != FRAMEWORK_SUCCESS) {
+        error = "Failed to send body";
+    }
+    
+    free(buffer);
+    return error;
+}
+
+static const char* send_body_file(int sockfd, SSL *ssl, HTTP_CLIENT_REQUEST *request)
+{
+    off_t offset = request->body_offset;
+    size_t remaining = (size_t)request->body_stream_length;
+    
+    if (!ssl) {
+        /* Plain sockets: let the kernel move file pages straight to the socket */
+        while (remaining > 0) {
+            size_t part = remaining > (1u << 30) ? (1u << 30) : remaining;
+            ssize_t bytes = sendfile(sockfd, request->body_fd, &offset, part);
+            if (bytes < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return "Failed to send body";
+            }
+            if (bytes == 0) {
+                return "Body file ended before Content-Length";
+            }
+            remaining -= bytes;
+        }
+        return NULL;
+    }
+    
+    /* TLS must encrypt in user space */
+    char *buffer = (char*)malloc(BODY_STREAM_BUFFER_SIZE);
+    if (!buffer) {
+        return "Out of memory";
+    }
+    
+    const char *error = NULL;
+    while (remaining > 0) {
+        size_t part = remaining > BODY_STREAM_BUFFER_SIZE ? BODY_STREAM_BUFFER_SIZE : remaining;
+        ssize_t bytes = pread(request->body_fd, buffer, part, offset);
+        if (bytes < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes <= 0) {
+            error = bytes == 0 ? "Body file ended before Content-Length" : "Failed to read body file";
+            break;
+        }
+        if (socket_write_all(sockfd, ssl, buffer, bytes) != FRAMEWORK_SUCCESS) {
+            error = "Failed to send body";
+            break;
+        }
+        offset += bytes;
+        remaining -= bytes;
+    }
+    
+    free(buffer);
+    return error;
+}
+
+/* Send the body that was not gathered with the head */
+static const char* send_request_body(int sockfd, SSL *ssl, HTTP_CLIENT_REQUEST *request, int compress)
+{
+    if (compress) {
+        return send_body_compressed(sockfd, ssl, request);
+    }
+    
+    if (request->body_reader) {
+        return send_body_callback(sockfd, ssl, request);
+    }
+    
+    if (request->body_fd >= 0) {
+        return send_body_file(sockfd, ssl, request);
+    }
+    
+    if (socket_write_all(sockfd, ssl, request->body, request->body_length) != FRAMEWORK_SUCCESS) {
+        return "Failed to send body";
+    }
+    
+    return NULL;
+}
+
+/* ==================== Request Execution ==================== */
+
+static HTTP_CLIENT_RESPONSE* execute_attempt(HTTP_CLIENT_REQUEST *request)
+{
+    if (!request) {
+        return NULL;
+    }
+    
+    /* Initialize OpenSSL if needed */
+    if (!g_ssl_initialized) {
+        init_openssl();
+    }
+    
+    struct timeval start_time, end_time;
+    gettimeofday(&start_time, NULL);
+    
+    /* Parse URL */
+    URL_PARTS url_parts;
+    if (parse_url(request->url, &url_parts) != FRAMEWORK_SUCCESS) {
+        return error_response("Invalid URL");
+    }
+    
+    /* Determine if HTTPS */
+    int use_ssl = (strcasecmp(url_parts.protocol, "https") == 0);
+    
+    /* Connect to server */
+    int sockfd = connect_with_timeout(url_parts.host, url_parts.port, request->timeout_seconds);
+    if (sockfd < 0) {
+        return error_response("Connection failed");
+    }
+    
+    /* Bound every blocking read and write by the request timeout */
+    if (request->timeout_seconds > 0) {
+        struct timeval tv;
+        tv.tv_sec = request->timeout_seconds;
+        tv.tv_usec = 0;
+        setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(sockfd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    }
+    
+    /* Setup SSL if needed */
+    SSL *ssl = NULL;
+    if (use_ssl) {
+        if (!g_ssl_ctx) {
+            close(sockfd);
+            return error_response("SSL not initialized");
+        }
+        
+        ssl = SSL_new(g_ssl_ctx);
+        if (!ssl) {
+            close(sockfd);
+            return error_response("Failed to create SSL connection");
+        }
+        
+        SSL_set_fd(ssl, sockfd);
+        
+        /* Set SNI hostname */
+        SSL_set_tlsext_host_name(ssl, url_parts.host);
         
         /* Disable verification if requested */
         if (!request->verify_ssl) {
@@ -760,114 +1686,135 @@ HTTP_CLIENT_RESPONSE* http_client_execute(HTTP_CLIENT_REQUEST *request)
             ERR_error_string_n(ERR_get_error(), error_buf, sizeof(error_buf));
             SSL_free(ssl);
             close(sockfd);
-            HTTP_CLIENT_RESPONSE *response = (HTTP_CLIENT_RESPONSE*)calloc(1, sizeof(HTTP_CLIENT_RESPONSE));
-            response->error_message = strdup(error_buf);
             framework_log(LOG_LEVEL_ERROR, "SSL handshake failed: %s", error_buf);
-            return response;
+            return error_response(error_buf);
         }
         
         framework_log(LOG_LEVEL_DEBUG, "SSL connection established");
     }
     
-    /* Build HTTP request */
-    char request_buf[8192];
-    int offset = snprintf(request_buf, sizeof(request_buf),
-                         "%s %s HTTP/1.1\r\n"
-                         "Host: %s\r\n"
-                         "User-Agent: Equinox-Framework/1.0\r\n"
-                         "Accept: */*\r\n"                         "Accept-Encoding: gzip, deflate\r\n"                         "Connection: close\r\n",
-                         request->method, url_parts.path, url_parts.host);
+    int streamed = (request->body_reader != NULL || request->body_fd >= 0);
+    int has_body = streamed || (request->body && request->body_length > 0);
+    long long body_length = streamed ? request->body_stream_length : (long long)request->body_length;
     
-    /* Add custom headers */
-    for (size_t i = 0; i < request->header_count; i++) {
-        offset += snprintf(request_buf + offset, sizeof(request_buf) - offset,
-                          "%s: %s\r\n",
-                          request->header_names[i], request->header_values[i]);
-    }
+    /* Large or unbounded uploads ask the server for permission first so a rejection costs no transfer */
+    int expect_continue = has_body && (body_length < 0 || body_length >= EXPECT_CONTINUE_THRESHOLD) &&
+                          !request_has_header(request, "Expect");
     
-    /* Add body if present */
-    if (request->body && request->body_length > 0) {
-        offset += snprintf(request_buf + offset, sizeof(request_buf) - offset,
-                          "Content-Length: %zu\r\n", request->body_length);
-    }
+    /* Opt-in compression; the encoded size is unknown up front so it is sent chunked */
+    int compress = has_body && request->codec &&
+                   (body_length < 0 || (unsigned long long)body_length >= request->compress_min_size) &&
+                   !request_has_header(request, "Content-Encoding");
+    long long wire_length = compress ? -1 : body_length;
+    
+    /* In-memory bodies are gathered into the head write unless we wait for 100 Continue */
+    int body_sent = has_body && !streamed && !expect_continue && !compress;
+    size_t reserve = (body_sent && ssl && request->body_length <= COALESCE_BODY_LIMIT) 
+                     ? request->body_length : 0;
     
-    offset += snprintf(request_buf + offset, sizeof(request_buf) - offset, "\r\n");
+    /* Build HTTP request */
+    REQUEST_HEAD head;
+    if (build_request_head(&head, request, &url_parts, has_body, wire_length,
+                           compress ? request->codec->name : NULL,
+                           expect_continue, reserve) != FRAMEWORK_SUCCESS) {
+        if (ssl) SSL_free(ssl);
+        close(sockfd);
+        return error_response("Out of memory");
+    }
     
     /* Send request */
-    if (socket_write(sockfd, ssl, request_buf, offset) < 0) {
+    const char *send_error = send_request_head(sockfd, ssl, &head,
+                                               body_sent ? request->body : NULL,
+                                               body_sent ? request->body_length : 0);
+    free(head.data);
+    
+    if (send_error) {
         if (ssl) SSL_free(ssl);
         close(sockfd);
-        HTTP_CLIENT_RESPONSE *response = (HTTP_CLIENT_RESPONSE*)calloc(1, sizeof(HTTP_CLIENT_RESPONSE));
-        response->error_message = strdup("Failed to send request");
-        return response;
+        return error_response(send_error);
     }
     
-    /* Send body if present */
-    if (request->body && request->body_length > 0) {
-        if (socket_write(sockfd, ssl, request->body, request->body_length) < 0) {
-            if (ssl) SSL_free(ssl);
-            close(sockfd);
-            HTTP_CLIENT_RESPONSE *response = (HTTP_CLIENT_RESPONSE*)calloc(1, sizeof(HTTP_CLIENT_RESPONSE));
-            response->error_message = strdup("Failed to send body");
-            return response;
-        }
+    RESPONSE_READER reader;
+    if (reader_init(&reader, sockfd, ssl) != FRAMEWORK_SUCCESS) {
+        if (ssl) SSL_free(ssl);
+        close(sockfd);
+        return error_response("Out of memory");
     }
     
-    /* Receive response */
-    char *response_buf = (char*)malloc(INITIAL_BUFFER_SIZE);
-    size_t response_capacity = INITIAL_BUFFER_SIZE;
-    size_t response_len = 0;
+    HTTP_CLIENT_RESPONSE *response = NULL;
     
-    while (1) {
-        if (response_len >= MAX_RESPONSE_SIZE) {
-            free(response_buf);
+    /* Wait briefly for 100 Continue; a final status means the body is not wanted */
+    if (expect_continue && wait_readable(sockfd, ssl, EXPECT_CONTINUE_TIMEOUT_MS) > 0) {
+        while (1) {
+            response = read_response_head(&reader);
+            if (!response || response->error_message) {
+                break;
+            }
+            if (response->status_code == 100) {
+                http_client_response_destroy(response);
+                response = NULL;
+                break;
+            }
+            if (response->status_code >= 200 || response->status_code == 101) {
+                has_body = 0;
+                break;
+            }
+            /* Other interim responses (e.g. 103 Early Hints) are informational */
+            http_client_response_destroy(response);
+            response = NULL;
+        }
+    }
+    
+    /* Send body if it was not already gathered with the head */
+    if (!response && has_body && !body_sent) {
+        const char *error = send_request_body(sockfd, ssl, request, compress);
+        if (error) {
+            reader_free(&reader);
             if (ssl) SSL_free(ssl);
             close(sockfd);
-            HTTP_CLIENT_RESPONSE *response = (HTTP_CLIENT_RESPONSE*)calloc(1, sizeof(HTTP_CLIENT_RESPONSE));
-            response->error_message = strdup("Response too large");
-            return response;
+            return error_response(error);
         }
-        
-        if (response_len >= response_capacity - 1) {
-            response_capacity *= 2;
-            char *new_buf = (char*)realloc(response_buf, response_capacity);
-            if (!new_buf) {
-                free(response_buf);
-                if (ssl) SSL_free(ssl);
-                close(sockfd);
-                HTTP_CLIENT_RESPONSE *response = (HTTP_CLIENT_RESPONSE*)calloc(1, sizeof(HTTP_CLIENT_RESPONSE));
-                response->error_message = strdup("Out of memory");
-                return response;
-            }
-            response_buf = new_buf;
+    }
+    
+    /* Skip interim 1xx responses until the final one arrives */
+    while (!response) {
+        response = read_response_head(&reader);
+        if (response && !response->error_message &&
+            response->status_code >= 100 && response->status_code < 200 &&
+            response->status_code != 101) {
+            http_client_response_destroy(response);
+            response = NULL;
+        } else {
+            break;
         }
+    }
+    
+    /* Read exactly the framed body, so completion does not wait for the server to close */
+    if (response && !response->error_message &&
+        response_has_body(request, response->status_code)) {
+        BODY_BUFFER body = { NULL, 0, 0 };
+        const char *error = read_response_body(&reader, response, &body);
         
-        ssize_t bytes = socket_read(sockfd, ssl, response_buf + response_len, 
-                                    response_capacity - response_len - 1);
-        
-        if (bytes <= 0) break;
-        response_len += bytes;
+        if (error) {
+            free(body.data);
+            response->error_message = strdup(error);
+        } else {
+            finish_response_body(response, &body);
+        }
     }
     
+    reader_free(&reader);
+    
     if (ssl) {
         SSL_shutdown(ssl);
         SSL_free(ssl);
     }
     close(sockfd);
     
-    if (response_len == 0) {
-        free(response_buf);
-        HTTP_CLIENT_RESPONSE *response = (HTTP_CLIENT_RESPONSE*)calloc(1, sizeof(HTTP_CLIENT_RESPONSE));
-        response->error_message = strdup("Empty response");
-        return response;
+    if (!response) {
+        return error_response("Out of memory");
     }
     
-    response_buf[response_len] = '\0';
-    
-    /* Parse response */
-    HTTP_CLIENT_RESPONSE *response = parse_http_response(response_buf, response_len);
-    free(response_buf);
-    
     /* Calculate elapsed time */
     gettimeofday(&end_time, NULL);
     response->elapsed_time_ms = (end_time.tv_sec - start_time.tv_sec) * 1000.0 +
@@ -876,6 +1823,285 @@ HTTP_CLIENT_RESPONSE* http_client_execute(HTTP_CLIENT_REQUEST *request)
     return response;
 }
 
+/* ==================== Circuit Breaking and Retries ==================== */
+
+/* Breaker for one host:port */
+typedef struct _resilience_host_ {
+    char host[256];
+    int port;
+    CIRCUIT_BREAKER *breaker;
+    struct _resilience_host_ *next;
+} RESILIENCE_HOST;
+
+/*
+ * One installed policy. Requests hold a reference for their whole retry
+ * loop, so replacing the policy never frees a breaker or budget in use;
+ * the last reference frees them. refs, hosts and rng are guarded by
+ * g_resilience_mutex; config is immutable after install.
+ */
+typedef struct {
+    int refs;
+    HTTP_CLIENT_RESILIENCE config;
+    RETRY_BUDGET *budget;
+    RESILIENCE_HOST *hosts;
+    uint64_t rng;
+} RESILIENCE_POLICY;
+
+static pthread_mutex_t g_resilience_mutex = PTHREAD_MUTEX_INITIALIZER;
+static RESILIENCE_POLICY *g_resilience = NULL;
+
+void http_client_resilience_init(HTTP_CLIENT_RESILIENCE *config)
+{
+    if (!config) return;
+    
+    memset(config, 0, sizeof(HTTP_CLIENT_RESILIENCE));
+    circuit_breaker_config_init(&config->breaker);
+    config->max_retries = 2;
+    config->retry_base_delay_ms = 50;
+    config->retry_max_delay_ms = 2000;
+    config->retry_budget_ratio = 0.1;
+    config->retry_budget_burst = 10;
+    config->seed = 1;
+}
+
+static void policy_free(RESILIENCE_POLICY *policy)
+{
+    RESILIENCE_HOST *entry = policy->hosts;
+    while (entry) {
+        RESILIENCE_HOST *next = entry->next;
+        circuit_breaker_destroy(entry->breaker);
+        free(entry);
+        entry = next;
+    }
+    
+    retry_budget_destroy(policy->budget);
+    free(policy);
+}
+
+/* Drop a reference; caller must not hold g_resilience_mutex */
+static void policy_release(RESILIENCE_POLICY *policy)
+{
+    if (!policy) {
+        return;
+    }
+    
+    pthread_mutex_lock(&g_resilience_mutex);
+    int last = --policy->refs == 0;
+    pthread_mutex_unlock(&g_resilience_mutex);
+    
+    if (last) {
+        policy_free(policy);
+    }
+}
+
+int http_client_set_resilience(const HTTP_CLIENT_RESILIENCE *config)
+{
+    RESILIENCE_POLICY *policy = NULL;
+    
+    if (config) {
+        policy = (RESILIENCE_POLICY*)calloc(1, sizeof(RESILIENCE_POLICY));
+        if (!policy) {
+            return FRAMEWORK_ERROR_MEMORY;
+        }
+        
+        policy->budget = retry_budget_create(config->retry_budget_ratio, config->retry_budget_burst);
+        if (!policy->budget) {
+            free(policy);
+            return FRAMEWORK_ERROR_INVALID;
+        }
+        
+        policy->refs = 1;
+        policy->config = *config;
+        policy->rng = config->seed;
+    }
+    
+    /* Swap under the lock; in-flight requests finish on the old policy */
+    pthread_mutex_lock(&g_resilience_mutex);
+    RESILIENCE_POLICY *old = g_resilience;
+    g_resilience = policy;
+    pthread_mutex_unlock(&g_resilience_mutex);
+    
+    policy_release(old);
+    
+    if (config) {
+        framework_log(LOG_LEVEL_INFO, "HTTP client circuit breaking enabled (max %d retries, budget %.0f%%)",
+                     config->max_retries, config->retry_budget_ratio * 100);
+    }
+    return FRAMEWORK_SUCCESS;
+}
+
+/* Find or lazily create the breaker for a host; caller holds g_resilience_mutex */
+static RESILIENCE_HOST* resilience_host(RESILIENCE_POLICY *policy, const char *host, int port, int create)
+{
+    for (RESILIENCE_HOST *entry = policy->hosts; entry; entry = entry->next) {
+        if (entry->port == port && strcasecmp(entry->host, host) == 0) {
+            return entry;
+        }
+    }
+    
+    if (!create) {
+        return NULL;
+    }
+    
+    RESILIENCE_HOST *entry = (RESILIENCE_HOST*)calloc(1, sizeof(RESILIENCE_HOST));
+    if (!entry) {
+        return NULL;
+    }
+    
+    entry->breaker = circuit_breaker_create(&policy->config.breaker);
+    if (!entry->breaker) {
+        free(entry);
+        return NULL;
+    }
+    
+    snprintf(entry->host, sizeof(entry->host), "%s", host);
+    entry->port = port;
+    entry->next = policy->hosts;
+    policy->hosts = entry;
+    
+    return entry;
+}
+
+CIRCUIT_STATE http_client_circuit_state(const char *host, int port)
+{
+    if (!host) {
+        return CIRCUIT_CLOSED;
+    }
+    
+    CIRCUIT_STATE state = CIRCUIT_CLOSED;
+    
+    pthread_mutex_lock(&g_resilience_mutex);
+    RESILIENCE_HOST *entry = g_resilience ? resilience_host(g_resilience, host, port, 0) : NULL;
+    if (entry) {
+        state = circuit_breaker_state(entry->breaker);
+    }
+    pthread_mutex_unlock(&g_resilience_mutex);
+    
+    return state;
+}
+
+static uint64_t resilience_now(const HTTP_CLIENT_RESILIENCE *config)
+{
+    if (config->breaker.clock) {
+        return config->breaker.clock(config->breaker.clock_data);
+    }
+    
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static void resilience_sleep(const HTTP_CLIENT_RESILIENCE *config, uint64_t ms)
+{
+    if (config->sleep) {
+        config->sleep(ms, config->breaker.clock_data);
+        return;
+    }
+    
+    struct timespec ts;
+    ts.tv_sec = (time_t)(ms / 1000);
+    ts.tv_nsec = (long)(ms % 1000) * 1000000L;
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+        /* Resume with the remaining time after a signal */
+    }
+}
+
+/* Methods safe to repeat after an unknown outcome (RFC 9110 section 9.2.2) */
+static int method_is_idempotent(const char *method)
+{
+    return strcasecmp(method, "GET") == 0 || strcasecmp(method, "HEAD") == 0 ||
+           strcasecmp(method, "OPTIONS") == 0 || strcasecmp(method, "PUT") == 0 ||
+           strcasecmp(method, "DELETE") == 0;
+}
+
+static int response_is_failure(const HTTP_CLIENT_RESPONSE *response)
+{
+    return !response || response->error_message || response->status_code >= 500;
+}
+
+/* Run the retry loop for one request under a referenced policy */
+static HTTP_CLIENT_RESPONSE* execute_with_policy(HTTP_CLIENT_REQUEST *request,
+                                                 RESILIENCE_POLICY *policy,
+                                                 CIRCUIT_BREAKER *breaker)
+{
+    const HTTP_CLIENT_RESILIENCE *config = &policy->config;
+    
+    /* Callback bodies are consumed by the first attempt and cannot be replayed */
+    int retryable = method_is_idempotent(request->method) && !request->body_reader;
+    
+    retry_budget_deposit(policy->budget);
+    
+    CIRCUIT_PERMIT permit = circuit_breaker_acquire(breaker);
+    if (permit == CIRCUIT_PERMIT_DENIED) {
+        return error_response("Circuit open");
+    }
+    
+    for (int attempt = 0; ; attempt++) {
+        uint64_t started = resilience_now(config);
+        HTTP_CLIENT_RESPONSE *response = execute_attempt(request);
+        int failed = response_is_failure(response);
+        
+        circuit_breaker_record(breaker, permit, !failed, resilience_now(config) - started);
+        
+        if (!failed || !retryable || attempt >= config->max_retries ||
+            !retry_budget_withdraw(policy->budget)) {
+            return response;
+        }
+        
+        pthread_mutex_lock(&g_resilience_mutex);
+        uint64_t delay = circuit_backoff_delay(&policy->rng, (unsigned)attempt,
+                                               config->retry_base_delay_ms,
+                                               config->retry_max_delay_ms);
+        pthread_mutex_unlock(&g_resilience_mutex);
+        
+        framework_log(LOG_LEVEL_DEBUG, "Retrying %s %s in %llums (%s)", request->method, request->url,
+                     (unsigned long long)delay,
+                     response && response->error_message ? response->error_message : "server error");
+        resilience_sleep(config, delay);
+        
+        /* If our own failures opened the circuit, report the last real outcome */
+        permit = circuit_breaker_acquire(breaker);
+        if (permit == CIRCUIT_PERMIT_DENIED) {
+            return response;
+        }
+        
+        http_client_response_destroy(response);
+    }
+}
+
+HTTP_CLIENT_RESPONSE* http_client_execute(HTTP_CLIENT_REQUEST *request)
+{
+    if (!request) {
+        return NULL;
+    }
+    
+    URL_PARTS url_parts;
+    int url_valid = parse_url(request->url, &url_parts) == FRAMEWORK_SUCCESS;
+    
+    pthread_mutex_lock(&g_resilience_mutex);
+    RESILIENCE_POLICY *policy = g_resilience;
+    RESILIENCE_HOST *entry = NULL;
+    if (policy) {
+        policy->refs++;
+        entry = url_valid ? resilience_host(policy, url_parts.host, url_parts.port, 1) : NULL;
+    }
+    pthread_mutex_unlock(&g_resilience_mutex);
+    
+    if (!policy) {
+        return execute_attempt(request);
+    }
+    
+    HTTP_CLIENT_RESPONSE *response;
+    if (!url_valid) {
+        response = error_response("Invalid URL");
+    } else {
+        response = execute_with_policy(request, policy, entry ? entry->breaker : NULL);
+    }
+    
+    policy_release(policy);
+    return response;
+}
+
 /* ==================== Convenience Functions ==================== */
 
 HTTP_CLIENT_RESPONSE* http_client_get(const char *url)
@@ -0,0 +1,1004 @@
+#define _GNU_SOURCE
+#include "http_proxy.h"
+#include "framework.h"
+#include <stdlib.h>
+#include <limits.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+
+#define PROXY_HEAD_MAX (64 * 1024)
+#define PROXY_LINE_MAX 4096
+#define PROXY_PIPE_CHUNK (64 * 1024)
+#define PROXY_INITIAL_BUFFER 8192
+#define PROXY_DEFAULT_TIMEOUT 30
+
+/* One side of an exchange: a socket plus bytes read past what was consumed */
+typedef struct {
+    int fd;
+    char *data;
+    size_t start;
+    size_t end;
+    size_t capacity;
+} PROXY_STREAM;
+
+/* Growable output buffer for rewritten message heads */
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+    int error;
+} PROXY_BUFFER;
+
+/* Framing and connection details gathered while rewriting a head */
+typedef struct {
+    int chunked;
+    int has_transfer_encoding;
+    int has_length;
+    unsigned long long content_length;
+    int invalid_framing;            /* Unparseable or repeated Content-Length */
+    int connection_close;
+    int expect_continue;
+} PROXY_MESSAGE_INFO;
+
+/* One request being relayed */
+typedef struct {
+    HTTP_PROXY_UPSTREAM *upstream;
+    PROXY_STREAM client;
+    PROXY_STREAM server;
+    int pipe_fds[2];
+    int use_splice;
+    char *copy_buffer;
+    char method[16];
+    char path[512];
+} PROXY_EXCHANGE;
+
+/* ==================== Upstream Management ==================== */
+
+HTTP_PROXY_UPSTREAM* http_proxy_upstream_create(const char *upstream_url)
+{
+    if (!upstream_url) {
+        return NULL;
+    }
+    
+    if (strncasecmp(upstream_url, "http://", 7) != 0) {
+        framework_log(LOG_LEVEL_ERROR, "Proxy upstream must be an http:// URL: %s", upstream_url);
+        return NULL;
+    }
+    
+    HTTP_PROXY_UPSTREAM *upstream = (HTTP_PROXY_UPSTREAM*)calloc(1, sizeof(HTTP_PROXY_UPSTREAM));
+    if (!upstream) {
+        return NULL;
+    }
+    
+    /* Split authority and base path */
+    const char *authority = upstream_url + 7;
+    const char *path = strchr(authority, '/');
+    size_t authority_len = path ? (size_t)(path - authority) : strlen(authority);
+    
+    if (authority_len == 0 || authority_len >= sizeof(upstream->host_header)) {
+        free(upstream);
+        return NULL;
+    }
+    memcpy(upstream->host_header, authority, authority_len);
+    
+    const char *colon = memchr(authority, ':', authority_len);
+    size_t host_len = colon ? (size_t)(colon - authority) : authority_len;
+    if (host_len == 0 || host_len >= sizeof(upstream->host)) {
+        free(upstream);
+        return NULL;
+    }
+    memcpy(upstream->host, authority, host_len);
+    upstream->port = colon ? atoi(colon + 1) : 80;
+    
+    /* A base path of "/" adds nothing to forwarded paths */
+    if (path) {
+        strncpy(upstream->base_path, path, sizeof(upstream->base_path) - 1);
+        size_t base_len = strlen(upstream->base_path);
+        while (base_len > 0 && upstream->base_path[base_len - 1] == '/') {
+            upstream->base_path[--base_len] = '\0';
+        }
+    }
+    
+    if (upstream->port <= 0 || upstream->port > 65535) {
+        free(upstream);
+        return NULL;
+    }
+    
+    upstream->timeout_seconds = PROXY_DEFAULT_TIMEOUT;
+    upstream->max_active = HTTP_PROXY_MAX_ACTIVE;
+    pthread_mutex_init(&upstream->mutex, NULL);
+    pthread_cond_init(&upstream->drained, NULL);
+    
+    return upstream;
+}
+
+void http_proxy_upstream_destroy(HTTP_PROXY_UPSTREAM *upstream)
+{
+    if (!upstream) return;
+    
+    /* Running exchanges hold a pointer to the upstream */
+    pthread_mutex_lock(&upstream->mutex);
+    while (upstream->active_count > 0) {
+        pthread_cond_wait(&upstream->drained, &upstream->mutex);
+    }
+    for (size_t i = 0; i < upstream->idle_count; i++) {
+        close(upstream->idle_sockets[i]);
+    }
+    upstream->idle_count = 0;
+    pthread_mutex_unlock(&upstream->mutex);
+    
+    pthread_cond_destroy(&upstream->drained);
+    pthread_mutex_destroy(&upstream->mutex);
+    free(upstream);
+}
+
+static void set_socket_timeouts(int fd, int timeout_seconds)
+{
+    struct timeval tv;
+    tv.tv_sec = timeout_seconds;
+    tv.tv_usec = 0;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+static int upstream_connect(HTTP_PROXY_UPSTREAM *upstream)
+{
+    struct addrinfo hints, *result, *rp;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    
+    char port_str[16];
+    snprintf(port_str, sizeof(port_str), "%d", upstream->port);
+    
+    if (getaddrinfo(upstream->host, port_str, &hints, &result) != 0) {
+        return -1;
+    }
+    
+    int fd = -1;
+    for (rp = result; rp != NULL; rp = rp->ai_next) {
+        fd = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
+        if (fd < 0) continue;
+        
+        set_socket_timeouts(fd, upstream->timeout_seconds);
+        if (connect(fd, rp->ai_addr, rp->ai_addrlen) == 0) {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(result);
+    
+    if (fd >= 0) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    
+    return fd;
+}
+
+/* Take an idle pooled connection, or open a new one; *reused tells which */
+static int upstream_acquire(HTTP_PROXY_UPSTREAM *upstream, int *reused)
+{
+    while (1) {
+        int fd = -1;
+        
+        pthread_mutex_lock(&upstream->mutex);
+        if (upstream->idle_count > 0) {
+            fd = upstream->idle_sockets[--upstream->idle_count];
+        }
+        pthread_mutex_unlock(&upstream->mutex);
+        
+        if (fd < 0) {
+            break;
+        }
+        
+        /* An idle connection must have nothing to read; EOF or stray data means it is dead */
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, 0) == 0) {
+            *reused = 1;
+            return fd;
+        }
+        close(fd);
+    }
+    
+    *reused = 0;
+    return upstream_connect(upstream);
+}
+
+static void upstream_release(HTTP_PROXY_UPSTREAM *upstream, int fd, int reusable)
+{
+    if (fd < 0) return;
+    
+    if (reusable) {
+        pthread_mutex_lock(&upstream->mutex);
+        if (upstream->idle_count < HTTP_PROXY_MAX_IDLE) {
+            upstream->idle_sockets[upstream->idle_count++] = fd;
+            fd = -1;
+        }
+        pthread_mutex_unlock(&upstream->mutex);
+    }
+    
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+/* ==================== Buffers and Streams ==================== */
+
+static void buffer_append(PROXY_BUFFER *buffer, const char *text, size_t len)
+{
+    if (buffer->error) return;
+    
+    if (buffer->length + len > buffer->capacity) {
+        size_t new_capacity = buffer->capacity ? buffer->capacity * 2 : PROXY_INITIAL_BUFFER;
+        while (new_capacity < buffer->length + len) {
+            new_capacity *= 2;
+        }
+        char *new_data = (char*)realloc(buffer->data, new_capacity);
+        if (!new_data) {
+            buffer->error = 1;
+            return;
+        }
+        buffer->data = new_data;
+        buffer->capacity = new_capacity;
+    }
+    
+    memcpy(buffer->data + buffer->length, text, len);
+    buffer->length += len;
+}
+
+static void buffer_append_str(PROXY_BUFFER *buffer, const char *text)
+{
+    buffer_append(buffer, text, strlen(text));
+}
+
+static void buffer_append_header(PROXY_BUFFER *buffer, const char *name, const char *value)
+{
+    buffer_append_str(buffer, name);
+    buffer_append(buffer, ": ", 2);
+    buffer_append_str(buffer, value);
+    buffer_append(buffer, "\r\n", 2);
+}
+
+static int write_all(int fd, const char *data, size_t len)
+{
+    while (len > 0) {
+        ssize_t sent = send(fd, data, len, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            return FRAMEWORK_ERROR_STATE;
+        }
+        data += sent;
+        len -= sent;
+    }
+    return FRAMEWORK_SUCCESS;
+}
+
+static size_t stream_buffered(const PROXY_STREAM *stream)
+{
+    return stream->end - stream->start;
+}
+
+/* Read until a complete head is buffered; returns its length including the blank line */
+static size_t stream_read_head(PROXY_STREAM *stream)
+{
+    size_t scanned = 0;
+    
+    while (1) {
+        const char *data = stream->data + stream->start;
+        size_t available = stream_buffered(stream);
+        
+        for (size_t i = scanned; i + 4 <= available; i++) {
+            if (data[i] == '\r' && memcmp(data + i, "\r\n\r\n", 4) == 0) {
+                return i + 4;
+            }
+        }
+        scanned = available >= 3 ? available - 3 : 0;
+        
+        if (available >= PROXY_HEAD_MAX) {
+            return 0;
+        }
+        
+        /* Compact, then grow if still full */
+        if (stream->start > 0) {
+            memmove(stream->data, stream->data + stream->start, available);
+            stream->start = 0;
+            stream->end = available;
+        }
+        if (stream->end == stream->capacity) {
+            size_t new_capacity = stream->capacity * 2 > PROXY_INITIAL_BUFFER ?
+                                  stream->capacity * 2 : PROXY_INITIAL_BUFFER;
+            char *new_data = (char*)realloc(stream->data, new_capacity);
+            if (!new_data) {
+                return 0;
+            }
+            stream->data = new_data;
+            stream->capacity = new_capacity;
+        }
+        
+        ssize_t bytes = recv(stream->fd, stream->data + stream->end, stream->capacity - stream->end, 0);
+        if (bytes < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes <= 0) {
+            return 0;
+        }
+        stream->end += bytes;
+    }
+}
+
+/* Read one line (CRLF included). Peeks at the socket so bytes past the line stay in the kernel. */
+static int stream_read_line(PROXY_STREAM *stream, char *line, size_t max_length, size_t *length)
+{
+    size_t have = 0;
+    
+    while (stream->start < stream->end && have < max_length) {
+        char c = stream->data[stream->start++];
+        line[have++] = c;
+        if (c == '\n') {
+            *length = have;
+            return FRAMEWORK_SUCCESS;
+        }
+    }
+    
+    while (have < max_length) {
+        ssize_t bytes = recv(stream->fd, line + have, max_length - have, MSG_PEEK);
+        if (bytes < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes <= 0) {
+            return FRAMEWORK_ERROR_STATE;
+        }
+        
+        char *newline = memchr(line + have, '\n', bytes);
+        size_t take = newline ? (size_t)(newline - (line + have)) + 1 : (size_t)bytes;
+        
+        if (recv(stream->fd, line + have, take, MSG_WAITALL) != (ssize_t)take) {
+            return FRAMEWORK_ERROR_STATE;
+        }
+        have += take;
+        
+        if (newline) {
+            *length = have;
+            return FRAMEWORK_SUCCESS;
+        }
+    }
+    
+    return FRAMEWORK_ERROR_INVALID;
+}
+
+/* ==================== Body Relay ==================== */
+
+/* Move length bytes (or everything until EOF) from a stream to a socket */
+static int relay_bytes(PROXY_EXCHANGE *exchange, PROXY_STREAM *from, int to_fd,
+                       unsigned long long length, int until_eof)
+{
+    /* Bytes already pulled into user space go first */
+    size_t take = stream_buffered(from);
+    if (!until_eof && take > length) {
+        take = (size_t)length;
+    }
+    if (take > 0) {
+        if (write_all(to_fd, from->data + from->start, take) != FRAMEWORK_SUCCESS) {
+            return FRAMEWORK_ERROR_STATE;
+        }
+        from->start += take;
+        length -= take;
+    }
+    
+    while (until_eof || length > 0) {
+        size_t want = PROXY_PIPE_CHUNK;
+        if (!until_eof && length < want) {
+            want = (size_t)length;
+        }
+        
+        ssize_t moved;
+        if (exchange->use_splice) {
+            moved = splice(from->fd, NULL, exchange->pipe_fds[1], NULL, want,
+                           SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (moved < 0 && errno == EINTR) {
+                continue;
+            }
+            if (moved < 0 && errno == EINVAL) {
+                /* Socket type cannot be spliced; fall back to copying */
+                exchange->use_splice = 0;
+                continue;
+            }
+            if (moved <= 0) {
+                return (moved == 0 && until_eof) ? FRAMEWORK_SUCCESS : FRAMEWORK_ERROR_STATE;
+            }
+            
+            /* Drain the pipe before reading again; a slow receiver blocks here,
+               which in turn stops us reading from the sender */
+            size_t pending = (size_t)moved;
+            while (pending > 0) {
+                ssize_t out = splice(exchange->pipe_fds[0], NULL, to_fd, NULL, pending,
+                                     SPLICE_F_MOVE | SPLICE_F_MORE);
+                if (out < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (out <= 0) {
+                    return FRAMEWORK_ERROR_STATE;
+                }
+                pending -= out;
+            }
+        } else {
+            if (!exchange->copy_buffer) {
+                exchange->copy_buffer = (char*)malloc(PROXY_PIPE_CHUNK);
+                if (!exchange->copy_buffer) {
+                    return FRAMEWORK_ERROR_MEMORY;
+                }
+            }
+            
+            moved = recv(from->fd, exchange->copy_buffer, want, 0);
+            if (moved < 0 && errno == EINTR) {
+                continue;
+            }
+            if (moved <= 0) {
+                return (moved == 0 && until_eof) ? FRAMEWORK_SUCCESS : FRAMEWORK_ERROR_STATE;
+            }
+            if (write_all(to_fd, exchange->copy_buffer, moved) != FRAMEWORK_SUCCESS) {
+                return FRAMEWORK_ERROR_STATE;
+            }
+        }
+        
+        if (!until_eof) {
+            length -= moved;
+        }
+    }
+    
+    return FRAMEWORK_SUCCESS;
+}
+
+/* Relay a chunked body verbatim: size lines are parsed here, chunk data is spliced */
+static int relay_chunked(PROXY_EXCHANGE *exchange, PROXY_STREAM *from, int to_fd)
+{
+    char line[PROXY_LINE_MAX];
+    size_t line_len;
+    
+    while (1) {
+        if (stream_read_line(from, line, sizeof(line), &line_len) != FRAMEWORK_SUCCESS) {
+            return FRAMEWORK_ERROR_STATE;
+        }
+        
+        unsigned long long chunk_size = 0;
+        size_t digits = 0;
+        while (digits < line_len && digits < 16 && isxdigit((unsigned char)line[digits])) {
+            char c = line[digits];
+            int value = (c <= '9') ? c - '0' : (c | 0x20) - 'a' + 10;
+            chunk_size = chunk_size * 16 + value;
+            digits++;
+        }
+        if (digits == 0 || digits == 16) {
+            return FRAMEWORK_ERROR_INVALID;
+        }
+        
+        if (write_all(to_fd, line, line_len) != FRAMEWORK_SUCCESS) {
+            return FRAMEWORK_ERROR_STATE;
+        }
+        
+        if (chunk_size == 0) {
+            /* Trailer fields, terminated by an empty line */
+            do {
+                if (stream_read_line(from, line, sizeof(line), &line_len) != FRAMEWORK_SUCCESS ||
+                    write_all(to_fd, line, line_len) != FRAMEWORK_SUCCESS) {
+                    return FRAMEWORK_ERROR_STATE;
+                }
+            } while (!(line_len == 2 || (line_len == 1 && line[0] == '\n')));
+            return FRAMEWORK_SUCCESS;
+        }
+        
+        /* Chunk data plus its trailing CRLF */
+        if (relay_bytes(exchange, from, to_fd, chunk_size + 2, 0) != FRAMEWORK_SUCCESS) {
+            return FRAMEWORK_ERROR_STATE;
+        }
+    }
+}
+
+/* ==================== Head Rewriting ==================== */
+
+static int name_is(const char *name, size_t name_len, const char *expected)
+{
+    return strlen(expected) == name_len && strncasecmp(name, expected, name_len) == 0;
+}
+
+/* Whether a token appears in a comma-separated header value */
+static int value_has_token(const char *value, size_t value_len, const char *token, size_t token_len)
+{
+    const char *end = value + value_len;
+    while (value < end) {
+        while (value < end && (*value == ' ' || *value == '\t' || *value == ',')) value++;
+        const char *token_end = value;
+        while (token_end < end && *token_end != ',') token_end++;
+        const char *trimmed = token_end;
+        while (trimmed > value && (trimmed[-1] == ' ' || trimmed[-1] == '\t')) trimmed--;
+        
+        if ((size_t)(trimmed - value) == token_len && strncasecmp(value, token, token_len) == 0) {
+            return 1;
+        }
+        value = token_end;
+    }
+    return 0;
+}
+
+/* Hop-by-hop headers apply to a single connection and are never forwarded */
+static int is_hop_by_hop(const char *name, size_t name_len, const char *connection, size_t connection_len)
+{
+    static const char *hop_headers[] = {
+        "Connection", "Keep-Alive", "Proxy-Connection", "Proxy-Authenticate",
+        "Proxy-Authorization", "TE", "Trailer", "Upgrade"
+    };
+    
+    for (size_t i = 0; i < sizeof(hop_headers) / sizeof(hop_headers[0]); i++) {
+        if (name_is(name, name_len, hop_headers[i])) {
+            return 1;
+        }
+    }
+    
+    /* Headers listed in Connection are hop-by-hop too */
+    return connection && value_has_token(connection, connection_len, name, name_len);
+}
+
+/* Content-Length value: decimal digits only, no sign, no overflow */
+static int parse_content_length(const char *value, size_t value_len, unsigned long long *length)
+{
+    if (value_len == 0) {
+        return 0;
+    }
+    
+    unsigned long long result = 0;
+    for (size_t i = 0; i < value_len; i++) {
+        if (value[i] < '0' || value[i] > '9' || result > (ULLONG_MAX - 9) / 10) {
+            return 0;
+        }
+        result = result * 10 + (unsigned long long)(value[i] - '0');
+    }
+    
+    *length = result;
+    return 1;
+}
+
+/*
+ * Copy header lines from head (after the start line) into out, dropping
+ * hop-by-hop headers and any names in skip[]. Transfer-Encoding is kept,
+ * since bodies are relayed with their original framing; Content-Length is
+ * dropped when the body is chunked. Values of Host and X-Forwarded-For are
+ * captured for request rewriting.
+ */
+static void rewrite_headers(const char *head, size_t head_len, PROXY_BUFFER *out,
+                            PROXY_MESSAGE_INFO *info, const char **skip, size_t skip_count,
+                            char *host, size_t host_size, char *forwarded_for, size_t forwarded_size)
+{
+    const char *end = head + head_len;
+    const char *connection = NULL;
+    size_t connection_len = 0;
+    
+    memset(info, 0, sizeof(PROXY_MESSAGE_INFO));
+    
+    /* First pass: the Connection header decides what else is hop-by-hop */
+    for (int pass = 0; pass < 2; pass++) {
+        const char *line = memchr(head, '\n', head_len);
+        line = line ? line + 1 : end;
+        
+        while (line < end) {
+            const char *line_end = memchr(line, '\n', end - line);
+            const char *next = line_end ? line_end + 1 : end;
+            if (!line_end) line_end = end;
+            if (line_end > line && line_end[-1] == '\r') line_end--;
+            
+            const char *colon = memchr(line, ':', line_end - line);
+            if (colon) {
+                const char *name = line;
+                size_t name_len = colon - line;
+                const char *value = colon + 1;
+                while (value < line_end && (*value == ' ' || *value == '\t')) value++;
+                size_t value_len = line_end - value;
+                while (value_len > 0 && (value[value_len - 1] == ' ' || value[value_len - 1] == '\t')) {
+                    value_len--;
+                }
+                
+                if (pass == 0) {
+                    if (name_is(name, name_len, "Connection")) {
+                        connection = value;
+                        connection_len = value_len;
+                        info->connection_close = value_has_token(value, value_len, "close", 5);
+                    } else if (name_is(name, name_len, "Transfer-Encoding")) {
+                        info->has_transfer_encoding = 1;
+                        info->chunked = value_has_token(value, value_len, "chunked", 7);
+                    } else if (name_is(name, name_len, "Content-Length")) {
+                        /* A second Content-Length, even an equal one, is refused rather than guessed at */
+                        if (info->has_length || !parse_content_length(value, value_len, &info->content_length)) {
+                            info->invalid_framing = 1;
+                        }
+                        info->has_length = 1;
+                    }
+                } else {
+                    int keep = !is_hop_by_hop(name, name_len, connection, connection_len);
+                    
+                    if (name_is(name, name_len, "Transfer-Encoding")) {
+                        keep = 1;
+                    } else if (name_is(name, name_len, "Content-Length")) {
+                        /* A chunked body is relayed chunked; a length next to it must not travel on */
+                        keep = !info->chunked;
+                    } else if (name_is(name, name_len, "Expect")) {
+                        info->expect_continue = value_has_token(value, value_len, "100-continue", 12);
+                    } else if (host && name_is(name, name_len, "Host")) {
+                        size_t n = value_len < host_size - 1 ? value_len : host_size - 1;
+                        memcpy(host, value, n);
+                        host[n] = '\0';
+                    } else if (forwarded_for && name_is(name, name_len, "X-Forwarded-For")) {
+                        size_t n = value_len < forwarded_size - 1 ? value_len : forwarded_size - 1;
+                        memcpy(forwarded_for, value, n);
+                        forwarded_for[n] = '\0';
+                    }
+                    
+                    for (size_t i = 0; keep && i < skip_count; i++) {
+                        if (name_is(name, name_len, skip[i])) {
+                            keep = 0;
+                        }
+                    }
+                    
+                    if (keep) {
+                        buffer_append(out, line, next - line);
+                        if (next[-1] != '\n') {
+                            buffer_append(out, "\r\n", 2);
+                        }
+                    }
+                }
+            }
+            
+            line = next;
+        }
+    }
+}
+
+/* ==================== Exchange ==================== */
+
+static void send_error_response(int fd, int status, const char *reason)
+{
+    char response[256];
+    int len = snprintf(response, sizeof(response),
+                       "HTTP/1.1 %d %s\r\n"
+                       "Content-Type: text/plain\r\n"
+                       "Content-Length: %zu\r\n"
+                       "Connection: close\r\n"
+                       "\r\n%s",
+                       status, reason, strlen(reason), reason);
+    write_all(fd, response, len);
+}
+
+static int gateway_error_status(void)
+{
+    return (errno == EAGAIN || errno == EWOULDBLOCK) ? 504 : 502;
+}
+
+/* Build the upstream request head from the client's; returns 0 if the head is malformed */
+static int build_upstream_request(PROXY_EXCHANGE *exchange, const char *head, size_t head_len,
+                                  PROXY_BUFFER *out, PROXY_MESSAGE_INFO *info)
+{
+    HTTP_PROXY_UPSTREAM *upstream = exchange->upstream;
+    
+    /* Request line: METHOD SP target SP version */
+    const char *line_end = memchr(head, '\r', head_len);
+    const char *method_end = memchr(head, ' ', head_len);
+    if (!line_end || !method_end || method_end > line_end) {
+        return 0;
+    }
+    const char *target = method_end + 1;
+    const char *target_end = memchr(target, ' ', line_end - target);
+    if (!target_end || target == target_end) {
+        return 0;
+    }
+    
+    size_t method_len = method_end - head;
+    size_t target_len = target_end - target;
+    snprintf(exchange->method, sizeof(exchange->method), "%.*s", (int)method_len, head);
+    snprintf(exchange->path, sizeof(exchange->path), "%.*s", (int)target_len, target);
+    
+    buffer_append(out, head, method_len + 1);
+    buffer_append_str(out, upstream->base_path);
+    buffer_append(out, target, target_len);
+    buffer_append_str(out, " HTTP/1.1\r\n");
+    
+    /* Forwarding headers are rebuilt below; Expect is answered by the proxy itself */
+    static const char *skip[] = { "Host", "X-Forwarded-For", "X-Forwarded-Host",
+                                  "X-Forwarded-Proto", "Expect" };
+    char host[256] = "";
+    char forwarded_for[512] = "";
+    rewrite_headers(head, head_len - 2, out, info, skip, sizeof(skip) / sizeof(skip[0]),
+                    host, sizeof(host), forwarded_for, sizeof(forwarded_for));
+    
+    /* Ambiguous framing would let the upstream split the body differently (request smuggling) */
+    if (info->invalid_framing || (info->has_transfer_encoding && (info->has_length || !info->chunked))) {
+        return 0;
+    }
+    
+    /* Client address for X-Forwarded-For */
+    char client_ip[INET6_ADDRSTRLEN] = "unknown";
+    struct sockaddr_storage addr;
+    socklen_t addr_len = sizeof(addr);
+    if (getpeername(exchange->client.fd, (struct sockaddr*)&addr, &addr_len) == 0) {
+        if (addr.ss_family == AF_INET) {
+            inet_ntop(AF_INET, &((struct sockaddr_in*)&addr)->sin_addr, client_ip, sizeof(client_ip));
+        } else if (addr.ss_family == AF_INET6) {
+            inet_ntop(AF_INET6, &((struct sockaddr_in6*)&addr)->sin6_addr, client_ip, sizeof(client_ip));
+        }
+    }
+    
+    buffer_append_header(out, "Host", upstream->host_header);
+    if (forwarded_for[0]) {
+        buffer_append_str(out, "X-Forwarded-For: ");
+        buffer_append_str(out, forwarded_for);
+        buffer_append(out, ", ", 2);
+        buffer_append_str(out, client_ip);
+        buffer_append(out, "\r\n", 2);
+    } else {
+        buffer_append_header(out, "X-Forwarded-For", client_ip);
+    }
+    if (host[0]) {
+        buffer_append_header(out, "X-Forwarded-Host", host);
+    }
+    buffer_append_str(out, "X-Forwarded-Proto: http\r\n"
+                           "Connection: keep-alive\r\n"
+                           "\r\n");
+    
+    return !out->error;
+}
+
+/* Run one exchange; returns the status sent to the client */
+static int run_exchange(PROXY_EXCHANGE *exchange)
+{
+    HTTP_PROXY_UPSTREAM *upstream = exchange->upstream;
+    int client_fd = exchange->client.fd;
+    
+    size_t head_len = stream_read_head(&exchange->client);
+    if (head_len == 0) {
+        send_error_response(client_fd, 400, "Bad Request");
+        return 400;
+    }
+    
+    PROXY_BUFFER request_head = { NULL, 0, 0, 0 };
+    PROXY_MESSAGE_INFO request_info;
+    int valid = build_upstream_request(exchange, exchange->client.data + exchange->client.start,
+                                       head_len, &request_head, &request_info);
+    exchange->client.start += head_len;
+    
+    if (!valid) {
+        free(request_head.data);
+        send_error_response(client_fd, 400, "Bad Request");
+        return 400;
+    }
+    
+    /* Send the head; a pooled connection may have been closed by the upstream meanwhile */
+    int reused = 0;
+    int upstream_fd = upstream_acquire(upstream, &reused);
+    while (upstream_fd >= 0 && write_all(upstream_fd, request_head.data, request_head.length) != FRAMEWORK_SUCCESS) {
+        close(upstream_fd);
+        upstream_fd = reused ? upstream_connect(upstream) : -1;
+        reused = 0;
+    }
+    free(request_head.data);
+    
+    if (upstream_fd < 0) {
+        framework_log(LOG_LEVEL_ERROR, "Proxy: cannot reach upstream %s:%d", upstream->host, upstream->port);
+        send_error_response(client_fd, 502, "Bad Gateway");
+        return 502;
+    }
+    
+    exchange->server.fd = upstream_fd;
+    
+    if (request_info.expect_continue) {
+        write_all(client_fd, "HTTP/1.1 100 Continue\r\n\r\n", 25);
+    }
+    
+    /* Request body */
+    int result = FRAMEWORK_SUCCESS;
+    if (request_info.chunked) {
+        result = relay_chunked(exchange, &exchange->client, upstream_fd);
+    } else if (request_info.has_length && request_info.content_length > 0) {
+        result = relay_bytes(exchange, &exchange->client, upstream_fd, request_info.content_length, 0);
+    }
+    
+    if (result != FRAMEWORK_SUCCESS) {
+        upstream_release(upstream, upstream_fd, 0);
+        send_error_response(client_fd, 502, "Bad Gateway");
+        return 502;
+    }
+    
+    /* Response head, skipping interim 1xx responses */
+    int status = 0;
+    size_t response_len = 0;
+    while (1) {
+        response_len = stream_read_head(&exchange->server);
+        const char *response = exchange->server.data + exchange->server.start;
+        
+        if (response_len < 12 || strncmp(response, "HTTP/1.", 7) != 0) {
+            status = (response_len == 0) ? gateway_error_status() : 502;
+            upstream_release(upstream, upstream_fd, 0);
+            send_error_response(client_fd, status, status == 504 ? "Gateway Timeout" : "Bad Gateway");
+            return status;
+        }
+        
+        status = atoi(response + 9);
+        if (status >= 200) {
+            break;
+        }
+        exchange->server.start += response_len;
+    }
+    
+    const char *response = exchange->server.data + exchange->server.start;
+    int http11 = (response[7] == '1');
+    const char *status_end = memchr(response, '\n', response_len);
+    
+    PROXY_BUFFER response_head = { NULL, 0, 0, 0 };
+    PROXY_MESSAGE_INFO response_info;
+    buffer_append(&response_head, response, status_end - response + 1);
+    rewrite_headers(response, response_len - 2, &response_head, &response_info, NULL, 0, NULL, 0, NULL, 0);
+    buffer_append_str(&response_head, "Connection: close\r\n\r\n");
+    exchange->server.start += response_len;
+    
+    /* Transfer-Encoding wins over Content-Length in responses, but a bad length is unusable */
+    if (response_info.invalid_framing && !response_info.chunked) {
+        free(response_head.data);
+        upstream_release(upstream, upstream_fd, 0);
+        send_error_response(client_fd, 502, "Bad Gateway");
+        return 502;
+    }
+    
+    int sent = !response_head.error &&
+               write_all(client_fd, response_head.data, response_head.length) == FRAMEWORK_SUCCESS;
+    free(response_head.data);
+    
+    /* Response body, framed exactly as the upstream sent it */
+    int no_body = strcasecmp(exchange->method, "HEAD") == 0 || status == 204 || status == 304;
+    int until_eof = !no_body && !response_info.chunked && !response_info.has_length;
+    
+    if (sent && !no_body) {
+        if (response_info.chunked) {
+            result = relay_chunked(exchange, &exchange->server, client_fd);
+        } else if (response_info.has_length) {
+            result = relay_bytes(exchange, &exchange->server, client_fd, response_info.content_length, 0);
+        } else {
+            result = relay_bytes(exchange, &exchange->server, client_fd, 0, 1);
+        }
+    }
+    
+    /* Only a fully consumed, cleanly framed HTTP/1.1 exchange leaves the connection reusable */
+    int reusable = sent && result == FRAMEWORK_SUCCESS && http11 && !until_eof &&
+                   !response_info.connection_close && stream_buffered(&exchange->server) == 0;
+    upstream_release(upstream, upstream_fd, reusable);
+    
+    return status;
+}
+
+/* Release an exchange slot taken in http_proxy_dispatch */
+static void exchange_finished(HTTP_PROXY_UPSTREAM *upstream)
+{
+    pthread_mutex_lock(&upstream->mutex);
+    if (--upstream->active_count == 0) {
+        pthread_cond_broadcast(&upstream->drained);
+    }
+    pthread_mutex_unlock(&upstream->mutex);
+}
+
+static void* proxy_exchange_thread(void *arg)
+{
+    PROXY_EXCHANGE *exchange = (PROXY_EXCHANGE*)arg;
+    HTTP_PROXY_UPSTREAM *upstream = exchange->upstream;
+    
+    struct timespec start_time, end_time;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    
+    /* The exchange runs with blocking sockets bounded by the upstream timeout */
+    int flags = fcntl(exchange->client.fd, F_GETFL, 0);
+    fcntl(exchange->client.fd, F_SETFL, flags & ~O_NONBLOCK);
+    set_socket_timeouts(exchange->client.fd, upstream->timeout_seconds);
+    
+    exchange->use_splice = (pipe2(exchange->pipe_fds, O_CLOEXEC) == 0);
+    
+    int status = run_exchange(exchange);
+    
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    double elapsed_ms = (end_time.tv_sec - start_time.tv_sec) * 1000.0 +
+                        (end_time.tv_nsec - start_time.tv_nsec) / 1000000.0;
+    framework_log(LOG_LEVEL_INFO, "%s %s - %d (%.2fms) [proxy %s:%d]",
+                 exchange->method[0] ? exchange->method : "-",
+                 exchange->path[0] ? exchange->path : "-",
+                 status, elapsed_ms, upstream->host, upstream->port);
+    
+    if (exchange->pipe_fds[0] >= 0) {
+        close(exchange->pipe_fds[0]);
+        close(exchange->pipe_fds[1]);
+    }
+    close(exchange->client.fd);
+    free(exchange->client.data);
+    free(exchange->server.data);
+    free(exchange->copy_buffer);
+    free(exchange);
+    
+    exchange_finished(upstream);
+    return NULL;
+}
+
+int http_proxy_dispatch(HTTP_PROXY_UPSTREAM *upstream, int client_socket,
+                        char *buffered, size_t buffered_length)
+{
+    if (!upstream || client_socket < 0 || !buffered) {
+        if (client_socket >= 0) close(client_socket);
+        free(buffered);
+        return FRAMEWORK_ERROR_NULL_PTR;
+    }
+    
+    /* Each exchange holds a thread and an upstream connection; shed load past the cap */
+    pthread_mutex_lock(&upstream->mutex);
+    int saturated = upstream->active_count >= upstream->max_active;
+    if (!saturated) {
+        upstream->active_count++;
+    }
+    pthread_mutex_unlock(&upstream->mutex);
+    
+    if (saturated) {
+        framework_log(LOG_LEVEL_WARNING, "Proxy: %zu exchanges running for %s:%d, refusing request",
+                     upstream->max_active, upstream->host, upstream->port);
+        send_error_response(client_socket, 503, "Service Unavailable");
+        close(client_socket);
+        free(buffered);
+        return FRAMEWORK_ERROR_STATE;
+    }
+    
+    PROXY_EXCHANGE *exchange = (PROXY_EXCHANGE*)calloc(1, sizeof(PROXY_EXCHANGE));
+    if (!exchange) {
+        close(client_socket);
+        free(buffered);
+        exchange_finished(upstream);
+        return FRAMEWORK_ERROR_MEMORY;
+    }
+    
+    exchange->upstream = upstream;
+    exchange->client.fd = client_socket;
+    exchange->server.fd = -1;
+    exchange->pipe_fds[0] = -1;
+    exchange->pipe_fds[1] = -1;
+    
+    /* The bytes the server loop already read become the client stream's buffer */
+    exchange->client.data = buffered;
+    exchange->client.capacity = buffered_length;
+    exchange->client.end = buffered_length;
+    
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    
+    pthread_t thread;
+    int created = pthread_create(&thread, &attr, proxy_exchange_thread, exchange);
+    pthread_attr_destroy(&attr);
+    
+    if (created != 0) {
+        framework_log(LOG_LEVEL_ERROR, "Proxy: failed to start exchange thread");
+        send_error_response(client_socket, 503, "Service Unavailable");
+        close(client_socket);
+        free(exchange->client.data);
+        free(exchange);
+        exchange_finished(upstream);
+        return FRAMEWORK_ERROR_STATE;
+    }
+    
+    return FRAMEWORK_SUCCESS;
+}
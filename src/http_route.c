@@ -1,6 +1,7 @@
 #define _POSIX_C_SOURCE 200809L
 #include "http_route.h"
 #include "http_server.h"
+#include "http_proxy.h"
 #include "framework.h"
 #include <stdlib.h>
 #include <string.h>
@@ -29,9 +30,34 @@ HTTP_ROUTE* http_route_create(HTTP_METHOD method, const char *path,
     return route;
 }
 
+HTTP_ROUTE* http_route_create_proxy(const char *path, HTTP_PROXY_UPSTREAM *upstream)
+{
+    if (!path || !upstream) {
+        return NULL;
+    }
+    
+    HTTP_ROUTE *route = (HTTP_ROUTE*)calloc(1, sizeof(HTTP_ROUTE));
+    if (!route) {
+        return NULL;
+    }
+    
+    /* Proxy routes forward every method */
+    route->method = HTTP_METHOD_UNKNOWN;
+    strncpy(route->path, path, sizeof(route->path) - 1);
+    route->proxy = upstream;
+    
+    framework_log(LOG_LEVEL_INFO, "Proxy route registered: %s -> %s:%d", 
+                 path, upstream->host, upstream->port);
+    
+    return route;
+}
+
 void http_route_destroy(HTTP_ROUTE *route)
 {
     if (!route) return;
+    if (route->proxy) {
+        http_proxy_upstream_destroy(route->proxy);
+    }
     free(route);
 }
 
@@ -42,7 +68,7 @@ int http_route_matches(HTTP_ROUTE *route, HTTP_METHOD method, const char *path)
     }
     
     /* Check method */
-    if (route->method != method) {
+    if (route->method != method && !route->proxy) {
         return 0;
     }
     
@@ -51,6 +77,14 @@ int http_route_matches(HTTP_ROUTE *route, HTTP_METHOD method, const char *path)
         return 1;
     }
     
+    /* Trailing wildcard segment: "/api/" + "*" matches "/api" and everything below it */
+    size_t route_len = strlen(route->path);
+    if (route_len >= 2 && strcmp(route->path + route_len - 2, "/*") == 0) {
+        size_t prefix_len = route_len - 2;
+        return (strncmp(route->path, path, prefix_len) == 0 &&
+                (path[prefix_len] == '\0' || path[prefix_len] == '/')) ? 1 : 0;
+    }
+    
     /* Check if pattern has parameters (contains ':') */
     if (strchr(route->path, ':') == NULL) {
         return 0;  /* No parameters, exact match already failed */
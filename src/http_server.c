@@ -2,8 +2,11 @@
 #define _DEFAULT_SOURCE
 #include "http_server.h"
 #include "http_route.h"
+#include "http_proxy.h"
 #include "http2.h"
+#include "json_parser.h"
 #include "application.h"
+#include "event_loop.h"
 #include "framework.h"
 #include <stdlib.h>
 #include <string.h>
@@ -15,18 +18,20 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <errno.h>
-#include <sys/epoll.h>
 #include <fcntl.h>
 
 #define INITIAL_ROUTE_CAPACITY 20
 #define INITIAL_HEADER_CAPACITY 10
 #define INITIAL_BODY_CAPACITY 4096
 #define MAX_REQUEST_SIZE 65536
-#define MAX_EPOLL_EVENTS 64
-#define EPOLL_TIMEOUT_MS 1000
+#define IDLE_SWEEP_INTERVAL_MS 1000
+#define IDLE_TIMEOUT_SECONDS 60
 
 /* Forward declarations */
 static int serve_static_file(HTTP_SERVER *server, const char *url_path, HTTP_RESPONSE *response);
+static void on_listener_ready(void *user_data, int fd, int events);
+static void on_client_ready(void *user_data, int fd, int events);
+static void on_idle_sweep(void *user_data, int timer);
 
 /* Connection state for tracking each client */
 typedef struct _connection_state_ {
@@ -68,8 +73,10 @@ HTTP_SERVER* http_server_create(const char *host, int port)
     }
     server->route_count = 0;
     
-    /* Initialize epoll for concurrent connections */
-    server->epoll_fd = -1;
+    /* Event loop is attached or created on start */
+    server->loop = NULL;
+    server->owns_loop = 0;
+    server->idle_timer = -1;
     server->max_connections = 1000;
     server->connection_states = NULL;
     server->connection_count = 0;
@@ -81,7 +88,7 @@ HTTP_SERVER* http_server_create(const char *host, int port)
     server->static_directory[0] = '\0';
     
     framework_log(LOG_LEVEL_INFO, "HTTP server created on %s:%d", server->host, server->port);
-    framework_log(LOG_LEVEL_INFO, "EPOLL-based concurrent connection handling enabled");
+    framework_log(LOG_LEVEL_INFO, "Event loop based concurrent connection handling enabled");
     return server;
 }
 
@@ -105,6 +112,10 @@ void http_server_destroy(HTTP_SERVER *server)
         free(server->connection_states);
     }
     
+    if (server->owns_loop) {
+        event_loop_destroy(server->loop);
+    }
+    
     free(server);
     framework_log(LOG_LEVEL_INFO, "HTTP server destroyed");
 }
@@ -166,6 +177,7 @@ static void remove_connection(HTTP_SERVER *server, int socket_fd)
                 http2_connection_destroy(server->connection_states[i].http2_conn);
             }
             
+            event_loop_remove_fd(server->loop, socket_fd);
             close(socket_fd);
             
             /* Move last connection to this slot */
@@ -178,6 +190,22 @@ static void remove_connection(HTTP_SERVER *server, int socket_fd)
     }
 }
 
+/* Stop tracking a connection without closing it (ownership moves elsewhere) */
+static void detach_connection(HTTP_SERVER *server, int socket_fd)
+{
+    event_loop_remove_fd(server->loop, socket_fd);
+    
+    for (size_t i = 0; i < server->connection_count; i++) {
+        if (server->connection_states[i].socket == socket_fd) {
+            if (i < server->connection_count - 1) {
+                server->connection_states[i] = server->connection_states[server->connection_count - 1];
+            }
+            server->connection_count--;
+            return;
+        }
+    }
+}
+
 int http_server_start(HTTP_SERVER *server)
 {
     if (!server) return FRAMEWORK_ERROR_NULL_PTR;
@@ -232,29 +260,37 @@ int http_server_start(HTTP_SERVER *server)
         return FRAMEWORK_ERROR_INVALID;
     }
     
-    /* Create epoll instance */
-    server->epoll_fd = epoll_create1(0);
-    if (server->epoll_fd < 0) {
-        framework_log(LOG_LEVEL_ERROR, "Failed to create epoll: %s", strerror(errno));
-        close(server->server_socket);
-        return FRAMEWORK_ERROR_INVALID;
+    /* Serve from a private loop unless one was attached */
+    if (!server->loop) {
+        server->loop = event_loop_create();
+        if (!server->loop) {
+            close(server->server_socket);
+            server->server_socket = -1;
+            return FRAMEWORK_ERROR_INVALID;
+        }
+        server->owns_loop = 1;
     }
     
-    /* Add server socket to epoll */
-    struct epoll_event ev;
-    ev.events = EPOLLIN;
-    ev.data.fd = server->server_socket;
-    if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->server_socket, &ev) < 0) {
-        framework_log(LOG_LEVEL_ERROR, "Failed to add server socket to epoll: %s", strerror(errno));
-        close(server->epoll_fd);
+    /* Watch server socket */
+    if (event_loop_add_fd(server->loop, server->server_socket, EVENT_LOOP_READ,
+                          on_listener_ready, server) != FRAMEWORK_SUCCESS) {
+        framework_log(LOG_LEVEL_ERROR, "Failed to add server socket to event loop");
         close(server->server_socket);
+        server->server_socket = -1;
         return FRAMEWORK_ERROR_INVALID;
     }
     
+    /* Periodic sweep of idle connections */
+    server->idle_timer = event_loop_add_timer(server->loop, IDLE_SWEEP_INTERVAL_MS,
+                                              IDLE_SWEEP_INTERVAL_MS, on_idle_sweep, server);
+    if (server->idle_timer < 0) {
+        framework_log(LOG_LEVEL_WARNING, "Failed to add idle sweep timer, idle connections stay open");
+    }
+    
     server->running = 1;
     framework_log(LOG_LEVEL_INFO, "HTTP server listening on %s:%d", server->host, server->port);
     framework_log(LOG_LEVEL_INFO, "Registered %zu routes", server->route_count);
-    framework_log(LOG_LEVEL_INFO, "Using EPOLL for concurrent connections (max: %zu)", server->max_connections);
+    framework_log(LOG_LEVEL_INFO, "Using event loop for concurrent connections (max: %zu)", server->max_connections);
     
     return FRAMEWORK_SUCCESS;
 }
@@ -272,23 +308,29 @@ int http_server_stop(HTTP_SERVER *server)
             if (server->connection_states[i].http2_conn) {
                 http2_connection_destroy(server->connection_states[i].http2_conn);
             }
+            event_loop_remove_fd(server->loop, server->connection_states[i].socket);
             close(server->connection_states[i].socket);
         }
         server->connection_count = 0;
     }
     
-    /* Close epoll */
-    if (server->epoll_fd >= 0) {
-        close(server->epoll_fd);
-        server->epoll_fd = -1;
+    if (server->idle_timer >= 0) {
+        event_loop_cancel_timer(server->loop, server->idle_timer);
+        server->idle_timer = -1;
     }
     
     /* Close server socket */
     if (server->server_socket >= 0) {
+        event_loop_remove_fd(server->loop, server->server_socket);
         close(server->server_socket);
         server->server_socket = -1;
     }
     
+    /* A private loop has nothing left to serve */
+    if (server->owns_loop) {
+        event_loop_stop(server->loop);
+    }
+    
     framework_log(LOG_LEVEL_INFO, "HTTP server stopped");
     return FRAMEWORK_SUCCESS;
 }
@@ -364,8 +406,8 @@ static int parse_http_request(const char *buffer, size_t buffer_len, HTTP_REQUES
     }
     
     request->method = http_method_from_string(method_str);
-    strncpy(request->path, path, sizeof(request->path) - 1);
-    strncpy(request->http_version, version, sizeof(request->http_version) - 1);
+    snprintf(request->path, sizeof(request->path), "%s", path);
+    snprintf(request->http_version, sizeof(request->http_version), "%s", version);
     
     /* Parse query string if present */
     char *query = strchr(request->path, '?');
@@ -527,6 +569,30 @@ static void process_http_request(HTTP_SERVER *server, CONNECTION_STATE *conn)
         }
     }
     
+    if (matched_route && matched_route->proxy) {
+        /* Proxied exchanges stream on their own thread; hand over the socket and what was read.
+         * Detach first: once dispatched the socket may already be closed and its number reused.
+         * Detaching recycles conn's slot, so the read bytes are copied out beforehand
+         * into the buffer the exchange then reads into. */
+        int client_socket = conn->socket;
+        size_t buffered_length = conn->buffer_used;
+        char *buffered = (char*)malloc(buffered_length);
+        if (!buffered) {
+            http_request_destroy(request);
+            http_response_destroy(response);
+            remove_connection(server, client_socket);
+            return;
+        }
+        memcpy(buffered, conn->buffer, buffered_length);
+        
+        detach_connection(server, client_socket);
+        http_proxy_dispatch(matched_route->proxy, client_socket, buffered, buffered_length);
+        
+        http_request_destroy(request);
+        http_response_destroy(response);
+        return;
+    }
+    
     if (matched_route && matched_route->handler) {
         /* Call route handler */
         matched_route->handler(request, response, matched_route->user_data);
@@ -642,13 +708,10 @@ static void accept_new_connection(HTTP_SERVER *server)
             continue;
         }
         
-        /* Add to epoll */
-        struct epoll_event ev;
-        ev.events = EPOLLIN | EPOLLET;  /* Edge-triggered */
-        ev.data.fd = client_socket;
-        if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, client_socket, &ev) < 0) {
-            framework_log(LOG_LEVEL_ERROR, "Failed to add client to epoll: %s", 
-                        strerror(errno));
+        /* Add to event loop (edge-triggered) */
+        if (event_loop_add_fd(server->loop, client_socket, EVENT_LOOP_READ | EVENT_LOOP_EDGE,
+                              on_client_ready, server) != FRAMEWORK_SUCCESS) {
+            framework_log(LOG_LEVEL_ERROR, "Failed to add client to event loop");
             remove_connection(server, client_socket);
             continue;
         }
@@ -658,75 +721,80 @@ static void accept_new_connection(HTTP_SERVER *server)
     }
 }
 
+/* Listener readable: accept everything pending */
+static void on_listener_ready(void *user_data, int fd, int events)
+{
+    (void)fd;
+    (void)events;
+    accept_new_connection((HTTP_SERVER*)user_data);
+}
+
+/* Client socket readable, or hung up */
+static void on_client_ready(void *user_data, int fd, int events)
+{
+    HTTP_SERVER *server = (HTTP_SERVER*)user_data;
+    
+    if (events & EVENT_LOOP_ERROR) {
+        /* Error or hangup */
+        remove_connection(server, fd);
+    } else if (events & EVENT_LOOP_READ) {
+        /* Data available to read */
+        handle_client_data(server, fd);
+    }
+}
+
+/* Close connections idle for longer than IDLE_TIMEOUT_SECONDS */
+static void on_idle_sweep(void *user_data, int timer)
+{
+    (void)timer;
+    HTTP_SERVER *server = (HTTP_SERVER*)user_data;
+    
+    time_t now = time(NULL);
+    for (size_t i = 0; i < server->connection_count; ) {
+        if (now - server->connection_states[i].last_activity > IDLE_TIMEOUT_SECONDS) {
+            framework_log(LOG_LEVEL_DEBUG, "Closing idle connection (socket %d)",
+                        server->connection_states[i].socket);
+            int socket = server->connection_states[i].socket;
+            remove_connection(server, socket);
+            /* Don't increment i, as remove_connection shifts the array */
+        } else {
+            i++;
+        }
+    }
+}
+
+int http_server_set_event_loop(HTTP_SERVER *server, EVENT_LOOP *loop)
+{
+    if (!server) return FRAMEWORK_ERROR_NULL_PTR;
+    if (server->running) return FRAMEWORK_ERROR_STATE;
+    
+    if (server->owns_loop) {
+        event_loop_destroy(server->loop);
+        server->owns_loop = 0;
+    }
+    server->loop = loop;
+    return FRAMEWORK_SUCCESS;
+}
+
 int http_server_run(HTTP_SERVER *server)
 {
     if (!server || !server->running) {
         return FRAMEWORK_ERROR_STATE;
     }
     
-    framework_log(LOG_LEVEL_INFO, "HTTP server running with EPOLL, press Ctrl+C to stop...");
+    framework_log(LOG_LEVEL_INFO, "HTTP server running, press Ctrl+C to stop...");
     framework_log(LOG_LEVEL_INFO, "Handling multiple concurrent connections...");
     
-    struct epoll_event events[MAX_EPOLL_EVENTS];
-    
-    while (server->running) {
-        /* Wait for events */
-        int nfds = epoll_wait(server->epoll_fd, events, MAX_EPOLL_EVENTS, EPOLL_TIMEOUT_MS);
-        
-        if (nfds < 0) {
-            if (errno == EINTR) {
-                continue;  /* Interrupted by signal */
-            }
-            framework_log(LOG_LEVEL_ERROR, "epoll_wait failed: %s", strerror(errno));
-            break;
-        }
-        
-        /* Process events */
-        for (int i = 0; i < nfds; i++) {
-            int fd = events[i].data.fd;
-            
-            if (fd == server->server_socket) {
-                /* New connection */
-                accept_new_connection(server);
-            } else {
-                /* Data on client socket */
-                if (events[i].events & (EPOLLERR | EPOLLHUP)) {
-                    /* Error or hangup */
-                    remove_connection(server, fd);
-                } else if (events[i].events & EPOLLIN) {
-                    /* Data available to read */
-                    handle_client_data(server, fd);
-                }
-            }
-        }
-        
-        /* Optional: Clean up idle connections (timeout after 60 seconds) */
-        time_t now = time(NULL);
-        for (size_t i = 0; i < server->connection_count; ) {
-            if (now - server->connection_states[i].last_activity > 60) {
-                framework_log(LOG_LEVEL_DEBUG, "Closing idle connection (socket %d)",
-                            server->connection_states[i].socket);
-                int socket = server->connection_states[i].socket;
-                remove_connection(server, socket);
-                /* Don't increment i, as remove_connection shifts the array */
-            } else {
-                i++;
-            }
-        }
-    }
+    /* Returns once http_server_stop() stops a private loop, or the owner stops a shared one */
+    int result = event_loop_run(server->loop);
     
     framework_log(LOG_LEVEL_INFO, "HTTP server event loop terminated");
-    return FRAMEWORK_SUCCESS;
+    return result;
 }
 
 /* Route Management */
-int http_server_add_route(HTTP_SERVER *server, HTTP_METHOD method, const char *path,
-                         http_route_handler_fn handler, void *user_data)
+static int append_route(HTTP_SERVER *server, HTTP_ROUTE *route)
 {
-    if (!server || !path || !handler) {
-        return FRAMEWORK_ERROR_NULL_PTR;
-    }
-    
     /* Resize array if needed */
     if (server->route_count >= server->route_capacity) {
         size_t new_capacity = server->route_capacity * 2;
@@ -739,12 +807,26 @@ int http_server_add_route(HTTP_SERVER *server, HTTP_METHOD method, const char *p
         server->route_capacity = new_capacity;
     }
     
+    server->routes[server->route_count++] = route;
+    return FRAMEWORK_SUCCESS;
+}
+
+int http_server_add_route(HTTP_SERVER *server, HTTP_METHOD method, const char *path,
+                         http_route_handler_fn handler, void *user_data)
+{
+    if (!server || !path || !handler) {
+        return FRAMEWORK_ERROR_NULL_PTR;
+    }
+    
     HTTP_ROUTE *route = http_route_create(method, path, handler, user_data);
     if (!route) {
         return FRAMEWORK_ERROR_MEMORY;
     }
     
-    server->routes[server->route_count++] = route;
+    if (append_route(server, route) != FRAMEWORK_SUCCESS) {
+        http_route_destroy(route);
+        return FRAMEWORK_ERROR_MEMORY;
+    }
     
     framework_log(LOG_LEVEL_DEBUG, "Route registered: %s %s", 
                  http_method_to_string(method), path);
@@ -752,6 +834,31 @@ int http_server_add_route(HTTP_SERVER *server, HTTP_METHOD method, const char *p
     return FRAMEWORK_SUCCESS;
 }
 
+int http_server_proxy(HTTP_SERVER *server, const char *path, const char *upstream_url)
+{
+    if (!server || !path || !upstream_url) {
+        return FRAMEWORK_ERROR_NULL_PTR;
+    }
+    
+    HTTP_PROXY_UPSTREAM *upstream = http_proxy_upstream_create(upstream_url);
+    if (!upstream) {
+        return FRAMEWORK_ERROR_INVALID;
+    }
+    
+    HTTP_ROUTE *route = http_route_create_proxy(path, upstream);
+    if (!route) {
+        http_proxy_upstream_destroy(upstream);
+        return FRAMEWORK_ERROR_MEMORY;
+    }
+    
+    if (append_route(server, route) != FRAMEWORK_SUCCESS) {
+        http_route_destroy(route);
+        return FRAMEWORK_ERROR_MEMORY;
+    }
+    
+    return FRAMEWORK_SUCCESS;
+}
+
 int http_server_get(HTTP_SERVER *server, const char *path, 
                    http_route_handler_fn handler, void *user_data)
 {
@@ -1080,6 +1187,38 @@ int http_response_set_json(HTTP_RESPONSE *response, const char *json)
     return http_response_set_body(response, json, strlen(json));
 }
 
+int http_response_set_json_builder(HTTP_RESPONSE *response, JSON_BUILDER *builder)
+{
+    if (!response || !builder) {
+        return FRAMEWORK_ERROR_NULL_PTR;
+    }
+    
+    if (builder->error || !builder->buffer) {
+        return FRAMEWORK_ERROR_MEMORY;
+    }
+    
+    http_response_add_header(response, "Content-Type", "application/json");
+    
+    /* A caller-owned buffer cannot be handed over */
+    if (builder->fixed) {
+        return http_response_set_body(response, builder->buffer, builder->position);
+    }
+    
+    /* Swap buffers: the body becomes the builder's output, the builder reuses the old body */
+    char *body = response->body;
+    size_t body_capacity = response->body_capacity;
+    
+    response->body = builder->buffer;
+    response->body_length = builder->position;
+    response->body_capacity = builder->size;
+    
+    builder->buffer = body;
+    builder->size = body ? body_capacity : 0;
+    json_builder_reset(builder);
+    
+    return FRAMEWORK_SUCCESS;
+}
+
 int http_response_set_text(HTTP_RESPONSE *response, const char *text)
 {
     if (!response || !text) {
@@ -1131,7 +1270,9 @@ const char* http_status_to_string(HTTP_STATUS status)
         case HTTP_STATUS_METHOD_NOT_ALLOWED: return "Method Not Allowed";
         case HTTP_STATUS_INTERNAL_ERROR: return "Internal Server Error";
         case HTTP_STATUS_NOT_IMPLEMENTED: return "Not Implemented";
+        case HTTP_STATUS_BAD_GATEWAY: return "Bad Gateway";
         case HTTP_STATUS_SERVICE_UNAVAILABLE: return "Service Unavailable";
+        case HTTP_STATUS_GATEWAY_TIMEOUT: return "Gateway Timeout";
         default: return "Unknown";
     }
 }
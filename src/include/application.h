@@ -8,6 +8,7 @@ typedef struct _module_ MODULE;
 typedef struct _service_controller_ SERVICE_CONTROLLER;
 typedef struct _kafka_client_ KAFKA_CLIENT;
 typedef struct _http_server_ HTTP_SERVER;
+typedef struct _event_loop_ EVENT_LOOP;
 
 /* Function list for initialization and cleanup */
 typedef struct _function_list_
@@ -43,6 +44,7 @@ typedef struct _application_
     /* Server management */
     HTTP_SERVER *http_server;
     KAFKA_CLIENT *kafka_client;
+    EVENT_LOOP *loop;   /* Runs HTTP, Kafka, timers and posted tasks on one thread */
     
     int initialized;
     int running;
@@ -68,4 +70,10 @@ void application_set_http_server(APPLICATION *app, HTTP_SERVER *server);
 void application_set_kafka_client(APPLICATION *app, KAFKA_CLIENT *kafka);
 int application_run(APPLICATION *app);
 
+/* Event loop used by application_run (created on first use); add timers or fds before running */
+EVENT_LOOP* application_get_loop(APPLICATION *app);
+
+/* Run fn(arg) on the event loop thread; callable from any thread once the loop exists */
+int application_post(APPLICATION *app, void (*fn)(void *arg), void *arg);
+
 #endif /* APPLICATION_H */
@@ -0,0 +1,164 @@
+/**
+ * Circuit Breaker Module
+ *
+ * Generic circuit breaker (closed / open / half-open) driven by failure
+ * and slow-call rates over a rolling time window, plus a retry budget
+ * and jittered backoff. Time and randomness are injectable so behaviour
+ * is fully deterministic.
+ */
+
+#ifndef CIRCUIT_BREAKER_H
+#define CIRCUIT_BREAKER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct _circuit_breaker_ CIRCUIT_BREAKER;
+typedef struct _retry_budget_ RETRY_BUDGET;
+
+/* Circuit states */
+typedef enum {
+    CIRCUIT_CLOSED = 0,     /* Calls flow, outcomes are recorded */
+    CIRCUIT_OPEN,           /* Calls are rejected until the open period ends */
+    CIRCUIT_HALF_OPEN       /* A limited number of trial calls decide */
+} CIRCUIT_STATE;
+
+/* Permission returned by circuit_breaker_acquire */
+typedef enum {
+    CIRCUIT_PERMIT_DENIED = 0,
+    CIRCUIT_PERMIT_NORMAL,
+    CIRCUIT_PERMIT_TRIAL
+} CIRCUIT_PERMIT;
+
+/**
+ * Clock callback returning monotonic milliseconds
+ */
+typedef uint64_t (*CIRCUIT_CLOCK_FN)(void *user_data);
+
+/* Circuit breaker configuration */
+typedef struct {
+    double failure_rate_threshold;      /* Open when failures/calls >= this (0..1) */
+    double slow_call_rate_threshold;    /* Open when slow/calls >= this (0..1, >1 disables) */
+    uint64_t slow_call_duration_ms;     /* Calls at least this long are slow */
+    uint64_t window_ms;                 /* Rolling window length */
+    size_t window_buckets;              /* Window resolution */
+    size_t minimum_calls;               /* Calls in window before rates are evaluated */
+    uint64_t open_duration_ms;          /* Time spent open before trial calls */
+    size_t half_open_max_calls;         /* Trial calls; all must succeed to close */
+    
+    CIRCUIT_CLOCK_FN clock;             /* NULL = CLOCK_MONOTONIC */
+    void *clock_data;
+} CIRCUIT_BREAKER_CONFIG;
+
+/* ==================== Circuit Breaker ==================== */
+
+/**
+ * Fill a configuration with defaults
+ * (50% failures or 100% slow calls over 10s with at least 20 calls, 5s open, 3 trials)
+ *
+ * @param config Configuration to initialize
+ */
+void circuit_breaker_config_init(CIRCUIT_BREAKER_CONFIG *config);
+
+/**
+ * Create a circuit breaker
+ *
+ * @param config Configuration (copied)
+ * @return New breaker or NULL on failure
+ */
+CIRCUIT_BREAKER* circuit_breaker_create(const CIRCUIT_BREAKER_CONFIG *config);
+
+/**
+ * Destroy a circuit breaker
+ *
+ * @param breaker Breaker to destroy
+ */
+void circuit_breaker_destroy(CIRCUIT_BREAKER *breaker);
+
+/**
+ * Ask permission for a call
+ *
+ * @param breaker Circuit breaker
+ * @return CIRCUIT_PERMIT_DENIED if the call must fail fast
+ */
+CIRCUIT_PERMIT circuit_breaker_acquire(CIRCUIT_BREAKER *breaker);
+
+/**
+ * Record the outcome of a permitted call
+ *
+ * @param breaker Circuit breaker
+ * @param permit Permit returned by circuit_breaker_acquire
+ * @param success 1 if the call succeeded
+ * @param duration_ms Call duration
+ */
+void circuit_breaker_record(CIRCUIT_BREAKER *breaker, CIRCUIT_PERMIT permit,
+                            int success, uint64_t duration_ms);
+
+/**
+ * Current state (an expired open period reports half-open)
+ *
+ * @param breaker Circuit breaker
+ * @return Circuit state
+ */
+CIRCUIT_STATE circuit_breaker_state(CIRCUIT_BREAKER *breaker);
+
+/**
+ * Convert a state to a string
+ *
+ * @param state Circuit state
+ * @return "closed", "open" or "half-open"
+ */
+const char* circuit_state_to_string(CIRCUIT_STATE state);
+
+/* ==================== Retry Budget ==================== */
+
+/**
+ * Create a retry budget
+ *
+ * Every first attempt deposits ratio tokens and every retry withdraws one,
+ * so retries stay below ratio of the request rate (plus a burst of
+ * max_tokens).
+ *
+ * @param ratio Retry tokens earned per request (e.g., 0.1 = 10% extra load)
+ * @param max_tokens Bucket capacity; the bucket starts full
+ * @return New budget or NULL on failure
+ */
+RETRY_BUDGET* retry_budget_create(double ratio, double max_tokens);
+
+/**
+ * Destroy a retry budget
+ *
+ * @param budget Budget to destroy
+ */
+void retry_budget_destroy(RETRY_BUDGET *budget);
+
+/**
+ * Record a first attempt
+ *
+ * @param budget Retry budget
+ */
+void retry_budget_deposit(RETRY_BUDGET *budget);
+
+/**
+ * Try to spend one retry
+ *
+ * @param budget Retry budget
+ * @return 1 if the retry may proceed, 0 if the budget is exhausted
+ */
+int retry_budget_withdraw(RETRY_BUDGET *budget);
+
+/* ==================== Backoff ==================== */
+
+/**
+ * Full-jitter exponential backoff: uniform in [0, min(max, base * 2^attempt)]
+ *
+ * @param rng_state Generator state (any non-zero seed; updated)
+ * @param attempt Retry number starting at 0
+ * @param base_ms Base delay
+ * @param max_ms Delay cap
+ * @return Delay in milliseconds
+ */
+uint64_t circuit_backoff_delay(uint64_t *rng_state, unsigned attempt,
+                               uint64_t base_ms, uint64_t max_ms);
+
+#endif /* CIRCUIT_BREAKER_H */
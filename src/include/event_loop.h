@@ -0,0 +1,194 @@
+/**
+ * Event Loop Module
+ *
+ * One epoll instance that drives everything an application waits on:
+ * sockets, timers (timerfd), Kafka consumer queues and work posted from
+ * other threads (eventfd). All callbacks run on the thread that calls
+ * event_loop_run(), so handlers registered on one loop never run
+ * concurrently and need no locks.
+ *
+ * Posted tasks go through a lock-free multi-producer single-consumer
+ * queue. Producers only signal the eventfd when the loop is not already
+ * due to drain, so a burst of posts costs one wakeup.
+ */
+
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct _event_loop_ EVENT_LOOP;
+
+/* Readiness flags (watch requests and callback arguments) */
+#define EVENT_LOOP_READ     0x01
+#define EVENT_LOOP_WRITE    0x02
+#define EVENT_LOOP_ERROR    0x04    /* Error or hangup; reported, never requested */
+#define EVENT_LOOP_EDGE     0x08    /* Edge-triggered watch */
+
+/**
+ * File descriptor callback
+ * @param user_data User data given when the watch was added
+ * @param fd Ready file descriptor
+ * @param events EVENT_LOOP_READ / _WRITE / _ERROR
+ */
+typedef void (*EVENT_LOOP_FD_FN)(void *user_data, int fd, int events);
+
+/**
+ * Timer callback
+ * @param user_data User data given when the timer was added
+ * @param timer Timer id
+ */
+typedef void (*EVENT_LOOP_TIMER_FN)(void *user_data, int timer);
+
+/**
+ * Task callback for work posted to the loop
+ * @param arg Argument given to event_loop_post
+ */
+typedef void (*EVENT_LOOP_TASK_FN)(void *arg);
+
+/*
+ * Intrusive task node for event_loop_post_task()
+ *
+ * Owned by the loop from posting until fn is called; fn may free or
+ * repost it. next is private to the queue.
+ */
+typedef struct _event_loop_task_ {
+    struct _event_loop_task_ *next;
+    EVENT_LOOP_TASK_FN fn;
+    void *arg;
+} EVENT_LOOP_TASK;
+
+/* ==================== Loop ==================== */
+
+/**
+ * Create an event loop
+ * @return New loop or NULL on failure
+ */
+EVENT_LOOP* event_loop_create(void);
+
+/**
+ * Destroy an event loop, dropping tasks that were posted but not run
+ *
+ * Watched file descriptors are not closed; timers are.
+ *
+ * @param loop Loop to destroy
+ */
+void event_loop_destroy(EVENT_LOOP *loop);
+
+/**
+ * Dispatch events on the calling thread until event_loop_stop()
+ * @param loop Loop
+ * @return FRAMEWORK_SUCCESS, or FRAMEWORK_ERROR_STATE if epoll_wait failed
+ */
+int event_loop_run(EVENT_LOOP *loop);
+
+/**
+ * Dispatch the events that are ready, waiting at most timeout_ms
+ * @param loop Loop
+ * @param timeout_ms Longest wait (-1 = until something is ready, 0 = no wait)
+ * @return Number of callbacks run, or -1 on error
+ */
+int event_loop_run_once(EVENT_LOOP *loop, int timeout_ms);
+
+/**
+ * Make event_loop_run() return after the current callback
+ *
+ * Safe to call from any thread and from signal handlers.
+ *
+ * @param loop Loop
+ */
+void event_loop_stop(EVENT_LOOP *loop);
+
+/**
+ * Check whether the caller is the thread running the loop
+ * @param loop Loop
+ * @return 1 if called from inside event_loop_run(), 0 otherwise
+ */
+int event_loop_in_loop_thread(const EVENT_LOOP *loop);
+
+/* ==================== File Descriptors ==================== */
+
+/**
+ * Watch a file descriptor
+ * @param loop Loop
+ * @param fd File descriptor (one watch per descriptor)
+ * @param events EVENT_LOOP_READ and/or _WRITE, optionally | EVENT_LOOP_EDGE
+ * @param callback Called on readiness
+ * @param user_data Passed to callback
+ * @return FRAMEWORK_SUCCESS or an error code
+ */
+int event_loop_add_fd(EVENT_LOOP *loop, int fd, int events,
+                      EVENT_LOOP_FD_FN callback, void *user_data);
+
+/**
+ * Change the events a watched descriptor is waiting for
+ * @param loop Loop
+ * @param fd Watched file descriptor
+ * @param events New event flags
+ * @return FRAMEWORK_SUCCESS or an error code
+ */
+int event_loop_modify_fd(EVENT_LOOP *loop, int fd, int events);
+
+/**
+ * Stop watching a file descriptor (call before closing it)
+ *
+ * Events already collected for fd in the current iteration are dropped.
+ *
+ * @param loop Loop
+ * @param fd Watched file descriptor
+ * @return FRAMEWORK_SUCCESS or FRAMEWORK_ERROR_INVALID if fd is not watched
+ */
+int event_loop_remove_fd(EVENT_LOOP *loop, int fd);
+
+/* ==================== Timers ==================== */
+
+/**
+ * Add a timer backed by a timerfd
+ * @param loop Loop
+ * @param initial_ms Delay before the first expiry (0 is treated as 1)
+ * @param interval_ms Period after that (0 = one-shot)
+ * @param callback Called on expiry
+ * @param user_data Passed to callback
+ * @return Timer id (>= 0), or -1 on error
+ */
+int event_loop_add_timer(EVENT_LOOP *loop, uint64_t initial_ms, uint64_t interval_ms,
+                         EVENT_LOOP_TIMER_FN callback, void *user_data);
+
+/**
+ * Cancel a timer (one-shot timers must be cancelled after they fire too)
+ * @param loop Loop
+ * @param timer Timer id from event_loop_add_timer
+ * @return FRAMEWORK_SUCCESS or FRAMEWORK_ERROR_INVALID
+ */
+int event_loop_cancel_timer(EVENT_LOOP *loop, int timer);
+
+/* ==================== Tasks ==================== */
+
+/**
+ * Run fn(arg) on the loop thread
+ *
+ * Safe to call from any thread. Tasks run in the order they were posted
+ * by each thread; a task posted from the loop thread runs later, never
+ * from inside the call. Allocates one small node per call.
+ *
+ * @param loop Loop
+ * @param fn Task function
+ * @param arg Passed to fn
+ * @return FRAMEWORK_SUCCESS or FRAMEWORK_ERROR_MEMORY
+ */
+int event_loop_post(EVENT_LOOP *loop, EVENT_LOOP_TASK_FN fn, void *arg);
+
+/**
+ * Run task->fn(task->arg) on the loop thread, without allocating
+ *
+ * Same ordering as event_loop_post(). The node must stay valid and must
+ * not be posted again until its fn has started.
+ *
+ * @param loop Loop
+ * @param task Caller-owned node with fn and arg set
+ * @return FRAMEWORK_SUCCESS or FRAMEWORK_ERROR_NULL_PTR
+ */
+int event_loop_post_task(EVENT_LOOP *loop, EVENT_LOOP_TASK *task);
+
+#endif /* EVENT_LOOP_H */
@@ -9,7 +9,10 @@
 #define HTTP_CLIENT_H
 
 #include "framework.h"
+#include "circuit_breaker.h"
 #include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
 
 /* Forward declarations */
 typedef struct _http_client_request_ HTTP_CLIENT_REQUEST;
@@ -24,6 +27,45 @@ typedef struct _http_client_async_handle_ HTTP_CLIENT_ASYNC_HANDLE;
  */
 typedef void (*HTTP_CLIENT_CALLBACK)(HTTP_CLIENT_RESPONSE *response, void *user_data);
 
+/**
+ * Read callback for streamed request bodies
+ * 
+ * @param user_data User-provided data pointer
+ * @param buffer Destination buffer
+ * @param size Maximum bytes to produce
+ * @return Bytes written to buffer, 0 at end of body, -1 on error
+ */
+typedef ssize_t (*HTTP_CLIENT_BODY_READER)(void *user_data, char *buffer, size_t size);
+
+/**
+ * Streaming compression codec for request bodies
+ * 
+ * compress() consumes input and produces output incrementally. It is
+ * called with finish = 1 and no further input until it returns 1 to
+ * signal the end of the encoded stream.
+ */
+typedef struct {
+    const char *name;               /* Content-Encoding token, e.g. "gzip" */
+    void* (*create)(void);
+    int (*compress)(void *state, const char *input, size_t input_length, size_t *consumed,
+                    char *output, size_t output_size, size_t *produced, int finish);
+    void (*destroy)(void *state);
+} HTTP_CLIENT_CODEC;
+
+/* Client-wide circuit breaking and retry policy */
+typedef struct {
+    CIRCUIT_BREAKER_CONFIG breaker;     /* Applied to each host:port; its clock also times calls */
+    
+    int max_retries;                    /* Retries per call (idempotent methods only) */
+    uint64_t retry_base_delay_ms;       /* Backoff base, doubled per retry */
+    uint64_t retry_max_delay_ms;        /* Backoff cap */
+    double retry_budget_ratio;          /* Retries per request over time (0.1 = 10% extra load) */
+    double retry_budget_burst;          /* Retries available before the ratio applies */
+    uint64_t seed;                      /* Backoff jitter seed */
+    
+    void (*sleep)(uint64_t ms, void *user_data);   /* NULL = nanosleep; gets breaker.clock_data */
+} HTTP_CLIENT_RESILIENCE;
+
 /* HTTP Client Request */
 struct _http_client_request_ {
     char *url;
@@ -42,6 +84,17 @@ struct _http_client_request_ {
     int follow_redirects;
     int max_redirects;
     int verify_ssl;
+    
+    /* Streamed body source (used instead of body when set) */
+    HTTP_CLIENT_BODY_READER body_reader;
+    void *body_reader_data;
+    int body_fd;
+    off_t body_offset;
+    long long body_stream_length;   /* -1 = unknown, sent chunked */
+    
+    /* Request body compression */
+    const HTTP_CLIENT_CODEC *codec;
+    size_t compress_min_size;
 };
 
 /* HTTP Client Response */
@@ -103,6 +156,64 @@ int http_client_request_set_body(HTTP_CLIENT_REQUEST *request,
                                   const char *body, 
                                   size_t length);
 
+/**
+ * Stream the request body from a read callback
+ * 
+ * The callback is invoked while the request executes, so uploads of any
+ * size need no in-memory copy. With an unknown length the body is sent
+ * using chunked transfer encoding.
+ * 
+ * @param request Target request
+ * @param reader Read callback
+ * @param user_data User data passed to the callback
+ * @param content_length Total body length, or -1 if unknown
+ * @return FRAMEWORK_SUCCESS or error code
+ */
+int http_client_request_set_body_callback(HTTP_CLIENT_REQUEST *request,
+                                          HTTP_CLIENT_BODY_READER reader,
+                                          void *user_data,
+                                          long long content_length);
+
+/**
+ * Stream the request body from a file descriptor
+ * 
+ * Plain HTTP uploads use sendfile() so the data never enters user space.
+ * The descriptor is not closed and its file offset is not changed.
+ * 
+ * @param request Target request
+ * @param fd Open file descriptor
+ * @param offset Offset of the first byte to send
+ * @param length Bytes to send (0 = until end of file)
+ * @return FRAMEWORK_SUCCESS or error code
+ */
+int http_client_request_set_body_file(HTTP_CLIENT_REQUEST *request,
+                                      int fd,
+                                      off_t offset,
+                                      size_t length);
+
+/**
+ * Compress the request body while it is sent
+ * 
+ * Bodies of at least min_size bytes (and streamed bodies of unknown
+ * length) are encoded on the fly and sent chunked with a matching
+ * Content-Encoding header. Skipped if a Content-Encoding header is set.
+ * 
+ * @param request Target request
+ * @param codec Codec such as http_client_codec_gzip(), or NULL to disable
+ * @param min_size Smallest body worth compressing
+ * @return FRAMEWORK_SUCCESS or error code
+ */
+int http_client_request_set_compression(HTTP_CLIENT_REQUEST *request,
+                                        const HTTP_CLIENT_CODEC *codec,
+                                        size_t min_size);
+
+/**
+ * Built-in gzip request codec (zlib)
+ * 
+ * @return Codec for use with http_client_request_set_compression
+ */
+const HTTP_CLIENT_CODEC* http_client_codec_gzip(void);
+
 /**
  * Set request timeout in seconds
  * 
@@ -205,6 +316,42 @@ int http_client_async_cancel(HTTP_CLIENT_ASYNC_HANDLE *handle);
  */
 int http_client_async_is_complete(HTTP_CLIENT_ASYNC_HANDLE *handle);
 
+/* ==================== Circuit Breaking and Retries ==================== */
+
+/**
+ * Fill a resilience policy with defaults
+ * (circuit_breaker_config_init, 2 retries, 50ms-2s backoff, 10% retry budget)
+ * 
+ * @param config Policy to initialize
+ */
+void http_client_resilience_init(HTTP_CLIENT_RESILIENCE *config);
+
+/**
+ * Enable circuit breaking and retries for all requests
+ * 
+ * Each host:port gets its own breaker; while it is open, requests fail
+ * immediately with error_message "Circuit open". Transport errors and 5xx
+ * responses count as failures. Failed idempotent requests (GET, HEAD,
+ * OPTIONS, PUT, DELETE) are retried with jittered exponential backoff while
+ * the shared retry budget allows. Bodies from read callbacks are never
+ * replayed. Safe to call while requests are running: requests already in
+ * flight finish under the policy they started with, whose breakers and
+ * budget are freed once the last of them returns.
+ * 
+ * @param config Policy (copied), or NULL to disable and drop all breakers
+ * @return FRAMEWORK_SUCCESS or error code
+ */
+int http_client_set_resilience(const HTTP_CLIENT_RESILIENCE *config);
+
+/**
+ * Get the circuit state for a host
+ * 
+ * @param host Host name as it appears in request URLs
+ * @param port Port number
+ * @return Circuit state (CIRCUIT_CLOSED if unknown or disabled)
+ */
+CIRCUIT_STATE http_client_circuit_state(const char *host, int port);
+
 /* ==================== Convenience Functions ==================== */
 
 /**
@@ -0,0 +1,69 @@
+/**
+ * HTTP Reverse Proxy Module
+ *
+ * Relays requests matched by a proxy route to an upstream HTTP server.
+ * Bodies are streamed between the client and upstream sockets with
+ * splice() through a pipe, so payload bytes never enter user space.
+ * Upstream connections are kept alive and reused.
+ */
+
+#ifndef HTTP_PROXY_H
+#define HTTP_PROXY_H
+
+#include "http_server.h"
+#include <stddef.h>
+#include <pthread.h>
+
+#define HTTP_PROXY_MAX_IDLE 32
+#define HTTP_PROXY_MAX_ACTIVE 256
+
+/* Upstream target of a proxy route, with its keep-alive connection pool */
+typedef struct _http_proxy_upstream_ {
+    char host[256];
+    int port;
+    char base_path[512];         /* Prepended to forwarded paths ("" = none) */
+    char host_header[300];       /* Host header sent upstream */
+    int timeout_seconds;
+    size_t max_active;           /* Concurrent exchanges; more are refused with 503 */
+
+    pthread_mutex_t mutex;
+    pthread_cond_t drained;
+    int idle_sockets[HTTP_PROXY_MAX_IDLE];
+    size_t idle_count;
+    size_t active_count;         /* Exchanges currently running */
+} HTTP_PROXY_UPSTREAM;
+
+/**
+ * Create an upstream from a URL such as "http://127.0.0.1:8080/base"
+ *
+ * @param upstream_url Upstream URL (http:// only)
+ * @return New upstream or NULL on failure
+ */
+HTTP_PROXY_UPSTREAM* http_proxy_upstream_create(const char *upstream_url);
+
+/**
+ * Destroy an upstream, waiting for running exchanges to finish
+ *
+ * @param upstream Upstream to destroy
+ */
+void http_proxy_upstream_destroy(HTTP_PROXY_UPSTREAM *upstream);
+
+/**
+ * Hand a client connection over to the proxy
+ *
+ * The buffered bytes must contain the complete request head and may
+ * contain the start of the body. The exchange runs on its own thread and
+ * the client socket is closed when it completes. When max_active exchanges
+ * are already running, the client gets 503 Service Unavailable instead.
+ *
+ * @param upstream Target upstream
+ * @param client_socket Client connection (ownership transferred)
+ * @param buffered Bytes already read from the client, malloc'd (ownership
+ *                 transferred; becomes the exchange's read buffer)
+ * @param buffered_length Number of buffered bytes
+ * @return FRAMEWORK_SUCCESS or error code
+ */
+int http_proxy_dispatch(HTTP_PROXY_UPSTREAM *upstream, int client_socket,
+                        char *buffered, size_t buffered_length);
+
+#endif /* HTTP_PROXY_H */
@@ -3,12 +3,15 @@
 
 #include "http_server.h"
 
+struct _http_proxy_upstream_;
+
 /* HTTP Route structure */
 struct _http_route_ {
     HTTP_METHOD method;
     char path[512];
     http_route_handler_fn handler;
     void *user_data;
+    struct _http_proxy_upstream_ *proxy;  /* Set for reverse-proxy routes (owned) */
 };
 
 typedef struct _http_route_ HTTP_ROUTE;
@@ -16,6 +19,7 @@ typedef struct _http_route_ HTTP_ROUTE;
 /* Route management functions */
 HTTP_ROUTE* http_route_create(HTTP_METHOD method, const char *path, 
                               http_route_handler_fn handler, void *user_data);
+HTTP_ROUTE* http_route_create_proxy(const char *path, struct _http_proxy_upstream_ *upstream);
 void http_route_destroy(HTTP_ROUTE *route);
 
 int http_route_matches(HTTP_ROUTE *route, HTTP_METHOD method, const char *path);
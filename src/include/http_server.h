@@ -8,6 +8,8 @@
 typedef struct _application_ APPLICATION;
 typedef struct _http_server_ HTTP_SERVER;
 typedef struct _http_route_ HTTP_ROUTE;
+typedef struct _json_builder_ JSON_BUILDER;
+typedef struct _event_loop_ EVENT_LOOP;
 
 /* HTTP Methods */
 typedef enum {
@@ -34,7 +36,9 @@ typedef enum {
     HTTP_STATUS_METHOD_NOT_ALLOWED = 405,
     HTTP_STATUS_INTERNAL_ERROR = 500,
     HTTP_STATUS_NOT_IMPLEMENTED = 501,
-    HTTP_STATUS_SERVICE_UNAVAILABLE = 503
+    HTTP_STATUS_BAD_GATEWAY = 502,
+    HTTP_STATUS_SERVICE_UNAVAILABLE = 503,
+    HTTP_STATUS_GATEWAY_TIMEOUT = 504
 } HTTP_STATUS;
 
 /* HTTP Header */
@@ -107,8 +111,10 @@ struct _http_server_ {
     APPLICATION *app;
     void *context;
     
-    /* EPOLL for concurrent connections */
-    int epoll_fd;
+    /* Event loop for concurrent connections */
+    EVENT_LOOP *loop;
+    int owns_loop;              /* Loop created by http_server_start */
+    int idle_timer;
     struct _connection_state_ *connection_states;
     size_t connection_count;
     size_t max_connections;
@@ -131,10 +137,38 @@ int http_server_start(HTTP_SERVER *server);
 int http_server_stop(HTTP_SERVER *server);
 int http_server_run(HTTP_SERVER *server);  /* Blocking call */
 
+/**
+ * Serve from an existing event loop instead of a private one
+ *
+ * Call before http_server_start(). The listener and connections are then
+ * dispatched by whoever runs the loop, on that thread, alongside any other
+ * sources registered on it.
+ *
+ * @param server HTTP server (not running)
+ * @param loop Event loop (NULL: create a private loop on start)
+ * @return FRAMEWORK_SUCCESS or FRAMEWORK_ERROR_STATE if the server is running
+ */
+int http_server_set_event_loop(HTTP_SERVER *server, EVENT_LOOP *loop);
+
 /* Route registration */
 int http_server_add_route(HTTP_SERVER *server, HTTP_METHOD method, const char *path, 
                          http_route_handler_fn handler, void *user_data);
 
+/**
+ * Register a reverse-proxy route
+ * 
+ * Requests of any method matching the path are relayed to the upstream.
+ * A final "*" segment matches the prefix and everything below it. Request
+ * and response bodies are streamed with splice(); upstream connections
+ * are kept alive and pooled.
+ * 
+ * @param server HTTP server instance
+ * @param path Route pattern (e.g., /api followed by a "*" segment)
+ * @param upstream_url Upstream base URL (e.g., "http://127.0.0.1:8080")
+ * @return 0 on success, error code on failure
+ */
+int http_server_proxy(HTTP_SERVER *server, const char *path, const char *upstream_url);
+
 /**
  * Serve static files from a directory
  * @param server HTTP server instance
@@ -178,6 +212,18 @@ int http_response_set_status(HTTP_RESPONSE *response, HTTP_STATUS status);
 int http_response_add_header(HTTP_RESPONSE *response, const char *name, const char *value);
 int http_response_set_body(HTTP_RESPONSE *response, const char *body, size_t length);
 int http_response_set_json(HTTP_RESPONSE *response, const char *json);
+
+/**
+ * Set a JSON body by taking over a builder's buffer instead of copying it
+ *
+ * The builder is reset and continues in the response's previous body
+ * buffer, so a builder reused across responses stops allocating.
+ *
+ * @param response Response
+ * @param builder Builder holding a complete document
+ * @return FRAMEWORK_SUCCESS or error code (builder ran out of memory)
+ */
+int http_response_set_json_builder(HTTP_RESPONSE *response, JSON_BUILDER *builder);
 int http_response_set_text(HTTP_RESPONSE *response, const char *text);
 
 /* Utility functions */
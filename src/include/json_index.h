@@ -0,0 +1,59 @@
+/**
+ * JSON Structural Index
+ *
+ * Vectorized first pass over JSON text. Each 64-byte block is classified
+ * at once (quotes, backslashes, structural characters, whitespace) and
+ * the offsets of every structural character, string quote and scalar
+ * start are recorded. Parsers use the index to jump over whitespace,
+ * string bodies and whole containers instead of walking byte by byte.
+ *
+ * The implementation (AVX2, SSE2 or portable scalar) is chosen at run
+ * time from the CPU's capabilities.
+ */
+
+#ifndef JSON_INDEX_H
+#define JSON_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Structural index of one document */
+typedef struct {
+    uint32_t *positions;    /* Ascending offsets of {}[]:, quotes and scalar starts */
+    size_t count;
+    size_t capacity;
+} JSON_INDEX;
+
+/**
+ * Initialize an empty index
+ * @param index Index to initialize
+ */
+void json_index_init(JSON_INDEX *index);
+
+/**
+ * Index a document, reusing the index's memory when large enough
+ *
+ * Quotes are matched while indexing, so characters inside strings never
+ * appear in the index. Only an unterminated string is reported as an
+ * error; full validation is left to the parser.
+ *
+ * @param index Index to fill
+ * @param json JSON text (need not be NUL-terminated)
+ * @param length Length of the text (below 4GB)
+ * @return 0 on success, -1 on unterminated string or allocation failure
+ */
+int json_index_build(JSON_INDEX *index, const char *json, size_t length);
+
+/**
+ * Free an index's memory
+ * @param index Index to free
+ */
+void json_index_free(JSON_INDEX *index);
+
+/**
+ * Name of the implementation selected for this CPU
+ * @return "avx2", "sse2" or "scalar"
+ */
+const char* json_index_backend(void);
+
+#endif /* JSON_INDEX_H */
@@ -0,0 +1,109 @@
+/**
+ * MessagePack Encoding
+ *
+ * Binary wire format for the same data the JSON parser handles: structs
+ * described by a JSON_SCHEMA and JSON_VALUE trees encode to MessagePack
+ * and decode back with no struct or schema changes, so a topic or route
+ * can switch format by changing only the encode/decode call. Maps keep
+ * the schema field names as keys, so messages stay self-describing.
+ *
+ * Doubles that a float represents exactly are written as float32; the
+ * value read back is the same double.
+ */
+
+#ifndef JSON_MSGPACK_H
+#define JSON_MSGPACK_H
+
+#include "json_parser.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* Output buffer */
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t length;              /* Bytes written */
+    int error;                  /* Out of memory, or a fixed buffer was too small */
+    int fixed;                  /* Caller's buffer: never grown or freed */
+} JSON_MSGPACK_WRITER;
+
+/**
+ * Initialize a writer that grows as needed
+ * @param writer Writer to initialize
+ * @param initial_size Initial capacity (0 for a default)
+ * @return 0 on success, -1 on allocation failure
+ */
+int json_msgpack_writer_init(JSON_MSGPACK_WRITER *writer, size_t initial_size);
+
+/**
+ * Initialize a writer over a caller buffer; output that does not fit sets error
+ * @param writer Writer to initialize
+ * @param buffer Output buffer
+ * @param size Buffer size
+ */
+void json_msgpack_writer_init_fixed(JSON_MSGPACK_WRITER *writer, uint8_t *buffer, size_t size);
+
+/**
+ * Discard the output, keeping the buffer
+ * @param writer Writer
+ */
+void json_msgpack_writer_reset(JSON_MSGPACK_WRITER *writer);
+
+/**
+ * Release a growable writer's buffer
+ * @param writer Writer
+ */
+void json_msgpack_writer_free(JSON_MSGPACK_WRITER *writer);
+
+/* Single items, each in its smallest encoding; containers are followed by their items */
+void json_msgpack_write_nil(JSON_MSGPACK_WRITER *writer);
+void json_msgpack_write_bool(JSON_MSGPACK_WRITER *writer, int value);
+void json_msgpack_write_int(JSON_MSGPACK_WRITER *writer, int64_t value);
+void json_msgpack_write_double(JSON_MSGPACK_WRITER *writer, double value);
+void json_msgpack_write_string(JSON_MSGPACK_WRITER *writer, const char *value, size_t length);
+void json_msgpack_write_array(JSON_MSGPACK_WRITER *writer, size_t count);
+void json_msgpack_write_map(JSON_MSGPACK_WRITER *writer, size_t count);
+
+/**
+ * Encode a struct as a map keyed by field name (same fields as json_serialize)
+ * @param writer Writer to append to
+ * @param source Source struct
+ * @param schema Schema definition
+ * @return 0 on success, -1 on error
+ */
+int json_msgpack_write_schema(JSON_MSGPACK_WRITER *writer, const void *source, const JSON_SCHEMA *schema);
+
+/**
+ * Encode a JSON tree
+ * @param writer Writer to append to
+ * @param value Tree to encode
+ * @return 0 on success, -1 on error
+ */
+int json_msgpack_write_value(JSON_MSGPACK_WRITER *writer, const JSON_VALUE *value);
+
+/**
+ * Decode one MessagePack item into a JSON tree
+ *
+ * Binary items become strings. Map keys must be strings; extension types
+ * are rejected. Trailing bytes after the item are an error.
+ *
+ * @param data Encoded data
+ * @param length Data length
+ * @param arena Arena to allocate from, or NULL for a tree freed by json_free
+ * @return JSON_VALUE pointer or NULL on error
+ */
+JSON_VALUE* json_msgpack_parse(const void *data, size_t length, JSON_ARENA *arena);
+
+/**
+ * Decode a map straight into a struct (same rules as json_parse_schema_buffer)
+ * @param data Encoded data
+ * @param length Data length
+ * @param schema Schema definition
+ * @param target Target struct
+ * @param result Validation result (can be NULL)
+ * @return 0 on success, -1 on error
+ */
+int json_msgpack_parse_schema(const void *data, size_t length, const JSON_SCHEMA *schema,
+                              void *target, JSON_VALIDATION_RESULT *result);
+
+#endif /* JSON_MSGPACK_H */
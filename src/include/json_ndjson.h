@@ -0,0 +1,173 @@
+/**
+ * NDJSON (JSON Lines)
+ *
+ * Batch reader and writer for newline-delimited JSON records typed by a
+ * JSON_SCHEMA. The reader splits input at newlines, decodes a batch of
+ * records in parallel on its own worker threads, and hands them to the
+ * caller in input order. Input can be one large buffer (an mmap'ed file)
+ * or arbitrary chunks (a streamed HTTP body); only a record split across
+ * chunks is copied.
+ *
+ * The writer serializes records into one large buffer and passes it to a
+ * sink whenever it fills, so output is written in few large writes.
+ */
+
+#ifndef JSON_NDJSON_H
+#define JSON_NDJSON_H
+
+#include "json_parser.h"
+#include <stddef.h>
+
+/* ==================== Reader ==================== */
+
+typedef struct _json_ndjson_reader_ JSON_NDJSON_READER;
+
+/*
+ * Record callbacks, called from the thread that feeds the reader, in input
+ * order. Returning non-zero stops reading and makes feed/finish fail.
+ * record points into the reader's batch and is only valid during the call;
+ * so are its SCHEMA_FLAG_DYNAMIC arrays and maps, which are decoded into
+ * per-thread arenas that are reset after each batch. line is the 1-based
+ * line number in the input.
+ */
+typedef struct {
+    int (*on_record)(void *user_data, void *record, size_t line);
+    int (*on_error)(void *user_data, size_t line, const char *message);    /* NULL: first bad record fails */
+} JSON_NDJSON_CALLBACKS;
+
+/* Reader settings */
+typedef struct {
+    size_t threads;             /* Decoding threads, including the caller (0 = one per CPU) */
+    size_t batch_size;          /* Records decoded per batch */
+    size_t max_record_size;     /* Longest record buffered across feed calls */
+} JSON_NDJSON_CONFIG;
+
+/**
+ * Initialize config with defaults (one thread per CPU, 4096-record batches, 1MB records)
+ * @param config Config to initialize
+ */
+void json_ndjson_config_init(JSON_NDJSON_CONFIG *config);
+
+/**
+ * Create a reader and start its worker threads
+ * @param config Settings (NULL for defaults)
+ * @param schema Schema of every record (compiled here)
+ * @param record_size Size of the struct the schema describes
+ * @param callbacks Record callbacks (copied)
+ * @param user_data User data passed to every callback
+ * @return JSON_NDJSON_READER pointer or NULL on error
+ */
+JSON_NDJSON_READER* json_ndjson_reader_create(const JSON_NDJSON_CONFIG *config,
+                                              const JSON_SCHEMA *schema, size_t record_size,
+                                              const JSON_NDJSON_CALLBACKS *callbacks, void *user_data);
+
+/**
+ * Stop the worker threads and free the reader
+ * @param reader Reader to destroy
+ */
+void json_ndjson_reader_destroy(JSON_NDJSON_READER *reader);
+
+/**
+ * Decode the complete records in the next chunk of input
+ *
+ * Every complete record has been delivered when this returns, so the
+ * chunk may be reused. Larger chunks give larger parallel batches.
+ *
+ * @param reader Reader
+ * @param data Chunk (need not be NUL-terminated)
+ * @param length Chunk length
+ * @return 0 on success, -1 on a bad record, limit or callback abort (sticky until reset)
+ */
+int json_ndjson_reader_feed(JSON_NDJSON_READER *reader, const char *data, size_t length);
+
+/**
+ * Signal end of input, decoding a last record that has no trailing newline
+ * @param reader Reader
+ * @return 0 on success, -1 on error
+ */
+int json_ndjson_reader_finish(JSON_NDJSON_READER *reader);
+
+/**
+ * Reset to read new input, keeping buffers and threads
+ * @param reader Reader
+ */
+void json_ndjson_reader_reset(JSON_NDJSON_READER *reader);
+
+/**
+ * Get the error message after a failure
+ * @param reader Reader
+ * @return Error message, or empty string
+ */
+const char* json_ndjson_reader_error(const JSON_NDJSON_READER *reader);
+
+/**
+ * Get the number of records delivered to on_record
+ * @param reader Reader
+ * @return Record count since create or reset
+ */
+size_t json_ndjson_reader_count(const JSON_NDJSON_READER *reader);
+
+/* ==================== Writer ==================== */
+
+/* Receives a full buffer; returning non-zero fails the write */
+typedef int (*JSON_NDJSON_SINK)(void *user_data, const char *data, size_t length);
+
+/* Output batching */
+typedef struct {
+    JSON_BUILDER *builder;      /* Pending output, one record per line */
+    size_t flush_size;          /* Hand the buffer to the sink once it holds this much */
+    JSON_NDJSON_SINK sink;      /* NULL: keep all output in the builder */
+    void *user_data;
+    size_t records;             /* Records written */
+} JSON_NDJSON_WRITER;
+
+/**
+ * Initialize a writer
+ *
+ * Without a sink, output accumulates in writer->builder, e.g. for
+ * http_response_set_json_builder().
+ *
+ * @param writer Writer to initialize
+ * @param flush_size Buffer size that triggers a flush (0 for 1MB)
+ * @param sink Output callback, or NULL
+ * @param user_data User data passed to the sink
+ * @return 0 on success, -1 on allocation failure
+ */
+int json_ndjson_writer_init(JSON_NDJSON_WRITER *writer, size_t flush_size,
+                            JSON_NDJSON_SINK sink, void *user_data);
+
+/**
+ * Append one record
+ * @param writer Writer
+ * @param record Source struct
+ * @param schema Schema definition
+ * @return 0 on success, -1 on error
+ */
+int json_ndjson_write(JSON_NDJSON_WRITER *writer, const void *record, const JSON_SCHEMA *schema);
+
+/**
+ * Append an array of records
+ * @param writer Writer
+ * @param records First struct
+ * @param count Number of structs
+ * @param record_size Size of each struct
+ * @param schema Schema definition
+ * @return 0 on success, -1 on error
+ */
+int json_ndjson_write_batch(JSON_NDJSON_WRITER *writer, const void *records, size_t count,
+                            size_t record_size, const JSON_SCHEMA *schema);
+
+/**
+ * Pass pending output to the sink (no-op without a sink)
+ * @param writer Writer
+ * @return 0 on success, -1 if the sink failed
+ */
+int json_ndjson_writer_flush(JSON_NDJSON_WRITER *writer);
+
+/**
+ * Free the writer's buffer (flush first to keep pending output)
+ * @param writer Writer
+ */
+void json_ndjson_writer_free(JSON_NDJSON_WRITER *writer);
+
+#endif /* JSON_NDJSON_H */
@@ -0,0 +1,62 @@
+/**
+ * JSON Number Conversion
+ *
+ * Allocation-free conversion between JSON number text and int64/double.
+ * Parsing is correctly rounded: doubles use Clinger's fast path, then the
+ * Eisel-Lemire algorithm, and fall back to strtod only for the rare inputs
+ * those cannot decide. Formatting emits the shortest text that reads back
+ * to the same double (Grisu3, with a strtod-checked fallback for the few
+ * values it cannot prove) and integers through a two-digit table.
+ */
+
+#ifndef JSON_NUMBER_H
+#define JSON_NUMBER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Large enough for any formatted int64 or double, including the terminator */
+#define JSON_NUMBER_BUFFER_SIZE 32
+
+/* Parsed number */
+typedef struct {
+    int is_double;      /* Fraction, exponent, or integer beyond int64 */
+    int64_t integer;    /* Integer value (truncated, saturating, for doubles) */
+    double real;        /* Value as a double */
+} JSON_NUMBER;
+
+/**
+ * Parse a number at the start of text
+ *
+ * Accepts -?[0-9]+(.[0-9]*)?([eE][+-]?[0-9]*)? and stops at the first
+ * character that cannot continue the number.
+ *
+ * @param text Number text (need not be NUL-terminated)
+ * @param length Bytes available
+ * @param number Parsed value
+ * @return Bytes consumed, 0 if text does not start with a number
+ */
+size_t json_number_parse(const char *text, size_t length, JSON_NUMBER *number);
+
+/**
+ * Format an integer
+ * @param value Value to format
+ * @param buffer Output, at least JSON_NUMBER_BUFFER_SIZE bytes (NUL-terminated)
+ * @return Length written, excluding the terminator
+ */
+size_t json_number_format_int64(int64_t value, char *buffer);
+
+/**
+ * Format a double with the fewest digits that read back exactly
+ *
+ * Uses plain notation for decimal exponents in [-6, 21) and scientific
+ * notation otherwise (as JavaScript does). NaN and infinity have no JSON
+ * representation and are written as null.
+ *
+ * @param value Value to format
+ * @param buffer Output, at least JSON_NUMBER_BUFFER_SIZE bytes (NUL-terminated)
+ * @return Length written, excluding the terminator
+ */
+size_t json_number_format_double(double value, char *buffer);
+
+#endif /* JSON_NUMBER_H */
@@ -15,9 +15,17 @@ typedef enum {
     JSON_TYPE_OBJECT
 } JSON_TYPE;
 
+/* JSON value flags */
+#define JSON_VALUE_FLAG_ARENA       0x01   /* Owned by a JSON_ARENA; json_free ignores it */
+#define JSON_VALUE_FLAG_SOURCE      0x02   /* From json_parse_source; remembers its input range */
+#define JSON_VALUE_FLAG_MODIFIED    0x04   /* Edited since parsing (containers) */
+#define JSON_VALUE_FLAG_GROWABLE    0x08   /* Child arrays have spare capacity for edits */
+#define JSON_VALUE_FLAG_INTERNED    0x10   /* Object keys belong to a JSON_INTERN pool */
+
 /* JSON value structure */
 typedef struct _json_value_ {
     JSON_TYPE type;
+    unsigned int flags;
     union {
         int boolean_value;
         int64_t integer_value;
@@ -31,10 +39,13 @@ typedef struct _json_value_ {
             char **keys;
             struct _json_value_ **values;
             size_t count;
+            struct _json_object_index_ *index;  /* Key hash table for large objects, NULL until built */
         } object_value;
     } data;
 } JSON_VALUE;
 
+typedef struct _json_object_index_ JSON_OBJECT_INDEX;
+
 /* Schema field types */
 typedef enum {
     SCHEMA_TYPE_BOOL,
@@ -44,13 +55,18 @@ typedef enum {
     SCHEMA_TYPE_STRING,
     SCHEMA_TYPE_ARRAY,
     SCHEMA_TYPE_OBJECT,
-    SCHEMA_TYPE_CUSTOM
+    SCHEMA_TYPE_CUSTOM,
+    SCHEMA_TYPE_ENUM,              /* JSON string stored as its index in enum_names (an int) */
+    SCHEMA_TYPE_MAP                /* JSON object with arbitrary keys, stored as key/value entries */
 } SCHEMA_TYPE;
 
 /* Schema field flags */
 #define SCHEMA_FLAG_REQUIRED    0x01
 #define SCHEMA_FLAG_NULLABLE    0x02
 #define SCHEMA_FLAG_READONLY    0x04
+#define SCHEMA_FLAG_DYNAMIC     0x08   /* Array/map elements live in a JSON_ARENA (see json_parse_schema_arena) */
+
+struct _json_builder_;
 
 /* Schema field definition */
 typedef struct _json_schema_field_ {
@@ -59,17 +75,32 @@ typedef struct _json_schema_field_ {
     size_t offset;                 /* Offset in target struct */
     size_t max_length;             /* Max length for strings/arrays */
     int flags;                     /* Schema flags */
-    void *default_value;           /* Default value if not present */
+    void *default_value;           /* Stored when the field is absent (a value of the field's type, a string for STRING) */
     struct _json_schema_ *nested;  /* Nested schema for objects */
     int (*validator)(void *value); /* Custom validator function */
+    
+    /* Arrays only */
+    SCHEMA_TYPE element_type;      /* Type of each element (nested schema for objects) */
+    size_t element_size;           /* Bytes between elements */
+    size_t count_offset;           /* Offset of the size_t element count, or SCHEMA_NO_COUNT */
+    
+    /* Enums, maps and custom fields */
+    const char *const *enum_names; /* Names by value, NULL-terminated */
+    size_t value_offset;           /* Maps: offset of the value in each entry (the key is first) */
+    int (*decode)(const char *json, size_t length, void *field);          /* Custom: raw JSON value in */
+    int (*encode)(struct _json_builder_ *builder, const void *field);     /* Custom: one JSON value out */
 } JSON_SCHEMA_FIELD;
 
+/* Array without a count field: elements end at the first all-zero element or at capacity */
+#define SCHEMA_NO_COUNT ((size_t)-1)
+
 /* Schema definition */
 typedef struct _json_schema_ {
     const char *name;
     JSON_SCHEMA_FIELD *fields;
     size_t field_count;
     size_t struct_size;
+    struct _json_compiled_schema_ *compiled;   /* Key lookup table, built on first use */
 } JSON_SCHEMA;
 
 /* Schema validation result */
@@ -77,36 +108,155 @@ typedef struct {
     int valid;
     char error_message[512];
     const char *error_field;
+    size_t error_offset;           /* Byte offset of the error in the input */
 } JSON_VALIDATION_RESULT;
 
 /* Helper macros for schema definition */
 #define JSON_SCHEMA_FIELD_BOOL(struct_type, field_name, flags) \
-    { #field_name, SCHEMA_TYPE_BOOL, offsetof(struct_type, field_name), 0, flags, NULL, NULL, NULL }
+    { #field_name, SCHEMA_TYPE_BOOL, offsetof(struct_type, field_name), 0, flags, NULL, NULL, NULL, 0, 0, 0, NULL, 0, NULL, NULL }
 
 #define JSON_SCHEMA_FIELD_INT(struct_type, field_name, flags) \
-    { #field_name, SCHEMA_TYPE_INT, offsetof(struct_type, field_name), 0, flags, NULL, NULL, NULL }
+    { #field_name, SCHEMA_TYPE_INT, offsetof(struct_type, field_name), 0, flags, NULL, NULL, NULL, 0, 0, 0, NULL, 0, NULL, NULL }
 
 #define JSON_SCHEMA_FIELD_INT64(struct_type, field_name, flags) \
-    { #field_name, SCHEMA_TYPE_INT64, offsetof(struct_type, field_name), 0, flags, NULL, NULL, NULL }
+    { #field_name, SCHEMA_TYPE_INT64, offsetof(struct_type, field_name), 0, flags, NULL, NULL, NULL, 0, 0, 0, NULL, 0, NULL, NULL }
 
 #define JSON_SCHEMA_FIELD_DOUBLE(struct_type, field_name, flags) \
-    { #field_name, SCHEMA_TYPE_DOUBLE, offsetof(struct_type, field_name), 0, flags, NULL, NULL, NULL }
+    { #field_name, SCHEMA_TYPE_DOUBLE, offsetof(struct_type, field_name), 0, flags, NULL, NULL, NULL, 0, 0, 0, NULL, 0, NULL, NULL }
 
 #define JSON_SCHEMA_FIELD_STRING(struct_type, field_name, max_len, flags) \
-    { #field_name, SCHEMA_TYPE_STRING, offsetof(struct_type, field_name), max_len, flags, NULL, NULL, NULL }
+    { #field_name, SCHEMA_TYPE_STRING, offsetof(struct_type, field_name), max_len, flags, NULL, NULL, NULL, 0, 0, 0, NULL, 0, NULL, NULL }
 
 #define JSON_SCHEMA_FIELD_OBJECT(struct_type, field_name, nested_schema, flags) \
-    { #field_name, SCHEMA_TYPE_OBJECT, offsetof(struct_type, field_name), 0, flags, NULL, nested_schema, NULL }
+    { #field_name, SCHEMA_TYPE_OBJECT, offsetof(struct_type, field_name), 0, flags, NULL, nested_schema, NULL, 0, 0, 0, NULL, 0, NULL, NULL }
+
+/*
+ * Arrays are stored inline in the struct, e.g. `int readings[16]` with a
+ * `size_t reading_count` field; capacity and element size come from the
+ * declaration. Strings are `char tags[8][32]`-style rows.
+ */
+#define JSON_SCHEMA_FIELD_ARRAY(struct_type, field_name, element, count_field, flags) \
+    { #field_name, SCHEMA_TYPE_ARRAY, offsetof(struct_type, field_name), \
+      JSON_SCHEMA_CAPACITY(struct_type, field_name), flags, NULL, NULL, NULL, \
+      element, JSON_SCHEMA_ELEMENT_SIZE(struct_type, field_name), offsetof(struct_type, count_field), NULL, 0, NULL, NULL }
+
+#define JSON_SCHEMA_FIELD_OBJECT_ARRAY(struct_type, field_name, nested_schema, count_field, flags) \
+    { #field_name, SCHEMA_TYPE_ARRAY, offsetof(struct_type, field_name), \
+      JSON_SCHEMA_CAPACITY(struct_type, field_name), flags, NULL, nested_schema, NULL, \
+      SCHEMA_TYPE_OBJECT, JSON_SCHEMA_ELEMENT_SIZE(struct_type, field_name), offsetof(struct_type, count_field), NULL, 0, NULL, NULL }
+
+/* Sentinel-terminated: the array ends at its first all-zero element */
+#define JSON_SCHEMA_FIELD_ARRAY_TERMINATED(struct_type, field_name, element, flags) \
+    { #field_name, SCHEMA_TYPE_ARRAY, offsetof(struct_type, field_name), \
+      JSON_SCHEMA_CAPACITY(struct_type, field_name), flags, NULL, NULL, NULL, \
+      element, JSON_SCHEMA_ELEMENT_SIZE(struct_type, field_name), SCHEMA_NO_COUNT, NULL, 0, NULL, NULL }
+
+#define JSON_SCHEMA_FIELD_OBJECT_ARRAY_TERMINATED(struct_type, field_name, nested_schema, flags) \
+    { #field_name, SCHEMA_TYPE_ARRAY, offsetof(struct_type, field_name), \
+      JSON_SCHEMA_CAPACITY(struct_type, field_name), flags, NULL, nested_schema, NULL, \
+      SCHEMA_TYPE_OBJECT, JSON_SCHEMA_ELEMENT_SIZE(struct_type, field_name), SCHEMA_NO_COUNT, NULL, 0, NULL, NULL }
+
+/*
+ * Dynamic arrays are a pointer member, e.g. `int64_t *ids` with a
+ * `size_t id_count`, pointing at elements allocated from the arena given
+ * to json_parse_schema_arena; there is no capacity limit. String elements
+ * are `char *`, also in the arena.
+ */
+#define JSON_SCHEMA_FIELD_DYNAMIC_ARRAY(struct_type, field_name, element, count_field, flags) \
+    { #field_name, SCHEMA_TYPE_ARRAY, offsetof(struct_type, field_name), 0, (flags) | SCHEMA_FLAG_DYNAMIC, \
+      NULL, NULL, NULL, element, JSON_SCHEMA_ELEMENT_SIZE(struct_type, field_name), offsetof(struct_type, count_field), NULL, 0, NULL, NULL }
+
+#define JSON_SCHEMA_FIELD_OBJECT_DYNAMIC_ARRAY(struct_type, field_name, nested_schema, count_field, flags) \
+    { #field_name, SCHEMA_TYPE_ARRAY, offsetof(struct_type, field_name), 0, (flags) | SCHEMA_FLAG_DYNAMIC, \
+      NULL, nested_schema, NULL, SCHEMA_TYPE_OBJECT, JSON_SCHEMA_ELEMENT_SIZE(struct_type, field_name), \
+      offsetof(struct_type, count_field), NULL, 0, NULL, NULL }
+
+/*
+ * Maps decode an object with arbitrary keys into an arena array of
+ * entries, e.g. `LABEL *labels` with a `size_t label_count`, where LABEL
+ * is `{ char *key; int value; }`: the key (a `char *`) must be the
+ * entry's first member. Keys keep their input order; string values are
+ * `char *` as well.
+ */
+#define JSON_SCHEMA_FIELD_MAP(struct_type, field_name, entry_type, value_member, element, count_field, flags) \
+    { #field_name, SCHEMA_TYPE_MAP, offsetof(struct_type, field_name), 0, (flags) | SCHEMA_FLAG_DYNAMIC, \
+      NULL, NULL, NULL, element, sizeof(entry_type), offsetof(struct_type, count_field), \
+      NULL, offsetof(entry_type, value_member), NULL, NULL }
+
+#define JSON_SCHEMA_FIELD_OBJECT_MAP(struct_type, field_name, entry_type, value_member, nested_schema, count_field, flags) \
+    { #field_name, SCHEMA_TYPE_MAP, offsetof(struct_type, field_name), 0, (flags) | SCHEMA_FLAG_DYNAMIC, \
+      NULL, nested_schema, NULL, SCHEMA_TYPE_OBJECT, sizeof(entry_type), offsetof(struct_type, count_field), \
+      NULL, offsetof(entry_type, value_member), NULL, NULL }
+
+/*
+ * Enums map strings to an int (or C enum) member through a lookup table
+ * built when the schema is compiled; names is a NULL-terminated array
+ * indexed by value, e.g. { "pending", "paid", "shipped", NULL }. Unknown
+ * strings are a schema error; values out of range serialize as null.
+ */
+#define JSON_SCHEMA_FIELD_ENUM(struct_type, field_name, names, flags) \
+    { #field_name, SCHEMA_TYPE_ENUM, offsetof(struct_type, field_name), 0, flags, NULL, NULL, NULL, 0, 0, 0, names, 0, NULL, NULL }
+
+#define JSON_SCHEMA_FIELD_ENUM_ARRAY(struct_type, field_name, names, count_field, flags) \
+    { #field_name, SCHEMA_TYPE_ARRAY, offsetof(struct_type, field_name), \
+      JSON_SCHEMA_CAPACITY(struct_type, field_name), flags, NULL, NULL, NULL, \
+      SCHEMA_TYPE_ENUM, JSON_SCHEMA_ELEMENT_SIZE(struct_type, field_name), offsetof(struct_type, count_field), names, 0, NULL, NULL }
+
+/*
+ * Custom fields are decoded by a hook that receives the raw JSON text of
+ * the value (e.g. a timestamp string to parse into a time_t) and returns
+ * 0, or -1 to fail the parse. The encode hook writes one JSON value with
+ * the builder API; NULL hooks skip the value and serialize null.
+ */
+#define JSON_SCHEMA_FIELD_CUSTOM(struct_type, field_name, decode_fn, encode_fn, flags) \
+    { #field_name, SCHEMA_TYPE_CUSTOM, offsetof(struct_type, field_name), 0, flags, NULL, NULL, NULL, \
+      0, 0, 0, NULL, 0, decode_fn, encode_fn }
+
+/*
+ * Defaults are stored when a field is absent (a present null leaves the
+ * field zeroed). Defined at file scope, as JSON_SCHEMA_DEFINE is.
+ */
+#define JSON_SCHEMA_FIELD_BOOL_DEFAULT(struct_type, field_name, value, flags) \
+    { #field_name, SCHEMA_TYPE_BOOL, offsetof(struct_type, field_name), 0, flags, &(int){ value }, NULL, NULL, 0, 0, 0, NULL, 0, NULL, NULL }
+
+#define JSON_SCHEMA_FIELD_INT_DEFAULT(struct_type, field_name, value, flags) \
+    { #field_name, SCHEMA_TYPE_INT, offsetof(struct_type, field_name), 0, flags, &(int){ value }, NULL, NULL, 0, 0, 0, NULL, 0, NULL, NULL }
+
+#define JSON_SCHEMA_FIELD_INT64_DEFAULT(struct_type, field_name, value, flags) \
+    { #field_name, SCHEMA_TYPE_INT64, offsetof(struct_type, field_name), 0, flags, &(int64_t){ value }, \
+      NULL, NULL, 0, 0, 0, NULL, 0, NULL, NULL }
+
+#define JSON_SCHEMA_FIELD_DOUBLE_DEFAULT(struct_type, field_name, value, flags) \
+    { #field_name, SCHEMA_TYPE_DOUBLE, offsetof(struct_type, field_name), 0, flags, &(double){ value }, \
+      NULL, NULL, 0, 0, 0, NULL, 0, NULL, NULL }
+
+#define JSON_SCHEMA_FIELD_STRING_DEFAULT(struct_type, field_name, max_len, value, flags) \
+    { #field_name, SCHEMA_TYPE_STRING, offsetof(struct_type, field_name), max_len, flags, (void*)(value), \
+      NULL, NULL, 0, 0, 0, NULL, 0, NULL, NULL }
+
+#define JSON_SCHEMA_FIELD_ENUM_DEFAULT(struct_type, field_name, names, value, flags) \
+    { #field_name, SCHEMA_TYPE_ENUM, offsetof(struct_type, field_name), 0, flags, &(int){ value }, \
+      NULL, NULL, 0, 0, 0, names, 0, NULL, NULL }
+
+#define JSON_SCHEMA_ELEMENT_SIZE(struct_type, field_name) sizeof(((struct_type*)0)->field_name[0])
+#define JSON_SCHEMA_CAPACITY(struct_type, field_name) \
+    (sizeof(((struct_type*)0)->field_name) / JSON_SCHEMA_ELEMENT_SIZE(struct_type, field_name))
 
 #define JSON_SCHEMA_DEFINE(schema_name, struct_type, ...) \
     static JSON_SCHEMA_FIELD schema_name##_fields[] = { __VA_ARGS__ }; \
     static JSON_SCHEMA schema_name = { \
-        #schema_name, \
-        schema_name##_fields, \
-        sizeof(schema_name##_fields) / sizeof(JSON_SCHEMA_FIELD), \
-        sizeof(struct_type) \
+        .name = #schema_name, \
+        .fields = schema_name##_fields, \
+        .field_count = sizeof(schema_name##_fields) / sizeof(JSON_SCHEMA_FIELD), \
+        .struct_size = sizeof(struct_type) \
     }
 
+/* Bump allocator backing arena-parsed documents */
+typedef struct _json_arena_ JSON_ARENA;
+
+/* Shared table of canonical object keys */
+typedef struct _json_intern_ JSON_INTERN;
+
 /* JSON Parser API */
 
 /**
@@ -116,6 +266,144 @@ typedef struct {
  */
 JSON_VALUE* json_parse(const char *json_string);
 
+/**
+ * Parse JSON text into a tree allocated from an arena
+ * 
+ * Nodes, strings and child arrays are bump-allocated from the arena, so a
+ * document costs no per-node allocations and is released all at once by
+ * json_arena_reset (json_free is a no-op on these values). The input does
+ * not need to be NUL-terminated.
+ * 
+ * @param json JSON text
+ * @param length Length of the text in bytes
+ * @param arena Arena to allocate from
+ * @return JSON_VALUE pointer or NULL on error
+ */
+JSON_VALUE* json_parse_arena(const char *json, size_t length, JSON_ARENA *arena);
+
+/**
+ * Parse JSON text into a heap tree that remembers where each value came from
+ * 
+ * Every node records its range of the input, so json_write_patch can copy
+ * the parts of an edited document that did not change. The input must stay
+ * valid and unchanged for as long as the tree is written from.
+ * 
+ * @param json JSON text (need not be NUL-terminated)
+ * @param length Length of the text in bytes
+ * @return JSON_VALUE pointer or NULL on error
+ */
+JSON_VALUE* json_parse_source(const char *json, size_t length);
+
+/**
+ * Parse JSON text into a heap tree whose object keys come from a pool
+ * 
+ * Keys up to 64 bytes are looked up in the pool (and added while it has
+ * room) instead of being copied, so documents that repeat the same keys
+ * allocate only their values. Keys of one parsed document compare equal
+ * exactly when their pointers do. json_free leaves the keys to the pool,
+ * so free every tree before destroying it. The input does not need to be
+ * NUL-terminated.
+ * 
+ * @param json JSON text
+ * @param length Length of the text in bytes
+ * @param pool Key pool, which may be shared by concurrent parsers
+ * @return JSON_VALUE pointer or NULL on error
+ */
+JSON_VALUE* json_parse_interned(const char *json, size_t length, JSON_INTERN *pool);
+
+/**
+ * Create a key pool
+ * 
+ * Lookups are lock-free and inserts use compare-and-swap, so any number of
+ * threads can parse through one pool. Once max_keys keys are stored new
+ * keys are copied per document instead, which bounds the pool against
+ * input with endless distinct keys.
+ * 
+ * @param max_keys Most keys kept (0 for 4096)
+ * @return JSON_INTERN pointer or NULL on error
+ */
+JSON_INTERN* json_intern_create(size_t max_keys);
+
+/**
+ * Free a pool and its keys (no tree parsed through it may be used afterwards)
+ * @param pool Pool to destroy
+ */
+void json_intern_destroy(JSON_INTERN *pool);
+
+/**
+ * Get the canonical pointer of a key, adding it if the pool has room
+ * @param pool Key pool
+ * @param str Key text (need not be NUL-terminated, must not contain NUL)
+ * @param length Key length
+ * @return Canonical NUL-terminated key, or NULL if the pool is full
+ */
+const char* json_intern(JSON_INTERN *pool, const char *str, size_t length);
+
+/**
+ * Get the number of keys in a pool
+ * @param pool Key pool
+ * @return Keys stored
+ */
+size_t json_intern_count(const JSON_INTERN *pool);
+
+/**
+ * Reject strings that are not well-formed UTF-8 (off by default)
+ *
+ * Escapes are always decoded to UTF-8 and raw control characters always
+ * rejected; this adds a check of the bytes themselves to every parser in
+ * this file. Set once at startup.
+ *
+ * @param enabled 1 to validate, 0 to pass bytes through
+ */
+void json_set_strict_utf8(int enabled);
+
+/**
+ * Check that text is well-formed UTF-8 (no overlong forms, surrogates or
+ * code points beyond U+10FFFF)
+ * @param text Text to check
+ * @param length Length in bytes
+ * @return 1 if valid, 0 otherwise
+ */
+int json_utf8_valid(const char *text, size_t length);
+
+/**
+ * Create an arena
+ * @param block_size Size of each memory block (0 = 64KB)
+ * @return JSON_ARENA pointer or NULL on error
+ */
+JSON_ARENA* json_arena_create(size_t block_size);
+
+/**
+ * Release everything allocated from the arena, keeping its memory for reuse
+ * 
+ * Blocks are coalesced into one so that a document of the same size fits
+ * without further allocation.
+ * 
+ * @param arena Arena to reset
+ */
+void json_arena_reset(JSON_ARENA *arena);
+
+/**
+ * Destroy an arena and all values allocated from it
+ * @param arena Arena to destroy
+ */
+void json_arena_destroy(JSON_ARENA *arena);
+
+/**
+ * Allocate uninitialized memory from an arena (8-byte aligned)
+ * @param arena Arena to allocate from
+ * @param size Number of bytes
+ * @return Pointer valid until the next reset, or NULL on error
+ */
+void* json_arena_alloc(JSON_ARENA *arena, size_t size);
+
+/**
+ * Get the number of bytes currently allocated from an arena
+ * @param arena Arena
+ * @return Bytes in use
+ */
+size_t json_arena_used(const JSON_ARENA *arena);
+
 /**
  * Parse JSON string directly into struct using schema
  * @param json_string JSON string to parse
@@ -125,6 +413,98 @@ JSON_VALUE* json_parse(const char *json_string);
  */
 int json_parse_with_schema(const char *json_string, const JSON_SCHEMA *schema, void *target);
 
+/**
+ * Parse a JSON buffer directly into a struct using schema
+ * 
+ * The text is tokenized once and each key is looked up in the schema's
+ * hash table; values are written straight into target and unknown
+ * members are skipped without allocating. No JSON_VALUE tree is built.
+ * The buffer does not need to be NUL-terminated.
+ * 
+ * @param json JSON text
+ * @param length Length of the text in bytes
+ * @param schema Schema definition
+ * @param target Target struct to populate
+ * @param result Validation result (may be NULL)
+ * @return 0 on success, -1 on failure
+ */
+int json_parse_schema_buffer(const char *json, size_t length, const JSON_SCHEMA *schema,
+                             void *target, JSON_VALIDATION_RESULT *result);
+
+/**
+ * Parse a JSON buffer into a struct whose dynamic arrays and maps are
+ * allocated from an arena
+ * 
+ * Same fast path as json_parse_schema_buffer; elements of
+ * SCHEMA_FLAG_DYNAMIC fields (and their strings) are bump-allocated and
+ * stay valid until json_arena_reset. Without an arena such fields fail
+ * the parse.
+ * 
+ * @param json JSON text (need not be NUL-terminated)
+ * @param length Length of the text in bytes
+ * @param schema Schema definition
+ * @param target Target struct to populate
+ * @param arena Arena for dynamic arrays and maps
+ * @param result Validation result (may be NULL)
+ * @return 0 on success, -1 on failure
+ */
+int json_parse_schema_arena(const char *json, size_t length, const JSON_SCHEMA *schema,
+                            void *target, JSON_ARENA *arena, JSON_VALIDATION_RESULT *result);
+
+/**
+ * Build a schema's key lookup tables ahead of time (including nested schemas)
+ * 
+ * Optional: tables are otherwise built on first use. Safe to call from
+ * several threads; the tables live as long as the process.
+ * 
+ * @param schema Schema definition
+ * @return 0 on success, -1 on failure
+ */
+int json_schema_compile(const JSON_SCHEMA *schema);
+
+/**
+ * Find a field by name through the schema's lookup table
+ * @param schema Schema definition
+ * @param name Field name (need not be NUL-terminated)
+ * @param length Name length
+ * @return Field index, or -1 if there is no such field
+ */
+int json_schema_find_field(const JSON_SCHEMA *schema, const char *name, size_t length);
+
+/**
+ * Find an enum value by name through the schema's lookup table
+ * @param schema Schema definition
+ * @param field Index of an enum field (or an array/map of enums)
+ * @param name Enum string (need not be NUL-terminated)
+ * @param length Name length
+ * @return Enum value, or -1 if the name is unknown
+ */
+int json_schema_find_enum(const JSON_SCHEMA *schema, size_t field, const char *name, size_t length);
+
+/**
+ * Check a document without decoding it, e.g. to gate a body that is
+ * forwarded verbatim
+ *
+ * Checks the full syntax, including escapes, raw control characters,
+ * trailing data and (with json_set_strict_utf8) UTF-8, with nesting
+ * limited to 1024 levels. With a schema the top level must be an object
+ * whose required fields are present and whose known fields have the
+ * schema's types: integers in range for INT/INT64, strings that fit
+ * max_length, arrays within capacity, nested objects recursively; null
+ * only where SCHEMA_FLAG_NULLABLE is set. This is stricter than parsing,
+ * which truncates or zeroes such values. Field validators are not run.
+ *
+ * Nothing is allocated and no tree is built (compile the schema once
+ * with json_schema_compile to keep the first call allocation-free too).
+ *
+ * @param json JSON text (need not be NUL-terminated)
+ * @param length Length of the text in bytes
+ * @param schema Schema definition, or NULL to check syntax only
+ * @param result Validation result with error_offset (may be NULL)
+ * @return 0 if valid, -1 otherwise
+ */
+int json_validate(const char *json, size_t length, const JSON_SCHEMA *schema, JSON_VALIDATION_RESULT *result);
+
 /**
  * Parse JSON string with validation
  * @param json_string JSON string to parse
@@ -138,23 +518,268 @@ int json_parse_and_validate(const char *json_string, const JSON_SCHEMA *schema,
 
 /**
  * Serialize struct to JSON string using schema
+ *
+ * Field names are quoted once when the schema is compiled; strings are
+ * escaped, nested objects and arrays are written recursively.
+ *
  * @param source Source struct
  * @param schema Schema definition
  * @param buffer Output buffer
  * @param buffer_size Size of output buffer
- * @return Number of bytes written, or -1 on error
+ * @return Number of bytes written (NUL-terminated), or -1 on error or if it does not fit
  */
 int json_serialize(const void *source, const JSON_SCHEMA *schema, 
                    char *buffer, size_t buffer_size);
 
+/* Output buffer for the builder API below */
+typedef struct _json_builder_ JSON_BUILDER;
+
 /**
- * Get value from JSON object by key path (e.g., "user.address.city")
+ * Serialize struct into a builder, growing its buffer as needed
+ *
+ * Inside an open builder array this appends one element, so a list of
+ * structs can be written between json_builder_start_array/end_array.
+ *
+ * @param source Source struct
+ * @param schema Schema definition
+ * @param builder Builder to append to
+ * @return 0 on success, -1 on error
+ */
+int json_serialize_builder(const void *source, const JSON_SCHEMA *schema, JSON_BUILDER *builder);
+
+/**
+ * Get value from JSON object by key path (e.g., "user.address.city", "items[2].sku")
+ *
+ * Objects with many keys are looked up through a hash index. A heap tree
+ * builds it on the first lookup in each such object, so threads sharing
+ * one heap tree must serialize lookups; arena trees are indexed while
+ * parsing and are read-only here.
+ *
  * @param value JSON object
- * @param path Dot-separated path
- * @return JSON_VALUE pointer or NULL if not found
+ * @param path Dot-separated non-empty keys with [n] array indices
+ * @return JSON_VALUE pointer or NULL if not found or the path is malformed
  */
 JSON_VALUE* json_get_path(JSON_VALUE *value, const char *path);
 
+/**
+ * Look up an object member by canonical key, comparing pointers only
+ * 
+ * For objects from json_parse_interned, key must come from json_intern on
+ * the same pool (look it up once, e.g. at startup); other objects fall
+ * back to a string lookup.
+ * 
+ * @param object JSON object
+ * @param key Canonical key
+ * @return JSON_VALUE pointer or NULL if not found
+ */
+JSON_VALUE* json_object_get_interned(JSON_VALUE *object, const char *key);
+
+/* Path parsed once for repeated lookups */
+typedef struct _json_path_ JSON_PATH;
+
+/**
+ * Compile a path (same syntax as json_get_path)
+ * @param path Path text, copied
+ * @return JSON_PATH pointer, or NULL on an empty key, a leading or
+ *         trailing '.', or an empty or non-numeric index
+ */
+JSON_PATH* json_path_compile(const char *path);
+
+/**
+ * Free a compiled path
+ * @param path Path to free
+ */
+void json_path_free(JSON_PATH *path);
+
+/**
+ * Look up a compiled path without allocating
+ * @param path Compiled path
+ * @param value JSON value to search from
+ * @return JSON_VALUE pointer or NULL if not found
+ */
+JSON_VALUE* json_path_get(const JSON_PATH *path, JSON_VALUE *value);
+
+/* Lazy (on-demand) access */
+
+/* Document indexed for on-demand access; values are decoded only when read */
+typedef struct _json_doc_ JSON_DOC;
+
+/* Position of one value in a JSON_DOC; plain data, copy freely */
+typedef struct {
+    const JSON_DOC *doc;
+    size_t entry;           /* Structural index entry where the value starts */
+    size_t key_entry;       /* Entry of the member's key; (size_t)-1 outside objects */
+} JSON_CURSOR;
+
+/**
+ * Open a document for on-demand access
+ * 
+ * Builds the structural index and pairs up brackets, so any container can
+ * be skipped in one step. Nothing else is decoded; only values that are
+ * read are checked, so errors in untouched parts go unnoticed. The text
+ * must stay alive and unmodified while the document is in use and need
+ * not be NUL-terminated.
+ * 
+ * @param json JSON text
+ * @param length Length of the text in bytes
+ * @return JSON_DOC pointer, or NULL on unbalanced brackets, unterminated strings or error
+ */
+JSON_DOC* json_doc_open(const char *json, size_t length);
+
+/**
+ * Point an open document at new text, reusing its memory
+ * @param doc Document
+ * @param json JSON text
+ * @param length Length of the text in bytes
+ * @return 0 on success, -1 on failure (the document is then empty)
+ */
+int json_doc_reopen(JSON_DOC *doc, const char *json, size_t length);
+
+/**
+ * Close a document; cursors into it become invalid
+ * @param doc Document
+ */
+void json_doc_close(JSON_DOC *doc);
+
+/**
+ * Get a cursor on the document's top-level value
+ * @param doc Document
+ * @param cursor Cursor to set
+ * @return 0 on success, -1 if the document is empty
+ */
+int json_doc_root(const JSON_DOC *doc, JSON_CURSOR *cursor);
+
+/**
+ * Find a value by key path (e.g., "user.address.city", "items[2].sku") without decoding anything else
+ * @param doc Document
+ * @param path Dot-separated keys with [n] array indices
+ * @param cursor Cursor to set
+ * @return 0 if found, -1 otherwise
+ */
+int json_doc_get_path(const JSON_DOC *doc, const char *path, JSON_CURSOR *cursor);
+
+/**
+ * Find a value by compiled path
+ * @param path Compiled path
+ * @param doc Document
+ * @param cursor Cursor to set
+ * @return 0 if found, -1 otherwise
+ */
+int json_path_get_doc(const JSON_PATH *path, const JSON_DOC *doc, JSON_CURSOR *cursor);
+
+/**
+ * Get the type of the value under a cursor
+ * @param cursor Cursor
+ * @param type Receives the type
+ * @return 0 on success, -1 if the value is malformed
+ */
+int json_cursor_type(const JSON_CURSOR *cursor, JSON_TYPE *type);
+
+/**
+ * Find a member of an object; other members' values are skipped undecoded
+ * @param object Cursor on an object
+ * @param key Member name
+ * @param value Cursor to set (may be the same as object)
+ * @return 0 if found, -1 otherwise
+ */
+int json_cursor_find_field(const JSON_CURSOR *object, const char *key, JSON_CURSOR *value);
+
+/**
+ * Same as json_cursor_find_field for a key that is not NUL-terminated
+ */
+int json_cursor_find_field_n(const JSON_CURSOR *object, const char *key, size_t key_length,
+                             JSON_CURSOR *value);
+
+/**
+ * Get the first element of an array or member of an object
+ * @param container Cursor on an array or object
+ * @param child Cursor to set
+ * @return 0 on success, -1 if empty or not a container
+ */
+int json_cursor_first(const JSON_CURSOR *container, JSON_CURSOR *child);
+
+/**
+ * Advance to the next element or member of the same container
+ * @param cursor Cursor from json_cursor_first
+ * @return 0 on success, -1 at the end
+ */
+int json_cursor_next(JSON_CURSOR *cursor);
+
+/**
+ * Get an array element by position
+ * @param array Cursor on an array
+ * @param index Zero-based element index
+ * @param element Cursor to set
+ * @return 0 on success, -1 if out of range or not an array
+ */
+int json_cursor_get_index(const JSON_CURSOR *array, size_t index, JSON_CURSOR *element);
+
+/**
+ * Get the key of an object member, escapes not decoded
+ * @param member Cursor from iterating an object or json_cursor_find_field
+ * @param raw Receives a pointer into the document text
+ * @param raw_length Receives the key length
+ * @return 0 on success, -1 if the cursor is not on a member
+ */
+int json_cursor_get_key(const JSON_CURSOR *member, const char **raw, size_t *raw_length);
+
+/**
+ * Read a number as int64 (doubles are truncated)
+ * @param cursor Cursor
+ * @param value Receives the value
+ * @return 0 on success, -1 if not a number
+ */
+int json_cursor_get_int64(const JSON_CURSOR *cursor, int64_t *value);
+
+/**
+ * Read a number as double
+ * @param cursor Cursor
+ * @param value Receives the value
+ * @return 0 on success, -1 if not a number
+ */
+int json_cursor_get_double(const JSON_CURSOR *cursor, double *value);
+
+/**
+ * Read a boolean
+ * @param cursor Cursor
+ * @param value Receives 1 or 0
+ * @return 0 on success, -1 if not a boolean
+ */
+int json_cursor_get_bool(const JSON_CURSOR *cursor, int *value);
+
+/**
+ * Check for null
+ * @param cursor Cursor
+ * @return 1 if the value is null, 0 otherwise
+ */
+int json_cursor_is_null(const JSON_CURSOR *cursor);
+
+/**
+ * Copy a string, decoding escapes and truncating to buffer_size - 1 bytes
+ * without splitting a UTF-8 character
+ * @param cursor Cursor
+ * @param buffer Output buffer (always NUL-terminated)
+ * @param buffer_size Size of output buffer
+ * @return Number of bytes written, or -1 if not a valid string
+ */
+int json_cursor_get_string(const JSON_CURSOR *cursor, char *buffer, size_t buffer_size);
+
+/**
+ * Get a string's bytes in place, escapes not decoded
+ * @param cursor Cursor
+ * @param raw Receives a pointer into the document text
+ * @param raw_length Receives the length
+ * @return 0 on success, -1 if not a string
+ */
+int json_cursor_get_raw_string(const JSON_CURSOR *cursor, const char **raw, size_t *raw_length);
+
+/**
+ * Fully parse the value under a cursor into a heap JSON_VALUE tree
+ * @param cursor Cursor
+ * @return JSON_VALUE pointer (free with json_free) or NULL on error
+ */
+JSON_VALUE* json_cursor_to_value(const JSON_CURSOR *cursor);
+
 /**
  * Get string value from JSON object
  * @param value JSON value
@@ -192,31 +817,154 @@ double json_get_double(JSON_VALUE *value, double default_val);
  */
 void json_free(JSON_VALUE *value);
 
+/*
+ * Editing. Heap trees (json_parse, json_parse_source, json_create_*) can be
+ * changed in place; arena trees are read-only. Containers take ownership of
+ * the values added to them and free the ones they replace or remove.
+ */
+
+/**
+ * Create a detached value, to be added to a tree or freed with json_free
+ * @return JSON_VALUE pointer or NULL on allocation failure
+ */
+JSON_VALUE* json_create_null(void);
+JSON_VALUE* json_create_bool(int value);
+JSON_VALUE* json_create_integer(int64_t value);
+JSON_VALUE* json_create_double(double value);
+JSON_VALUE* json_create_string(const char *value);     /* Copies value */
+JSON_VALUE* json_create_array(void);
+JSON_VALUE* json_create_object(void);
+
+/**
+ * Set an object member, replacing (and freeing) the value of an existing key
+ * @param object Object to change
+ * @param key Member key (copied)
+ * @param value Value to store; owned by the object on success, still the caller's on failure
+ * @return 0 on success, -1 on error
+ */
+int json_object_set(JSON_VALUE *object, const char *key, JSON_VALUE *value);
+
 /**
- * Create JSON string builder
+ * Append an element to an array (amortized constant time)
+ * @param array Array to change
+ * @param value Element; owned by the array on success, still the caller's on failure
+ * @return 0 on success, -1 on error
+ */
+int json_array_append(JSON_VALUE *array, JSON_VALUE *value);
+
+/**
+ * Insert an element before position index (index == count appends)
+ * @param array Array to change
+ * @param index Position of the new element
+ * @param value Element; owned by the array on success, still the caller's on failure
+ * @return 0 on success, -1 on error
+ */
+int json_array_insert(JSON_VALUE *array, size_t index, JSON_VALUE *value);
+
+/**
+ * Remove and free the value at a path ("user.tags[2]")
+ * @param value Root value
+ * @param path Path to the member or element to remove
+ * @return 0 on success, -1 if the path does not exist or the tree is read-only
+ */
+int json_remove(JSON_VALUE *value, const char *path);
+
+/**
+ * Serialize a tree as compact JSON into a caller buffer
+ * @param value Value to write
  * @param buffer Output buffer
- * @param buffer_size Buffer size
- * @return 0 on success
+ * @param buffer_size Size of the buffer
+ * @return Length written (excluding the terminator), or -1 if it does not fit
  */
-typedef struct {
+int json_write(const JSON_VALUE *value, char *buffer, size_t buffer_size);
+
+/**
+ * Serialize a tree as compact JSON into a builder (as an element inside an open container)
+ * @param value Value to write
+ * @param builder Builder to append to
+ * @return 0 on success, -1 on error
+ */
+int json_write_builder(const JSON_VALUE *value, JSON_BUILDER *builder);
+
+/**
+ * Serialize a tree from json_parse_source, copying every value that was not
+ * edited verbatim from the input (formatting included) and writing only
+ * edited containers and new values. An unedited document is reproduced
+ * byte for byte, apart from whitespace before and after the root value.
+ * @param value Value to write (edited containers are marked along the way)
+ * @param builder Builder to append to
+ * @return 0 on success, -1 on error
+ */
+int json_write_patch(JSON_VALUE *value, JSON_BUILDER *builder);
+
+/*
+ * JSON builder: values are formatted and escaped straight into one growable
+ * buffer. Each value is followed by ',' and closing a container drops the
+ * last one, so nested containers need no separator bookkeeping by callers.
+ * Hand the result to a response with http_response_set_json_builder() to
+ * skip the final copy.
+ */
+struct _json_builder_ {
     char *buffer;
     size_t size;
     size_t position;
-    int error;
-} JSON_BUILDER;
+    size_t depth;               /* Open containers */
+    int error;                  /* Allocation failed or fixed buffer full; output is discarded */
+    int fixed;                  /* Caller-owned buffer, never reallocated */
+};
 
+/**
+ * Create a JSON builder
+ * @param initial_size Initial buffer capacity (grows as needed)
+ * @return JSON_BUILDER pointer or NULL on error
+ */
 JSON_BUILDER* json_builder_create(size_t initial_size);
 void json_builder_destroy(JSON_BUILDER *builder);
+
+/**
+ * Initialize a builder over a caller-owned buffer (no json_builder_destroy)
+ *
+ * Output that does not fit sets error instead of growing the buffer.
+ *
+ * @param builder Builder to initialize
+ * @param buffer Output buffer
+ * @param size Buffer size (at least 1)
+ */
+void json_builder_init_fixed(JSON_BUILDER *builder, char *buffer, size_t size);
+
+/**
+ * Discard the output, keeping the buffer for the next document
+ * @param builder Builder to reset
+ */
+void json_builder_reset(JSON_BUILDER *builder);
+
 void json_builder_start_object(JSON_BUILDER *builder);
 void json_builder_end_object(JSON_BUILDER *builder);
 void json_builder_start_array(JSON_BUILDER *builder);
 void json_builder_end_array(JSON_BUILDER *builder);
+
+/**
+ * Write an object key for a following start_object or start_array
+ * @param builder Builder
+ * @param key Member name (escaped as needed)
+ */
+void json_builder_add_key(JSON_BUILDER *builder, const char *key);
+
+/* Keys and string values are escaped; key is NULL for array elements */
 void json_builder_add_string(JSON_BUILDER *builder, const char *key, const char *value);
 void json_builder_add_int(JSON_BUILDER *builder, const char *key, int value);
 void json_builder_add_int64(JSON_BUILDER *builder, const char *key, int64_t value);
 void json_builder_add_double(JSON_BUILDER *builder, const char *key, double value);
 void json_builder_add_bool(JSON_BUILDER *builder, const char *key, int value);
 void json_builder_add_null(JSON_BUILDER *builder, const char *key);
+
+/**
+ * Append text as is, e.g. an already encoded value or a record separator
+ * @param builder Builder
+ * @param text Text to append (not escaped)
+ * @param length Text length
+ */
+void json_builder_add_raw(JSON_BUILDER *builder, const char *text, size_t length);
 const char* json_builder_get_string(JSON_BUILDER *builder);
 
 #endif /* JSON_PARSER_H */
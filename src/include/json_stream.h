@@ -0,0 +1,104 @@
+/**
+ * Streaming JSON Parser
+ *
+ * Push (SAX-style) parser: feed the text in chunks of any size, e.g. as
+ * they arrive from recv(), and callbacks fire for each token. Parser
+ * state survives chunk boundaries, so a token may be split anywhere.
+ * Memory is bounded by the nesting depth and the longest string or
+ * number, never by the size of the document.
+ */
+
+#ifndef JSON_STREAM_H
+#define JSON_STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct _json_stream_ JSON_STREAM;
+
+/*
+ * Token callbacks; any may be NULL. Returning non-zero stops parsing and
+ * makes json_stream_feed fail. Strings and keys have escapes decoded and
+ * are not NUL-terminated; the pointer is only valid during the call.
+ */
+typedef struct {
+    int (*on_start_object)(void *user_data);
+    int (*on_end_object)(void *user_data);
+    int (*on_start_array)(void *user_data);
+    int (*on_end_array)(void *user_data);
+    int (*on_key)(void *user_data, const char *key, size_t length);
+    int (*on_string)(void *user_data, const char *value, size_t length);
+    int (*on_integer)(void *user_data, int64_t value);
+    int (*on_double)(void *user_data, double value);    /* Also integers beyond int64 */
+    int (*on_bool)(void *user_data, int value);
+    int (*on_null)(void *user_data);
+    int (*on_document_end)(void *user_data);           /* A top-level value is complete */
+} JSON_STREAM_CALLBACKS;
+
+/* Stream limits */
+typedef struct {
+    size_t max_depth;           /* Deepest nesting accepted */
+    size_t max_token_size;      /* Longest string or number buffered across chunks */
+    int multiple_values;        /* Accept a sequence of top-level values (NDJSON) */
+    int validate_utf8;          /* Reject strings and keys that are not well-formed UTF-8 */
+} JSON_STREAM_CONFIG;
+
+/**
+ * Initialize config with defaults (depth 1024, 1MB tokens, single value, no UTF-8 check)
+ * @param config Config to initialize
+ */
+void json_stream_config_init(JSON_STREAM_CONFIG *config);
+
+/**
+ * Create a streaming parser
+ * @param config Limits (NULL for defaults)
+ * @param callbacks Token callbacks (copied)
+ * @param user_data User data passed to every callback
+ * @return JSON_STREAM pointer or NULL on error
+ */
+JSON_STREAM* json_stream_create(const JSON_STREAM_CONFIG *config,
+                                const JSON_STREAM_CALLBACKS *callbacks, void *user_data);
+
+/**
+ * Destroy a streaming parser
+ * @param stream Parser to destroy
+ */
+void json_stream_destroy(JSON_STREAM *stream);
+
+/**
+ * Parse the next chunk of text
+ * @param stream Parser
+ * @param data Chunk (need not be NUL-terminated)
+ * @param length Chunk length
+ * @return 0 on success, -1 on syntax error, limit or callback abort (sticky until reset)
+ */
+int json_stream_feed(JSON_STREAM *stream, const char *data, size_t length);
+
+/**
+ * Signal end of input, completing a trailing top-level number
+ * @param stream Parser
+ * @return 0 if the input formed complete value(s), -1 otherwise
+ */
+int json_stream_finish(JSON_STREAM *stream);
+
+/**
+ * Reset to parse a new document, keeping buffers
+ * @param stream Parser
+ */
+void json_stream_reset(JSON_STREAM *stream);
+
+/**
+ * Get the error message after a failure
+ * @param stream Parser
+ * @return Error message, or empty string
+ */
+const char* json_stream_error(const JSON_STREAM *stream);
+
+/**
+ * Get the number of bytes consumed; after an error, the offset of the offending byte
+ * @param stream Parser
+ * @return Byte offset from the start of the input
+ */
+size_t json_stream_offset(const JSON_STREAM *stream);
+
+#endif /* JSON_STREAM_H */
@@ -9,6 +9,7 @@ typedef struct _application_ APPLICATION;
 typedef struct _kafka_client_ KAFKA_CLIENT;
 typedef struct _kafka_consumer_ KAFKA_CONSUMER;
 typedef struct _kafka_producer_ KAFKA_PRODUCER;
+typedef struct _event_loop_ EVENT_LOOP;
 
 /* Kafka message structure */
 typedef struct _kafka_message_ {
@@ -102,6 +103,9 @@ struct _kafka_client_ {
     /* Producer */
     KAFKA_PRODUCER *producer;
     
+    /* Event loop that runs the consumers (NULL: one thread per consumer) */
+    EVENT_LOOP *loop;
+    
     int running;
 };
 
@@ -135,6 +139,19 @@ int kafka_client_start(KAFKA_CLIENT *client);
  */
 int kafka_client_stop(KAFKA_CLIENT *client);
 
+/**
+ * Run consumers on an event loop instead of their own threads
+ *
+ * Call before kafka_client_start(). Each consumer queue signals an eventfd
+ * watched by the loop, and handlers run on the loop thread, so they never
+ * run concurrently with each other or with other handlers on that loop.
+ *
+ * @param client The Kafka client (not running)
+ * @param loop Event loop (NULL: back to one thread per consumer)
+ * @return 0 on success, error code on failure
+ */
+int kafka_client_set_event_loop(KAFKA_CLIENT *client, EVENT_LOOP *loop);
+
 /* ============================================================================
  * Kafka Consumer Functions
  * ========================================================================== */
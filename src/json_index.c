@@ -0,0 +1,287 @@
+#include "json_index.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define JSON_INDEX_X86 1
+#endif
+
+#define BLOCK_SIZE 64
+
+/* Character classes of one 64-byte block, one bit per byte */
+typedef struct {
+    uint64_t quote;
+    uint64_t backslash;
+    uint64_t op;            /* { } [ ] : , */
+    uint64_t whitespace;
+} BLOCK_MASKS;
+
+typedef void (*CLASSIFY_FN)(const char *block, BLOCK_MASKS *masks);
+
+/* ==================== Classification ==================== */
+
+enum {
+    CLASS_QUOTE = 1,
+    CLASS_BACKSLASH = 2,
+    CLASS_OP = 4,
+    CLASS_WHITESPACE = 8
+};
+
+static unsigned char g_char_class[256];
+static int g_char_class_ready = 0;
+
+static void classify_scalar(const char *block, BLOCK_MASKS *masks)
+{
+    uint64_t quote = 0, backslash = 0, op = 0, whitespace = 0;
+    
+    for (int i = 0; i < BLOCK_SIZE; i++) {
+        unsigned char c = g_char_class[(unsigned char)block[i]];
+        uint64_t bit = (uint64_t)1 << i;
+        if (c & CLASS_QUOTE) quote |= bit;
+        if (c & CLASS_BACKSLASH) backslash |= bit;
+        if (c & CLASS_OP) op |= bit;
+        if (c & CLASS_WHITESPACE) whitespace |= bit;
+    }
+    
+    masks->quote = quote;
+    masks->backslash = backslash;
+    masks->op = op;
+    masks->whitespace = whitespace;
+}
+
+#ifdef JSON_INDEX_X86
+
+static void classify_sse2(const char *block, BLOCK_MASKS *masks)
+{
+    uint64_t quote = 0, backslash = 0, op = 0, whitespace = 0;
+    
+    for (int i = 0; i < BLOCK_SIZE; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(block + i));
+        
+        uint64_t q = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+        uint64_t b = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+        uint64_t o = (uint32_t)_mm_movemask_epi8(_mm_or_si128(
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('{')), _mm_cmpeq_epi8(v, _mm_set1_epi8('}'))),
+                         _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('[')), _mm_cmpeq_epi8(v, _mm_set1_epi8(']')))),
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(':')), _mm_cmpeq_epi8(v, _mm_set1_epi8(',')))));
+        uint64_t w = (uint32_t)_mm_movemask_epi8(_mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))),
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\t')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')))));
+        
+        quote |= q << i;
+        backslash |= b << i;
+        op |= o << i;
+        whitespace |= w << i;
+    }
+    
+    masks->quote = quote;
+    masks->backslash = backslash;
+    masks->op = op;
+    masks->whitespace = whitespace;
+}
+
+__attribute__((target("avx2")))
+static void classify_avx2(const char *block, BLOCK_MASKS *masks)
+{
+    uint64_t quote = 0, backslash = 0, op = 0, whitespace = 0;
+    
+    for (int i = 0; i < BLOCK_SIZE; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(block + i));
+        
+        uint64_t q = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')));
+        uint64_t b = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')));
+        uint64_t o = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(
+            _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('{')),
+                                            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('}'))),
+                            _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('[')),
+                                            _mm256_cmpeq_epi8(v, _mm256_set1_epi8(']')))),
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(':')),
+                            _mm256_cmpeq_epi8(v, _mm256_set1_epi8(',')))));
+        uint64_t w = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))),
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')),
+                            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')))));
+        
+        quote |= q << i;
+        backslash |= b << i;
+        op |= o << i;
+        whitespace |= w << i;
+    }
+    
+    masks->quote = quote;
+    masks->backslash = backslash;
+    masks->op = op;
+    masks->whitespace = whitespace;
+}
+
+#endif /* JSON_INDEX_X86 */
+
+static CLASSIFY_FN g_classify = NULL;
+static const char *g_backend = "scalar";
+
+static CLASSIFY_FN select_backend(void)
+{
+    if (g_classify) {
+        return g_classify;
+    }
+    
+    if (!g_char_class_ready) {
+        g_char_class['"'] = CLASS_QUOTE;
+        g_char_class['\\'] = CLASS_BACKSLASH;
+        g_char_class['{'] = g_char_class['}'] = CLASS_OP;
+        g_char_class['['] = g_char_class[']'] = CLASS_OP;
+        g_char_class[':'] = g_char_class[','] = CLASS_OP;
+        g_char_class[' '] = g_char_class['\t'] = CLASS_WHITESPACE;
+        g_char_class['\n'] = g_char_class['\r'] = CLASS_WHITESPACE;
+        g_char_class_ready = 1;
+    }
+    
+    CLASSIFY_FN classify = classify_scalar;
+    const char *backend = "scalar";
+
+#ifdef JSON_INDEX_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        classify = classify_avx2;
+        backend = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        classify = classify_sse2;
+        backend = "sse2";
+    }
+#endif
+    
+    /* Racing initializers store identical values */
+    g_backend = backend;
+    g_classify = classify;
+    return classify;
+}
+
+const char* json_index_backend(void)
+{
+    select_backend();
+    return g_backend;
+}
+
+/* ==================== Index Construction ==================== */
+
+/* Bit i = XOR of bits 0..i: turns quote positions into an in-string mask */
+static uint64_t prefix_xor(uint64_t x)
+{
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+/* Characters preceded by an unescaped backslash; backslashes are rare so walk them */
+static uint64_t escaped_chars(uint64_t backslash, uint64_t *carry)
+{
+    uint64_t escaped = *carry;
+    uint64_t escapers = backslash & ~escaped;
+    
+    *carry = 0;
+    while (escapers) {
+        int bit = __builtin_ctzll(escapers);
+        escapers &= escapers - 1;
+        
+        if (bit == BLOCK_SIZE - 1) {
+            *carry = 1;
+        } else {
+            uint64_t next = (uint64_t)1 << (bit + 1);
+            escaped |= next;
+            escapers &= ~next;
+        }
+    }
+    
+    return escaped;
+}
+
+void json_index_init(JSON_INDEX *index)
+{
+    if (!index) return;
+    
+    index->positions = NULL;
+    index->count = 0;
+    index->capacity = 0;
+}
+
+void json_index_free(JSON_INDEX *index)
+{
+    if (!index) return;
+    
+    free(index->positions);
+    json_index_init(index);
+}
+
+int json_index_build(JSON_INDEX *index, const char *json, size_t length)
+{
+    if (!index || !json || length >= UINT32_MAX) {
+        return -1;
+    }
+    
+    CLASSIFY_FN classify = select_backend();
+    
+    /* Worst case every byte is an entry; rounding up to a block lets emission skip checks */
+    size_t needed = length + BLOCK_SIZE;
+    if (index->capacity < needed) {
+        uint32_t *positions = (uint32_t*)realloc(index->positions, needed * sizeof(uint32_t));
+        if (!positions) {
+            return -1;
+        }
+        index->positions = positions;
+        index->capacity = needed;
+    }
+    
+    uint32_t *out = index->positions;
+    size_t count = 0;
+    
+    uint64_t escape_carry = 0;
+    uint64_t in_string_carry = 0;       /* All ones while a string spans blocks */
+    uint64_t separator_carry = 1;       /* Document start counts as a separator */
+    
+    char tail[BLOCK_SIZE];
+    
+    for (size_t offset = 0; offset < length; offset += BLOCK_SIZE) {
+        const char *block = json + offset;
+        
+        if (length - offset < BLOCK_SIZE) {
+            memset(tail, ' ', sizeof(tail));
+            memcpy(tail, block, length - offset);
+            block = tail;
+        }
+        
+        BLOCK_MASKS masks;
+        classify(block, &masks);
+        
+        uint64_t escaped = 0;
+        if (masks.backslash | escape_carry) {
+            escaped = escaped_chars(masks.backslash, &escape_carry);
+        }
+        
+        uint64_t quotes = masks.quote & ~escaped;
+        uint64_t in_string = prefix_xor(quotes) ^ in_string_carry;
+        in_string_carry = (uint64_t)((int64_t)in_string >> 63);
+        
+        /* A scalar starts at any other character that follows whitespace or an operator */
+        uint64_t separators = masks.whitespace | masks.op;
+        uint64_t scalar_starts = ~(separators | masks.quote) & ~in_string &
+                                 ((separators << 1) | separator_carry);
+        separator_carry = separators >> 63;
+        
+        uint64_t structurals = (masks.op & ~in_string) | quotes | scalar_starts;
+        
+        while (structurals) {
+            out[count++] = (uint32_t)(offset + (size_t)__builtin_ctzll(structurals));
+            structurals &= structurals - 1;
+        }
+    }
+    
+    index->count = count;
+    
+    return in_string_carry ? -1 : 0;
+}
@@ -0,0 +1,1125 @@
+#include "json_msgpack.h"
+#include "json_number.h"
+#include "framework.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#define WRITER_DEFAULT_CAPACITY 256
+#define MAX_DEPTH 1024              /* Deepest tree json_msgpack_parse accepts */
+
+/* ==================== Writer ==================== */
+
+int json_msgpack_writer_init(JSON_MSGPACK_WRITER *writer, size_t initial_size)
+{
+    if (!writer) return -1;
+    
+    memset(writer, 0, sizeof(JSON_MSGPACK_WRITER));
+    writer->size = initial_size ? initial_size : WRITER_DEFAULT_CAPACITY;
+    writer->data = (uint8_t*)malloc(writer->size);
+    if (!writer->data) {
+        writer->size = 0;
+        writer->error = 1;
+        return -1;
+    }
+    return 0;
+}
+
+void json_msgpack_writer_init_fixed(JSON_MSGPACK_WRITER *writer, uint8_t *buffer, size_t size)
+{
+    if (!writer) return;
+    
+    writer->data = buffer;
+    writer->size = buffer ? size : 0;
+    writer->length = 0;
+    writer->error = 0;
+    writer->fixed = 1;
+}
+
+void json_msgpack_writer_reset(JSON_MSGPACK_WRITER *writer)
+{
+    if (!writer) return;
+    
+    writer->length = 0;
+    writer->error = 0;
+}
+
+void json_msgpack_writer_free(JSON_MSGPACK_WRITER *writer)
+{
+    if (!writer) return;
+    
+    if (!writer->fixed) {
+        free(writer->data);
+    }
+    writer->data = NULL;
+    writer->size = 0;
+    writer->length = 0;
+}
+
+/* Make room for length more bytes; a failure is sticky until reset */
+static int writer_reserve(JSON_MSGPACK_WRITER *writer, size_t length)
+{
+    if (writer->error) {
+        return -1;
+    }
+    if (writer->size - writer->length >= length) {
+        return 0;
+    }
+    if (writer->fixed) {
+        writer->error = 1;
+        return -1;
+    }
+    
+    size_t new_size = writer->size ? writer->size : WRITER_DEFAULT_CAPACITY;
+    while (new_size - writer->length < length) {
+        new_size *= 2;
+    }
+    
+    uint8_t *data = (uint8_t*)realloc(writer->data, new_size);
+    if (!data) {
+        writer->error = 1;
+        return -1;
+    }
+    writer->data = data;
+    writer->size = new_size;
+    return 0;
+}
+
+/* Type byte followed by a big-endian value of width bytes */
+static void write_header(JSON_MSGPACK_WRITER *writer, uint8_t type, uint64_t value, int width)
+{
+    if (writer_reserve(writer, 1 + (size_t)width) != 0) {
+        return;
+    }
+    
+    uint8_t *out = writer->data + writer->length;
+    out[0] = type;
+    for (int i = 0; i < width; i++) {
+        out[1 + i] = (uint8_t)(value >> (8 * (width - 1 - i)));
+    }
+    writer->length += 1 + (size_t)width;
+}
+
+void json_msgpack_write_nil(JSON_MSGPACK_WRITER *writer)
+{
+    write_header(writer, 0xC0, 0, 0);
+}
+
+void json_msgpack_write_bool(JSON_MSGPACK_WRITER *writer, int value)
+{
+    write_header(writer, value ? 0xC3 : 0xC2, 0, 0);
+}
+
+void json_msgpack_write_int(JSON_MSGPACK_WRITER *writer, int64_t value)
+{
+    if (value >= 0) {
+        uint64_t u = (uint64_t)value;
+        if (u < 0x80) {
+            write_header(writer, (uint8_t)u, 0, 0);
+        } else if (u <= 0xFF) {
+            write_header(writer, 0xCC, u, 1);
+        } else if (u <= 0xFFFF) {
+            write_header(writer, 0xCD, u, 2);
+        } else if (u <= 0xFFFFFFFFu) {
+            write_header(writer, 0xCE, u, 4);
+        } else {
+            write_header(writer, 0xCF, u, 8);
+        }
+    } else if (value >= -32) {
+        write_header(writer, (uint8_t)value, 0, 0);
+    } else if (value >= INT8_MIN) {
+        write_header(writer, 0xD0, (uint64_t)value, 1);
+    } else if (value >= INT16_MIN) {
+        write_header(writer, 0xD1, (uint64_t)value, 2);
+    } else if (value >= INT32_MIN) {
+        write_header(writer, 0xD2, (uint64_t)value, 4);
+    } else {
+        write_header(writer, 0xD3, (uint64_t)value, 8);
+    }
+}
+
+void json_msgpack_write_double(JSON_MSGPACK_WRITER *writer, double value)
+{
+    float narrow = (float)value;
+    
+    /* float32 when it holds the value exactly (NaN compares unequal but narrows losslessly) */
+    if ((double)narrow == value || value != value) {
+        uint32_t bits;
+        memcpy(&bits, &narrow, sizeof(bits));
+        write_header(writer, 0xCA, bits, 4);
+    } else {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        write_header(writer, 0xCB, bits, 8);
+    }
+}
+
+void json_msgpack_write_string(JSON_MSGPACK_WRITER *writer, const char *value, size_t length)
+{
+    if (length < 32) {
+        write_header(writer, (uint8_t)(0xA0 | length), 0, 0);
+    } else if (length <= 0xFF) {
+        write_header(writer, 0xD9, length, 1);
+    } else if (length <= 0xFFFF) {
+        write_header(writer, 0xDA, length, 2);
+    } else if (length <= 0xFFFFFFFFu) {
+        write_header(writer, 0xDB, length, 4);
+    } else {
+        writer->error = 1;
+        return;
+    }
+    
+    if (length > 0 && writer_reserve(writer, length) == 0) {
+        memcpy(writer->data + writer->length, value, length);
+        writer->length += length;
+    }
+}
+
+void json_msgpack_write_array(JSON_MSGPACK_WRITER *writer, size_t count)
+{
+    if (count < 16) {
+        write_header(writer, (uint8_t)(0x90 | count), 0, 0);
+    } else if (count <= 0xFFFF) {
+        write_header(writer, 0xDC, count, 2);
+    } else if (count <= 0xFFFFFFFFu) {
+        write_header(writer, 0xDD, count, 4);
+    } else {
+        writer->error = 1;
+    }
+}
+
+void json_msgpack_write_map(JSON_MSGPACK_WRITER *writer, size_t count)
+{
+    if (count < 16) {
+        write_header(writer, (uint8_t)(0x80 | count), 0, 0);
+    } else if (count <= 0xFFFF) {
+        write_header(writer, 0xDE, count, 2);
+    } else if (count <= 0xFFFFFFFFu) {
+        write_header(writer, 0xDF, count, 4);
+    } else {
+        writer->error = 1;
+    }
+}
+
+int json_msgpack_write_value(JSON_MSGPACK_WRITER *writer, const JSON_VALUE *value)
+{
+    if (!writer) return -1;
+    
+    if (!value) {
+        json_msgpack_write_nil(writer);
+        return writer->error ? -1 : 0;
+    }
+    
+    switch (value->type) {
+        case JSON_TYPE_BOOLEAN:
+            json_msgpack_write_bool(writer, value->data.boolean_value);
+            break;
+        
+        case JSON_TYPE_INTEGER:
+            json_msgpack_write_int(writer, value->data.integer_value);
+            break;
+        
+        case JSON_TYPE_DOUBLE:
+            json_msgpack_write_double(writer, value->data.double_value);
+            break;
+        
+        case JSON_TYPE_STRING:
+            json_msgpack_write_string(writer, value->data.string_value, strlen(value->data.string_value));
+            break;
+        
+        case JSON_TYPE_ARRAY:
+            json_msgpack_write_array(writer, value->data.array_value.count);
+            for (size_t i = 0; i < value->data.array_value.count && !writer->error; i++) {
+                json_msgpack_write_value(writer, value->data.array_value.elements[i]);
+            }
+            break;
+        
+        case JSON_TYPE_OBJECT:
+            json_msgpack_write_map(writer, value->data.object_value.count);
+            for (size_t i = 0; i < value->data.object_value.count && !writer->error; i++) {
+                const char *key = value->data.object_value.keys[i];
+                json_msgpack_write_string(writer, key, strlen(key));
+                json_msgpack_write_value(writer, value->data.object_value.values[i]);
+            }
+            break;
+        
+        default:
+            json_msgpack_write_nil(writer);
+            break;
+    }
+    
+    return writer->error ? -1 : 0;
+}
+
+/* ==================== Schema Encoding ==================== */
+
+/* Length of a string stored in a char array of size bytes (0 = unbounded) */
+static size_t stored_string_length(const char *str, size_t size)
+{
+    if (size == 0) {
+        return strlen(str);
+    }
+    const char *end = (const char*)memchr(str, '\0', size);
+    return end ? (size_t)(end - str) : size;
+}
+
+static int element_is_zero(const char *element, size_t size)
+{
+    for (size_t i = 0; i < size; i++) {
+        if (element[i]) return 0;
+    }
+    return 1;
+}
+
+/*
+ * Elements in use: the count field clamped to capacity, or up to the first
+ * all-zero element; dynamic arrays and maps trust the count
+ */
+static size_t array_count(const JSON_SCHEMA_FIELD *field, const void *source)
+{
+    const char *elements = (const char*)source + field->offset;
+    
+    if (field->flags & SCHEMA_FLAG_DYNAMIC) {
+        if (!*(const char *const *)elements || field->count_offset == SCHEMA_NO_COUNT) {
+            return 0;
+        }
+        return *(const size_t*)((const char*)source + field->count_offset);
+    }
+    if (field->count_offset != SCHEMA_NO_COUNT) {
+        size_t count = *(const size_t*)((const char*)source + field->count_offset);
+        return count < field->max_length ? count : field->max_length;
+    }
+    
+    size_t count = 0;
+    while (count < field->max_length &&
+           !element_is_zero(elements + count * field->element_size, field->element_size)) {
+        count++;
+    }
+    return count;
+}
+
+/* Write one member; dynamic arrays and maps (pointer set) hold strings as char* */
+static void write_schema_value(JSON_MSGPACK_WRITER *writer, const JSON_SCHEMA_FIELD *field, SCHEMA_TYPE type,
+                               const void *data, size_t size, int pointer)
+{
+    const JSON_SCHEMA *nested = field->nested;
+    
+    switch (type) {
+        case SCHEMA_TYPE_BOOL:
+            json_msgpack_write_bool(writer, *(const int*)data);
+            break;
+        
+        case SCHEMA_TYPE_INT:
+            json_msgpack_write_int(writer, *(const int*)data);
+            break;
+        
+        case SCHEMA_TYPE_INT64:
+            json_msgpack_write_int(writer, *(const int64_t*)data);
+            break;
+        
+        case SCHEMA_TYPE_DOUBLE:
+            json_msgpack_write_double(writer, *(const double*)data);
+            break;
+        
+        case SCHEMA_TYPE_STRING:
+            if (pointer) {
+                const char *str = *(const char *const *)data;
+                if (str) {
+                    json_msgpack_write_string(writer, str, strlen(str));
+                } else {
+                    json_msgpack_write_nil(writer);
+                }
+                break;
+            }
+            json_msgpack_write_string(writer, (const char*)data, stored_string_length((const char*)data, size));
+            break;
+        
+        case SCHEMA_TYPE_ENUM: {
+            int value = *(const int*)data;
+            size_t count = 0;
+            while (field->enum_names && field->enum_names[count] && count <= (size_t)value) {
+                count++;
+            }
+            if (value < 0 || (size_t)value >= count) {
+                json_msgpack_write_nil(writer);
+                break;
+            }
+            json_msgpack_write_string(writer, field->enum_names[value], strlen(field->enum_names[value]));
+            break;
+        }
+        
+        case SCHEMA_TYPE_OBJECT:
+            if (nested) {
+                json_msgpack_write_schema(writer, data, nested);
+                break;
+            }
+            json_msgpack_write_nil(writer);
+            break;
+        
+        default:
+            json_msgpack_write_nil(writer);
+            break;
+    }
+}
+
+int json_msgpack_write_schema(JSON_MSGPACK_WRITER *writer, const void *source, const JSON_SCHEMA *schema)
+{
+    if (!writer || !source || !schema) return -1;
+    
+    size_t count = 0;
+    for (size_t i = 0; i < schema->field_count; i++) {
+        if (!(schema->fields[i].flags & SCHEMA_FLAG_READONLY)) {
+            count++;
+        }
+    }
+    
+    json_msgpack_write_map(writer, count);
+    
+    for (size_t i = 0; i < schema->field_count && !writer->error; i++) {
+        const JSON_SCHEMA_FIELD *field = &schema->fields[i];
+        if (field->flags & SCHEMA_FLAG_READONLY) {
+            continue;
+        }
+        
+        json_msgpack_write_string(writer, field->name, strlen(field->name));
+        
+        int dynamic = (field->flags & SCHEMA_FLAG_DYNAMIC) != 0;
+        const char *elements = (const char*)source + field->offset;
+        if (dynamic) {
+            elements = *(const char *const *)elements;
+        }
+        
+        if (field->type == SCHEMA_TYPE_ARRAY) {
+            size_t elements_count = array_count(field, source);
+            
+            json_msgpack_write_array(writer, elements_count);
+            for (size_t e = 0; e < elements_count; e++) {
+                write_schema_value(writer, field, field->element_type, elements + e * field->element_size,
+                                   field->element_size, dynamic);
+            }
+        } else if (field->type == SCHEMA_TYPE_MAP) {
+            size_t entries_count = array_count(field, source);
+            
+            json_msgpack_write_map(writer, entries_count);
+            for (size_t e = 0; e < entries_count; e++) {
+                const char *entry = elements + e * field->element_size;
+                const char *key = *(const char *const *)entry;
+                
+                json_msgpack_write_string(writer, key ? key : "", key ? strlen(key) : 0);
+                write_schema_value(writer, field, field->element_type, entry + field->value_offset, 0, 1);
+            }
+        } else {
+            write_schema_value(writer, field, field->type, (const char*)source + field->offset,
+                               field->max_length, 0);
+        }
+    }
+    
+    return writer->error ? -1 : 0;
+}
+
+/* ==================== Reader ==================== */
+
+typedef enum {
+    ITEM_NIL,
+    ITEM_BOOL,
+    ITEM_NUMBER,
+    ITEM_STRING,                /* Also bin: JSON has no binary type */
+    ITEM_ARRAY,
+    ITEM_MAP,
+    ITEM_EXT
+} ITEM_KIND;
+
+/* One decoded item; containers leave their elements unread */
+typedef struct {
+    ITEM_KIND kind;
+    int boolean;
+    JSON_NUMBER number;
+    const char *bytes;          /* String payload */
+    size_t length;              /* String length, or container element count */
+} ITEM;
+
+typedef struct {
+    const uint8_t *data;
+    size_t length;
+    size_t position;
+    const char *error;
+} READER;
+
+static int reader_fail(READER *reader, const char *error)
+{
+    reader->error = error;
+    return -1;
+}
+
+/* Big-endian unsigned value of width bytes */
+static int read_uint(READER *reader, int width, uint64_t *value)
+{
+    if (reader->length - reader->position < (size_t)width) {
+        return reader_fail(reader, "Truncated data");
+    }
+    
+    uint64_t result = 0;
+    for (int i = 0; i < width; i++) {
+        result = (result << 8) | reader->data[reader->position + i];
+    }
+    reader->position += (size_t)width;
+    *value = result;
+    return 0;
+}
+
+static void set_integer(ITEM *item, int64_t value)
+{
+    item->kind = ITEM_NUMBER;
+    item->number.is_double = 0;
+    item->number.integer = value;
+    item->number.real = (double)value;
+}
+
+static void set_double(ITEM *item, double value)
+{
+    item->kind = ITEM_NUMBER;
+    item->number.is_double = 1;
+    item->number.real = value;
+    item->number.integer = (value >= -9223372036854775808.0 && value < 9223372036854775808.0) ? (int64_t)value :
+                           (value > 0 ? INT64_MAX : INT64_MIN);
+}
+
+/* Payload of length bytes at the current position */
+static int read_payload(READER *reader, ITEM *item, ITEM_KIND kind, uint64_t length)
+{
+    if (length > reader->length - reader->position) {
+        return reader_fail(reader, "Truncated data");
+    }
+    
+    item->kind = kind;
+    item->bytes = (const char*)reader->data + reader->position;
+    item->length = (size_t)length;
+    reader->position += (size_t)length;
+    return 0;
+}
+
+/* Containers need at least one byte per element, which bounds hostile counts */
+static int read_container(READER *reader, ITEM *item, ITEM_KIND kind, uint64_t count)
+{
+    uint64_t minimum = (kind == ITEM_MAP) ? count * 2 : count;
+    if (count > reader->length || minimum > reader->length - reader->position) {
+        return reader_fail(reader, "Truncated data");
+    }
+    
+    item->kind = kind;
+    item->length = (size_t)count;
+    return 0;
+}
+
+static int read_item(READER *reader, ITEM *item)
+{
+    if (reader->position >= reader->length) {
+        return reader_fail(reader, "Truncated data");
+    }
+    
+    uint8_t type = reader->data[reader->position++];
+    uint64_t value;
+    
+    if (type < 0x80) {
+        set_integer(item, type);
+        return 0;
+    }
+    if (type >= 0xE0) {
+        set_integer(item, (int8_t)type);
+        return 0;
+    }
+    if ((type & 0xE0) == 0xA0) {
+        return read_payload(reader, item, ITEM_STRING, type & 0x1F);
+    }
+    if ((type & 0xF0) == 0x90) {
+        return read_container(reader, item, ITEM_ARRAY, type & 0x0F);
+    }
+    if ((type & 0xF0) == 0x80) {
+        return read_container(reader, item, ITEM_MAP, type & 0x0F);
+    }
+    
+    switch (type) {
+        case 0xC0:
+            item->kind = ITEM_NIL;
+            return 0;
+        
+        case 0xC2:
+        case 0xC3:
+            item->kind = ITEM_BOOL;
+            item->boolean = (type == 0xC3);
+            return 0;
+        
+        case 0xCC: case 0xCD: case 0xCE: case 0xCF: {
+            int width = 1 << (type - 0xCC);
+            if (read_uint(reader, width, &value) != 0) return -1;
+            if (value > (uint64_t)INT64_MAX) {
+                set_double(item, (double)value);
+            } else {
+                set_integer(item, (int64_t)value);
+            }
+            return 0;
+        }
+        
+        case 0xD0: case 0xD1: case 0xD2: case 0xD3: {
+            int width = 1 << (type - 0xD0);
+            if (read_uint(reader, width, &value) != 0) return -1;
+            
+            /* Sign-extend from width bytes */
+            int shift = 64 - 8 * width;
+            set_integer(item, (int64_t)(value << shift) >> shift);
+            return 0;
+        }
+        
+        case 0xCA: {
+            if (read_uint(reader, 4, &value) != 0) return -1;
+            uint32_t bits = (uint32_t)value;
+            float narrow;
+            memcpy(&narrow, &bits, sizeof(narrow));
+            set_double(item, narrow);
+            return 0;
+        }
+        
+        case 0xCB: {
+            if (read_uint(reader, 8, &value) != 0) return -1;
+            double real;
+            memcpy(&real, &value, sizeof(real));
+            set_double(item, real);
+            return 0;
+        }
+        
+        case 0xD9: case 0xC4:
+            if (read_uint(reader, 1, &value) != 0) return -1;
+            return read_payload(reader, item, ITEM_STRING, value);
+        case 0xDA: case 0xC5:
+            if (read_uint(reader, 2, &value) != 0) return -1;
+            return read_payload(reader, item, ITEM_STRING, value);
+        case 0xDB: case 0xC6:
+            if (read_uint(reader, 4, &value) != 0) return -1;
+            return read_payload(reader, item, ITEM_STRING, value);
+        
+        case 0xDC:
+            if (read_uint(reader, 2, &value) != 0) return -1;
+            return read_container(reader, item, ITEM_ARRAY, value);
+        case 0xDD:
+            if (read_uint(reader, 4, &value) != 0) return -1;
+            return read_container(reader, item, ITEM_ARRAY, value);
+        case 0xDE:
+            if (read_uint(reader, 2, &value) != 0) return -1;
+            return read_container(reader, item, ITEM_MAP, value);
+        case 0xDF:
+            if (read_uint(reader, 4, &value) != 0) return -1;
+            return read_container(reader, item, ITEM_MAP, value);
+        
+        /* Extensions: fixext 1-16, then ext 8/16/32 (type byte follows the length) */
+        case 0xD4: case 0xD5: case 0xD6: case 0xD7: case 0xD8:
+            return read_payload(reader, item, ITEM_EXT, 1 + ((uint64_t)1 << (type - 0xD4)));
+        case 0xC7: case 0xC8: case 0xC9: {
+            int width = 1 << (type - 0xC7);
+            if (read_uint(reader, width, &value) != 0) return -1;
+            return read_payload(reader, item, ITEM_EXT, value + 1);
+        }
+        
+        default:
+            return reader_fail(reader, "Invalid type byte");
+    }
+}
+
+/* Skip the elements of an item already read, without recursion */
+static int skip_contents(READER *reader, const ITEM *item)
+{
+    size_t pending = 0;
+    if (item->kind == ITEM_ARRAY) {
+        pending = item->length;
+    } else if (item->kind == ITEM_MAP) {
+        pending = item->length * 2;
+    }
+    
+    while (pending > 0) {
+        ITEM next;
+        if (read_item(reader, &next) != 0) {
+            return -1;
+        }
+        pending--;
+        
+        if (next.kind == ITEM_ARRAY) {
+            pending += next.length;
+        } else if (next.kind == ITEM_MAP) {
+            pending += next.length * 2;
+        }
+        if (pending > reader->length - reader->position) {
+            return reader_fail(reader, "Truncated data");
+        }
+    }
+    return 0;
+}
+
+static int skip_item(READER *reader)
+{
+    ITEM item;
+    if (read_item(reader, &item) != 0) {
+        return -1;
+    }
+    return skip_contents(reader, &item);
+}
+
+/* ==================== Tree Decoding ==================== */
+
+static void* tree_alloc(JSON_ARENA *arena, size_t size)
+{
+    return arena ? json_arena_alloc(arena, size ? size : 1) : malloc(size ? size : 1);
+}
+
+static char* tree_string(JSON_ARENA *arena, const char *bytes, size_t length)
+{
+    char *str = (char*)tree_alloc(arena, length + 1);
+    if (str) {
+        memcpy(str, bytes, length);
+        str[length] = '\0';
+    }
+    return str;
+}
+
+static JSON_VALUE* tree_value(JSON_ARENA *arena, JSON_TYPE type)
+{
+    JSON_VALUE *value = (JSON_VALUE*)tree_alloc(arena, sizeof(JSON_VALUE));
+    if (value) {
+        memset(value, 0, sizeof(JSON_VALUE));
+        value->type = type;
+        value->flags = arena ? JSON_VALUE_FLAG_ARENA : 0;
+    }
+    return value;
+}
+
+/* Containers are attached as they fill, so json_free releases a partial tree */
+static JSON_VALUE* decode_value(READER *reader, JSON_ARENA *arena, int depth)
+{
+    ITEM item;
+    if (read_item(reader, &item) != 0) {
+        return NULL;
+    }
+    
+    JSON_VALUE *value = NULL;
+    
+    switch (item.kind) {
+        case ITEM_NIL:
+            value = tree_value(arena, JSON_TYPE_NULL);
+            break;
+        
+        case ITEM_BOOL:
+            value = tree_value(arena, JSON_TYPE_BOOLEAN);
+            if (value) value->data.boolean_value = item.boolean;
+            break;
+        
+        case ITEM_NUMBER:
+            value = tree_value(arena, item.number.is_double ? JSON_TYPE_DOUBLE : JSON_TYPE_INTEGER);
+            if (value && item.number.is_double) {
+                value->data.double_value = item.number.real;
+            } else if (value) {
+                value->data.integer_value = item.number.integer;
+            }
+            break;
+        
+        case ITEM_STRING:
+            value = tree_value(arena, JSON_TYPE_STRING);
+            if (value && !(value->data.string_value = tree_string(arena, item.bytes, item.length))) {
+                if (!arena) free(value);
+                value = NULL;
+            }
+            break;
+        
+        case ITEM_ARRAY:
+        case ITEM_MAP: {
+            if (depth >= MAX_DEPTH) {
+                reader_fail(reader, "Nesting too deep");
+                return NULL;
+            }
+            
+            int is_map = (item.kind == ITEM_MAP);
+            value = tree_value(arena, is_map ? JSON_TYPE_OBJECT : JSON_TYPE_ARRAY);
+            if (!value) break;
+            
+            JSON_VALUE **children = (JSON_VALUE**)tree_alloc(arena, item.length * sizeof(JSON_VALUE*));
+            char **keys = is_map ? (char**)tree_alloc(arena, item.length * sizeof(char*)) : NULL;
+            if (!children || (is_map && !keys)) {
+                if (!arena) {
+                    free(children);
+                    free(keys);
+                    free(value);
+                }
+                value = NULL;
+                break;
+            }
+            
+            if (is_map) {
+                value->data.object_value.keys = keys;
+                value->data.object_value.values = children;
+            } else {
+                value->data.array_value.elements = children;
+            }
+            
+            for (size_t i = 0; i < item.length; i++) {
+                if (is_map) {
+                    ITEM key;
+                    if (read_item(reader, &key) != 0) {
+                        json_free(value);
+                        return NULL;
+                    }
+                    if (key.kind != ITEM_STRING) {
+                        reader_fail(reader, "Map key is not a string");
+                        json_free(value);
+                        return NULL;
+                    }
+                    keys[i] = tree_string(arena, key.bytes, key.length);
+                    if (!keys[i]) {
+                        reader_fail(reader, "Out of memory");
+                        json_free(value);
+                        return NULL;
+                    }
+                }
+                
+                children[i] = decode_value(reader, arena, depth + 1);
+                if (!children[i]) {
+                    if (is_map && !arena) free(keys[i]);
+                    json_free(value);
+                    return NULL;
+                }
+                
+                if (is_map) {
+                    value->data.object_value.count = i + 1;
+                } else {
+                    value->data.array_value.count = i + 1;
+                }
+            }
+            break;
+        }
+        
+        case ITEM_EXT:
+            reader_fail(reader, "Unsupported extension type");
+            return NULL;
+    }
+    
+    if (!value && !reader->error) {
+        reader_fail(reader, "Out of memory");
+    }
+    return value;
+}
+
+JSON_VALUE* json_msgpack_parse(const void *data, size_t length, JSON_ARENA *arena)
+{
+    if (!data) return NULL;
+    
+    READER reader = { (const uint8_t*)data, length, 0, NULL };
+    JSON_VALUE *value = decode_value(&reader, arena, 0);
+    
+    if (value && reader.position != length) {
+        json_free(value);
+        value = NULL;
+        reader.error = "Trailing data after value";
+    }
+    
+    if (!value) {
+        framework_log(LOG_LEVEL_ERROR, "MessagePack decode error at offset %zu: %s", reader.position, reader.error);
+    }
+    return value;
+}
+
+/* ==================== Schema Decoding ==================== */
+
+static int decode_object(READER *reader, size_t count, const JSON_SCHEMA *schema,
+                         void *target, JSON_VALIDATION_RESULT *result);
+
+static int schema_error(JSON_VALIDATION_RESULT *result, const char *field, const char *format, const char *name)
+{
+    snprintf(result->error_message, sizeof(result->error_message), format, name);
+    result->error_field = field;
+    result->valid = 0;
+    return -1;
+}
+
+/* Copy at most size - 1 bytes without ending inside a UTF-8 character */
+static void store_string(char *dest, size_t size, const char *bytes, size_t length)
+{
+    if (length > size - 1) {
+        length = size - 1;
+        while (length > 0 && ((unsigned char)bytes[length] & 0xC0) == 0x80) {
+            length--;
+        }
+    }
+    memcpy(dest, bytes, length);
+    dest[length] = '\0';
+}
+
+/*
+ * Store an item already read into a member of the given type; mismatched
+ * types leave it zeroed. index is the field's position in schema (for its
+ * enum table).
+ */
+static int decode_member(READER *reader, const ITEM *item, const JSON_SCHEMA *schema, size_t index,
+                         SCHEMA_TYPE type, void *data, size_t size, JSON_VALIDATION_RESULT *result)
+{
+    const JSON_SCHEMA_FIELD *field = &schema->fields[index];
+    const JSON_SCHEMA *nested = field->nested;
+    
+    switch (type) {
+        case SCHEMA_TYPE_BOOL:
+            if (item->kind == ITEM_BOOL) {
+                *(int*)data = item->boolean;
+                return 0;
+            }
+            break;
+        
+        case SCHEMA_TYPE_INT:
+            if (item->kind == ITEM_NUMBER) {
+                *(int*)data = item->number.is_double ? (int)item->number.real : (int)item->number.integer;
+                return 0;
+            }
+            break;
+        
+        case SCHEMA_TYPE_INT64:
+            if (item->kind == ITEM_NUMBER) {
+                if (!item->number.is_double) {
+                    *(int64_t*)data = item->number.integer;
+                }
+                return 0;
+            }
+            break;
+        
+        case SCHEMA_TYPE_DOUBLE:
+            if (item->kind == ITEM_NUMBER) {
+                *(double*)data = item->number.real;
+                return 0;
+            }
+            break;
+        
+        case SCHEMA_TYPE_STRING:
+            if (item->kind == ITEM_STRING) {
+                if (size > 0) {
+                    store_string((char*)data, size, item->bytes, item->length);
+                }
+                return 0;
+            }
+            break;
+        
+        case SCHEMA_TYPE_OBJECT:
+            if (nested && item->kind == ITEM_MAP) {
+                return decode_object(reader, item->length, nested, data, result);
+            }
+            break;
+        
+        case SCHEMA_TYPE_ENUM:
+            if (item->kind == ITEM_STRING) {
+                int value = json_schema_find_enum(schema, index, item->bytes, item->length);
+                if (value < 0) {
+                    return schema_error(result, field->name, "Field '%s' has an unknown value", field->name);
+                }
+                *(int*)data = value;
+                return 0;
+            }
+            break;
+        
+        default:
+            break;
+    }
+    
+    return skip_contents(reader, item);
+}
+
+/* Store the default of a field that was absent from the input */
+static void apply_default(const JSON_SCHEMA_FIELD *field, void *target)
+{
+    void *field_ptr = (char*)target + field->offset;
+    
+    switch (field->type) {
+        case SCHEMA_TYPE_BOOL:
+        case SCHEMA_TYPE_INT:
+        case SCHEMA_TYPE_ENUM:
+            *(int*)field_ptr = *(const int*)field->default_value;
+            break;
+        
+        case SCHEMA_TYPE_INT64:
+            *(int64_t*)field_ptr = *(const int64_t*)field->default_value;
+            break;
+        
+        case SCHEMA_TYPE_DOUBLE:
+            *(double*)field_ptr = *(const double*)field->default_value;
+            break;
+        
+        case SCHEMA_TYPE_STRING:
+            if (field->max_length > 0) {
+                snprintf((char*)field_ptr, field->max_length, "%s", (const char*)field->default_value);
+            }
+            break;
+        
+        default:
+            break;
+    }
+}
+
+static int decode_field(READER *reader, const JSON_SCHEMA *schema, size_t index, void *target,
+                        JSON_VALIDATION_RESULT *result)
+{
+    const JSON_SCHEMA_FIELD *field = &schema->fields[index];
+    void *field_ptr = (char*)target + field->offset;
+    ITEM item;
+    
+    /* Dynamic arrays and maps are only decoded from JSON into an arena */
+    if (field->flags & SCHEMA_FLAG_DYNAMIC) {
+        return schema_error(result, field->name, "Field '%s' needs an arena", field->name);
+    }
+    
+    if (read_item(reader, &item) != 0) {
+        return -1;
+    }
+    
+    int rc;
+    if (field->type == SCHEMA_TYPE_ARRAY) {
+        if (item.kind != ITEM_ARRAY) {
+            rc = skip_contents(reader, &item);
+        } else {
+            size_t stored = item.length < field->max_length ? item.length : field->max_length;
+            rc = 0;
+            
+            for (size_t i = 0; i < item.length && rc == 0; i++) {
+                if (i >= stored) {
+                    rc = skip_item(reader);
+                    continue;
+                }
+                
+                ITEM element;
+                rc = read_item(reader, &element);
+                if (rc == 0) {
+                    rc = decode_member(reader, &element, schema, index, field->element_type,
+                                       (char*)field_ptr + i * field->element_size, field->element_size, result);
+                }
+            }
+            
+            if (rc == 0 && field->count_offset != SCHEMA_NO_COUNT) {
+                *(size_t*)((char*)target + field->count_offset) = stored;
+            }
+        }
+    } else if (field->type == SCHEMA_TYPE_OBJECT && field->nested && item.kind != ITEM_MAP) {
+        if (item.kind == ITEM_NIL && (field->flags & SCHEMA_FLAG_NULLABLE)) {
+            return 0;
+        }
+        return schema_error(result, field->name, "Field '%s' must be an object", field->name);
+    } else {
+        rc = decode_member(reader, &item, schema, index, field->type, field_ptr, field->max_length, result);
+    }
+    
+    if (rc != 0) {
+        return -1;
+    }
+    
+    if (field->validator && !field->validator(field_ptr)) {
+        return schema_error(result, field->name, "Validation failed for field '%s'", field->name);
+    }
+    
+    return 0;
+}
+
+/* Decode count key/value pairs (the map header is already read) */
+static int decode_object(READER *reader, size_t count, const JSON_SCHEMA *schema,
+                         void *target, JSON_VALIDATION_RESULT *result)
+{
+    memset(target, 0, schema->struct_size);
+    
+    /* Duplicate keys keep their first value */
+    unsigned char seen_small[64];
+    unsigned char *seen = seen_small;
+    if (schema->field_count > sizeof(seen_small)) {
+        seen = (unsigned char*)malloc(schema->field_count);
+        if (!seen) {
+            return reader_fail(reader, "Out of memory");
+        }
+    }
+    memset(seen, 0, schema->field_count);
+    
+    int rc = 0;
+    
+    for (size_t i = 0; i < count && rc == 0; i++) {
+        ITEM key;
+        if (read_item(reader, &key) != 0) {
+            rc = -1;
+            break;
+        }
+        if (key.kind != ITEM_STRING) {
+            rc = skip_contents(reader, &key);
+            if (rc == 0) {
+                rc = skip_item(reader);
+            }
+            continue;
+        }
+        
+        int index = json_schema_find_field(schema, key.bytes, key.length);
+        if (index >= 0 && !seen[index]) {
+            seen[index] = 1;
+            rc = decode_field(reader, schema, (size_t)index, target, result);
+        } else {
+            rc = skip_item(reader);
+        }
+    }
+    
+    if (rc == 0) {
+        for (size_t i = 0; i < schema->field_count; i++) {
+            if (seen[i]) {
+                continue;
+            }
+            if (schema->fields[i].flags & SCHEMA_FLAG_REQUIRED) {
+                rc = schema_error(result, schema->fields[i].name,
+                                  "Required field '%s' is missing", schema->fields[i].name);
+                break;
+            }
+            if (schema->fields[i].default_value) {
+                apply_default(&schema->fields[i], target);
+            }
+        }
+    }
+    
+    if (seen != seen_small) {
+        free(seen);
+    }
+    return rc;
+}
+
+int json_msgpack_parse_schema(const void *data, size_t length, const JSON_SCHEMA *schema,
+                              void *target, JSON_VALIDATION_RESULT *result)
+{
+    JSON_VALIDATION_RESULT local;
+    if (!result) {
+        result = &local;
+    }
+    
+    result->valid = 1;
+    result->error_message[0] = '\0';
+    result->error_field = NULL;
+    result->error_offset = 0;
+    
+    if (!data || !schema || !target) {
+        result->valid = 0;
+        snprintf(result->error_message, sizeof(result->error_message), "Invalid arguments");
+        return -1;
+    }
+    
+    READER reader = { (const uint8_t*)data, length, 0, NULL };
+    ITEM item;
+    
+    if (read_item(&reader, &item) != 0 || item.kind != ITEM_MAP) {
+        snprintf(result->error_message, sizeof(result->error_message), "Expected MessagePack map");
+        result->valid = 0;
+        return -1;
+    }
+    
+    if (decode_object(&reader, item.length, schema, target, result) != 0) {
+        /* Schema errors have already been reported; anything else is malformed data */
+        if (result->valid) {
+            snprintf(result->error_message, sizeof(result->error_message),
+                    "Failed to decode MessagePack at offset %zu: %s", reader.position,
+                    reader.error ? reader.error : "Invalid data");
+            result->error_offset = reader.position;
+            result->valid = 0;
+        }
+        return -1;
+    }
+    
+    return 0;
+}
@@ -0,0 +1,539 @@
+#include "json_ndjson.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DEFAULT_BATCH_SIZE 4096
+#define DEFAULT_MAX_RECORD_SIZE (1024 * 1024)
+#define DEFAULT_FLUSH_SIZE (1024 * 1024)
+#define MAX_THREADS 64
+#define PARALLEL_MIN_RECORDS 64     /* Smaller batches are not worth waking the workers */
+#define CLAIM_SIZE 16               /* Records a thread takes per claim */
+
+/* One line of input */
+typedef struct {
+    const char *text;
+    size_t length;
+    size_t line;
+} RECORD_SLICE;
+
+/* A decoding thread and the arena its records' dynamic arrays and maps live in */
+typedef struct {
+    struct _json_ndjson_reader_ *reader;
+    pthread_t thread;
+    JSON_ARENA *arena;
+} DECODER;
+
+struct _json_ndjson_reader_ {
+    JSON_NDJSON_CONFIG config;
+    JSON_NDJSON_CALLBACKS callbacks;
+    void *user_data;
+    const JSON_SCHEMA *schema;
+    size_t record_size;
+    
+    /* Current batch */
+    RECORD_SLICE *slices;
+    unsigned char *records;
+    unsigned char *failed_records;
+    size_t count;
+    size_t next;                /* Next record to claim, shared with the workers */
+    
+    /* Start of a record whose newline has not arrived yet */
+    char *carry;
+    size_t carry_length;
+    size_t carry_capacity;
+    
+    /* Worker pool: each batch bumps generation, the last worker to finish signals.
+     * decoders[0] is the caller; workers are decoders[1..worker_count]. */
+    DECODER *decoders;
+    size_t worker_count;
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;
+    pthread_cond_t work_done;
+    uint64_t generation;
+    size_t active;
+    int shutdown;
+    
+    size_t line;                /* Line number of the next record */
+    size_t delivered;
+    int failed;
+    char error[640];
+};
+
+static const char *ERROR_ABORTED = "Stopped by callback";
+
+/* ==================== Reader ==================== */
+
+void json_ndjson_config_init(JSON_NDJSON_CONFIG *config)
+{
+    if (!config) return;
+    
+    memset(config, 0, sizeof(JSON_NDJSON_CONFIG));
+    config->batch_size = DEFAULT_BATCH_SIZE;
+    config->max_record_size = DEFAULT_MAX_RECORD_SIZE;
+}
+
+static void decode_record(JSON_NDJSON_READER *reader, size_t i, JSON_ARENA *arena)
+{
+    const RECORD_SLICE *slice = &reader->slices[i];
+    void *target = reader->records + i * reader->record_size;
+    
+    memset(target, 0, reader->record_size);
+    reader->failed_records[i] =
+        json_parse_schema_arena(slice->text, slice->length, reader->schema, target, arena, NULL) != 0;
+}
+
+/* Decode records until the batch is exhausted; run by the caller and every worker */
+static void decode_claimed(JSON_NDJSON_READER *reader, JSON_ARENA *arena)
+{
+    for (;;) {
+        size_t first = __atomic_fetch_add(&reader->next, CLAIM_SIZE, __ATOMIC_RELAXED);
+        if (first >= reader->count) {
+            return;
+        }
+        
+        size_t last = first + CLAIM_SIZE < reader->count ? first + CLAIM_SIZE : reader->count;
+        for (size_t i = first; i < last; i++) {
+            decode_record(reader, i, arena);
+        }
+    }
+}
+
+static void* worker_main(void *arg)
+{
+    DECODER *decoder = (DECODER*)arg;
+    JSON_NDJSON_READER *reader = decoder->reader;
+    uint64_t seen = 0;
+    
+    pthread_mutex_lock(&reader->lock);
+    for (;;) {
+        while (!reader->shutdown && reader->generation == seen) {
+            pthread_cond_wait(&reader->work_ready, &reader->lock);
+        }
+        if (reader->shutdown) {
+            break;
+        }
+        
+        seen = reader->generation;
+        pthread_mutex_unlock(&reader->lock);
+        
+        decode_claimed(reader, decoder->arena);
+        
+        pthread_mutex_lock(&reader->lock);
+        if (--reader->active == 0) {
+            pthread_cond_signal(&reader->work_done);
+        }
+    }
+    pthread_mutex_unlock(&reader->lock);
+    
+    return NULL;
+}
+
+static int reader_fail(JSON_NDJSON_READER *reader, const char *error)
+{
+    reader->failed = 1;
+    snprintf(reader->error, sizeof(reader->error), "%s", error);
+    return -1;
+}
+
+/* Hand decoded records to the callbacks in input order */
+static int deliver_batch(JSON_NDJSON_READER *reader, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        const RECORD_SLICE *slice = &reader->slices[i];
+        void *record = reader->records + i * reader->record_size;
+        
+        if (!reader->failed_records[i]) {
+            if (reader->callbacks.on_record &&
+                reader->callbacks.on_record(reader->user_data, record, slice->line) != 0) {
+                return reader_fail(reader, ERROR_ABORTED);
+            }
+            reader->delivered++;
+            continue;
+        }
+        
+        /* Bad records are rare: decode again on this thread for the message */
+        JSON_VALIDATION_RESULT result;
+        memset(record, 0, reader->record_size);
+        json_parse_schema_arena(slice->text, slice->length, reader->schema, record,
+                                reader->decoders[0].arena, &result);
+        
+        if (!reader->callbacks.on_error) {
+            char message[sizeof(reader->error)];
+            snprintf(message, sizeof(message), "Line %zu: %s", slice->line, result.error_message);
+            return reader_fail(reader, message);
+        }
+        if (reader->callbacks.on_error(reader->user_data, slice->line, result.error_message) != 0) {
+            return reader_fail(reader, ERROR_ABORTED);
+        }
+    }
+    
+    return 0;
+}
+
+/* Decode the batch in parallel, then deliver it in input order */
+static int run_batch(JSON_NDJSON_READER *reader)
+{
+    if (reader->count == 0) {
+        return 0;
+    }
+    
+    JSON_ARENA *arena = reader->decoders[0].arena;
+    reader->next = 0;
+    if (reader->worker_count > 0 && reader->count >= PARALLEL_MIN_RECORDS) {
+        pthread_mutex_lock(&reader->lock);
+        reader->active = reader->worker_count;
+        reader->generation++;
+        pthread_cond_broadcast(&reader->work_ready);
+        pthread_mutex_unlock(&reader->lock);
+        
+        decode_claimed(reader, arena);
+        
+        pthread_mutex_lock(&reader->lock);
+        while (reader->active > 0) {
+            pthread_cond_wait(&reader->work_done, &reader->lock);
+        }
+        pthread_mutex_unlock(&reader->lock);
+    } else {
+        decode_claimed(reader, arena);
+    }
+    
+    size_t count = reader->count;
+    reader->count = 0;
+    
+    int rc = deliver_batch(reader, count);
+    
+    /* Delivered records no longer need their arrays and maps */
+    for (size_t i = 0; i <= reader->worker_count; i++) {
+        json_arena_reset(reader->decoders[i].arena);
+    }
+    return rc;
+}
+
+/* Only spaces, tabs and a CR from a CRLF line ending */
+static int blank_line(const char *text, size_t length)
+{
+    for (size_t i = 0; i < length; i++) {
+        if (text[i] != ' ' && text[i] != '\t' && text[i] != '\r') {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int add_record(JSON_NDJSON_READER *reader, const char *text, size_t length)
+{
+    size_t line = reader->line++;
+    
+    if (blank_line(text, length)) {
+        return 0;
+    }
+    
+    RECORD_SLICE *slice = &reader->slices[reader->count++];
+    slice->text = text;
+    slice->length = length;
+    slice->line = line;
+    
+    if (reader->count == reader->config.batch_size) {
+        return run_batch(reader);
+    }
+    return 0;
+}
+
+static int carry_append(JSON_NDJSON_READER *reader, const char *data, size_t length)
+{
+    size_t needed = reader->carry_length + length;
+    if (needed > reader->config.max_record_size) {
+        return reader_fail(reader, "Record exceeds maximum size");
+    }
+    
+    if (needed > reader->carry_capacity) {
+        size_t capacity = reader->carry_capacity ? reader->carry_capacity : 256;
+        while (capacity < needed) {
+            capacity *= 2;
+        }
+        
+        char *carry = (char*)realloc(reader->carry, capacity);
+        if (!carry) {
+            return reader_fail(reader, "Out of memory");
+        }
+        reader->carry = carry;
+        reader->carry_capacity = capacity;
+    }
+    
+    memcpy(reader->carry + reader->carry_length, data, length);
+    reader->carry_length = needed;
+    return 0;
+}
+
+JSON_NDJSON_READER* json_ndjson_reader_create(const JSON_NDJSON_CONFIG *config,
+                                              const JSON_SCHEMA *schema, size_t record_size,
+                                              const JSON_NDJSON_CALLBACKS *callbacks, void *user_data)
+{
+    if (!schema || record_size == 0 || json_schema_compile(schema) != 0) {
+        return NULL;
+    }
+    
+    JSON_NDJSON_READER *reader = (JSON_NDJSON_READER*)calloc(1, sizeof(JSON_NDJSON_READER));
+    if (!reader) {
+        return NULL;
+    }
+    
+    if (config) {
+        reader->config = *config;
+    } else {
+        json_ndjson_config_init(&reader->config);
+    }
+    
+    if (reader->config.batch_size == 0) {
+        reader->config.batch_size = DEFAULT_BATCH_SIZE;
+    }
+    if (reader->config.max_record_size == 0) {
+        reader->config.max_record_size = DEFAULT_MAX_RECORD_SIZE;
+    }
+    if (reader->config.threads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        reader->config.threads = cpus > 0 ? (size_t)cpus : 1;
+    }
+    if (reader->config.threads > MAX_THREADS) {
+        reader->config.threads = MAX_THREADS;
+    }
+    
+    if (callbacks) {
+        reader->callbacks = *callbacks;
+    }
+    reader->user_data = user_data;
+    reader->schema = schema;
+    reader->record_size = record_size;
+    
+    pthread_mutex_init(&reader->lock, NULL);
+    pthread_cond_init(&reader->work_ready, NULL);
+    pthread_cond_init(&reader->work_done, NULL);
+    
+    size_t batch = reader->config.batch_size;
+    reader->slices = (RECORD_SLICE*)malloc(batch * sizeof(RECORD_SLICE));
+    reader->records = (unsigned char*)malloc(batch * record_size);
+    reader->failed_records = (unsigned char*)malloc(batch);
+    reader->decoders = (DECODER*)calloc(reader->config.threads, sizeof(DECODER));
+    
+    if (!reader->slices || !reader->records || !reader->failed_records || !reader->decoders) {
+        json_ndjson_reader_destroy(reader);
+        return NULL;
+    }
+    
+    for (size_t i = 0; i < reader->config.threads; i++) {
+        reader->decoders[i].reader = reader;
+        reader->decoders[i].arena = json_arena_create(0);
+        if (!reader->decoders[i].arena) {
+            json_ndjson_reader_destroy(reader);
+            return NULL;
+        }
+    }
+    
+    /* The caller decodes too; if some threads fail to start, run with fewer */
+    for (size_t i = 1; i < reader->config.threads; i++) {
+        DECODER *decoder = &reader->decoders[i];
+        if (pthread_create(&decoder->thread, NULL, worker_main, decoder) != 0) {
+            break;
+        }
+        reader->worker_count++;
+    }
+    
+    json_ndjson_reader_reset(reader);
+    return reader;
+}
+
+void json_ndjson_reader_destroy(JSON_NDJSON_READER *reader)
+{
+    if (!reader) return;
+    
+    pthread_mutex_lock(&reader->lock);
+    reader->shutdown = 1;
+    pthread_cond_broadcast(&reader->work_ready);
+    pthread_mutex_unlock(&reader->lock);
+    
+    for (size_t i = 1; i <= reader->worker_count; i++) {
+        pthread_join(reader->decoders[i].thread, NULL);
+    }
+    
+    pthread_cond_destroy(&reader->work_done);
+    pthread_cond_destroy(&reader->work_ready);
+    pthread_mutex_destroy(&reader->lock);
+    
+    if (reader->decoders) {
+        for (size_t i = 0; i < reader->config.threads; i++) {
+            json_arena_destroy(reader->decoders[i].arena);
+        }
+    }
+    free(reader->decoders);
+    free(reader->slices);
+    free(reader->records);
+    free(reader->failed_records);
+    free(reader->carry);
+    free(reader);
+}
+
+int json_ndjson_reader_feed(JSON_NDJSON_READER *reader, const char *data, size_t length)
+{
+    if (!reader) return -1;
+    if (reader->failed) return -1;
+    if (!data && length > 0) return reader_fail(reader, "Invalid arguments");
+    if (length == 0) return 0;
+    
+    const char *end = data + length;
+    const char *position = data;
+    
+    /* Complete the record carried over from the previous chunk */
+    if (reader->carry_length > 0) {
+        const char *newline = (const char*)memchr(position, '\n', (size_t)(end - position));
+        if (!newline) {
+            return carry_append(reader, position, length);
+        }
+        
+        if (carry_append(reader, position, (size_t)(newline - position)) != 0 ||
+            add_record(reader, reader->carry, reader->carry_length) != 0) {
+            return -1;
+        }
+        position = newline + 1;
+    }
+    
+    /* Raw newlines cannot occur inside JSON strings, so every one ends a record */
+    while (position < end) {
+        const char *newline = (const char*)memchr(position, '\n', (size_t)(end - position));
+        if (!newline) {
+            break;
+        }
+        
+        if (add_record(reader, position, (size_t)(newline - position)) != 0) {
+            return -1;
+        }
+        position = newline + 1;
+    }
+    
+    /* Records point into this chunk, so deliver them before it goes away */
+    if (run_batch(reader) != 0) {
+        return -1;
+    }
+    
+    reader->carry_length = 0;
+    if (position < end) {
+        return carry_append(reader, position, (size_t)(end - position));
+    }
+    return 0;
+}
+
+int json_ndjson_reader_finish(JSON_NDJSON_READER *reader)
+{
+    if (!reader) return -1;
+    if (reader->failed) return -1;
+    
+    if (reader->carry_length > 0) {
+        if (add_record(reader, reader->carry, reader->carry_length) != 0 || run_batch(reader) != 0) {
+            return -1;
+        }
+        reader->carry_length = 0;
+    }
+    
+    return 0;
+}
+
+void json_ndjson_reader_reset(JSON_NDJSON_READER *reader)
+{
+    if (!reader) return;
+    
+    reader->count = 0;
+    reader->carry_length = 0;
+    reader->line = 1;
+    reader->delivered = 0;
+    reader->failed = 0;
+    reader->error[0] = '\0';
+}
+
+const char* json_ndjson_reader_error(const JSON_NDJSON_READER *reader)
+{
+    return reader ? reader->error : "";
+}
+
+size_t json_ndjson_reader_count(const JSON_NDJSON_READER *reader)
+{
+    return reader ? reader->delivered : 0;
+}
+
+/* ==================== Writer ==================== */
+
+int json_ndjson_writer_init(JSON_NDJSON_WRITER *writer, size_t flush_size,
+                            JSON_NDJSON_SINK sink, void *user_data)
+{
+    if (!writer) return -1;
+    
+    memset(writer, 0, sizeof(JSON_NDJSON_WRITER));
+    writer->flush_size = flush_size ? flush_size : DEFAULT_FLUSH_SIZE;
+    writer->sink = sink;
+    writer->user_data = user_data;
+    
+    /* With a sink the buffer is reused at its working size; without one it grows */
+    writer->builder = json_builder_create(sink ? writer->flush_size + writer->flush_size / 4 : 0);
+    return writer->builder ? 0 : -1;
+}
+
+int json_ndjson_write(JSON_NDJSON_WRITER *writer, const void *record, const JSON_SCHEMA *schema)
+{
+    if (!writer || !writer->builder || !record || !schema) {
+        return -1;
+    }
+    
+    if (json_serialize_builder(record, schema, writer->builder) != 0) {
+        return -1;
+    }
+    json_builder_add_raw(writer->builder, "\n", 1);
+    if (writer->builder->error) {
+        return -1;
+    }
+    
+    writer->records++;
+    if (writer->sink && writer->builder->position >= writer->flush_size) {
+        return json_ndjson_writer_flush(writer);
+    }
+    return 0;
+}
+
+int json_ndjson_write_batch(JSON_NDJSON_WRITER *writer, const void *records, size_t count,
+                            size_t record_size, const JSON_SCHEMA *schema)
+{
+    if (!records && count > 0) {
+        return -1;
+    }
+    
+    for (size_t i = 0; i < count; i++) {
+        if (json_ndjson_write(writer, (const char*)records + i * record_size, schema) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int json_ndjson_writer_flush(JSON_NDJSON_WRITER *writer)
+{
+    if (!writer || !writer->builder) return -1;
+    if (!writer->sink) return writer->builder->error ? -1 : 0;
+    
+    int rc = writer->builder->error ? -1 : 0;
+    if (rc == 0 && writer->builder->position > 0) {
+        rc = writer->sink(writer->user_data, writer->builder->buffer, writer->builder->position);
+        rc = rc != 0 ? -1 : 0;
+    }
+    
+    json_builder_reset(writer->builder);
+    return rc;
+}
+
+void json_ndjson_writer_free(JSON_NDJSON_WRITER *writer)
+{
+    if (!writer) return;
+    
+    json_builder_destroy(writer->builder);
+    writer->builder = NULL;
+}
@@ -1,912 +1,4639 @@
 #include "json_parser.h"
+#include "json_index.h"
+#include "json_number.h"
 #include "framework.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <ctype.h>
 #include <math.h>
+#include <limits.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 /* For strdup on C99 */
 #ifndef _GNU_SOURCE
 char* strdup(const char *s);
 #endif
 
-/* Parser state */
-typedef struct {
-    const char *json;
-    size_t position;
-    size_t length;
-    char error[256];
-} JSON_PARSER_STATE;
+#define ARENA_DEFAULT_BLOCK_SIZE (64 * 1024)
+#define ARENA_ALIGNMENT 8
+#define SCRATCH_INITIAL_CAPACITY 64
+#define KEY_BUFFER_SIZE 256        /* Escaped keys are decoded into a stack buffer */
+#define INDEX_MIN_LENGTH 4096      /* Below this, indexing costs more than it saves */
+#define BUILDER_MIN_CAPACITY 64
+#define OBJECT_INDEX_MIN_KEYS 16   /* Smaller objects are searched linearly */
+#define INTERN_DEFAULT_KEYS 4096
+#define INTERN_MAX_KEY_LENGTH 64   /* Longer keys are copied per document */
 
-/* Forward declarations */
-static JSON_VALUE* parse_value(JSON_PARSER_STATE *state);
-static void skip_whitespace(JSON_PARSER_STATE *state);
+/* ==================== Arena ==================== */
 
-/* Utility functions */
-static void skip_whitespace(JSON_PARSER_STATE *state)
+typedef struct _json_arena_block_ {
+    struct _json_arena_block_ *next;
+    size_t size;
+    size_t used;
+    char data[];
+} JSON_ARENA_BLOCK;
+
+struct _json_arena_ {
+    JSON_ARENA_BLOCK *blocks;      /* Head block is the one being bump-allocated */
+    size_t block_size;
+    
+    /* Parser scratch stack and structural index, kept across parses */
+    void **scratch;
+    size_t scratch_capacity;
+    JSON_INDEX index;
+};
+
+static JSON_ARENA_BLOCK* arena_block_create(size_t size)
 {
-    while (state->position < state->length) {
-        char c = state->json[state->position];
-        if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
-            state->position++;
-        } else {
-            break;
-        }
-    }
+    JSON_ARENA_BLOCK *block = (JSON_ARENA_BLOCK*)malloc(sizeof(JSON_ARENA_BLOCK) + size);
+    if (!block) return NULL;
+    
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
 }
 
-static char peek_char(JSON_PARSER_STATE *state)
+JSON_ARENA* json_arena_create(size_t block_size)
 {
-    if (state->position < state->length) {
-        return state->json[state->position];
+    JSON_ARENA *arena = (JSON_ARENA*)calloc(1, sizeof(JSON_ARENA));
+    if (!arena) return NULL;
+    
+    arena->block_size = block_size ? block_size : ARENA_DEFAULT_BLOCK_SIZE;
+    arena->blocks = arena_block_create(arena->block_size);
+    if (!arena->blocks) {
+        free(arena);
+        return NULL;
     }
-    return '\0';
+    json_index_init(&arena->index);
+    
+    return arena;
 }
 
-static char next_char(JSON_PARSER_STATE *state)
+void json_arena_destroy(JSON_ARENA *arena)
 {
-    if (state->position < state->length) {
-        return state->json[state->position++];
+    if (!arena) return;
+    
+    JSON_ARENA_BLOCK *block = arena->blocks;
+    while (block) {
+        JSON_ARENA_BLOCK *next = block->next;
+        free(block);
+        block = next;
     }
-    return '\0';
+    
+    free(arena->scratch);
+    json_index_free(&arena->index);
+    free(arena);
 }
 
-static int match_keyword(JSON_PARSER_STATE *state, const char *keyword)
+void json_arena_reset(JSON_ARENA *arena)
 {
-    size_t len = strlen(keyword);
-    if (state->position + len > state->length) {
-        return 0;
-    }
-    if (strncmp(&state->json[state->position], keyword, len) == 0) {
-        state->position += len;
-        return 1;
+    if (!arena) return;
+    
+    /* Coalesce into one block big enough for everything used so far */
+    if (arena->blocks && arena->blocks->next) {
+        size_t total = 0;
+        JSON_ARENA_BLOCK *block = arena->blocks;
+        while (block) {
+            JSON_ARENA_BLOCK *next = block->next;
+            total += block->size;
+            free(block);
+            block = next;
+        }
+        
+        arena->blocks = arena_block_create(total);
+        if (!arena->blocks) {
+            arena->blocks = arena_block_create(arena->block_size);
+        }
+    } else if (arena->blocks) {
+        arena->blocks->used = 0;
     }
-    return 0;
 }
 
-/* Parse string */
-static char* parse_string(JSON_PARSER_STATE *state)
+size_t json_arena_used(const JSON_ARENA *arena)
 {
-    if (next_char(state) != '"') {
-        snprintf(state->error, sizeof(state->error), "Expected '\"'");
-        return NULL;
+    size_t used = 0;
+    
+    for (const JSON_ARENA_BLOCK *block = arena ? arena->blocks : NULL; block; block = block->next) {
+        used += block->used;
     }
     
-    size_t start = state->position;
-    size_t length = 0;
+    return used;
+}
+
+void* json_arena_alloc(JSON_ARENA *arena, size_t size)
+{
+    if (!arena || !arena->blocks) return NULL;
     
-    while (state->position < state->length) {
-        char c = state->json[state->position];
-        if (c == '"') {
-            break;
-        } else if (c == '\\') {
-            state->position++;
-            if (state->position >= state->length) {
-                snprintf(state->error, sizeof(state->error), "Unterminated string");
-                return NULL;
-            }
-            state->position++;
-            length++;
-        } else {
-            state->position++;
-            length++;
-        }
-    }
+    size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
     
-    if (peek_char(state) != '"') {
-        snprintf(state->error, sizeof(state->error), "Unterminated string");
-        return NULL;
+    JSON_ARENA_BLOCK *head = arena->blocks;
+    if (head->size - head->used >= size) {
+        void *ptr = head->data + head->used;
+        head->used += size;
+        return ptr;
     }
     
-    char *str = (char*)malloc(length + 1);
-    if (!str) return NULL;
-    
-    size_t dest_pos = 0;
-    size_t src_pos = start;
-    
-    while (src_pos < state->position) {
-        char c = state->json[src_pos];
-        if (c == '\\') {
-            src_pos++;
-            char escape = state->json[src_pos];
-            switch (escape) {
-                case '"': str[dest_pos++] = '"'; break;
-                case '\\': str[dest_pos++] = '\\'; break;
-                case '/': str[dest_pos++] = '/'; break;
-                case 'b': str[dest_pos++] = '\b'; break;
-                case 'f': str[dest_pos++] = '\f'; break;
-                case 'n': str[dest_pos++] = '\n'; break;
-                case 'r': str[dest_pos++] = '\r'; break;
-                case 't': str[dest_pos++] = '\t'; break;
-                default: str[dest_pos++] = escape; break;
-            }
-            src_pos++;
-        } else {
-            str[dest_pos++] = c;
-            src_pos++;
-        }
+    /* Large requests get a dedicated block behind the head so its free space is kept */
+    if (size > arena->block_size / 4) {
+        JSON_ARENA_BLOCK *block = arena_block_create(size);
+        if (!block) return NULL;
+        
+        block->used = size;
+        block->next = head->next;
+        head->next = block;
+        return block->data;
     }
     
-    str[dest_pos] = '\0';
-    next_char(state); /* Skip closing quote */
+    JSON_ARENA_BLOCK *block = arena_block_create(arena->block_size);
+    if (!block) return NULL;
     
-    return str;
+    block->used = size;
+    block->next = head;
+    arena->blocks = block;
+    return block->data;
 }
 
-/* Parse number */
-static JSON_VALUE* parse_number(JSON_PARSER_STATE *state)
+/* ==================== Key Interning ==================== */
+
+static uint32_t fnv1a_hash(const char *data, size_t length);
+
+/* One canonical key; slots point at these, and callers get text */
+typedef struct {
+    uint32_t hash;
+    uint32_t length;
+    char text[];
+} INTERN_ENTRY;
+
+/*
+ * Insert-only open-addressed table, at most half full. Readers only load
+ * slots (acquire), writers publish a finished entry with a CAS, so lookups
+ * never lock and concurrent inserts of the same key agree on one winner.
+ */
+struct _json_intern_ {
+    size_t mask;
+    size_t limit;                  /* Most keys stored */
+    size_t count;                  /* Keys stored or being inserted (atomic) */
+    INTERN_ENTRY *slots[];
+};
+
+JSON_INTERN* json_intern_create(size_t max_keys)
 {
-    size_t start = state->position;
-    int is_double = 0;
-    
-    if (peek_char(state) == '-') {
-        next_char(state);
-    }
-    
-    while (isdigit(peek_char(state))) {
-        next_char(state);
+    if (max_keys == 0) {
+        max_keys = INTERN_DEFAULT_KEYS;
     }
-    
-    if (peek_char(state) == '.') {
-        is_double = 1;
-        next_char(state);
-        while (isdigit(peek_char(state))) {
-            next_char(state);
-        }
+    if (max_keys > SIZE_MAX / 4 / sizeof(INTERN_ENTRY*)) {
+        return NULL;
     }
     
-    if (peek_char(state) == 'e' || peek_char(state) == 'E') {
-        is_double = 1;
-        next_char(state);
-        if (peek_char(state) == '+' || peek_char(state) == '-') {
-            next_char(state);
-        }
-        while (isdigit(peek_char(state))) {
-            next_char(state);
-        }
+    size_t capacity = 16;
+    while (capacity < max_keys * 2) {
+        capacity *= 2;
     }
     
-    size_t length = state->position - start;
-    char *num_str = (char*)malloc(length + 1);
-    if (!num_str) return NULL;
+    JSON_INTERN *pool = (JSON_INTERN*)calloc(1, sizeof(JSON_INTERN) + capacity * sizeof(INTERN_ENTRY*));
+    if (!pool) return NULL;
     
-    strncpy(num_str, &state->json[start], length);
-    num_str[length] = '\0';
-    
-    JSON_VALUE *value = (JSON_VALUE*)calloc(1, sizeof(JSON_VALUE));
-    if (!value) {
-        free(num_str);
-        return NULL;
-    }
+    pool->mask = capacity - 1;
+    pool->limit = max_keys;
+    return pool;
+}
+
+void json_intern_destroy(JSON_INTERN *pool)
+{
+    if (!pool) return;
     
-    if (is_double) {
-        value->type = JSON_TYPE_DOUBLE;
-        value->data.double_value = atof(num_str);
-    } else {
-        value->type = JSON_TYPE_INTEGER;
-        value->data.integer_value = atoll(num_str);
+    for (size_t i = 0; i <= pool->mask; i++) {
+        free(pool->slots[i]);
     }
-    
-    free(num_str);
-    return value;
+    free(pool);
 }
 
-/* Parse array */
-static JSON_VALUE* parse_array(JSON_PARSER_STATE *state)
+size_t json_intern_count(const JSON_INTERN *pool)
 {
-    if (next_char(state) != '[') {
-        snprintf(state->error, sizeof(state->error), "Expected '['");
-        return NULL;
-    }
+    if (!pool) return 0;
     
-    JSON_VALUE *array = (JSON_VALUE*)calloc(1, sizeof(JSON_VALUE));
-    if (!array) return NULL;
+    size_t count = __atomic_load_n(&pool->count, __ATOMIC_RELAXED);
+    return count < pool->limit ? count : pool->limit;
+}
+
+/* Slot holding the key, or the empty slot where it would go */
+static size_t intern_probe(JSON_INTERN *pool, const char *str, size_t length, uint32_t hash, INTERN_ENTRY **found)
+{
+    size_t slot = hash & pool->mask;
     
-    array->type = JSON_TYPE_ARRAY;
-    array->data.array_value.elements = NULL;
-    array->data.array_value.count = 0;
+    while (1) {
+        INTERN_ENTRY *entry = __atomic_load_n(&pool->slots[slot], __ATOMIC_ACQUIRE);
+        if (!entry || (entry->hash == hash && entry->length == length && memcmp(entry->text, str, length) == 0)) {
+            *found = entry;
+            return slot;
+        }
+        slot = (slot + 1) & pool->mask;
+    }
+}
+
+const char* json_intern(JSON_INTERN *pool, const char *str, size_t length)
+{
+    if (!pool || !str || length > UINT32_MAX || memchr(str, '\0', length)) return NULL;
     
-    skip_whitespace(state);
+    uint32_t hash = fnv1a_hash(str, length);
+    INTERN_ENTRY *entry;
+    size_t slot = intern_probe(pool, str, length, hash, &entry);
+    if (entry) {
+        return entry->text;
+    }
     
-    if (peek_char(state) == ']') {
-        next_char(state);
-        return array;
+    /* Reserve room first so the table never fills past half */
+    if (__atomic_fetch_add(&pool->count, 1, __ATOMIC_RELAXED) >= pool->limit) {
+        __atomic_fetch_sub(&pool->count, 1, __ATOMIC_RELAXED);
+        return NULL;
     }
     
-    size_t capacity = 4;
-    array->data.array_value.elements = (JSON_VALUE**)malloc(capacity * sizeof(JSON_VALUE*));
-    if (!array->data.array_value.elements) {
-        free(array);
+    INTERN_ENTRY *created = (INTERN_ENTRY*)malloc(sizeof(INTERN_ENTRY) + length + 1);
+    if (!created) {
+        __atomic_fetch_sub(&pool->count, 1, __ATOMIC_RELAXED);
         return NULL;
     }
+    created->hash = hash;
+    created->length = (uint32_t)length;
+    memcpy(created->text, str, length);
+    created->text[length] = '\0';
     
     while (1) {
-        skip_whitespace(state);
-        
-        JSON_VALUE *element = parse_value(state);
-        if (!element) {
-            json_free(array);
-            return NULL;
-        }
-        
-        if (array->data.array_value.count >= capacity) {
-            capacity *= 2;
-            JSON_VALUE **new_elements = (JSON_VALUE**)realloc(
-                array->data.array_value.elements, capacity * sizeof(JSON_VALUE*));
-            if (!new_elements) {
-                json_free(element);
-                json_free(array);
-                return NULL;
-            }
-            array->data.array_value.elements = new_elements;
+        INTERN_ENTRY *expected = NULL;
+        if (__atomic_compare_exchange_n(&pool->slots[slot], &expected, created, 0,
+                                        __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+            return created->text;
         }
         
-        array->data.array_value.elements[array->data.array_value.count++] = element;
-        
-        skip_whitespace(state);
-        char c = peek_char(state);
-        
-        if (c == ']') {
-            next_char(state);
-            break;
-        } else if (c == ',') {
-            next_char(state);
-        } else {
-            snprintf(state->error, sizeof(state->error), "Expected ',' or ']'");
-            json_free(array);
-            return NULL;
+        /* Another thread took the slot; it may have inserted the same key */
+        slot = intern_probe(pool, str, length, hash, &entry);
+        if (entry) {
+            free(created);
+            __atomic_fetch_sub(&pool->count, 1, __ATOMIC_RELAXED);
+            return entry->text;
         }
     }
-    
-    return array;
 }
 
-/* Parse object */
-static JSON_VALUE* parse_object(JSON_PARSER_STATE *state)
+/* Whether str is a canonical pointer of the pool (not just an equal string) */
+static int intern_owns(JSON_INTERN *pool, const char *str)
 {
-    if (next_char(state) != '{') {
-        snprintf(state->error, sizeof(state->error), "Expected '{'");
-        return NULL;
-    }
-    
-    JSON_VALUE *object = (JSON_VALUE*)calloc(1, sizeof(JSON_VALUE));
-    if (!object) return NULL;
-    
-    object->type = JSON_TYPE_OBJECT;
-    object->data.object_value.keys = NULL;
-    object->data.object_value.values = NULL;
-    object->data.object_value.count = 0;
-    
-    skip_whitespace(state);
-    
-    if (peek_char(state) == '}') {
-        next_char(state);
-        return object;
-    }
-    
-    size_t capacity = 4;
-    object->data.object_value.keys = (char**)malloc(capacity * sizeof(char*));
-    object->data.object_value.values = (JSON_VALUE**)malloc(capacity * sizeof(JSON_VALUE*));
+    INTERN_ENTRY *entry;
+    size_t length = strlen(str);
     
-    if (!object->data.object_value.keys || !object->data.object_value.values) {
-        json_free(object);
-        return NULL;
-    }
+    intern_probe(pool, str, length, fnv1a_hash(str, length), &entry);
+    return entry && entry->text == str;
+}
+
+/* ==================== Strings ==================== */
+
+static int strict_utf8 = 0;
+
+void json_set_strict_utf8(int enabled)
+{
+    strict_utf8 = enabled;
+}
+
+int json_utf8_valid(const char *text, size_t length)
+{
+    const unsigned char *s = (const unsigned char*)text;
+    size_t i = 0;
     
-    while (1) {
-        skip_whitespace(state);
-        
-        char *key = parse_string(state);
-        if (!key) {
-            json_free(object);
-            return NULL;
+    while (i < length) {
+#ifdef __SSE2__
+        /* ASCII blocks have no high bits set */
+        while (i + 16 <= length && !_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(s + i)))) {
+            i += 16;
         }
+        if (i >= length) {
+            break;
+        }
+#endif
         
-        skip_whitespace(state);
-        
-        if (next_char(state) != ':') {
-            free(key);
-            json_free(object);
-            snprintf(state->error, sizeof(state->error), "Expected ':'");
-            return NULL;
+        unsigned char c = s[i];
+        if (c < 0x80) {
+            i++;
+            continue;
         }
         
-        skip_whitespace(state);
+        size_t trailing;
+        uint32_t code_point;
+        uint32_t minimum;
         
-        JSON_VALUE *value = parse_value(state);
-        if (!value) {
-            free(key);
-            json_free(object);
-            return NULL;
+        if ((c & 0xE0) == 0xC0) {
+            trailing = 1;
+            code_point = c & 0x1F;
+            minimum = 0x80;
+        } else if ((c & 0xF0) == 0xE0) {
+            trailing = 2;
+            code_point = c & 0x0F;
+            minimum = 0x800;
+        } else if ((c & 0xF8) == 0xF0) {
+            trailing = 3;
+            code_point = c & 0x07;
+            minimum = 0x10000;
+        } else {
+            return 0;
         }
         
-        if (object->data.object_value.count >= capacity) {
-            capacity *= 2;
-            char **new_keys = (char**)realloc(
-                object->data.object_value.keys, capacity * sizeof(char*));
-            JSON_VALUE **new_values = (JSON_VALUE**)realloc(
-                object->data.object_value.values, capacity * sizeof(JSON_VALUE*));
-            
-            if (!new_keys || !new_values) {
-                free(key);
-                json_free(value);
-                json_free(object);
-                return NULL;
+        if (trailing >= length - i) {
+            return 0;
+        }
+        for (size_t k = 1; k <= trailing; k++) {
+            unsigned char next = s[i + k];
+            if ((next & 0xC0) != 0x80) {
+                return 0;
             }
-            
-            object->data.object_value.keys = new_keys;
-            object->data.object_value.values = new_values;
+            code_point = (code_point << 6) | (next & 0x3F);
         }
         
-        object->data.object_value.keys[object->data.object_value.count] = key;
-        object->data.object_value.values[object->data.object_value.count] = value;
-        object->data.object_value.count++;
-        
-        skip_whitespace(state);
-        char c = peek_char(state);
-        
-        if (c == '}') {
-            next_char(state);
-            break;
-        } else if (c == ',') {
-            next_char(state);
-        } else {
-            snprintf(state->error, sizeof(state->error), "Expected ',' or '}'");
-            json_free(object);
-            return NULL;
+        /* Overlong forms, surrogates and values beyond Unicode */
+        if (code_point < minimum || code_point > 0x10FFFF || (code_point >= 0xD800 && code_point <= 0xDFFF)) {
+            return 0;
         }
+        i += trailing + 1;
     }
     
-    return object;
+    return 1;
 }
 
-/* Parse value */
-static JSON_VALUE* parse_value(JSON_PARSER_STATE *state)
+#ifdef __SSE2__
+/* Bit mask of the quotes, backslashes and control characters in a 16-byte block */
+static int special_bytes(__m128i v)
 {
-    skip_whitespace(state);
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1F);
     
-    char c = peek_char(state);
+    /* min(v, 0x1F) == v exactly for bytes below 0x20 */
+    __m128i special = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+        _mm_cmpeq_epi8(_mm_min_epu8(v, control), v));
+    return _mm_movemask_epi8(special);
+}
+#endif
+
+static int is_special_byte(unsigned char c)
+{
+    return c < 0x20 || c == '"' || c == '\\';
+}
+
+/* Length of the prefix that can be copied without escaping */
+static size_t escape_free_length(const char *str, size_t length)
+{
+    size_t i = 0;
+
+#ifdef __SSE2__
+    for (; i + 16 <= length; i += 16) {
+        int mask = special_bytes(_mm_loadu_si128((const __m128i*)(str + i)));
+        if (mask) {
+            return i + (size_t)__builtin_ctz((unsigned)mask);
+        }
+    }
+#endif
     
-    if (c == '{') {
-        return parse_object(state);
-    } else if (c == '[') {
-        return parse_array(state);
-    } else if (c == '"') {
-        char *str = parse_string(state);
-        if (!str) return NULL;
+    while (i < length && !is_special_byte((unsigned char)str[i])) {
+        i++;
+    }
+    return i;
+}
+
+/*
+ * Copy the escape-free prefix of src into dest in 16-byte blocks, checking
+ * each block as it is copied; returns its length. dest must have room for
+ * length bytes, as whole blocks are stored.
+ */
+static size_t copy_escape_free(const char *src, size_t length, char *dest)
+{
+    size_t i = 0;
+
+#ifdef __SSE2__
+    for (; i + 16 <= length; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_si128((__m128i*)(dest + i), v);
         
-        JSON_VALUE *value = (JSON_VALUE*)calloc(1, sizeof(JSON_VALUE));
-        if (!value) {
-            free(str);
-            return NULL;
+        int mask = special_bytes(v);
+        if (mask) {
+            return i + (size_t)__builtin_ctz((unsigned)mask);
         }
-        value->type = JSON_TYPE_STRING;
-        value->data.string_value = str;
-        return value;
-    } else if (match_keyword(state, "true")) {
-        JSON_VALUE *value = (JSON_VALUE*)calloc(1, sizeof(JSON_VALUE));
-        if (!value) return NULL;
-        value->type = JSON_TYPE_BOOLEAN;
-        value->data.boolean_value = 1;
-        return value;
-    } else if (match_keyword(state, "false")) {
-        JSON_VALUE *value = (JSON_VALUE*)calloc(1, sizeof(JSON_VALUE));
-        if (!value) return NULL;
-        value->type = JSON_TYPE_BOOLEAN;
-        value->data.boolean_value = 0;
+    }
+#endif
+    
+    for (; i < length; i++) {
+        char c = src[i];
+        if (is_special_byte((unsigned char)c)) {
+            break;
+        }
+        dest[i] = c;
+    }
+    return i;
+}
+
+static size_t encode_utf8(uint32_t code_point, char *out)
+{
+    if (code_point < 0x80) {
+        out[0] = (char)code_point;
+        return 1;
+    } else if (code_point < 0x800) {
+        out[0] = (char)(0xC0 | (code_point >> 6));
+        out[1] = (char)(0x80 | (code_point & 0x3F));
+        return 2;
+    } else if (code_point < 0x10000) {
+        out[0] = (char)(0xE0 | (code_point >> 12));
+        out[1] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (code_point & 0x3F));
+        return 3;
+    }
+    
+    out[0] = (char)(0xF0 | (code_point >> 18));
+    out[1] = (char)(0x80 | ((code_point >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (code_point & 0x3F));
+    return 4;
+}
+
+/* Shorten text cut at an arbitrary byte so it does not end inside a UTF-8 character */
+static size_t utf8_trim(const char *text, size_t length)
+{
+    size_t lead = length;
+    while (lead > 0 && length - lead < 3 && ((unsigned char)text[lead - 1] & 0xC0) == 0x80) {
+        lead--;
+    }
+    if (lead == 0) {
+        return length;
+    }
+    
+    unsigned char c = (unsigned char)text[lead - 1];
+    size_t needed = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+    return (length - (lead - 1) < needed) ? lead - 1 : length;
+}
+
+/* Four hex digits of a \u escape */
+static int parse_hex4(const char *text, uint32_t *value)
+{
+    uint32_t result = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = text[i];
+        result <<= 4;
+        if (c >= '0' && c <= '9') {
+            result |= (uint32_t)(c - '0');
+        } else if (c >= 'a' && c <= 'f') {
+            result |= (uint32_t)(c - 'a' + 10);
+        } else if (c >= 'A' && c <= 'F') {
+            result |= (uint32_t)(c - 'A' + 10);
+        } else {
+            return -1;
+        }
+    }
+    *value = result;
+    return 0;
+}
+
+/* Decode one escape sequence at src (after the backslash); returns source bytes consumed, 0 on error */
+static size_t decode_escape(const char *src, size_t length, char *out, size_t *out_length, const char **error)
+{
+    if (length == 0) {
+        *error = "Invalid escape sequence";
+        return 0;
+    }
+    
+    *out_length = 1;
+    switch (src[0]) {
+        case '"': out[0] = '"'; return 1;
+        case '\\': out[0] = '\\'; return 1;
+        case '/': out[0] = '/'; return 1;
+        case 'b': out[0] = '\b'; return 1;
+        case 'f': out[0] = '\f'; return 1;
+        case 'n': out[0] = '\n'; return 1;
+        case 'r': out[0] = '\r'; return 1;
+        case 't': out[0] = '\t'; return 1;
+        case 'u': break;
+        default:
+            *error = "Invalid escape sequence";
+            return 0;
+    }
+    
+    uint32_t code_point;
+    if (length < 5 || parse_hex4(src + 1, &code_point) != 0) {
+        *error = "Invalid unicode escape";
+        return 0;
+    }
+    
+    /* Decoded strings are NUL-terminated; an embedded NUL would silently cut them short */
+    if (code_point == 0) {
+        *error = "Escaped NUL in string";
+        return 0;
+    }
+    
+    size_t consumed = 5;
+    if (code_point >= 0xD800 && code_point <= 0xDBFF) {
+        uint32_t low;
+        if (length < 11 || src[5] != '\\' || src[6] != 'u' || parse_hex4(src + 7, &low) != 0 ||
+            low < 0xDC00 || low > 0xDFFF) {
+            *error = "Invalid surrogate pair";
+            return 0;
+        }
+        code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+        consumed = 11;
+    } else if (code_point >= 0xDC00 && code_point <= 0xDFFF) {
+        *error = "Invalid surrogate pair";
+        return 0;
+    }
+    
+    *out_length = encode_utf8(code_point, out);
+    return consumed;
+}
+
+/*
+ * Decode a string body (the text between the quotes) into dest and
+ * NUL-terminate it. Output stops at dest_size - 1 bytes without splitting
+ * a character. Escape-free runs are copied in blocks; escapes, including
+ * \u surrogate pairs, are decoded to UTF-8.
+ *
+ * Returns the decoded length, or DECODE_ERROR with *error set for an
+ * invalid escape, a raw control character, or (when strict UTF-8 is on)
+ * malformed UTF-8.
+ */
+#define DECODE_ERROR ((size_t)-1)
+
+static size_t decode_string(const char *src, size_t length, char *dest, size_t dest_size, const char **error)
+{
+    size_t limit = dest_size - 1;
+    size_t in = 0;
+    size_t out = 0;
+    
+    while (in < length) {
+        size_t run;
+        if (limit - out >= length - in) {
+            run = copy_escape_free(src + in, length - in, dest + out);
+        } else {
+            run = escape_free_length(src + in, length - in);
+            if (run > limit - out) {
+                memcpy(dest + out, src + in, limit - out);
+                out = utf8_trim(dest, limit);
+                break;
+            }
+            memcpy(dest + out, src + in, run);
+        }
+        in += run;
+        out += run;
+        
+        if (in == length) {
+            break;
+        }
+        if (src[in] != '\\') {
+            *error = "Control character in string";
+            return DECODE_ERROR;
+        }
+        
+        char decoded[4];
+        size_t decoded_length;
+        size_t consumed = decode_escape(src + in + 1, length - in - 1, decoded, &decoded_length, error);
+        if (consumed == 0) {
+            return DECODE_ERROR;
+        }
+        if (decoded_length > limit - out) {
+            break;
+        }
+        
+        memcpy(dest + out, decoded, decoded_length);
+        in += consumed + 1;
+        out += decoded_length;
+    }
+    
+    dest[out] = '\0';
+    
+    if (strict_utf8 && !json_utf8_valid(dest, out)) {
+        *error = "Invalid UTF-8 in string";
+        return DECODE_ERROR;
+    }
+    
+    return out;
+}
+
+/* ==================== Parser ==================== */
+
+/* Parser state */
+typedef struct {
+    const char *json;
+    size_t position;
+    size_t length;
+    char error[256];
+    
+    JSON_ARENA *arena;             /* NULL = every node is heap allocated */
+    JSON_INTERN *intern;           /* Canonical object keys (heap parses only) */
+    int track_source;              /* Record each node's source range (heap only) */
+    
+    /* Children of open containers, copied out exactly sized when each closes */
+    void **stack;
+    size_t stack_count;
+    size_t stack_capacity;
+    
+    /* Structural index (NULL = scan byte by byte); index_next only moves forward */
+    const uint32_t *index;
+    size_t index_count;
+    size_t index_next;
+} JSON_PARSER_STATE;
+
+/* Forward declarations */
+static JSON_VALUE* parse_value(JSON_PARSER_STATE *state);
+static void skip_whitespace(JSON_PARSER_STATE *state);
+static void builder_append_length(JSON_BUILDER *builder, const char *str, size_t len);
+static void builder_append_escaped(JSON_BUILDER *builder, const char *str, size_t length);
+
+static uint32_t fnv1a_hash(const char *data, size_t length)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* Open-addressed table from key to member, at most half full */
+struct _json_object_index_ {
+    size_t mask;
+    struct {
+        uint32_t hash;
+        uint32_t member;           /* Member index + 1, 0 = empty slot */
+    } slots[];
+};
+
+static size_t object_index_size(size_t count, size_t *mask)
+{
+    size_t capacity = 1;
+    while (capacity < count * 2) {
+        capacity <<= 1;
+    }
+    *mask = capacity - 1;
+    return sizeof(JSON_OBJECT_INDEX) + capacity * sizeof(((JSON_OBJECT_INDEX*)0)->slots[0]);
+}
+
+/* Insert members in order; a duplicate key keeps its first member, as linear lookup does */
+static void object_index_fill(JSON_OBJECT_INDEX *index, size_t mask, char **keys, size_t count)
+{
+    index->mask = mask;
+    memset(index->slots, 0, (mask + 1) * sizeof(index->slots[0]));
+    
+    for (size_t i = 0; i < count; i++) {
+        size_t length = strlen(keys[i]);
+        uint32_t hash = fnv1a_hash(keys[i], length);
+        size_t slot = hash & mask;
+        
+        while (index->slots[slot].member) {
+            if (index->slots[slot].hash == hash && strcmp(keys[index->slots[slot].member - 1], keys[i]) == 0) {
+                break;
+            }
+            slot = (slot + 1) & mask;
+        }
+        
+        if (!index->slots[slot].member) {
+            index->slots[slot].hash = hash;
+            index->slots[slot].member = (uint32_t)(i + 1);
+        }
+    }
+}
+
+/* Allocation follows the parse mode: arena memory is released by json_arena_reset */
+static void* state_alloc(JSON_PARSER_STATE *state, size_t size)
+{
+    if (state->arena) {
+        return json_arena_alloc(state->arena, size);
+    }
+    return malloc(size);
+}
+
+static void state_release(JSON_PARSER_STATE *state, void *ptr)
+{
+    if (!state->arena) {
+        free(ptr);
+    }
+}
+
+static void state_free_value(JSON_PARSER_STATE *state, JSON_VALUE *value)
+{
+    if (!state->arena) {
+        json_free(value);
+    }
+}
+
+/* Node from json_parse_source, followed by the range of input it was parsed from */
+typedef struct {
+    JSON_VALUE value;
+    const char *start;
+    size_t length;
+} JSON_SOURCE_VALUE;
+
+static JSON_VALUE* new_value(JSON_PARSER_STATE *state, JSON_TYPE type)
+{
+    size_t size = state->track_source ? sizeof(JSON_SOURCE_VALUE) : sizeof(JSON_VALUE);
+    JSON_VALUE *value = (JSON_VALUE*)state_alloc(state, size);
+    if (!value) return NULL;
+    
+    memset(value, 0, size);
+    value->type = type;
+    value->flags = state->arena ? JSON_VALUE_FLAG_ARENA : 0;
+    if (state->track_source) {
+        value->flags |= JSON_VALUE_FLAG_SOURCE;
+    }
+    return value;
+}
+
+static int stack_push(JSON_PARSER_STATE *state, void *item)
+{
+    if (state->stack_count >= state->stack_capacity) {
+        size_t new_capacity = state->stack_capacity ? state->stack_capacity * 2 : SCRATCH_INITIAL_CAPACITY;
+        void **new_stack = (void**)realloc(state->stack, new_capacity * sizeof(void*));
+        if (!new_stack) {
+            snprintf(state->error, sizeof(state->error), "Out of memory");
+            return -1;
+        }
+        state->stack = new_stack;
+        state->stack_capacity = new_capacity;
+    }
+    
+    state->stack[state->stack_count++] = item;
+    return 0;
+}
+
+/* Drop children pushed since base; objects push key/value pairs */
+static void stack_unwind(JSON_PARSER_STATE *state, size_t base, int pairs)
+{
+    for (size_t i = base; i < state->stack_count; i++) {
+        if (pairs && (i - base) % 2 == 0) {
+            if (!state->intern || !intern_owns(state->intern, (const char*)state->stack[i])) {
+                state_release(state, state->stack[i]);
+            }
+        } else {
+            state_free_value(state, (JSON_VALUE*)state->stack[i]);
+        }
+    }
+    state->stack_count = base;
+}
+
+/* Index the text when it is large enough to pay off; parsing works either way */
+static void state_use_index(JSON_PARSER_STATE *state, JSON_INDEX *index)
+{
+    if (state->length < INDEX_MIN_LENGTH || json_index_build(index, state->json, state->length) != 0) {
+        return;
+    }
+    
+    state->index = index->positions;
+    state->index_count = index->count;
+    state->index_next = 0;
+}
+
+/* Offset of the first indexed token at or after position */
+static size_t index_seek(JSON_PARSER_STATE *state, size_t position)
+{
+    while (state->index_next < state->index_count && state->index[state->index_next] < position) {
+        state->index_next++;
+    }
+    return state->index_next < state->index_count ? state->index[state->index_next] : state->length;
+}
+
+/* Utility functions */
+static void skip_whitespace(JSON_PARSER_STATE *state)
+{
+    if (state->index) {
+        /*
+         * Every non-whitespace byte that follows whitespace outside a string
+         * starts an index entry, so the next entry ends the run
+         */
+        if (state->position < state->length) {
+            char c = state->json[state->position];
+            if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+                state->position = index_seek(state, state->position);
+            }
+        }
+        return;
+    }
+    
+    while (state->position < state->length) {
+        char c = state->json[state->position];
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+            state->position++;
+        } else {
+            break;
+        }
+    }
+}
+
+static char peek_char(JSON_PARSER_STATE *state)
+{
+    if (state->position < state->length) {
+        return state->json[state->position];
+    }
+    return '\0';
+}
+
+static char next_char(JSON_PARSER_STATE *state)
+{
+    if (state->position < state->length) {
+        return state->json[state->position++];
+    }
+    return '\0';
+}
+
+static int match_keyword(JSON_PARSER_STATE *state, const char *keyword)
+{
+    size_t len = strlen(keyword);
+    if (state->position + len > state->length) {
+        return 0;
+    }
+    if (strncmp(&state->json[state->position], keyword, len) == 0) {
+        state->position += len;
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Find the extent of a string token; position ends after the closing quote.
+ * escaped (optional) is set if the body contains a backslash. Contents are
+ * checked when the string is decoded.
+ */
+static int scan_string(JSON_PARSER_STATE *state, const char **raw, size_t *raw_length, int *escaped)
+{
+    if (next_char(state) != '"') {
+        snprintf(state->error, sizeof(state->error), "Expected '\"'");
+        return -1;
+    }
+    
+    size_t start = state->position;
+    
+    if (state->index) {
+        /* Quotes inside strings are not indexed: the next entry is the closing quote */
+        size_t end = index_seek(state, start);
+        if (end < state->length && state->json[end] == '"') {
+            *raw = &state->json[start];
+            *raw_length = end - start;
+            if (escaped) {
+                *escaped = memchr(*raw, '\\', *raw_length) != NULL;
+            }
+            state->position = end + 1;
+            return 0;
+        }
+        
+        state->position = state->length;
+        snprintf(state->error, sizeof(state->error), "Unterminated string");
+        return -1;
+    }
+    
+    int has_escape = 0;
+    while (state->position < state->length) {
+        state->position += escape_free_length(state->json + state->position, state->length - state->position);
+        if (state->position >= state->length) {
+            break;
+        }
+        
+        char c = state->json[state->position];
+        if (c == '"') {
+            *raw = &state->json[start];
+            *raw_length = state->position - start;
+            if (escaped) {
+                *escaped = has_escape;
+            }
+            state->position++;
+            return 0;
+        } else if (c == '\\') {
+            has_escape = 1;
+            state->position += 2;
+        } else {
+            state->position++;
+        }
+    }
+    
+    state->position = state->length;
+    snprintf(state->error, sizeof(state->error), "Unterminated string");
+    return -1;
+}
+
+/* Decode a scanned string body, reporting errors through the parser state */
+static size_t state_decode_string(JSON_PARSER_STATE *state, const char *raw, size_t raw_length,
+                                  char *dest, size_t dest_size)
+{
+    const char *error;
+    size_t length = decode_string(raw, raw_length, dest, dest_size, &error);
+    if (length == DECODE_ERROR) {
+        snprintf(state->error, sizeof(state->error), "%s", error);
+    }
+    return length;
+}
+
+/* Parse string; decoding never lengthens it, so the raw length bounds the allocation */
+static char* parse_string(JSON_PARSER_STATE *state)
+{
+    const char *raw;
+    size_t raw_length;
+    
+    if (scan_string(state, &raw, &raw_length, NULL) != 0) {
+        return NULL;
+    }
+    
+    char *str = (char*)state_alloc(state, raw_length + 1);
+    if (!str) return NULL;
+    
+    if (state_decode_string(state, raw, raw_length, str, raw_length + 1) == DECODE_ERROR) {
+        state_release(state, str);
+        return NULL;
+    }
+    
+    return str;
+}
+
+/* Parse a number without allocating; integers that overflow int64 become doubles */
+static int scan_number(JSON_PARSER_STATE *state, JSON_NUMBER *number)
+{
+    size_t consumed = json_number_parse(state->json + state->position,
+                                        state->length - state->position, number);
+    if (consumed == 0) {
+        snprintf(state->error, sizeof(state->error), "Invalid number");
+        return -1;
+    }
+    
+    state->position += consumed;
+    return 0;
+}
+
+/* Parse number */
+static JSON_VALUE* parse_number(JSON_PARSER_STATE *state)
+{
+    JSON_NUMBER number;
+    if (scan_number(state, &number) != 0) {
+        return NULL;
+    }
+    
+    JSON_VALUE *value = new_value(state, number.is_double ? JSON_TYPE_DOUBLE : JSON_TYPE_INTEGER);
+    if (!value) return NULL;
+    
+    if (number.is_double) {
+        value->data.double_value = number.real;
+    } else {
+        value->data.integer_value = number.integer;
+    }
+    
+    return value;
+}
+
+/* Skip over any value without allocating, checking its syntax */
+static int skip_value(JSON_PARSER_STATE *state)
+{
+    skip_whitespace(state);
+    
+    char c = peek_char(state);
+    
+    if (c == '"') {
+        const char *raw;
+        size_t raw_length;
+        return scan_string(state, &raw, &raw_length, NULL);
+    } else if (c == '{' || c == '[') {
+        char close = (c == '{') ? '}' : ']';
+        next_char(state);
+        skip_whitespace(state);
+        
+        if (peek_char(state) == close) {
+            next_char(state);
+            return 0;
+        }
+        
+        while (1) {
+            if (close == '}') {
+                const char *raw;
+                size_t raw_length;
+                
+                skip_whitespace(state);
+                if (scan_string(state, &raw, &raw_length, NULL) != 0) {
+                    return -1;
+                }
+                skip_whitespace(state);
+                if (next_char(state) != ':') {
+                    snprintf(state->error, sizeof(state->error), "Expected ':'");
+                    return -1;
+                }
+            }
+            
+            if (skip_value(state) != 0) {
+                return -1;
+            }
+            
+            skip_whitespace(state);
+            char next = next_char(state);
+            if (next == close) {
+                return 0;
+            } else if (next != ',') {
+                snprintf(state->error, sizeof(state->error), "Expected ',' or '%c'", close);
+                return -1;
+            }
+        }
+    } else if (match_keyword(state, "true") || match_keyword(state, "false") ||
+               match_keyword(state, "null")) {
+        return 0;
+    } else if (c == '-' || isdigit((unsigned char)c)) {
+        JSON_NUMBER number;
+        return scan_number(state, &number);
+    }
+    
+    snprintf(state->error, sizeof(state->error), "Unexpected character: '%c'", c);
+    return -1;
+}
+
+/* Parse array */
+static JSON_VALUE* parse_array(JSON_PARSER_STATE *state)
+{
+    if (next_char(state) != '[') {
+        snprintf(state->error, sizeof(state->error), "Expected '['");
+        return NULL;
+    }
+    
+    JSON_VALUE *array = new_value(state, JSON_TYPE_ARRAY);
+    if (!array) return NULL;
+    
+    skip_whitespace(state);
+    
+    if (peek_char(state) == ']') {
+        next_char(state);
+        return array;
+    }
+    
+    size_t base = state->stack_count;
+    
+    while (1) {
+        skip_whitespace(state);
+        
+        JSON_VALUE *element = parse_value(state);
+        if (!element || stack_push(state, element) != 0) {
+            if (element) state_free_value(state, element);
+            stack_unwind(state, base, 0);
+            state_free_value(state, array);
+            return NULL;
+        }
+        
+        skip_whitespace(state);
+        char c = peek_char(state);
+        
+        if (c == ']') {
+            next_char(state);
+            break;
+        } else if (c == ',') {
+            next_char(state);
+        } else {
+            snprintf(state->error, sizeof(state->error), "Expected ',' or ']'");
+            stack_unwind(state, base, 0);
+            state_free_value(state, array);
+            return NULL;
+        }
+    }
+    
+    size_t count = state->stack_count - base;
+    JSON_VALUE **elements = (JSON_VALUE**)state_alloc(state, count * sizeof(JSON_VALUE*));
+    if (!elements) {
+        stack_unwind(state, base, 0);
+        state_free_value(state, array);
+        return NULL;
+    }
+    
+    memcpy(elements, &state->stack[base], count * sizeof(JSON_VALUE*));
+    state->stack_count = base;
+    
+    array->data.array_value.elements = elements;
+    array->data.array_value.count = count;
+    
+    return array;
+}
+
+/* Object key: the pool's canonical pointer when it has (or takes) the key, else a copy */
+static char* parse_key(JSON_PARSER_STATE *state, int *interned)
+{
+    const char *raw;
+    size_t raw_length;
+    
+    *interned = 0;
+    if (!state->intern) {
+        return parse_string(state);
+    }
+    
+    if (scan_string(state, &raw, &raw_length, NULL) != 0) {
+        return NULL;
+    }
+    
+    if (raw_length <= INTERN_MAX_KEY_LENGTH) {
+        /* Decoding checks escapes and UTF-8 as parse_string would */
+        char decoded[INTERN_MAX_KEY_LENGTH + 1];
+        size_t length = state_decode_string(state, raw, raw_length, decoded, sizeof(decoded));
+        if (length == DECODE_ERROR) {
+            return NULL;
+        }
+        
+        const char *key = json_intern(state->intern, decoded, length);
+        if (key) {
+            *interned = 1;
+            return (char*)key;
+        }
+    }
+    
+    char *str = (char*)state_alloc(state, raw_length + 1);
+    if (!str) return NULL;
+    
+    if (state_decode_string(state, raw, raw_length, str, raw_length + 1) == DECODE_ERROR) {
+        state_release(state, str);
+        return NULL;
+    }
+    return str;
+}
+
+/* Parse object */
+static JSON_VALUE* parse_object(JSON_PARSER_STATE *state)
+{
+    if (next_char(state) != '{') {
+        snprintf(state->error, sizeof(state->error), "Expected '{'");
+        return NULL;
+    }
+    
+    JSON_VALUE *object = new_value(state, JSON_TYPE_OBJECT);
+    if (!object) return NULL;
+    
+    skip_whitespace(state);
+    
+    if (peek_char(state) == '}') {
+        next_char(state);
+        return object;
+    }
+    
+    size_t base = state->stack_count;
+    size_t interned_count = 0;
+    
+    while (1) {
+        skip_whitespace(state);
+        
+        int interned;
+        char *key = parse_key(state, &interned);
+        if (!key || stack_push(state, key) != 0) {
+            if (key && !interned) state_release(state, key);
+            goto fail;
+        }
+        interned_count += interned;
+        
+        skip_whitespace(state);
+        
+        if (next_char(state) != ':') {
+            snprintf(state->error, sizeof(state->error), "Expected ':'");
+            goto fail;
+        }
+        
+        skip_whitespace(state);
+        
+        JSON_VALUE *value = parse_value(state);
+        if (!value || stack_push(state, value) != 0) {
+            if (value) state_free_value(state, value);
+            goto fail;
+        }
+        
+        skip_whitespace(state);
+        char c = peek_char(state);
+        
+        if (c == '}') {
+            next_char(state);
+            break;
+        } else if (c == ',') {
+            next_char(state);
+        } else {
+            snprintf(state->error, sizeof(state->error), "Expected ',' or '}'");
+            goto fail;
+        }
+    }
+    
+    size_t count = (state->stack_count - base) / 2;
+    char **keys = (char**)state_alloc(state, count * sizeof(char*));
+    JSON_VALUE **values = (JSON_VALUE**)state_alloc(state, count * sizeof(JSON_VALUE*));
+    if (!keys || !values) {
+        state_release(state, keys);
+        state_release(state, values);
+        goto fail;
+    }
+    
+    /* Objects own all their keys or none; a partly interned one copies the canonical keys */
+    if (interned_count > 0 && interned_count < count) {
+        for (size_t i = 0; i < count; i++) {
+            char *key = (char*)state->stack[base + 2 * i];
+            if (intern_owns(state->intern, key)) {
+                char *copy = strdup(key);
+                if (!copy) {
+                    snprintf(state->error, sizeof(state->error), "Out of memory");
+                    state_release(state, keys);
+                    state_release(state, values);
+                    goto fail;
+                }
+                state->stack[base + 2 * i] = copy;
+            }
+        }
+        interned_count = 0;
+    }
+    
+    for (size_t i = 0; i < count; i++) {
+        keys[i] = (char*)state->stack[base + 2 * i];
+        values[i] = (JSON_VALUE*)state->stack[base + 2 * i + 1];
+    }
+    state->stack_count = base;
+    if (interned_count > 0) {
+        object->flags |= JSON_VALUE_FLAG_INTERNED;
+    }
+    
+    object->data.object_value.keys = keys;
+    object->data.object_value.values = values;
+    object->data.object_value.count = count;
+    
+    /* Arena trees have no owner to free a lazily built index, so index them now */
+    if (state->arena && count >= OBJECT_INDEX_MIN_KEYS && count <= UINT32_MAX) {
+        size_t mask;
+        JSON_OBJECT_INDEX *index = (JSON_OBJECT_INDEX*)state_alloc(state, object_index_size(count, &mask));
+        if (index) {
+            object_index_fill(index, mask, keys, count);
+            object->data.object_value.index = index;
+        }
+    }
+    
+    return object;
+
+fail:
+    stack_unwind(state, base, 1);
+    state_free_value(state, object);
+    return NULL;
+}
+
+/* Parse the value at the current position (whitespace already skipped) */
+static JSON_VALUE* parse_token(JSON_PARSER_STATE *state)
+{
+    char c = peek_char(state);
+    
+    if (c == '{') {
+        return parse_object(state);
+    } else if (c == '[') {
+        return parse_array(state);
+    } else if (c == '"') {
+        char *str = parse_string(state);
+        if (!str) return NULL;
+        
+        JSON_VALUE *value = new_value(state, JSON_TYPE_STRING);
+        if (!value) {
+            state_release(state, str);
+            return NULL;
+        }
+        value->data.string_value = str;
         return value;
-    } else if (match_keyword(state, "null")) {
-        JSON_VALUE *value = (JSON_VALUE*)calloc(1, sizeof(JSON_VALUE));
+    } else if (match_keyword(state, "true")) {
+        JSON_VALUE *value = new_value(state, JSON_TYPE_BOOLEAN);
+        if (!value) return NULL;
+        value->data.boolean_value = 1;
+        return value;
+    } else if (match_keyword(state, "false")) {
+        JSON_VALUE *value = new_value(state, JSON_TYPE_BOOLEAN);
         if (!value) return NULL;
-        value->type = JSON_TYPE_NULL;
+        value->data.boolean_value = 0;
         return value;
-    } else if (c == '-' || isdigit(c)) {
+    } else if (match_keyword(state, "null")) {
+        return new_value(state, JSON_TYPE_NULL);
+    } else if (c == '-' || isdigit((unsigned char)c)) {
         return parse_number(state);
     } else {
-        snprintf(state->error, sizeof(state->error), "Unexpected character: '%c'", c);
-        return NULL;
+        snprintf(state->error, sizeof(state->error), "Unexpected character: '%c'", c);
+        return NULL;
+    }
+}
+
+/* Parse value */
+static JSON_VALUE* parse_value(JSON_PARSER_STATE *state)
+{
+    skip_whitespace(state);
+    
+    if (!state->track_source) {
+        return parse_token(state);
+    }
+    
+    size_t start = state->position;
+    JSON_VALUE *value = parse_token(state);
+    if (value) {
+        JSON_SOURCE_VALUE *source = (JSON_SOURCE_VALUE*)value;
+        source->start = state->json + start;
+        source->length = state->position - start;
+    }
+    return value;
+}
+
+/* Public API */
+
+JSON_VALUE* json_parse(const char *json_string)
+{
+    if (!json_string) return NULL;
+    
+    JSON_PARSER_STATE state = {
+        .json = json_string,
+        .position = 0,
+        .length = strlen(json_string),
+        .error = {0}
+    };
+    
+    JSON_INDEX index;
+    json_index_init(&index);
+    state_use_index(&state, &index);
+    
+    JSON_VALUE *value = parse_value(&state);
+    free(state.stack);
+    json_index_free(&index);
+    
+    if (!value && state.error[0]) {
+        framework_log(LOG_LEVEL_ERROR, "JSON parse error: %s", state.error);
+    }
+    
+    return value;
+}
+
+JSON_VALUE* json_parse_interned(const char *json, size_t length, JSON_INTERN *pool)
+{
+    if (!json || !pool) return NULL;
+    
+    JSON_PARSER_STATE state = {
+        .json = json,
+        .position = 0,
+        .length = length,
+        .error = {0},
+        .intern = pool
+    };
+    
+    JSON_INDEX index;
+    json_index_init(&index);
+    state_use_index(&state, &index);
+    
+    JSON_VALUE *value = parse_value(&state);
+    free(state.stack);
+    json_index_free(&index);
+    
+    if (!value && state.error[0]) {
+        framework_log(LOG_LEVEL_ERROR, "JSON parse error at offset %zu: %s", state.position, state.error);
+    }
+    
+    return value;
+}
+
+JSON_VALUE* json_parse_arena(const char *json, size_t length, JSON_ARENA *arena)
+{
+    if (!json || !arena) return NULL;
+    
+    JSON_PARSER_STATE state = {
+        .json = json,
+        .position = 0,
+        .length = length,
+        .error = {0},
+        .arena = arena,
+        .stack = arena->scratch,
+        .stack_capacity = arena->scratch_capacity
+    };
+    
+    state_use_index(&state, &arena->index);
+    
+    JSON_VALUE *value = parse_value(&state);
+    
+    /* The scratch stack may have grown; keep it for the next parse */
+    arena->scratch = state.stack;
+    arena->scratch_capacity = state.stack_capacity;
+    
+    if (!value && state.error[0]) {
+        framework_log(LOG_LEVEL_ERROR, "JSON parse error at offset %zu: %s", state.position, state.error);
+    }
+    
+    return value;
+}
+
+JSON_VALUE* json_parse_source(const char *json, size_t length)
+{
+    if (!json) return NULL;
+    
+    JSON_PARSER_STATE state = {
+        .json = json,
+        .position = 0,
+        .length = length,
+        .error = {0},
+        .track_source = 1
+    };
+    
+    JSON_INDEX index;
+    json_index_init(&index);
+    state_use_index(&state, &index);
+    
+    JSON_VALUE *value = parse_value(&state);
+    free(state.stack);
+    json_index_free(&index);
+    
+    if (!value && state.error[0]) {
+        framework_log(LOG_LEVEL_ERROR, "JSON parse error at offset %zu: %s", state.position, state.error);
+    }
+    
+    return value;
+}
+
+/* ==================== Object Lookup and Paths ==================== */
+
+/* Heap objects are indexed on first lookup; arena objects are indexed while parsing */
+static JSON_OBJECT_INDEX* object_index(JSON_VALUE *object)
+{
+    size_t count = object->data.object_value.count;
+    if (object->data.object_value.index || count < OBJECT_INDEX_MIN_KEYS ||
+        count > UINT32_MAX || (object->flags & JSON_VALUE_FLAG_ARENA)) {
+        return object->data.object_value.index;
+    }
+    
+    size_t mask;
+    JSON_OBJECT_INDEX *index = (JSON_OBJECT_INDEX*)malloc(object_index_size(count, &mask));
+    if (index) {
+        object_index_fill(index, mask, object->data.object_value.keys, count);
+        object->data.object_value.index = index;
+    }
+    return index;
+}
+
+static int key_equals(const char *candidate, const char *key, size_t key_length)
+{
+    if (candidate == key) {
+        return candidate[key_length] == '\0';
+    }
+    return strncmp(candidate, key, key_length) == 0 && candidate[key_length] == '\0';
+}
+
+#define NO_MEMBER ((size_t)-1)
+
+/* Position of a key among an object's members, or NO_MEMBER */
+static size_t find_object_member(JSON_VALUE *object, const char *key, size_t key_length, uint32_t hash)
+{
+    char **keys = object->data.object_value.keys;
+    JSON_OBJECT_INDEX *index = object_index(object);
+    
+    if (index) {
+        for (size_t slot = hash & index->mask; index->slots[slot].member; slot = (slot + 1) & index->mask) {
+            uint32_t member = index->slots[slot].member - 1;
+            if (index->slots[slot].hash == hash && key_equals(keys[member], key, key_length)) {
+                return member;
+            }
+        }
+        return NO_MEMBER;
+    }
+    
+    for (size_t i = 0; i < object->data.object_value.count; i++) {
+        if (key_equals(keys[i], key, key_length)) {
+            return i;
+        }
+    }
+    
+    return NO_MEMBER;
+}
+
+/* Find value in object by key */
+static JSON_VALUE* find_object_value(JSON_VALUE *object, const char *key, size_t key_length, uint32_t hash)
+{
+    if (!object || object->type != JSON_TYPE_OBJECT) {
+        return NULL;
+    }
+    
+    size_t member = find_object_member(object, key, key_length, hash);
+    return member == NO_MEMBER ? NULL : object->data.object_value.values[member];
+}
+
+JSON_VALUE* json_object_get_interned(JSON_VALUE *object, const char *key)
+{
+    if (!object || object->type != JSON_TYPE_OBJECT || !key) {
+        return NULL;
+    }
+    
+    if (!(object->flags & JSON_VALUE_FLAG_INTERNED)) {
+        size_t key_length = strlen(key);
+        return find_object_value(object, key, key_length, fnv1a_hash(key, key_length));
+    }
+    
+    /* Canonical keys are equal exactly when their pointers are; the entry carries the hash */
+    char **keys = object->data.object_value.keys;
+    JSON_OBJECT_INDEX *index = object_index(object);
+    
+    if (index) {
+        uint32_t hash = ((const INTERN_ENTRY*)(key - offsetof(INTERN_ENTRY, text)))->hash;
+        for (size_t slot = hash & index->mask; index->slots[slot].member; slot = (slot + 1) & index->mask) {
+            uint32_t member = index->slots[slot].member - 1;
+            if (keys[member] == key) {
+                return object->data.object_value.values[member];
+            }
+        }
+        return NULL;
+    }
+    
+    for (size_t i = 0; i < object->data.object_value.count; i++) {
+        if (keys[i] == key) {
+            return object->data.object_value.values[i];
+        }
+    }
+    return NULL;
+}
+
+static JSON_VALUE* find_array_element(JSON_VALUE *array, size_t index)
+{
+    if (!array || array->type != JSON_TYPE_ARRAY || index >= array->data.array_value.count) {
+        return NULL;
+    }
+    return array->data.array_value.elements[index];
+}
+
+/* One step of a path: an object key or an array index */
+typedef struct {
+    const char *key;               /* NULL for an array index */
+    size_t length;                 /* Key length, or the array index */
+    uint32_t hash;
+} PATH_SEGMENT;
+
+/*
+ * Step to the next segment of a path: "a.b[3].c". Keys are non-empty and
+ * each '.' must be followed by one; indices are decimal digits. Returns 1
+ * for a segment, 0 at the end, -1 on a malformed path (an empty key, a
+ * leading or trailing '.', or an empty or non-numeric index).
+ */
+static int next_path_segment(const char **path, PATH_SEGMENT *segment)
+{
+    const char *p = *path;
+    if (*p == '\0') {
+        return 0;
+    }
+    
+    if (*p == '[') {
+        p++;
+        if (*p < '0' || *p > '9') {
+            return -1;
+        }
+        
+        size_t index = 0;
+        while (*p >= '0' && *p <= '9') {
+            if (index > (SIZE_MAX - 9) / 10) {
+                return -1;
+            }
+            index = index * 10 + (size_t)(*p++ - '0');
+        }
+        if (*p != ']') {
+            return -1;
+        }
+        p++;
+        
+        segment->key = NULL;
+        segment->length = index;
+    } else {
+        const char *end = p;
+        while (*end && *end != '.' && *end != '[' && *end != ']') {
+            end++;
+        }
+        if (end == p) {
+            return -1;
+        }
+        
+        segment->key = p;
+        segment->length = (size_t)(end - p);
+        segment->hash = fnv1a_hash(p, segment->length);
+        p = end;
+    }
+    
+    /* A segment ends the path, opens an index, or is followed by '.' and a key */
+    if (*p == '.') {
+        p++;
+        if (*p == '\0' || *p == '.' || *p == '[' || *p == ']') {
+            return -1;
+        }
+    } else if (*p != '\0' && *p != '[') {
+        return -1;
+    }
+    
+    *path = p;
+    return 1;
+}
+
+static JSON_VALUE* path_step(JSON_VALUE *current, const PATH_SEGMENT *segment)
+{
+    if (segment->key) {
+        return find_object_value(current, segment->key, segment->length, segment->hash);
+    }
+    return find_array_element(current, segment->length);
+}
+
+JSON_VALUE* json_get_path(JSON_VALUE *value, const char *path)
+{
+    if (!value || !path) return NULL;
+    
+    JSON_VALUE *current = value;
+    PATH_SEGMENT segment;
+    int status;
+    
+    while (current && (status = next_path_segment(&path, &segment)) != 0) {
+        if (status < 0) {
+            return NULL;
+        }
+        current = path_step(current, &segment);
+    }
+    
+    return current;
+}
+
+/* Compiled path: segments, then the key text they point into, in one block */
+struct _json_path_ {
+    size_t count;
+    PATH_SEGMENT segments[];
+};
+
+JSON_PATH* json_path_compile(const char *path)
+{
+    if (!path) return NULL;
+    
+    /* Validate and count first so the path is a single allocation */
+    const char *cursor = path;
+    PATH_SEGMENT segment;
+    size_t count = 0;
+    int status;
+    
+    while ((status = next_path_segment(&cursor, &segment)) != 0) {
+        if (status < 0) {
+            framework_log(LOG_LEVEL_ERROR, "Invalid JSON path: %s", path);
+            return NULL;
+        }
+        count++;
+    }
+    
+    size_t text_length = strlen(path);
+    size_t header = sizeof(JSON_PATH) + count * sizeof(PATH_SEGMENT);
+    JSON_PATH *compiled = (JSON_PATH*)malloc(header + text_length + 1);
+    if (!compiled) return NULL;
+    
+    char *text = (char*)compiled + header;
+    memcpy(text, path, text_length + 1);
+    
+    compiled->count = 0;
+    cursor = text;
+    while (next_path_segment(&cursor, &compiled->segments[compiled->count]) > 0) {
+        compiled->count++;
+    }
+    
+    return compiled;
+}
+
+void json_path_free(JSON_PATH *path)
+{
+    free(path);
+}
+
+JSON_VALUE* json_path_get(const JSON_PATH *path, JSON_VALUE *value)
+{
+    if (!path) return NULL;
+    
+    JSON_VALUE *current = value;
+    for (size_t i = 0; current && i < path->count; i++) {
+        current = path_step(current, &path->segments[i]);
+    }
+    
+    return current;
+}
+
+const char* json_get_string(JSON_VALUE *value)
+{
+    if (value && value->type == JSON_TYPE_STRING) {
+        return value->data.string_value;
+    }
+    return NULL;
+}
+
+int json_get_int(JSON_VALUE *value, int default_val)
+{
+    if (!value) return default_val;
+    
+    if (value->type == JSON_TYPE_INTEGER) {
+        return (int)value->data.integer_value;
+    } else if (value->type == JSON_TYPE_DOUBLE) {
+        return (int)value->data.double_value;
+    }
+    
+    return default_val;
+}
+
+int json_get_bool(JSON_VALUE *value, int default_val)
+{
+    if (value && value->type == JSON_TYPE_BOOLEAN) {
+        return value->data.boolean_value;
+    }
+    return default_val;
+}
+
+double json_get_double(JSON_VALUE *value, double default_val)
+{
+    if (!value) return default_val;
+    
+    if (value->type == JSON_TYPE_DOUBLE) {
+        return value->data.double_value;
+    } else if (value->type == JSON_TYPE_INTEGER) {
+        return (double)value->data.integer_value;
+    }
+    
+    return default_val;
+}
+
+void json_free(JSON_VALUE *value)
+{
+    if (!value) return;
+    
+    /* Arena nodes are released all at once by json_arena_reset */
+    if (value->flags & JSON_VALUE_FLAG_ARENA) return;
+    
+    switch (value->type) {
+        case JSON_TYPE_STRING:
+            free(value->data.string_value);
+            break;
+        
+        case JSON_TYPE_ARRAY:
+            for (size_t i = 0; i < value->data.array_value.count; i++) {
+                json_free(value->data.array_value.elements[i]);
+            }
+            free(value->data.array_value.elements);
+            break;
+        
+        case JSON_TYPE_OBJECT:
+            for (size_t i = 0; i < value->data.object_value.count; i++) {
+                if (!(value->flags & JSON_VALUE_FLAG_INTERNED)) {
+                    free(value->data.object_value.keys[i]);
+                }
+                json_free(value->data.object_value.values[i]);
+            }
+            free(value->data.object_value.keys);
+            free(value->data.object_value.values);
+            free(value->data.object_value.index);
+            break;
+        
+        default:
+            break;
+    }
+    
+    free(value);
+}
+
+/* ==================== Editing ==================== */
+
+#define CHILDREN_MIN_CAPACITY 4
+
+static JSON_VALUE* create_value(JSON_TYPE type)
+{
+    JSON_VALUE *value = (JSON_VALUE*)calloc(1, sizeof(JSON_VALUE));
+    if (value) {
+        value->type = type;
+    }
+    return value;
+}
+
+JSON_VALUE* json_create_null(void)
+{
+    return create_value(JSON_TYPE_NULL);
+}
+
+JSON_VALUE* json_create_bool(int value)
+{
+    JSON_VALUE *node = create_value(JSON_TYPE_BOOLEAN);
+    if (node) {
+        node->data.boolean_value = value ? 1 : 0;
+    }
+    return node;
+}
+
+JSON_VALUE* json_create_integer(int64_t value)
+{
+    JSON_VALUE *node = create_value(JSON_TYPE_INTEGER);
+    if (node) {
+        node->data.integer_value = value;
+    }
+    return node;
+}
+
+JSON_VALUE* json_create_double(double value)
+{
+    JSON_VALUE *node = create_value(JSON_TYPE_DOUBLE);
+    if (node) {
+        node->data.double_value = value;
+    }
+    return node;
+}
+
+JSON_VALUE* json_create_string(const char *value)
+{
+    if (!value) return NULL;
+    
+    JSON_VALUE *node = create_value(JSON_TYPE_STRING);
+    if (!node) return NULL;
+    
+    node->data.string_value = strdup(value);
+    if (!node->data.string_value) {
+        free(node);
+        return NULL;
+    }
+    return node;
+}
+
+JSON_VALUE* json_create_array(void)
+{
+    return create_value(JSON_TYPE_ARRAY);
+}
+
+JSON_VALUE* json_create_object(void)
+{
+    return create_value(JSON_TYPE_OBJECT);
+}
+
+/*
+ * Capacity to grow a container's child arrays to before adding one more
+ * child, or 0 if there is room. Parsed containers are sized exactly; once
+ * grown (JSON_VALUE_FLAG_GROWABLE) capacity is the next power of two.
+ */
+static size_t grow_capacity(const JSON_VALUE *container, size_t count)
+{
+    size_t capacity = CHILDREN_MIN_CAPACITY;
+    while (capacity < count) {
+        capacity <<= 1;
+    }
+    
+    if ((container->flags & JSON_VALUE_FLAG_GROWABLE) && count < capacity) {
+        return 0;
+    }
+    return count < capacity ? capacity : capacity << 1;
+}
+
+/* Heap trees only: arena memory cannot be resized or freed per node */
+static int editable(const JSON_VALUE *container, JSON_TYPE type, const JSON_VALUE *value)
+{
+    return container && container->type == type && !(container->flags & JSON_VALUE_FLAG_ARENA) &&
+           value && value != container && !(value->flags & JSON_VALUE_FLAG_ARENA);
+}
+
+/* Replace an object's canonical keys with copies of its own before they change */
+static int own_keys(JSON_VALUE *object)
+{
+    if (!(object->flags & JSON_VALUE_FLAG_INTERNED)) {
+        return 0;
+    }
+    
+    char **keys = object->data.object_value.keys;
+    size_t count = object->data.object_value.count;
+    char **copies = (char**)malloc((count ? count : 1) * sizeof(char*));
+    if (!copies) {
+        return -1;
+    }
+    
+    for (size_t i = 0; i < count; i++) {
+        copies[i] = strdup(keys[i]);
+        if (!copies[i]) {
+            while (i > 0) {
+                free(copies[--i]);
+            }
+            free(copies);
+            return -1;
+        }
+    }
+    
+    memcpy(keys, copies, count * sizeof(char*));
+    free(copies);
+    object->flags &= ~(unsigned int)JSON_VALUE_FLAG_INTERNED;
+    return 0;
+}
+
+/* Add a member's slot to an object's hash index, or drop the index when it is full */
+static void object_index_insert(JSON_VALUE *object, size_t member, uint32_t hash)
+{
+    JSON_OBJECT_INDEX *index = object->data.object_value.index;
+    if (!index) return;
+    
+    if ((member + 1) * 2 > index->mask + 1 || member >= UINT32_MAX) {
+        /* Rebuilt at twice the size on the next lookup */
+        free(index);
+        object->data.object_value.index = NULL;
+        return;
+    }
+    
+    size_t slot = hash & index->mask;
+    while (index->slots[slot].member) {
+        slot = (slot + 1) & index->mask;
+    }
+    index->slots[slot].hash = hash;
+    index->slots[slot].member = (uint32_t)(member + 1);
+}
+
+int json_object_set(JSON_VALUE *object, const char *key, JSON_VALUE *value)
+{
+    if (!key || !editable(object, JSON_TYPE_OBJECT, value)) {
+        return -1;
+    }
+    
+    size_t key_length = strlen(key);
+    uint32_t hash = fnv1a_hash(key, key_length);
+    size_t member = find_object_member(object, key, key_length, hash);
+    
+    if (member != NO_MEMBER) {
+        json_free(object->data.object_value.values[member]);
+        object->data.object_value.values[member] = value;
+        object->flags |= JSON_VALUE_FLAG_MODIFIED;
+        return 0;
+    }
+    
+    if (own_keys(object) != 0) {
+        return -1;
+    }
+    
+    char *key_copy = (char*)malloc(key_length + 1);
+    if (!key_copy) {
+        return -1;
+    }
+    memcpy(key_copy, key, key_length + 1);
+    
+    size_t count = object->data.object_value.count;
+    size_t capacity = grow_capacity(object, count);
+    if (capacity) {
+        char **keys = (char**)realloc(object->data.object_value.keys, capacity * sizeof(char*));
+        if (keys) {
+            object->data.object_value.keys = keys;
+        }
+        JSON_VALUE **values = keys ? (JSON_VALUE**)realloc(object->data.object_value.values,
+                                                            capacity * sizeof(JSON_VALUE*)) : NULL;
+        if (!values) {
+            free(key_copy);
+            return -1;
+        }
+        object->data.object_value.values = values;
+        object->flags |= JSON_VALUE_FLAG_GROWABLE;
+    }
+    
+    object->data.object_value.keys[count] = key_copy;
+    object->data.object_value.values[count] = value;
+    object->data.object_value.count = count + 1;
+    object->flags |= JSON_VALUE_FLAG_MODIFIED;
+    
+    object_index_insert(object, count, hash);
+    return 0;
+}
+
+int json_array_insert(JSON_VALUE *array, size_t index, JSON_VALUE *value)
+{
+    if (!editable(array, JSON_TYPE_ARRAY, value) || index > array->data.array_value.count) {
+        return -1;
+    }
+    
+    size_t count = array->data.array_value.count;
+    size_t capacity = grow_capacity(array, count);
+    if (capacity) {
+        JSON_VALUE **elements = (JSON_VALUE**)realloc(array->data.array_value.elements,
+                                                      capacity * sizeof(JSON_VALUE*));
+        if (!elements) {
+            return -1;
+        }
+        array->data.array_value.elements = elements;
+        array->flags |= JSON_VALUE_FLAG_GROWABLE;
+    }
+    
+    JSON_VALUE **elements = array->data.array_value.elements;
+    memmove(&elements[index + 1], &elements[index], (count - index) * sizeof(JSON_VALUE*));
+    elements[index] = value;
+    array->data.array_value.count = count + 1;
+    array->flags |= JSON_VALUE_FLAG_MODIFIED;
+    return 0;
+}
+
+int json_array_append(JSON_VALUE *array, JSON_VALUE *value)
+{
+    return json_array_insert(array, array ? array->data.array_value.count : 0, value);
+}
+
+/* Free and unlink one child; later members shift down, so an object's index is dropped */
+static int remove_child(JSON_VALUE *container, const PATH_SEGMENT *segment)
+{
+    if (container->flags & JSON_VALUE_FLAG_ARENA) {
+        return -1;
+    }
+    
+    if (!segment->key) {
+        if (container->type != JSON_TYPE_ARRAY || segment->length >= container->data.array_value.count) {
+            return -1;
+        }
+        
+        JSON_VALUE **elements = container->data.array_value.elements;
+        size_t count = container->data.array_value.count;
+        json_free(elements[segment->length]);
+        memmove(&elements[segment->length], &elements[segment->length + 1],
+                (count - segment->length - 1) * sizeof(JSON_VALUE*));
+        container->data.array_value.count = count - 1;
+        container->flags |= JSON_VALUE_FLAG_MODIFIED;
+        return 0;
+    }
+    
+    if (container->type != JSON_TYPE_OBJECT) {
+        return -1;
+    }
+    
+    size_t member = find_object_member(container, segment->key, segment->length, segment->hash);
+    if (member == NO_MEMBER || own_keys(container) != 0) {
+        return -1;
+    }
+    
+    char **keys = container->data.object_value.keys;
+    JSON_VALUE **values = container->data.object_value.values;
+    size_t tail = container->data.object_value.count - member - 1;
+    
+    free(keys[member]);
+    json_free(values[member]);
+    memmove(&keys[member], &keys[member + 1], tail * sizeof(char*));
+    memmove(&values[member], &values[member + 1], tail * sizeof(JSON_VALUE*));
+    container->data.object_value.count--;
+    container->flags |= JSON_VALUE_FLAG_MODIFIED;
+    
+    free(container->data.object_value.index);
+    container->data.object_value.index = NULL;
+    return 0;
+}
+
+int json_remove(JSON_VALUE *value, const char *path)
+{
+    if (!value || !path) return -1;
+    
+    PATH_SEGMENT segment;
+    int status = next_path_segment(&path, &segment);
+    if (status <= 0) {
+        return -1;
+    }
+    
+    /* Walk to the parent of the last segment */
+    JSON_VALUE *parent = value;
+    PATH_SEGMENT next;
+    while ((status = next_path_segment(&path, &next)) > 0) {
+        parent = path_step(parent, &segment);
+        if (!parent) {
+            return -1;
+        }
+        segment = next;
+    }
+    
+    return status < 0 ? -1 : remove_child(parent, &segment);
+}
+
+/* ==================== Lazy Documents ==================== */
+
+#define NO_ENTRY ((size_t)-1)
+#define NO_MATCH UINT32_MAX
+
+struct _json_doc_ {
+    const char *json;
+    size_t length;
+    JSON_INDEX index;
+    
+    /* For each opening bracket's entry, the entry of its closing bracket */
+    uint32_t *match;
+    size_t match_capacity;
+};
+
+static char doc_char(const JSON_DOC *doc, size_t entry)
+{
+    if (entry < doc->index.count) {
+        return doc->json[doc->index.positions[entry]];
+    }
+    return '\0';
+}
+
+/* Last entry of the value starting at entry: containers jump to their closing bracket */
+static size_t doc_value_end(const JSON_DOC *doc, size_t entry)
+{
+    char c = doc_char(doc, entry);
+    if (c == '{' || c == '[') {
+        return doc->match[entry];
+    } else if (c == '"') {
+        return entry + 1;
+    }
+    return entry;
+}
+
+/* A member starts with key, closing quote and ':' entries, then its value */
+static int doc_is_member(const JSON_DOC *doc, size_t entry)
+{
+    return doc_char(doc, entry) == '"' && doc_char(doc, entry + 2) == ':';
+}
+
+static int doc_is_value(const JSON_DOC *doc, size_t entry)
+{
+    char c = doc_char(doc, entry);
+    return c != '\0' && c != '}' && c != ']' && c != ',' && c != ':';
+}
+
+/* Parser state positioned on a cursor's value, for reusing the scanners */
+static void cursor_state(const JSON_CURSOR *cursor, JSON_PARSER_STATE *state)
+{
+    const JSON_DOC *doc = cursor->doc;
+    
+    memset(state, 0, sizeof(JSON_PARSER_STATE));
+    state->json = doc->json;
+    state->length = doc->length;
+    state->position = doc->index.positions[cursor->entry];
+    state->index = doc->index.positions;
+    state->index_count = doc->index.count;
+    state->index_next = cursor->entry;
+}
+
+/* Scalars must be followed by whitespace, a separator or the end of the text */
+static int scalar_complete(const JSON_PARSER_STATE *state)
+{
+    if (state->position >= state->length) {
+        return 1;
+    }
+    
+    char c = state->json[state->position];
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' ||
+           c == ',' || c == ']' || c == '}' || c == ':';
+}
+
+static int raw_key_equals(const char *raw, size_t raw_length, const char *key, size_t key_length)
+{
+    if (!memchr(raw, '\\', raw_length)) {
+        return raw_length == key_length && memcmp(raw, key, key_length) == 0;
+    }
+    
+    char buffer[KEY_BUFFER_SIZE];
+    const char *error;
+    size_t length = decode_string(raw, raw_length, buffer, sizeof(buffer), &error);
+    return length == key_length && memcmp(buffer, key, key_length) == 0;
+}
+
+int json_doc_reopen(JSON_DOC *doc, const char *json, size_t length)
+{
+    if (!doc || !json) return -1;
+    
+    doc->json = NULL;
+    doc->length = 0;
+    
+    if (json_index_build(&doc->index, json, length) != 0) {
+        doc->index.count = 0;
+        return -1;
+    }
+    
+    size_t count = doc->index.count;
+    if (doc->match_capacity < count) {
+        uint32_t *match = (uint32_t*)realloc(doc->match, count * sizeof(uint32_t));
+        if (!match) {
+            doc->index.count = 0;
+            return -1;
+        }
+        doc->match = match;
+        doc->match_capacity = count;
+    }
+    
+    /* Pair brackets; open containers are chained through their match slots */
+    const uint32_t *positions = doc->index.positions;
+    uint32_t open = NO_MATCH;
+    
+    for (size_t i = 0; i < count; i++) {
+        char c = json[positions[i]];
+        
+        if (c == '{' || c == '[') {
+            doc->match[i] = open;
+            open = (uint32_t)i;
+        } else if (c == '}' || c == ']') {
+            if (open == NO_MATCH || json[positions[open]] != (c == '}' ? '{' : '[')) {
+                doc->index.count = 0;
+                return -1;
+            }
+            uint32_t parent = doc->match[open];
+            doc->match[open] = (uint32_t)i;
+            open = parent;
+        }
+    }
+    
+    if (open != NO_MATCH) {
+        doc->index.count = 0;
+        return -1;
+    }
+    
+    doc->json = json;
+    doc->length = length;
+    return 0;
+}
+
+JSON_DOC* json_doc_open(const char *json, size_t length)
+{
+    if (!json) return NULL;
+    
+    JSON_DOC *doc = (JSON_DOC*)calloc(1, sizeof(JSON_DOC));
+    if (!doc) return NULL;
+    
+    json_index_init(&doc->index);
+    
+    if (json_doc_reopen(doc, json, length) != 0) {
+        json_doc_close(doc);
+        return NULL;
+    }
+    
+    return doc;
+}
+
+void json_doc_close(JSON_DOC *doc)
+{
+    if (!doc) return;
+    
+    json_index_free(&doc->index);
+    free(doc->match);
+    free(doc);
+}
+
+int json_doc_root(const JSON_DOC *doc, JSON_CURSOR *cursor)
+{
+    if (!doc || !cursor || !doc_is_value(doc, 0)) {
+        return -1;
+    }
+    
+    cursor->doc = doc;
+    cursor->entry = 0;
+    cursor->key_entry = NO_ENTRY;
+    return 0;
+}
+
+static int doc_path_step(JSON_CURSOR *cursor, const PATH_SEGMENT *segment)
+{
+    if (segment->key) {
+        return json_cursor_find_field_n(cursor, segment->key, segment->length, cursor);
+    }
+    return json_cursor_get_index(cursor, segment->length, cursor);
+}
+
+int json_doc_get_path(const JSON_DOC *doc, const char *path, JSON_CURSOR *cursor)
+{
+    if (!path || json_doc_root(doc, cursor) != 0) {
+        return -1;
+    }
+    
+    PATH_SEGMENT segment;
+    int status;
+    
+    while ((status = next_path_segment(&path, &segment)) != 0) {
+        if (status < 0 || doc_path_step(cursor, &segment) != 0) {
+            return -1;
+        }
+    }
+    
+    return 0;
+}
+
+int json_path_get_doc(const JSON_PATH *path, const JSON_DOC *doc, JSON_CURSOR *cursor)
+{
+    if (!path || json_doc_root(doc, cursor) != 0) {
+        return -1;
+    }
+    
+    for (size_t i = 0; i < path->count; i++) {
+        if (doc_path_step(cursor, &path->segments[i]) != 0) {
+            return -1;
+        }
+    }
+    
+    return 0;
+}
+
+int json_cursor_type(const JSON_CURSOR *cursor, JSON_TYPE *type)
+{
+    if (!cursor || !type) return -1;
+    
+    switch (doc_char(cursor->doc, cursor->entry)) {
+        case '{': *type = JSON_TYPE_OBJECT; return 0;
+        case '[': *type = JSON_TYPE_ARRAY; return 0;
+        case '"': *type = JSON_TYPE_STRING; return 0;
+        case 't':
+        case 'f': *type = JSON_TYPE_BOOLEAN; return 0;
+        case 'n': *type = JSON_TYPE_NULL; return 0;
+        default: break;
+    }
+    
+    JSON_PARSER_STATE state;
+    JSON_NUMBER number;
+    cursor_state(cursor, &state);
+    if (scan_number(&state, &number) != 0 || !scalar_complete(&state)) {
+        return -1;
+    }
+    
+    *type = number.is_double ? JSON_TYPE_DOUBLE : JSON_TYPE_INTEGER;
+    return 0;
+}
+
+int json_cursor_find_field_n(const JSON_CURSOR *object, const char *key, size_t key_length,
+                             JSON_CURSOR *value)
+{
+    if (!object || !key || !value || doc_char(object->doc, object->entry) != '{') {
+        return -1;
+    }
+    
+    const JSON_DOC *doc = object->doc;
+    size_t close = doc->match[object->entry];
+    size_t entry = object->entry + 1;
+    
+    while (entry < close) {
+        if (!doc_is_member(doc, entry) || !doc_is_value(doc, entry + 3)) {
+            return -1;
+        }
+        
+        const char *raw = &doc->json[doc->index.positions[entry] + 1];
+        size_t raw_length = doc->index.positions[entry + 1] - doc->index.positions[entry] - 1;
+        
+        if (raw_key_equals(raw, raw_length, key, key_length)) {
+            value->doc = doc;
+            value->entry = entry + 3;
+            value->key_entry = entry;
+            return 0;
+        }
+        
+        /* Nested containers are skipped in one step via the bracket table */
+        entry = doc_value_end(doc, entry + 3) + 1;
+        if (entry < close) {
+            if (doc_char(doc, entry) != ',') {
+                return -1;
+            }
+            entry++;
+        }
+    }
+    
+    return -1;
+}
+
+int json_cursor_find_field(const JSON_CURSOR *object, const char *key, JSON_CURSOR *value)
+{
+    if (!key) return -1;
+    
+    return json_cursor_find_field_n(object, key, strlen(key), value);
+}
+
+int json_cursor_first(const JSON_CURSOR *container, JSON_CURSOR *child)
+{
+    if (!container || !child) return -1;
+    
+    const JSON_DOC *doc = container->doc;
+    char c = doc_char(doc, container->entry);
+    size_t entry = container->entry + 1;
+    
+    if (c == '[' && doc_is_value(doc, entry)) {
+        child->key_entry = NO_ENTRY;
+    } else if (c == '{' && doc_is_member(doc, entry) && doc_is_value(doc, entry + 3)) {
+        child->key_entry = entry;
+        entry += 3;
+    } else {
+        return -1;
+    }
+    
+    child->doc = doc;
+    child->entry = entry;
+    return 0;
+}
+
+int json_cursor_next(JSON_CURSOR *cursor)
+{
+    if (!cursor) return -1;
+    
+    const JSON_DOC *doc = cursor->doc;
+    size_t entry = doc_value_end(doc, cursor->entry) + 1;
+    
+    if (doc_char(doc, entry) != ',') {
+        return -1;
+    }
+    entry++;
+    
+    if (cursor->key_entry != NO_ENTRY) {
+        if (!doc_is_member(doc, entry)) {
+            return -1;
+        }
+        cursor->key_entry = entry;
+        entry += 3;
+    }
+    
+    if (!doc_is_value(doc, entry)) {
+        return -1;
+    }
+    
+    cursor->entry = entry;
+    return 0;
+}
+
+int json_cursor_get_index(const JSON_CURSOR *array, size_t index, JSON_CURSOR *element)
+{
+    if (!array || doc_char(array->doc, array->entry) != '[') {
+        return -1;
+    }
+    
+    JSON_CURSOR current;
+    if (json_cursor_first(array, &current) != 0) {
+        return -1;
+    }
+    
+    for (size_t i = 0; i < index; i++) {
+        if (json_cursor_next(&current) != 0) {
+            return -1;
+        }
+    }
+    
+    *element = current;
+    return 0;
+}
+
+int json_cursor_get_key(const JSON_CURSOR *member, const char **raw, size_t *raw_length)
+{
+    if (!member || !raw || !raw_length || member->key_entry == NO_ENTRY) {
+        return -1;
+    }
+    
+    const uint32_t *positions = member->doc->index.positions;
+    *raw = &member->doc->json[positions[member->key_entry] + 1];
+    *raw_length = positions[member->key_entry + 1] - positions[member->key_entry] - 1;
+    return 0;
+}
+
+int json_cursor_get_int64(const JSON_CURSOR *cursor, int64_t *value)
+{
+    if (!cursor || !value) return -1;
+    
+    JSON_PARSER_STATE state;
+    JSON_NUMBER number;
+    cursor_state(cursor, &state);
+    if (scan_number(&state, &number) != 0 || !scalar_complete(&state)) {
+        return -1;
+    }
+    
+    *value = number.is_double ? (int64_t)number.real : number.integer;
+    return 0;
+}
+
+int json_cursor_get_double(const JSON_CURSOR *cursor, double *value)
+{
+    if (!cursor || !value) return -1;
+    
+    JSON_PARSER_STATE state;
+    JSON_NUMBER number;
+    cursor_state(cursor, &state);
+    if (scan_number(&state, &number) != 0 || !scalar_complete(&state)) {
+        return -1;
+    }
+    
+    *value = number.real;
+    return 0;
+}
+
+int json_cursor_get_bool(const JSON_CURSOR *cursor, int *value)
+{
+    if (!cursor || !value) return -1;
+    
+    JSON_PARSER_STATE state;
+    cursor_state(cursor, &state);
+    
+    int result;
+    if (match_keyword(&state, "true")) {
+        result = 1;
+    } else if (match_keyword(&state, "false")) {
+        result = 0;
+    } else {
+        return -1;
+    }
+    
+    if (!scalar_complete(&state)) {
+        return -1;
+    }
+    
+    *value = result;
+    return 0;
+}
+
+int json_cursor_is_null(const JSON_CURSOR *cursor)
+{
+    if (!cursor) return 0;
+    
+    JSON_PARSER_STATE state;
+    cursor_state(cursor, &state);
+    return match_keyword(&state, "null") && scalar_complete(&state);
+}
+
+int json_cursor_get_raw_string(const JSON_CURSOR *cursor, const char **raw, size_t *raw_length)
+{
+    if (!cursor || !raw || !raw_length || doc_char(cursor->doc, cursor->entry) != '"') {
+        return -1;
+    }
+    
+    const uint32_t *positions = cursor->doc->index.positions;
+    *raw = &cursor->doc->json[positions[cursor->entry] + 1];
+    *raw_length = positions[cursor->entry + 1] - positions[cursor->entry] - 1;
+    return 0;
+}
+
+int json_cursor_get_string(const JSON_CURSOR *cursor, char *buffer, size_t buffer_size)
+{
+    const char *raw;
+    size_t raw_length;
+    
+    if (!buffer || buffer_size == 0 || json_cursor_get_raw_string(cursor, &raw, &raw_length) != 0) {
+        return -1;
+    }
+    
+    const char *error;
+    size_t length = decode_string(raw, raw_length, buffer, buffer_size, &error);
+    return length == DECODE_ERROR ? -1 : (int)length;
+}
+
+JSON_VALUE* json_cursor_to_value(const JSON_CURSOR *cursor)
+{
+    if (!cursor || !doc_is_value(cursor->doc, cursor->entry)) {
+        return NULL;
+    }
+    
+    JSON_PARSER_STATE state;
+    cursor_state(cursor, &state);
+    
+    JSON_VALUE *value = parse_value(&state);
+    free(state.stack);
+    
+    if (!value && state.error[0]) {
+        framework_log(LOG_LEVEL_ERROR, "JSON parse error at offset %zu: %s", state.position, state.error);
+    }
+    
+    return value;
+}
+
+/* ==================== Compiled Schemas ==================== */
+
+
+/* Open-addressed table from field name to field index */
+typedef struct {
+    uint32_t hash;
+    uint32_t field;                /* Field index + 1, 0 = empty slot */
+} SCHEMA_SLOT;
+
+/* Enum name to value table of one field (value + 1 in the slot's field member) */
+typedef struct {
+    size_t mask;
+    SCHEMA_SLOT *slots;            /* NULL for fields that are not enums */
+} SCHEMA_ENUM_TABLE;
+
+struct _json_compiled_schema_ {
+    size_t mask;
+    SCHEMA_SLOT *slots;
+    size_t *name_lengths;
+    
+    /* Serializer output before each field's value: ,"name": with the name escaped */
+    const char **prefixes;
+    size_t *prefix_lengths;
+    
+    SCHEMA_ENUM_TABLE *enums;      /* One per field */
+};
+
+/* Names of an enum field (or array/map of enums), or 0 */
+static size_t enum_name_count(const JSON_SCHEMA_FIELD *field)
+{
+    int is_enum = field->type == SCHEMA_TYPE_ENUM ||
+                  ((field->type == SCHEMA_TYPE_ARRAY || field->type == SCHEMA_TYPE_MAP) &&
+                   field->element_type == SCHEMA_TYPE_ENUM);
+    if (!is_enum || !field->enum_names) {
+        return 0;
+    }
+    
+    size_t count = 0;
+    while (field->enum_names[count]) {
+        count++;
+    }
+    return count;
+}
+
+static size_t enum_table_capacity(size_t count)
+{
+    size_t capacity = 4;
+    while (capacity < count * 2) {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+/* Insert names in order; a duplicate name keeps its first value */
+static void enum_table_fill(SCHEMA_ENUM_TABLE *table, const char *const *names, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        size_t length = strlen(names[i]);
+        uint32_t hash = fnv1a_hash(names[i], length);
+        size_t slot = hash & table->mask;
+        
+        while (table->slots[slot].field) {
+            if (table->slots[slot].hash == hash && strcmp(names[table->slots[slot].field - 1], names[i]) == 0) {
+                break;
+            }
+            slot = (slot + 1) & table->mask;
+        }
+        
+        if (!table->slots[slot].field) {
+            table->slots[slot].hash = hash;
+            table->slots[slot].field = (uint32_t)(i + 1);
+        }
+    }
+}
+
+static int enum_find(const JSON_SCHEMA_FIELD *field, const SCHEMA_ENUM_TABLE *table,
+                     const char *name, size_t length)
+{
+    if (!table->slots) {
+        return -1;
+    }
+    
+    uint32_t hash = fnv1a_hash(name, length);
+    for (size_t slot = hash & table->mask; table->slots[slot].field; slot = (slot + 1) & table->mask) {
+        size_t value = table->slots[slot].field - 1;
+        if (table->slots[slot].hash == hash && key_equals(field->enum_names[value], name, length)) {
+            return (int)value;
+        }
+    }
+    return -1;
+}
+
+/* Serializer text before a field's value */
+static void write_field_prefix(JSON_BUILDER *builder, const char *name)
+{
+    builder_append_length(builder, ",\"", 2);
+    builder_append_escaped(builder, name, strlen(name));
+    builder_append_length(builder, "\":", 2);
+}
+
+static struct _json_compiled_schema_* compile_schema(const JSON_SCHEMA *schema)
+{
+    size_t capacity = 8;
+    while (capacity < schema->field_count * 2) {
+        capacity *= 2;
+    }
+    
+    /* Measure the escaped prefixes first */
+    JSON_BUILDER *measure = json_builder_create(0);
+    if (!measure) return NULL;
+    
+    for (size_t i = 0; i < schema->field_count; i++) {
+        write_field_prefix(measure, schema->fields[i].name);
+    }
+    size_t text_size = measure->position + 1;
+    int failed = measure->error;
+    json_builder_destroy(measure);
+    if (failed) return NULL;
+    
+    size_t enum_slots = 0;
+    for (size_t i = 0; i < schema->field_count; i++) {
+        size_t names = enum_name_count(&schema->fields[i]);
+        if (names > 0) {
+            enum_slots += enum_table_capacity(names);
+        }
+    }
+    
+    /*
+     * One allocation: header, slots, name lengths, prefix lengths, prefix
+     * table, enum tables, enum slots, prefix text
+     */
+    size_t size = sizeof(struct _json_compiled_schema_) + capacity * sizeof(SCHEMA_SLOT) +
+                  schema->field_count * (2 * sizeof(size_t) + sizeof(char*) + sizeof(SCHEMA_ENUM_TABLE)) +
+                  enum_slots * sizeof(SCHEMA_SLOT) + text_size;
+    struct _json_compiled_schema_ *compiled = (struct _json_compiled_schema_*)calloc(1, size);
+    if (!compiled) return NULL;
+    
+    compiled->mask = capacity - 1;
+    compiled->slots = (SCHEMA_SLOT*)(compiled + 1);
+    compiled->name_lengths = (size_t*)(compiled->slots + capacity);
+    compiled->prefix_lengths = compiled->name_lengths + schema->field_count;
+    compiled->prefixes = (const char**)(compiled->prefix_lengths + schema->field_count);
+    compiled->enums = (SCHEMA_ENUM_TABLE*)(compiled->prefixes + schema->field_count);
+    
+    SCHEMA_SLOT *next_enum_slot = (SCHEMA_SLOT*)(compiled->enums + schema->field_count);
+    for (size_t i = 0; i < schema->field_count; i++) {
+        size_t names = enum_name_count(&schema->fields[i]);
+        if (names > 0) {
+            SCHEMA_ENUM_TABLE *table = &compiled->enums[i];
+            size_t table_capacity = enum_table_capacity(names);
+            table->mask = table_capacity - 1;
+            table->slots = next_enum_slot;
+            next_enum_slot += table_capacity;
+            enum_table_fill(table, schema->fields[i].enum_names, names);
+        }
+    }
+    
+    JSON_BUILDER text;
+    json_builder_init_fixed(&text, (char*)next_enum_slot, text_size);
+    
+    for (size_t i = 0; i < schema->field_count; i++) {
+        const char *name = schema->fields[i].name;
+        size_t length = strlen(name);
+        uint32_t hash = fnv1a_hash(name, length);
+        
+        compiled->name_lengths[i] = length;
+        
+        size_t start = text.position;
+        write_field_prefix(&text, name);
+        compiled->prefixes[i] = text.buffer + start;
+        compiled->prefix_lengths[i] = text.position - start;
+        
+        size_t slot = hash & compiled->mask;
+        while (compiled->slots[slot].field) {
+            slot = (slot + 1) & compiled->mask;
+        }
+        compiled->slots[slot].hash = hash;
+        compiled->slots[slot].field = (uint32_t)(i + 1);
+    }
+    
+    return compiled;
+}
+
+/* Schemas are static and shared between threads; the first user publishes the table */
+static struct _json_compiled_schema_* schema_compiled(const JSON_SCHEMA *schema)
+{
+    JSON_SCHEMA *shared = (JSON_SCHEMA*)schema;
+    struct _json_compiled_schema_ *compiled = __atomic_load_n(&shared->compiled, __ATOMIC_ACQUIRE);
+    if (compiled) {
+        return compiled;
+    }
+    
+    compiled = compile_schema(schema);
+    if (!compiled) return NULL;
+    
+    struct _json_compiled_schema_ *expected = NULL;
+    if (!__atomic_compare_exchange_n(&shared->compiled, &expected, compiled, 0,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        free(compiled);
+        return expected;
+    }
+    
+    return compiled;
+}
+
+int json_schema_compile(const JSON_SCHEMA *schema)
+{
+    if (!schema) return -1;
+    
+    for (size_t i = 0; i < schema->field_count; i++) {
+        if (schema->fields[i].nested && json_schema_compile(schema->fields[i].nested) != 0) {
+            return -1;
+        }
+    }
+    
+    return schema_compiled(schema) ? 0 : -1;
+}
+
+static int schema_find_field(const JSON_SCHEMA *schema, const struct _json_compiled_schema_ *compiled,
+                             const char *key, size_t length)
+{
+    uint32_t hash = fnv1a_hash(key, length);
+    size_t slot = hash & compiled->mask;
+    
+    while (compiled->slots[slot].field) {
+        size_t index = compiled->slots[slot].field - 1;
+        if (compiled->slots[slot].hash == hash && compiled->name_lengths[index] == length &&
+            memcmp(schema->fields[index].name, key, length) == 0) {
+            return (int)index;
+        }
+        slot = (slot + 1) & compiled->mask;
+    }
+    
+    return -1;
+}
+
+int json_schema_find_field(const JSON_SCHEMA *schema, const char *name, size_t length)
+{
+    if (!schema || !name) return -1;
+    
+    const struct _json_compiled_schema_ *compiled = schema_compiled(schema);
+    if (!compiled) return -1;
+    
+    return schema_find_field(schema, compiled, name, length);
+}
+
+int json_schema_find_enum(const JSON_SCHEMA *schema, size_t field, const char *name, size_t length)
+{
+    if (!schema || !name || field >= schema->field_count) return -1;
+    
+    const struct _json_compiled_schema_ *compiled = schema_compiled(schema);
+    if (!compiled) return -1;
+    
+    return enum_find(&schema->fields[field], &compiled->enums[field], name, length);
+}
+
+/* ==================== Schema Parsing ==================== */
+
+static int schema_error(JSON_VALIDATION_RESULT *result, const char *field, const char *format, const char *name)
+{
+    snprintf(result->error_message, sizeof(result->error_message), format, name);
+    result->error_field = field;
+    result->valid = 0;
+    return -1;
+}
+
+static int schema_parse_object(JSON_PARSER_STATE *state, const JSON_SCHEMA *schema,
+                               void *target, JSON_VALIDATION_RESULT *result);
+
+/* String size for members of dynamic arrays and maps: a char* into the arena */
+#define SCHEMA_STRING_POINTER ((size_t)-1)
+
+/* Copy a string out of the input into the arena */
+static char* schema_arena_string(JSON_PARSER_STATE *state, const char *raw, size_t raw_length)
+{
+    char *str = (char*)json_arena_alloc(state->arena, raw_length + 1);
+    if (!str) {
+        snprintf(state->error, sizeof(state->error), "Out of memory");
+        return NULL;
+    }
+    if (state_decode_string(state, raw, raw_length, str, raw_length + 1) == DECODE_ERROR) {
+        return NULL;
+    }
+    return str;
+}
+
+/*
+ * Decode one value of the given type into data (a field, array element or
+ * map value); mismatched types leave it zeroed. size is the capacity of an
+ * inline string, or SCHEMA_STRING_POINTER.
+ */
+static int schema_parse_value(JSON_PARSER_STATE *state, const JSON_SCHEMA_FIELD *field,
+                              const SCHEMA_ENUM_TABLE *enums, SCHEMA_TYPE type, void *data,
+                              size_t size, JSON_VALIDATION_RESULT *result)
+{
+    char c = peek_char(state);
+    
+    switch (type) {
+        case SCHEMA_TYPE_BOOL:
+            if (match_keyword(state, "true")) {
+                *(int*)data = 1;
+                return 0;
+            }
+            break;
+        
+        case SCHEMA_TYPE_INT:
+        case SCHEMA_TYPE_INT64:
+        case SCHEMA_TYPE_DOUBLE:
+            if (c == '-' || isdigit((unsigned char)c)) {
+                JSON_NUMBER number;
+                if (scan_number(state, &number) != 0) {
+                    return -1;
+                }
+                
+                if (type == SCHEMA_TYPE_INT) {
+                    *(int*)data = number.is_double ? (int)number.real : (int)number.integer;
+                } else if (type == SCHEMA_TYPE_INT64) {
+                    if (!number.is_double) {
+                        *(int64_t*)data = number.integer;
+                    }
+                } else {
+                    *(double*)data = number.real;
+                }
+                return 0;
+            }
+            break;
+        
+        case SCHEMA_TYPE_STRING:
+            if (c == '"' && size > 0) {
+                const char *raw;
+                size_t raw_length;
+                
+                if (scan_string(state, &raw, &raw_length, NULL) != 0) {
+                    return -1;
+                }
+                if (size == SCHEMA_STRING_POINTER) {
+                    *(char**)data = schema_arena_string(state, raw, raw_length);
+                    return *(char**)data ? 0 : -1;
+                }
+                return state_decode_string(state, raw, raw_length, (char*)data, size) == DECODE_ERROR ? -1 : 0;
+            }
+            break;
+        
+        case SCHEMA_TYPE_OBJECT:
+            if (field->nested) {
+                if (c == 'n' && (field->flags & SCHEMA_FLAG_NULLABLE)) {
+                    return skip_value(state);
+                }
+                if (c != '{') {
+                    return schema_error(result, field->name, "Field '%s' must be an object", field->name);
+                }
+                return schema_parse_object(state, field->nested, data, result);
+            }
+            break;
+        
+        case SCHEMA_TYPE_ENUM:
+            if (c == '"') {
+                const char *name;
+                size_t name_length;
+                int escaped;
+                char name_buffer[KEY_BUFFER_SIZE];
+                
+                if (scan_string(state, &name, &name_length, &escaped) != 0) {
+                    return -1;
+                }
+                if (escaped) {
+                    name_length = state_decode_string(state, name, name_length, name_buffer, sizeof(name_buffer));
+                    if (name_length == DECODE_ERROR) {
+                        return -1;
+                    }
+                    name = name_buffer;
+                }
+                
+                int value = enum_find(field, enums, name, name_length);
+                if (value < 0) {
+                    return schema_error(result, field->name, "Field '%s' has an unknown value", field->name);
+                }
+                *(int*)data = value;
+                return 0;
+            }
+            break;
+        
+        case SCHEMA_TYPE_CUSTOM:
+            if (field->decode) {
+                size_t start = state->position;
+                if (skip_value(state) != 0) {
+                    return -1;
+                }
+                if (field->decode(state->json + start, state->position - start, data) != 0) {
+                    return schema_error(result, field->name, "Field '%s' could not be decoded", field->name);
+                }
+                return 0;
+            }
+            break;
+        
+        default:
+            break;
+    }
+    
+    return skip_value(state);
+}
+
+/* Room for at least one more element in a dynamic array, doubling in the arena */
+static char* schema_grow_elements(JSON_PARSER_STATE *state, char *elements, size_t count,
+                                  size_t *capacity, size_t element_size)
+{
+    size_t grown = *capacity ? *capacity * 2 : 8;
+    if (grown > SIZE_MAX / element_size) {
+        snprintf(state->error, sizeof(state->error), "Out of memory");
+        return NULL;
+    }
+    
+    char *resized = (char*)json_arena_alloc(state->arena, grown * element_size);
+    if (!resized) {
+        snprintf(state->error, sizeof(state->error), "Out of memory");
+        return NULL;
+    }
+    if (count > 0) {
+        memcpy(resized, elements, count * element_size);
+    }
+    
+    *capacity = grown;
+    return resized;
+}
+
+/*
+ * Decode an array inline (elements past capacity are skipped) or, for
+ * dynamic arrays, into the arena; non-arrays leave the field empty
+ */
+static int schema_parse_array(JSON_PARSER_STATE *state, const JSON_SCHEMA_FIELD *field,
+                              const SCHEMA_ENUM_TABLE *enums, void *target, JSON_VALIDATION_RESULT *result)
+{
+    void *field_ptr = (char*)target + field->offset;
+    int dynamic = (field->flags & SCHEMA_FLAG_DYNAMIC) != 0;
+    
+    if (peek_char(state) != '[') {
+        return skip_value(state);
+    }
+    if (dynamic && !state->arena) {
+        return schema_error(result, field->name, "Field '%s' needs an arena", field->name);
+    }
+    next_char(state);
+    
+    char *elements = dynamic ? NULL : (char*)field_ptr;
+    size_t capacity = dynamic ? 0 : field->max_length;
+    size_t string_size = dynamic ? SCHEMA_STRING_POINTER : field->element_size;
+    size_t count = 0;
+    
+    skip_whitespace(state);
+    if (peek_char(state) == ']') {
+        next_char(state);
+    } else {
+        while (1) {
+            skip_whitespace(state);
+            if (dynamic && count == capacity) {
+                elements = schema_grow_elements(state, elements, count, &capacity, field->element_size);
+                if (!elements) {
+                    return -1;
+                }
+            }
+            
+            if (count < capacity) {
+                char *element = elements + count * field->element_size;
+                if (dynamic) {
+                    memset(element, 0, field->element_size);
+                }
+                if (schema_parse_value(state, field, enums, field->element_type, element,
+                                       string_size, result) != 0) {
+                    return -1;
+                }
+                count++;
+            } else if (skip_value(state) != 0) {
+                return -1;
+            }
+            
+            skip_whitespace(state);
+            char c = next_char(state);
+            if (c == ']') {
+                break;
+            } else if (c != ',') {
+                snprintf(state->error, sizeof(state->error), "Expected ',' or ']'");
+                return -1;
+            }
+        }
+    }
+    
+    if (dynamic) {
+        *(void**)field_ptr = count > 0 ? elements : NULL;
+    }
+    if (field->count_offset != SCHEMA_NO_COUNT) {
+        *(size_t*)((char*)target + field->count_offset) = count;
+    }
+    return 0;
+}
+
+/* Decode an object with arbitrary keys into arena entries: key, then value at value_offset */
+static int schema_parse_map(JSON_PARSER_STATE *state, const JSON_SCHEMA_FIELD *field,
+                            const SCHEMA_ENUM_TABLE *enums, void *target, JSON_VALIDATION_RESULT *result)
+{
+    if (peek_char(state) != '{') {
+        return skip_value(state);
+    }
+    if (!state->arena) {
+        return schema_error(result, field->name, "Field '%s' needs an arena", field->name);
+    }
+    next_char(state);
+    
+    char *entries = NULL;
+    size_t capacity = 0;
+    size_t count = 0;
+    
+    skip_whitespace(state);
+    if (peek_char(state) == '}') {
+        next_char(state);
+    } else {
+        while (1) {
+            const char *raw;
+            size_t raw_length;
+            
+            skip_whitespace(state);
+            if (scan_string(state, &raw, &raw_length, NULL) != 0) {
+                return -1;
+            }
+            
+            if (count == capacity) {
+                entries = schema_grow_elements(state, entries, count, &capacity, field->element_size);
+                if (!entries) {
+                    return -1;
+                }
+            }
+            char *entry = entries + count * field->element_size;
+            memset(entry, 0, field->element_size);
+            
+            *(char**)entry = schema_arena_string(state, raw, raw_length);
+            if (!*(char**)entry) {
+                return -1;
+            }
+            
+            skip_whitespace(state);
+            if (next_char(state) != ':') {
+                snprintf(state->error, sizeof(state->error), "Expected ':'");
+                return -1;
+            }
+            skip_whitespace(state);
+            
+            if (schema_parse_value(state, field, enums, field->element_type, entry + field->value_offset,
+                                   SCHEMA_STRING_POINTER, result) != 0) {
+                return -1;
+            }
+            count++;
+            
+            skip_whitespace(state);
+            char c = next_char(state);
+            if (c == '}') {
+                break;
+            } else if (c != ',') {
+                snprintf(state->error, sizeof(state->error), "Expected ',' or '}'");
+                return -1;
+            }
+        }
+    }
+    
+    *(void**)((char*)target + field->offset) = count > 0 ? entries : NULL;
+    if (field->count_offset != SCHEMA_NO_COUNT) {
+        *(size_t*)((char*)target + field->count_offset) = count;
+    }
+    return 0;
+}
+
+/* Decode one member straight into its struct field */
+static int schema_parse_field(JSON_PARSER_STATE *state, const JSON_SCHEMA_FIELD *field,
+                              const SCHEMA_ENUM_TABLE *enums, void *target, JSON_VALIDATION_RESULT *result)
+{
+    void *field_ptr = (char*)target + field->offset;
+    int rc;
+    
+    if (field->type == SCHEMA_TYPE_ARRAY) {
+        rc = schema_parse_array(state, field, enums, target, result);
+    } else if (field->type == SCHEMA_TYPE_MAP) {
+        rc = schema_parse_map(state, field, enums, target, result);
+    } else {
+        rc = schema_parse_value(state, field, enums, field->type, field_ptr, field->max_length, result);
+    }
+    if (rc != 0) {
+        return -1;
+    }
+    
+    if (field->validator && !field->validator(field_ptr)) {
+        return schema_error(result, field->name, "Validation failed for field '%s'", field->name);
+    }
+    
+    return 0;
+}
+
+/* Store the default of a field that was absent from the input */
+static void schema_apply_default(const JSON_SCHEMA_FIELD *field, void *target)
+{
+    void *field_ptr = (char*)target + field->offset;
+    
+    switch (field->type) {
+        case SCHEMA_TYPE_BOOL:
+        case SCHEMA_TYPE_INT:
+        case SCHEMA_TYPE_ENUM:
+            *(int*)field_ptr = *(const int*)field->default_value;
+            break;
+        
+        case SCHEMA_TYPE_INT64:
+            *(int64_t*)field_ptr = *(const int64_t*)field->default_value;
+            break;
+        
+        case SCHEMA_TYPE_DOUBLE:
+            *(double*)field_ptr = *(const double*)field->default_value;
+            break;
+        
+        case SCHEMA_TYPE_STRING:
+            if (field->max_length > 0) {
+                snprintf((char*)field_ptr, field->max_length, "%s", (const char*)field->default_value);
+            }
+            break;
+        
+        default:
+            break;
+    }
+}
+
+/* Tokenize an object once, dispatching each key through the schema's hash table */
+static int schema_parse_object(JSON_PARSER_STATE *state, const JSON_SCHEMA *schema,
+                               void *target, JSON_VALIDATION_RESULT *result)
+{
+    if (next_char(state) != '{') {
+        snprintf(state->error, sizeof(state->error), "Expected '{'");
+        return -1;
+    }
+    
+    const struct _json_compiled_schema_ *compiled = schema_compiled(schema);
+    if (!compiled) {
+        snprintf(state->error, sizeof(state->error), "Out of memory");
+        return -1;
+    }
+    
+    memset(target, 0, schema->struct_size);
+    
+    /* Duplicate keys keep their first value */
+    unsigned char seen_small[64];
+    unsigned char *seen = seen_small;
+    if (schema->field_count > sizeof(seen_small)) {
+        seen = (unsigned char*)malloc(schema->field_count);
+        if (!seen) {
+            snprintf(state->error, sizeof(state->error), "Out of memory");
+            return -1;
+        }
+    }
+    memset(seen, 0, schema->field_count);
+    
+    int rc = 0;
+    
+    skip_whitespace(state);
+    if (peek_char(state) == '}') {
+        next_char(state);
+    } else {
+        while (1) {
+            const char *key;
+            size_t key_length;
+            int escaped;
+            char key_buffer[KEY_BUFFER_SIZE];
+            
+            skip_whitespace(state);
+            if (scan_string(state, &key, &key_length, &escaped) != 0) {
+                rc = -1;
+                break;
+            }
+            
+            if (escaped) {
+                key_length = state_decode_string(state, key, key_length, key_buffer, sizeof(key_buffer));
+                if (key_length == DECODE_ERROR) {
+                    rc = -1;
+                    break;
+                }
+                key = key_buffer;
+            }
+            
+            skip_whitespace(state);
+            if (next_char(state) != ':') {
+                snprintf(state->error, sizeof(state->error), "Expected ':'");
+                rc = -1;
+                break;
+            }
+            skip_whitespace(state);
+            
+            int index = schema_find_field(schema, compiled, key, key_length);
+            if (index >= 0 && !seen[index]) {
+                seen[index] = 1;
+                rc = schema_parse_field(state, &schema->fields[index], &compiled->enums[index], target, result);
+            } else {
+                rc = skip_value(state);
+            }
+            if (rc != 0) {
+                break;
+            }
+            
+            skip_whitespace(state);
+            char c = next_char(state);
+            if (c == '}') {
+                break;
+            } else if (c != ',') {
+                snprintf(state->error, sizeof(state->error), "Expected ',' or '}'");
+                rc = -1;
+                break;
+            }
+        }
+    }
+    
+    if (rc == 0) {
+        for (size_t i = 0; i < schema->field_count; i++) {
+            if (seen[i]) {
+                continue;
+            }
+            if (schema->fields[i].flags & SCHEMA_FLAG_REQUIRED) {
+                rc = schema_error(result, schema->fields[i].name,
+                                  "Required field '%s' is missing", schema->fields[i].name);
+                break;
+            }
+            if (schema->fields[i].default_value) {
+                schema_apply_default(&schema->fields[i], target);
+            }
+        }
+    }
+    
+    if (seen != seen_small) {
+        free(seen);
+    }
+    return rc;
+}
+
+/* Shared by the buffer and arena entry points; arena may be NULL */
+static int parse_schema(const char *json, size_t length, const JSON_SCHEMA *schema,
+                        void *target, JSON_ARENA *arena, JSON_VALIDATION_RESULT *result)
+{
+    JSON_VALIDATION_RESULT local;
+    if (!result) {
+        result = &local;
+    }
+    
+    result->valid = 1;
+    result->error_message[0] = '\0';
+    result->error_field = NULL;
+    result->error_offset = 0;
+    
+    if (!json || !schema || !target) {
+        result->valid = 0;
+        snprintf(result->error_message, sizeof(result->error_message), "Invalid arguments");
+        return -1;
+    }
+    
+    JSON_PARSER_STATE state = {
+        .json = json,
+        .position = 0,
+        .length = length,
+        .error = {0},
+        .arena = arena
+    };
+    
+    skip_whitespace(&state);
+    if (peek_char(&state) != '{') {
+        snprintf(result->error_message, sizeof(result->error_message), "Expected JSON object");
+        result->valid = 0;
+        return -1;
+    }
+    
+    /* The arena keeps its index across parses */
+    JSON_INDEX index;
+    if (arena) {
+        state_use_index(&state, &arena->index);
+    } else {
+        json_index_init(&index);
+        state_use_index(&state, &index);
+    }
+    
+    int rc = schema_parse_object(&state, schema, target, result);
+    if (!arena) {
+        json_index_free(&index);
+    }
+    
+    if (rc != 0) {
+        /* Schema errors have already been reported; anything else is a syntax error */
+        if (result->valid) {
+            snprintf(result->error_message, sizeof(result->error_message),
+                    "Failed to parse JSON at offset %zu: %s", state.position, state.error);
+            result->error_offset = state.position;
+            result->valid = 0;
+        }
+        return -1;
+    }
+    
+    return 0;
+}
+
+int json_parse_schema_buffer(const char *json, size_t length, const JSON_SCHEMA *schema,
+                             void *target, JSON_VALIDATION_RESULT *result)
+{
+    return parse_schema(json, length, schema, target, NULL, result);
+}
+
+int json_parse_schema_arena(const char *json, size_t length, const JSON_SCHEMA *schema,
+                            void *target, JSON_ARENA *arena, JSON_VALIDATION_RESULT *result)
+{
+    if (!arena) {
+        JSON_VALIDATION_RESULT local;
+        if (!result) {
+            result = &local;
+        }
+        result->valid = 0;
+        result->error_field = NULL;
+        result->error_offset = 0;
+        snprintf(result->error_message, sizeof(result->error_message), "Invalid arguments");
+        return -1;
+    }
+    
+    return parse_schema(json, length, schema, target, arena, result);
+}
+
+int json_parse_with_schema(const char *json_string, const JSON_SCHEMA *schema, void *target)
+{
+    if (!json_string) return -1;
+    
+    return json_parse_schema_buffer(json_string, strlen(json_string), schema, target, NULL);
+}
+
+int json_parse_and_validate(const char *json_string, const JSON_SCHEMA *schema,
+                           void *target, JSON_VALIDATION_RESULT *result)
+{
+    return json_parse_schema_buffer(json_string, json_string ? strlen(json_string) : 0,
+                                    schema, target, result);
+}
+
+/* ==================== Validation ==================== */
+
+#define VALIDATE_MAX_DEPTH 1024
+
+static int validate_fail(JSON_PARSER_STATE *state, size_t position, const char *error)
+{
+    state->position = position;
+    snprintf(state->error, sizeof(state->error), "%s", error);
+    return -1;
+}
+
+/*
+ * Check a string token in one pass, the way decode_string would read it,
+ * without copying; position ends after the closing quote. decoded_length
+ * (optional) receives the length the string would decode to.
+ */
+static int validate_string(JSON_PARSER_STATE *state, size_t *decoded_length)
+{
+    size_t start = state->position + 1;
+    size_t position = start;
+    size_t decoded = 0;
+    
+    while (1) {
+        size_t run = escape_free_length(state->json + position, state->length - position);
+        position += run;
+        decoded += run;
+        
+        if (position >= state->length) {
+            return validate_fail(state, state->length, "Unterminated string");
+        }
+        
+        char c = state->json[position];
+        if (c == '"') {
+            break;
+        }
+        if (c != '\\') {
+            return validate_fail(state, position, "Control character in string");
+        }
+        
+        char out[4];
+        size_t out_length;
+        const char *error;
+        size_t consumed = decode_escape(state->json + position + 1, state->length - position - 1,
+                                        out, &out_length, &error);
+        if (consumed == 0) {
+            return validate_fail(state, position, error);
+        }
+        position += consumed + 1;
+        decoded += out_length;
+    }
+    
+    if (strict_utf8 && !json_utf8_valid(state->json + start, position - start)) {
+        return validate_fail(state, start, "Invalid UTF-8 in string");
+    }
+    
+    state->position = position + 1;
+    if (decoded_length) {
+        *decoded_length = decoded;
+    }
+    return 0;
+}
+
+/*
+ * Check a number against the JSON grammar, which is stricter than
+ * json_number_parse ("01", "1." and "1e" are rejected); number (optional)
+ * receives its value
+ */
+static int validate_number(JSON_PARSER_STATE *state, JSON_NUMBER *number)
+{
+    const char *text = state->json;
+    size_t start = state->position;
+    size_t i = start;
+    
+    if (i < state->length && text[i] == '-') {
+        i++;
+    }
+    if (i >= state->length || !isdigit((unsigned char)text[i])) {
+        return validate_fail(state, start, "Invalid number");
+    }
+    if (text[i] == '0') {
+        i++;
+    } else {
+        while (i < state->length && isdigit((unsigned char)text[i])) {
+            i++;
+        }
+    }
+    
+    if (i < state->length && text[i] == '.') {
+        i++;
+        if (i >= state->length || !isdigit((unsigned char)text[i])) {
+            return validate_fail(state, start, "Invalid number");
+        }
+        while (i < state->length && isdigit((unsigned char)text[i])) {
+            i++;
+        }
+    }
+    
+    if (i < state->length && (text[i] == 'e' || text[i] == 'E')) {
+        i++;
+        if (i < state->length && (text[i] == '+' || text[i] == '-')) {
+            i++;
+        }
+        if (i >= state->length || !isdigit((unsigned char)text[i])) {
+            return validate_fail(state, start, "Invalid number");
+        }
+        while (i < state->length && isdigit((unsigned char)text[i])) {
+            i++;
+        }
+    }
+    
+    if (number && scan_number(state, number) != 0) {
+        return validate_fail(state, start, "Invalid number");
+    }
+    state->position = i;
+    return 0;
+}
+
+/* Check one scalar; position ends after it */
+static int validate_scalar(JSON_PARSER_STATE *state)
+{
+    char c = peek_char(state);
+    
+    if (c == '"') {
+        return validate_string(state, NULL);
+    }
+    if (c == '-' || isdigit((unsigned char)c)) {
+        return validate_number(state, NULL);
+    }
+    if (match_keyword(state, "true") || match_keyword(state, "false") || match_keyword(state, "null")) {
+        return 0;
+    }
+    
+    return validate_fail(state, state->position,
+                         state->position < state->length ? "Unexpected character" : "Unexpected end of input");
+}
+
+/*
+ * Check any value without recursion or allocation. Open containers are
+ * tracked in a bit stack (set for objects); depth is the nesting already
+ * entered by the caller.
+ */
+static int validate_value(JSON_PARSER_STATE *state, size_t depth)
+{
+    uint64_t objects[VALIDATE_MAX_DEPTH / 64];
+    size_t level = 0;
+    int expect_key = 0;
+    
+    while (1) {
+        skip_whitespace(state);
+        
+        if (expect_key) {
+            if (peek_char(state) != '"') {
+                return validate_fail(state, state->position, "Expected string key");
+            }
+            if (validate_string(state, NULL) != 0) {
+                return -1;
+            }
+            skip_whitespace(state);
+            if (peek_char(state) != ':') {
+                return validate_fail(state, state->position, "Expected ':'");
+            }
+            state->position++;
+            skip_whitespace(state);
+            expect_key = 0;
+        }
+        
+        char c = peek_char(state);
+        if (c == '{' || c == '[') {
+            if (depth + level >= VALIDATE_MAX_DEPTH) {
+                return validate_fail(state, state->position, "Maximum nesting depth exceeded");
+            }
+            
+            uint64_t bit = 1ULL << (level % 64);
+            if (c == '{') {
+                objects[level / 64] |= bit;
+            } else {
+                objects[level / 64] &= ~bit;
+            }
+            level++;
+            state->position++;
+            
+            skip_whitespace(state);
+            if (peek_char(state) != (c == '{' ? '}' : ']')) {
+                expect_key = (c == '{');
+                continue;
+            }
+            state->position++;
+            level--;
+        } else if (validate_scalar(state) != 0) {
+            return -1;
+        }
+        
+        /* A value is complete: close finished containers, stop at the next element */
+        while (level > 0) {
+            int object = (objects[(level - 1) / 64] >> ((level - 1) % 64)) & 1;
+            char close = object ? '}' : ']';
+            
+            skip_whitespace(state);
+            c = peek_char(state);
+            if (c == ',') {
+                state->position++;
+                expect_key = object;
+                break;
+            }
+            if (c != close) {
+                return validate_fail(state, state->position,
+                                     object ? "Expected ',' or '}'" : "Expected ',' or ']'");
+            }
+            state->position++;
+            level--;
+        }
+        
+        if (level == 0) {
+            return 0;
+        }
+    }
+}
+
+static int validate_object(JSON_PARSER_STATE *state, const JSON_SCHEMA *schema, size_t depth,
+                           JSON_VALIDATION_RESULT *result);
+
+/* Report a schema violation at the offset of the offending value */
+static int validate_schema_error(JSON_PARSER_STATE *state, size_t position, JSON_VALIDATION_RESULT *result,
+                                 const char *field, const char *format)
+{
+    result->error_offset = position;
+    state->position = position;
+    return schema_error(result, field, format, field);
+}
+
+/* Check a value against a field or array element type (max_length 0 = any string length) */
+static int validate_typed(JSON_PARSER_STATE *state, const JSON_SCHEMA_FIELD *field, const SCHEMA_ENUM_TABLE *enums,
+                          SCHEMA_TYPE type, size_t max_length, size_t depth, JSON_VALIDATION_RESULT *result)
+{
+    const JSON_SCHEMA *nested = field->nested;
+    const char *name = field->name;
+    size_t start = state->position;
+    char c = peek_char(state);
+    
+    switch (type) {
+        case SCHEMA_TYPE_BOOL:
+            if (match_keyword(state, "true") || match_keyword(state, "false")) {
+                return 0;
+            }
+            break;
+        
+        case SCHEMA_TYPE_INT:
+        case SCHEMA_TYPE_INT64:
+        case SCHEMA_TYPE_DOUBLE:
+            if (c == '-' || isdigit((unsigned char)c)) {
+                JSON_NUMBER number;
+                if (validate_number(state, &number) != 0) {
+                    return -1;
+                }
+                if (type == SCHEMA_TYPE_DOUBLE) {
+                    return 0;
+                }
+                if (number.is_double ||
+                    (type == SCHEMA_TYPE_INT && (number.integer < INT_MIN || number.integer > INT_MAX))) {
+                    return validate_schema_error(state, start, result, name,
+                                                 "Field '%s' is not an integer in range");
+                }
+                return 0;
+            }
+            break;
+        
+        case SCHEMA_TYPE_STRING:
+            if (c == '"') {
+                size_t length;
+                if (validate_string(state, &length) != 0) {
+                    return -1;
+                }
+                if (max_length > 0 && length >= max_length) {
+                    return validate_schema_error(state, start, result, name, "Field '%s' is too long");
+                }
+                return 0;
+            }
+            break;
+        
+        case SCHEMA_TYPE_OBJECT:
+            if (c == '{') {
+                if (!nested) {
+                    return validate_value(state, depth);
+                }
+                if (depth >= VALIDATE_MAX_DEPTH) {
+                    return validate_fail(state, start, "Maximum nesting depth exceeded");
+                }
+                return validate_object(state, nested, depth + 1, result);
+            }
+            break;
+        
+        case SCHEMA_TYPE_ENUM:
+            if (c == '"') {
+                const char *raw;
+                size_t raw_length;
+                int escaped;
+                char name_buffer[KEY_BUFFER_SIZE];
+                
+                if (validate_string(state, NULL) != 0) {
+                    return -1;
+                }
+                
+                /* Already checked, so the plain scan and decode cannot fail */
+                state->position = start;
+                scan_string(state, &raw, &raw_length, &escaped);
+                if (escaped) {
+                    raw_length = state_decode_string(state, raw, raw_length, name_buffer, sizeof(name_buffer));
+                    raw = name_buffer;
+                }
+                if (enum_find(field, enums, raw, raw_length) < 0) {
+                    return validate_schema_error(state, start, result, name, "Field '%s' has an unknown value");
+                }
+                return 0;
+            }
+            break;
+        
+        default:
+            return validate_value(state, depth);
+    }
+    
+    return validate_schema_error(state, start, result, name, "Field '%s' has the wrong type");
+}
+
+static int validate_array(JSON_PARSER_STATE *state, const JSON_SCHEMA_FIELD *field, const SCHEMA_ENUM_TABLE *enums,
+                          size_t depth, JSON_VALIDATION_RESULT *result)
+{
+    size_t start = state->position;
+    if (peek_char(state) != '[') {
+        return validate_schema_error(state, start, result, field->name, "Field '%s' must be an array");
+    }
+    if (depth >= VALIDATE_MAX_DEPTH) {
+        return validate_fail(state, start, "Maximum nesting depth exceeded");
+    }
+    state->position++;
+    
+    skip_whitespace(state);
+    if (peek_char(state) == ']') {
+        state->position++;
+        return 0;
+    }
+    
+    /* Inline strings are stored in rows of element_size bytes; dynamic ones have no limit */
+    int dynamic = (field->flags & SCHEMA_FLAG_DYNAMIC) != 0;
+    size_t element_length = field->element_type == SCHEMA_TYPE_STRING && !dynamic ? field->element_size : 0;
+    size_t count = 0;
+    
+    while (1) {
+        skip_whitespace(state);
+        if (!dynamic && count == field->max_length) {
+            return validate_schema_error(state, state->position, result, field->name,
+                                         "Field '%s' has too many elements");
+        }
+        if (validate_typed(state, field, enums, field->element_type, element_length, depth + 1, result) != 0) {
+            return -1;
+        }
+        count++;
+        
+        skip_whitespace(state);
+        char c = peek_char(state);
+        if (c == ']') {
+            state->position++;
+            return 0;
+        }
+        if (c != ',') {
+            return validate_fail(state, state->position, "Expected ',' or ']'");
+        }
+        state->position++;
     }
 }
 
-/* Public API */
+/* Check a map: any keys, every value of the element type */
+static int validate_map(JSON_PARSER_STATE *state, const JSON_SCHEMA_FIELD *field, const SCHEMA_ENUM_TABLE *enums,
+                        size_t depth, JSON_VALIDATION_RESULT *result)
+{
+    size_t start = state->position;
+    if (peek_char(state) != '{') {
+        return validate_schema_error(state, start, result, field->name, "Field '%s' must be an object");
+    }
+    if (depth >= VALIDATE_MAX_DEPTH) {
+        return validate_fail(state, start, "Maximum nesting depth exceeded");
+    }
+    state->position++;
+    
+    skip_whitespace(state);
+    if (peek_char(state) == '}') {
+        state->position++;
+        return 0;
+    }
+    
+    while (1) {
+        skip_whitespace(state);
+        if (peek_char(state) != '"') {
+            return validate_fail(state, state->position, "Expected string key");
+        }
+        if (validate_string(state, NULL) != 0) {
+            return -1;
+        }
+        
+        skip_whitespace(state);
+        if (peek_char(state) != ':') {
+            return validate_fail(state, state->position, "Expected ':'");
+        }
+        state->position++;
+        skip_whitespace(state);
+        
+        if (validate_typed(state, field, enums, field->element_type, 0, depth + 1, result) != 0) {
+            return -1;
+        }
+        
+        skip_whitespace(state);
+        char c = peek_char(state);
+        if (c == '}') {
+            state->position++;
+            return 0;
+        }
+        if (c != ',') {
+            return validate_fail(state, state->position, "Expected ',' or '}'");
+        }
+        state->position++;
+    }
+}
 
-JSON_VALUE* json_parse(const char *json_string)
+/* Check an object against a schema; unknown members only need to be well-formed */
+static int validate_object(JSON_PARSER_STATE *state, const JSON_SCHEMA *schema, size_t depth,
+                           JSON_VALIDATION_RESULT *result)
 {
-    if (!json_string) return NULL;
+    const struct _json_compiled_schema_ *compiled = schema_compiled(schema);
+    if (!compiled) {
+        return validate_fail(state, state->position, "Out of memory");
+    }
+    
+    /* Duplicate keys are checked for syntax only, as parsing keeps the first */
+    unsigned char seen[schema->field_count + 1];
+    memset(seen, 0, schema->field_count);
+    
+    state->position++;
+    skip_whitespace(state);
+    if (peek_char(state) == '}') {
+        state->position++;
+    } else {
+        while (1) {
+            const char *key;
+            size_t key_length;
+            int escaped;
+            char key_buffer[KEY_BUFFER_SIZE];
+            
+            skip_whitespace(state);
+            size_t key_start = state->position;
+            if (peek_char(state) != '"') {
+                return validate_fail(state, key_start, "Expected string key");
+            }
+            if (validate_string(state, NULL) != 0) {
+                return -1;
+            }
+            
+            /* Already checked, so the plain scan and decode cannot fail */
+            state->position = key_start;
+            scan_string(state, &key, &key_length, &escaped);
+            if (escaped) {
+                key_length = state_decode_string(state, key, key_length, key_buffer, sizeof(key_buffer));
+                key = key_buffer;
+            }
+            
+            skip_whitespace(state);
+            if (peek_char(state) != ':') {
+                return validate_fail(state, state->position, "Expected ':'");
+            }
+            state->position++;
+            skip_whitespace(state);
+            
+            int rc;
+            int index = schema_find_field(schema, compiled, key, key_length);
+            if (index >= 0 && !seen[index]) {
+                const JSON_SCHEMA_FIELD *field = &schema->fields[index];
+                seen[index] = 1;
+                
+                if (peek_char(state) == 'n' && (field->flags & SCHEMA_FLAG_NULLABLE) &&
+                    match_keyword(state, "null")) {
+                    rc = 0;
+                } else if (field->type == SCHEMA_TYPE_ARRAY) {
+                    rc = validate_array(state, field, &compiled->enums[index], depth, result);
+                } else if (field->type == SCHEMA_TYPE_MAP) {
+                    rc = validate_map(state, field, &compiled->enums[index], depth, result);
+                } else {
+                    rc = validate_typed(state, field, &compiled->enums[index], field->type, field->max_length,
+                                       depth, result);
+                }
+            } else {
+                rc = validate_value(state, depth);
+            }
+            if (rc != 0) {
+                return -1;
+            }
+            
+            skip_whitespace(state);
+            char c = peek_char(state);
+            if (c == '}') {
+                state->position++;
+                break;
+            }
+            if (c != ',') {
+                return validate_fail(state, state->position, "Expected ',' or '}'");
+            }
+            state->position++;
+        }
+    }
+    
+    for (size_t i = 0; i < schema->field_count; i++) {
+        if (!seen[i] && (schema->fields[i].flags & SCHEMA_FLAG_REQUIRED)) {
+            result->error_offset = state->position;
+            return schema_error(result, schema->fields[i].name,
+                                "Required field '%s' is missing", schema->fields[i].name);
+        }
+    }
+    return 0;
+}
+
+int json_validate(const char *json, size_t length, const JSON_SCHEMA *schema, JSON_VALIDATION_RESULT *result)
+{
+    JSON_VALIDATION_RESULT local;
+    if (!result) {
+        result = &local;
+    }
+    
+    result->valid = 1;
+    result->error_message[0] = '\0';
+    result->error_field = NULL;
+    result->error_offset = 0;
+    
+    if (!json) {
+        result->valid = 0;
+        snprintf(result->error_message, sizeof(result->error_message), "Invalid arguments");
+        return -1;
+    }
     
     JSON_PARSER_STATE state = {
-        .json = json_string,
+        .json = json,
         .position = 0,
-        .length = strlen(json_string),
+        .length = length,
         .error = {0}
     };
     
-    JSON_VALUE *value = parse_value(&state);
+    skip_whitespace(&state);
     
-    if (!value && state.error[0]) {
-        framework_log(LOG_LEVEL_ERROR, "JSON parse error: %s", state.error);
+    int rc;
+    if (!schema) {
+        rc = validate_value(&state, 0);
+    } else if (peek_char(&state) == '{') {
+        rc = validate_object(&state, schema, 1, result);
+    } else {
+        rc = validate_fail(&state, state.position, "Expected JSON object");
     }
     
-    return value;
+    if (rc == 0) {
+        skip_whitespace(&state);
+        if (state.position < state.length) {
+            rc = validate_fail(&state, state.position, "Unexpected data after JSON value");
+        }
+    }
+    
+    /* Schema errors have already been reported; anything else is a syntax error */
+    if (rc != 0 && result->valid) {
+        snprintf(result->error_message, sizeof(result->error_message),
+                 "Invalid JSON at offset %zu: %s", state.position, state.error);
+        result->error_offset = state.position;
+        result->valid = 0;
+    }
+    
+    return rc;
 }
 
-/* Find value in object by key */
-static JSON_VALUE* find_object_value(JSON_VALUE *object, const char *key)
+/* JSON Builder */
+JSON_BUILDER* json_builder_create(size_t initial_size)
 {
-    if (!object || object->type != JSON_TYPE_OBJECT) {
-        return NULL;
+    JSON_BUILDER *builder = (JSON_BUILDER*)calloc(1, sizeof(JSON_BUILDER));
+    if (!builder) return NULL;
+    
+    if (initial_size < BUILDER_MIN_CAPACITY) {
+        initial_size = BUILDER_MIN_CAPACITY;
     }
     
-    for (size_t i = 0; i < object->data.object_value.count; i++) {
-        if (strcmp(object->data.object_value.keys[i], key) == 0) {
-            return object->data.object_value.values[i];
-        }
+    builder->buffer = (char*)malloc(initial_size);
+    if (!builder->buffer) {
+        free(builder);
+        return NULL;
     }
     
-    return NULL;
+    builder->buffer[0] = '\0';
+    builder->size = initial_size;
+    builder->position = 0;
+    builder->depth = 0;
+    builder->error = 0;
+    
+    return builder;
 }
 
-JSON_VALUE* json_get_path(JSON_VALUE *value, const char *path)
+void json_builder_destroy(JSON_BUILDER *builder)
 {
-    if (!value || !path) return NULL;
+    if (builder) {
+        free(builder->buffer);
+        free(builder);
+    }
+}
+
+void json_builder_init_fixed(JSON_BUILDER *builder, char *buffer, size_t size)
+{
+    if (!builder) return;
     
-    /* Duplicate path for tokenization */
-    size_t path_len = strlen(path);
-    char *path_copy = (char*)malloc(path_len + 1);
-    if (!path_copy) return NULL;
-    strcpy(path_copy, path);
+    builder->buffer = buffer;
+    builder->size = size;
+    builder->position = 0;
+    builder->depth = 0;
+    builder->error = (!buffer || size == 0);
+    builder->fixed = 1;
+    if (!builder->error) {
+        buffer[0] = '\0';
+    }
+}
+
+void json_builder_reset(JSON_BUILDER *builder)
+{
+    if (!builder) return;
     
-    JSON_VALUE *current = value;
-    char *token = strtok(path_copy, ".");
+    builder->position = 0;
+    builder->depth = 0;
+    builder->error = 0;
+    if (builder->buffer) {
+        builder->buffer[0] = '\0';
+    }
+}
+
+/* Make room for length bytes plus the terminator; returns the write position or NULL */
+static char* builder_reserve(JSON_BUILDER *builder, size_t length)
+{
+    if (builder->error) return NULL;
     
-    while (token && current) {
-        current = find_object_value(current, token);
-        token = strtok(NULL, ".");
+    size_t needed = builder->position + length + 1;
+    if (needed > builder->size) {
+        if (builder->fixed) {
+            builder->error = 1;
+            return NULL;
+        }
+        
+        size_t new_size = builder->size ? builder->size * 2 : BUILDER_MIN_CAPACITY;
+        while (new_size < needed) {
+            new_size *= 2;
+        }
+        
+        char *new_buffer = (char*)realloc(builder->buffer, new_size);
+        if (!new_buffer) {
+            builder->error = 1;
+            return NULL;
+        }
+        
+        builder->buffer = new_buffer;
+        builder->size = new_size;
     }
     
-    free(path_copy);
-    return current;
+    return builder->buffer + builder->position;
 }
 
-const char* json_get_string(JSON_VALUE *value)
+static void builder_append_length(JSON_BUILDER *builder, const char *str, size_t len)
 {
-    if (value && value->type == JSON_TYPE_STRING) {
-        return value->data.string_value;
+    char *out = builder_reserve(builder, len);
+    if (!out) return;
+    
+    memcpy(out, str, len);
+    builder->position += len;
+    builder->buffer[builder->position] = '\0';
+}
+
+/* Append a string body with JSON escaping, copying runs that need none in bulk */
+static void builder_append_escaped(JSON_BUILDER *builder, const char *str, size_t length)
+{
+    static const char hex_digits[] = "0123456789abcdef";
+    
+    while (length > 0) {
+        size_t run = escape_free_length(str, length);
+        builder_append_length(builder, str, run);
+        if (run == length) {
+            break;
+        }
+        
+        unsigned char c = (unsigned char)str[run];
+        char escape[6] = { '\\', 0, 0, 0, 0, 0 };
+        size_t escape_length = 2;
+        
+        switch (c) {
+            case '"':  escape[1] = '"'; break;
+            case '\\': escape[1] = '\\'; break;
+            case '\b': escape[1] = 'b'; break;
+            case '\f': escape[1] = 'f'; break;
+            case '\n': escape[1] = 'n'; break;
+            case '\r': escape[1] = 'r'; break;
+            case '\t': escape[1] = 't'; break;
+            default:
+                escape[1] = 'u';
+                escape[2] = '0';
+                escape[3] = '0';
+                escape[4] = hex_digits[c >> 4];
+                escape[5] = hex_digits[c & 0xF];
+                escape_length = 6;
+                break;
+        }
+        builder_append_length(builder, escape, escape_length);
+        
+        str += run + 1;
+        length -= run + 1;
     }
-    return NULL;
 }
 
-int json_get_int(JSON_VALUE *value, int default_val)
+/* Write "key": for object members; array elements pass NULL */
+static void builder_key(JSON_BUILDER *builder, const char *key)
 {
-    if (!value) return default_val;
+    if (!key) return;
     
-    if (value->type == JSON_TYPE_INTEGER) {
-        return (int)value->data.integer_value;
-    } else if (value->type == JSON_TYPE_DOUBLE) {
-        return (int)value->data.double_value;
+    builder_append_length(builder, "\"", 1);
+    builder_append_escaped(builder, key, strlen(key));
+    builder_append_length(builder, "\":", 2);
+}
+
+/* Close a container, dropping the separator after its last value */
+static void builder_close(JSON_BUILDER *builder, char close)
+{
+    if (builder->position > 0 && builder->buffer[builder->position - 1] == ',') {
+        builder->position--;
     }
     
-    return default_val;
+    char text[2] = { close, ',' };
+    if (builder->depth > 0) {
+        builder->depth--;
+    }
+    
+    /* A nested container is itself a value and needs a separator */
+    builder_append_length(builder, text, builder->depth > 0 ? 2 : 1);
 }
 
-int json_get_bool(JSON_VALUE *value, int default_val)
+void json_builder_start_object(JSON_BUILDER *builder)
 {
-    if (value && value->type == JSON_TYPE_BOOLEAN) {
-        return value->data.boolean_value;
+    builder_append_length(builder, "{", 1);
+    builder->depth++;
+}
+
+void json_builder_end_object(JSON_BUILDER *builder)
+{
+    builder_close(builder, '}');
+}
+
+void json_builder_start_array(JSON_BUILDER *builder)
+{
+    builder_append_length(builder, "[", 1);
+    builder->depth++;
+}
+
+void json_builder_end_array(JSON_BUILDER *builder)
+{
+    builder_close(builder, ']');
+}
+
+void json_builder_add_key(JSON_BUILDER *builder, const char *key)
+{
+    builder_key(builder, key);
+}
+
+void json_builder_add_string(JSON_BUILDER *builder, const char *key, const char *value)
+{
+    builder_key(builder, key);
+    builder_append_length(builder, "\"", 1);
+    if (value) {
+        builder_append_escaped(builder, value, strlen(value));
     }
-    return default_val;
+    builder_append_length(builder, "\",", 2);
 }
 
-double json_get_double(JSON_VALUE *value, double default_val)
+/* Numbers are formatted straight into the buffer (the formatters write the terminator) */
+static void builder_write_int64(JSON_BUILDER *builder, int64_t value)
 {
-    if (!value) return default_val;
+    if (builder->error) return;
     
-    if (value->type == JSON_TYPE_DOUBLE) {
-        return value->data.double_value;
-    } else if (value->type == JSON_TYPE_INTEGER) {
-        return (double)value->data.integer_value;
+    if (builder->size - builder->position > JSON_NUMBER_BUFFER_SIZE) {
+        builder->position += json_number_format_int64(value, builder->buffer + builder->position);
+        return;
     }
     
-    return default_val;
+    /* Near the end: format aside so a fixed buffer is only refused what does not fit */
+    char number[JSON_NUMBER_BUFFER_SIZE];
+    builder_append_length(builder, number, json_number_format_int64(value, number));
 }
 
-void json_free(JSON_VALUE *value)
+static void builder_write_double(JSON_BUILDER *builder, double value)
 {
-    if (!value) return;
+    if (builder->error) return;
     
-    switch (value->type) {
-        case JSON_TYPE_STRING:
-            free(value->data.string_value);
-            break;
-            
-        case JSON_TYPE_ARRAY:
-            for (size_t i = 0; i < value->data.array_value.count; i++) {
-                json_free(value->data.array_value.elements[i]);
-            }
-            free(value->data.array_value.elements);
-            break;
-            
-        case JSON_TYPE_OBJECT:
-            for (size_t i = 0; i < value->data.object_value.count; i++) {
-                free(value->data.object_value.keys[i]);
-                json_free(value->data.object_value.values[i]);
-            }
-            free(value->data.object_value.keys);
-            free(value->data.object_value.values);
-            break;
-            
-        default:
-            break;
+    if (builder->size - builder->position > JSON_NUMBER_BUFFER_SIZE) {
+        builder->position += json_number_format_double(value, builder->buffer + builder->position);
+        return;
+    }
+    
+    char number[JSON_NUMBER_BUFFER_SIZE];
+    builder_append_length(builder, number, json_number_format_double(value, number));
+}
+
+void json_builder_add_int(JSON_BUILDER *builder, const char *key, int value)
+{
+    builder_key(builder, key);
+    builder_write_int64(builder, value);
+    builder_append_length(builder, ",", 1);
+}
+
+void json_builder_add_int64(JSON_BUILDER *builder, const char *key, int64_t value)
+{
+    builder_key(builder, key);
+    builder_write_int64(builder, value);
+    builder_append_length(builder, ",", 1);
+}
+
+void json_builder_add_double(JSON_BUILDER *builder, const char *key, double value)
+{
+    builder_key(builder, key);
+    builder_write_double(builder, value);
+    builder_append_length(builder, ",", 1);
+}
+
+void json_builder_add_bool(JSON_BUILDER *builder, const char *key, int value)
+{
+    builder_key(builder, key);
+    if (value) {
+        builder_append_length(builder, "true,", 5);
+    } else {
+        builder_append_length(builder, "false,", 6);
     }
+}
+
+void json_builder_add_null(JSON_BUILDER *builder, const char *key)
+{
+    builder_key(builder, key);
+    builder_append_length(builder, "null,", 5);
+}
+
+void json_builder_add_raw(JSON_BUILDER *builder, const char *text, size_t length)
+{
+    if (!builder || (!text && length > 0)) return;
     
-    free(value);
+    builder_append_length(builder, text, length);
+}
+
+const char* json_builder_get_string(JSON_BUILDER *builder)
+{
+    if (builder && !builder->error) {
+        return builder->buffer;
+    }
+    return NULL;
 }
 
-/* Forward declaration for schema parsing */
-static int json_parse_with_schema_value(JSON_VALUE *json_value, const JSON_SCHEMA *schema, void *target);
+/* ==================== Schema Serialization ==================== */
 
-/* Schema-based parsing */
-static int apply_schema_field(JSON_VALUE *json_obj, const JSON_SCHEMA_FIELD *field, 
-                             void *target, JSON_VALIDATION_RESULT *result)
+static int serialize_object(JSON_BUILDER *builder, const void *source, const JSON_SCHEMA *schema);
+
+/* Length of a string stored in a char array of size bytes (0 = unbounded) */
+static size_t stored_string_length(const char *str, size_t size)
+{
+    if (size == 0) {
+        return strlen(str);
+    }
+    const char *end = (const char*)memchr(str, '\0', size);
+    return end ? (size_t)(end - str) : size;
+}
+
+/* Run a custom field's encode hook, which writes one value in builder style (with a trailing ',') */
+static void serialize_custom(JSON_BUILDER *builder, const JSON_SCHEMA_FIELD *field, const void *data)
 {
-    JSON_VALUE *field_value = find_object_value(json_obj, field->name);
+    size_t start = builder->position;
     
-    if (!field_value) {
-        if (field->flags & SCHEMA_FLAG_REQUIRED) {
-            if (result) {
-                snprintf(result->error_message, sizeof(result->error_message),
-                        "Required field '%s' is missing", field->name);
-                result->error_field = field->name;
-                result->valid = 0;
-            }
-            return -1;
-        }
-        return 0;
+    if (!field->encode) {
+        builder_append_length(builder, "null", 4);
+        return;
+    }
+    if (field->encode(builder, data) != 0) {
+        builder->error = 1;
+        return;
     }
     
-    void *field_ptr = (char*)target + field->offset;
+    if (builder->position > start && builder->buffer[builder->position - 1] == ',') {
+        builder->position--;
+    }
+    if (builder->position == start) {
+        builder_append_length(builder, "null", 4);
+    }
+}
+
+/*
+ * Write one value of the given type stored at data; size is the capacity
+ * of an inline string, or SCHEMA_STRING_POINTER for a char*
+ */
+static void serialize_value(JSON_BUILDER *builder, const JSON_SCHEMA_FIELD *field, SCHEMA_TYPE type,
+                            const void *data, size_t size)
+{
+    const JSON_SCHEMA *nested = field->nested;
     
-    switch (field->type) {
+    switch (type) {
         case SCHEMA_TYPE_BOOL:
-            *(int*)field_ptr = json_get_bool(field_value, 0);
+            if (*(const int*)data) {
+                builder_append_length(builder, "true", 4);
+            } else {
+                builder_append_length(builder, "false", 5);
+            }
             break;
-            
+        
         case SCHEMA_TYPE_INT:
-            *(int*)field_ptr = json_get_int(field_value, 0);
+            builder_write_int64(builder, *(const int*)data);
             break;
-            
+        
         case SCHEMA_TYPE_INT64:
-            if (field_value->type == JSON_TYPE_INTEGER) {
-                *(int64_t*)field_ptr = field_value->data.integer_value;
-            }
+            builder_write_int64(builder, *(const int64_t*)data);
             break;
-            
+        
         case SCHEMA_TYPE_DOUBLE:
-            *(double*)field_ptr = json_get_double(field_value, 0.0);
+            builder_write_double(builder, *(const double*)data);
             break;
-            
-        case SCHEMA_TYPE_STRING: {
-            const char *str = json_get_string(field_value);
-            if (str) {
-                strncpy((char*)field_ptr, str, field->max_length - 1);
-                ((char*)field_ptr)[field->max_length - 1] = '\0';
+        
+        case SCHEMA_TYPE_STRING:
+            if (size == SCHEMA_STRING_POINTER) {
+                const char *str = *(const char *const *)data;
+                if (!str) {
+                    builder_append_length(builder, "null", 4);
+                    break;
+                }
+                builder_append_length(builder, "\"", 1);
+                builder_append_escaped(builder, str, strlen(str));
+                builder_append_length(builder, "\"", 1);
+                break;
             }
+            builder_append_length(builder, "\"", 1);
+            builder_append_escaped(builder, (const char*)data, stored_string_length((const char*)data, size));
+            builder_append_length(builder, "\"", 1);
             break;
-        }
-            
+        
         case SCHEMA_TYPE_OBJECT:
-            if (field->nested) {
-                return json_parse_with_schema_value(field_value, field->nested, field_ptr);
+            if (nested) {
+                serialize_object(builder, data, nested);
+                break;
             }
+            builder_append_length(builder, "null", 4);
             break;
-            
-        default:
-            break;
-    }
-    
-    if (field->validator) {
-        if (!field->validator(field_ptr)) {
-            if (result) {
-                snprintf(result->error_message, sizeof(result->error_message),
-                        "Validation failed for field '%s'", field->name);
-                result->error_field = field->name;
-                result->valid = 0;
+        
+        case SCHEMA_TYPE_ENUM: {
+            int value = *(const int*)data;
+            size_t count = 0;
+            while (field->enum_names && field->enum_names[count] && count <= (size_t)value) {
+                count++;
             }
-            return -1;
+            if (value < 0 || (size_t)value >= count) {
+                builder_append_length(builder, "null", 4);
+                break;
+            }
+            builder_append_length(builder, "\"", 1);
+            builder_append_escaped(builder, field->enum_names[value], strlen(field->enum_names[value]));
+            builder_append_length(builder, "\"", 1);
+            break;
         }
+        
+        case SCHEMA_TYPE_CUSTOM:
+            serialize_custom(builder, field, data);
+            break;
+        
+        default:
+            builder_append_length(builder, "null", 4);
+            break;
     }
-    
-    return 0;
 }
 
-static int json_parse_with_schema_value(JSON_VALUE *json_value, const JSON_SCHEMA *schema, void *target)
+static int element_is_zero(const char *element, size_t size)
 {
-    if (!json_value || !schema || !target) {
-        return -1;
-    }
-    
-    if (json_value->type != JSON_TYPE_OBJECT) {
-        return -1;
-    }
-    
-    memset(target, 0, schema->struct_size);
-    
-    for (size_t i = 0; i < schema->field_count; i++) {
-        if (apply_schema_field(json_value, &schema->fields[i], target, NULL) != 0) {
-            return -1;
-        }
+    for (size_t i = 0; i < size; i++) {
+        if (element[i]) return 0;
     }
-    
-    return 0;
-}
-
-int json_parse_with_schema(const char *json_string, const JSON_SCHEMA *schema, void *target)
-{
-    JSON_VALUE *json = json_parse(json_string);
-    if (!json) return -1;
-    
-    int result = json_parse_with_schema_value(json, schema, target);
-    json_free(json);
-    
-    return result;
+    return 1;
 }
 
-int json_parse_and_validate(const char *json_string, const JSON_SCHEMA *schema,
-                           void *target, JSON_VALIDATION_RESULT *result)
+static void serialize_array(JSON_BUILDER *builder, const JSON_SCHEMA_FIELD *field, const void *source)
 {
-    if (result) {
-        result->valid = 1;
-        result->error_message[0] = '\0';
-        result->error_field = NULL;
-    }
+    const char *elements = (const char*)source + field->offset;
+    size_t string_size = field->element_size;
+    size_t count;
     
-    JSON_VALUE *json = json_parse(json_string);
-    if (!json) {
-        if (result) {
-            snprintf(result->error_message, sizeof(result->error_message),
-                    "Failed to parse JSON");
-            result->valid = 0;
+    if (field->flags & SCHEMA_FLAG_DYNAMIC) {
+        elements = *(const char *const *)elements;
+        string_size = SCHEMA_STRING_POINTER;
+        count = elements && field->count_offset != SCHEMA_NO_COUNT ?
+                *(const size_t*)((const char*)source + field->count_offset) : 0;
+    } else if (field->count_offset != SCHEMA_NO_COUNT) {
+        count = *(const size_t*)((const char*)source + field->count_offset);
+        if (count > field->max_length) {
+            count = field->max_length;
+        }
+    } else {
+        count = 0;
+        while (count < field->max_length && !element_is_zero(elements + count * field->element_size,
+                                                            field->element_size)) {
+            count++;
         }
-        return -1;
     }
     
-    if (json->type != JSON_TYPE_OBJECT) {
-        if (result) {
-            snprintf(result->error_message, sizeof(result->error_message),
-                    "Expected JSON object");
-            result->valid = 0;
+    builder_append_length(builder, "[", 1);
+    for (size_t i = 0; i < count; i++) {
+        if (i > 0) {
+            builder_append_length(builder, ",", 1);
         }
-        json_free(json);
-        return -1;
+        serialize_value(builder, field, field->element_type, elements + i * field->element_size, string_size);
     }
+    builder_append_length(builder, "]", 1);
+}
+
+/* Maps are written back as objects, keys in entry order */
+static void serialize_map(JSON_BUILDER *builder, const JSON_SCHEMA_FIELD *field, const void *source)
+{
+    const char *entries = *(const char *const *)((const char*)source + field->offset);
+    size_t count = entries && field->count_offset != SCHEMA_NO_COUNT ?
+                   *(const size_t*)((const char*)source + field->count_offset) : 0;
     
-    memset(target, 0, schema->struct_size);
-    
-    for (size_t i = 0; i < schema->field_count; i++) {
-        if (apply_schema_field(json, &schema->fields[i], target, result) != 0) {
-            json_free(json);
-            return -1;
+    builder_append_length(builder, "{", 1);
+    for (size_t i = 0; i < count; i++) {
+        const char *entry = entries + i * field->element_size;
+        const char *key = *(const char *const *)entry;
+        
+        if (i > 0) {
+            builder_append_length(builder, ",", 1);
         }
+        builder_append_length(builder, "\"", 1);
+        builder_append_escaped(builder, key ? key : "", key ? strlen(key) : 0);
+        builder_append_length(builder, "\":", 2);
+        serialize_value(builder, field, field->element_type, entry + field->value_offset, SCHEMA_STRING_POINTER);
     }
-    
-    json_free(json);
-    return 0;
+    builder_append_length(builder, "}", 1);
 }
 
-/* JSON serialization */
-int json_serialize(const void *source, const JSON_SCHEMA *schema,
-                  char *buffer, size_t buffer_size)
+static int serialize_object(JSON_BUILDER *builder, const void *source, const JSON_SCHEMA *schema)
 {
-    if (!source || !schema || !buffer || buffer_size == 0) {
+    const struct _json_compiled_schema_ *compiled = schema_compiled(schema);
+    if (!compiled) {
+        builder->error = 1;
         return -1;
     }
     
-    size_t pos = 0;
-    
-    pos += snprintf(buffer + pos, buffer_size - pos, "{");
+    builder_append_length(builder, "{", 1);
     
+    size_t skip = 1;    /* The first field written drops its prefix's leading comma */
     for (size_t i = 0; i < schema->field_count; i++) {
         const JSON_SCHEMA_FIELD *field = &schema->fields[i];
-        const void *field_ptr = (const char*)source + field->offset;
         
-        if (i > 0) {
-            pos += snprintf(buffer + pos, buffer_size - pos, ",");
+        if (field->flags & SCHEMA_FLAG_READONLY) {
+            continue;
         }
         
-        pos += snprintf(buffer + pos, buffer_size - pos, "\"%s\":", field->name);
-        
-        switch (field->type) {
-            case SCHEMA_TYPE_BOOL:
-                pos += snprintf(buffer + pos, buffer_size - pos, "%s",
-                              *(int*)field_ptr ? "true" : "false");
-                break;
-                
-            case SCHEMA_TYPE_INT:
-                pos += snprintf(buffer + pos, buffer_size - pos, "%d",
-                              *(int*)field_ptr);
-                break;
-                
-            case SCHEMA_TYPE_INT64:
-                pos += snprintf(buffer + pos, buffer_size - pos, "%lld",
-                              (long long)*(int64_t*)field_ptr);
-                break;
-                
-            case SCHEMA_TYPE_DOUBLE:
-                pos += snprintf(buffer + pos, buffer_size - pos, "%.10g",
-                              *(double*)field_ptr);
-                break;
-                
-            case SCHEMA_TYPE_STRING:
-                pos += snprintf(buffer + pos, buffer_size - pos, "\"%s\"",
-                              (char*)field_ptr);
-                break;
-                
-            default:
-                pos += snprintf(buffer + pos, buffer_size - pos, "null");
-                break;
-        }
+        builder_append_length(builder, compiled->prefixes[i] + skip, compiled->prefix_lengths[i] - skip);
+        skip = 0;
         
-        if (pos >= buffer_size) {
-            return -1;
+        if (field->type == SCHEMA_TYPE_ARRAY) {
+            serialize_array(builder, field, source);
+        } else if (field->type == SCHEMA_TYPE_MAP) {
+            serialize_map(builder, field, source);
+        } else {
+            serialize_value(builder, field, field->type, (const char*)source + field->offset, field->max_length);
         }
     }
     
-    pos += snprintf(buffer + pos, buffer_size - pos, "}");
-    
-    return (int)pos;
+    builder_append_length(builder, "}", 1);
+    return builder->error ? -1 : 0;
 }
 
-/* JSON Builder */
-JSON_BUILDER* json_builder_create(size_t initial_size)
+int json_serialize(const void *source, const JSON_SCHEMA *schema,
+                  char *buffer, size_t buffer_size)
 {
-    JSON_BUILDER *builder = (JSON_BUILDER*)calloc(1, sizeof(JSON_BUILDER));
-    if (!builder) return NULL;
-    
-    builder->buffer = (char*)malloc(initial_size);
-    if (!builder->buffer) {
-        free(builder);
-        return NULL;
+    if (!source || !schema || !buffer || buffer_size == 0) {
+        return -1;
     }
     
-    builder->size = initial_size;
-    builder->position = 0;
-    builder->error = 0;
+    JSON_BUILDER builder;
+    json_builder_init_fixed(&builder, buffer, buffer_size);
     
-    return builder;
-}
-
-void json_builder_destroy(JSON_BUILDER *builder)
-{
-    if (builder) {
-        free(builder->buffer);
-        free(builder);
+    if (serialize_object(&builder, source, schema) != 0 || builder.position > INT_MAX) {
+        return -1;
     }
+    
+    return (int)builder.position;
 }
 
-static void builder_append(JSON_BUILDER *builder, const char *str)
+int json_serialize_builder(const void *source, const JSON_SCHEMA *schema, JSON_BUILDER *builder)
 {
-    if (builder->error) return;
+    if (!source || !schema || !builder) {
+        return -1;
+    }
     
-    size_t len = strlen(str);
+    if (serialize_object(builder, source, schema) != 0) {
+        return -1;
+    }
     
-    if (builder->position + len >= builder->size) {
-        size_t new_size = builder->size * 2;
-        while (builder->position + len >= new_size) {
-            new_size *= 2;
-        }
-        
-        char *new_buffer = (char*)realloc(builder->buffer, new_size);
-        if (!new_buffer) {
-            builder->error = 1;
-            return;
-        }
-        
-        builder->buffer = new_buffer;
-        builder->size = new_size;
+    /* Inside an open container the object is one element of it */
+    if (builder->depth > 0) {
+        builder_append_length(builder, ",", 1);
     }
     
-    memcpy(builder->buffer + builder->position, str, len);
-    builder->position += len;
-    builder->buffer[builder->position] = '\0';
+    return builder->error ? -1 : 0;
 }
 
-void json_builder_start_object(JSON_BUILDER *builder)
-{
-    builder_append(builder, "{");
-}
+/* ==================== Tree Serialization ==================== */
 
-void json_builder_end_object(JSON_BUILDER *builder)
+/*
+ * Write a value followed by a separator (builder_close drops the last one).
+ * With patch set, nodes from json_parse_source that were not modified are
+ * copied verbatim from their input.
+ */
+static void write_value(JSON_BUILDER *builder, const JSON_VALUE *value, int patch)
 {
-    if (builder->position > 0 && builder->buffer[builder->position - 1] == ',') {
-        builder->position--;
+    if (patch && (value->flags & JSON_VALUE_FLAG_SOURCE) && !(value->flags & JSON_VALUE_FLAG_MODIFIED)) {
+        const JSON_SOURCE_VALUE *source = (const JSON_SOURCE_VALUE*)value;
+        builder_append_length(builder, source->start, source->length);
+        builder_append_length(builder, ",", 1);
+        return;
     }
-    builder_append(builder, "}");
-}
-
-void json_builder_start_array(JSON_BUILDER *builder)
-{
-    builder_append(builder, "[");
-}
-
-void json_builder_end_array(JSON_BUILDER *builder)
-{
-    if (builder->position > 0 && builder->buffer[builder->position - 1] == ',') {
-        builder->position--;
+    
+    switch (value->type) {
+        case JSON_TYPE_NULL:
+            builder_append_length(builder, "null,", 5);
+            break;
+        
+        case JSON_TYPE_BOOLEAN:
+            if (value->data.boolean_value) {
+                builder_append_length(builder, "true,", 5);
+            } else {
+                builder_append_length(builder, "false,", 6);
+            }
+            break;
+        
+        case JSON_TYPE_INTEGER:
+            builder_write_int64(builder, value->data.integer_value);
+            builder_append_length(builder, ",", 1);
+            break;
+        
+        case JSON_TYPE_DOUBLE:
+            builder_write_double(builder, value->data.double_value);
+            builder_append_length(builder, ",", 1);
+            break;
+        
+        case JSON_TYPE_STRING:
+            builder_append_length(builder, "\"", 1);
+            builder_append_escaped(builder, value->data.string_value, strlen(value->data.string_value));
+            builder_append_length(builder, "\",", 2);
+            break;
+        
+        case JSON_TYPE_ARRAY:
+            json_builder_start_array(builder);
+            for (size_t i = 0; i < value->data.array_value.count && !builder->error; i++) {
+                write_value(builder, value->data.array_value.elements[i], patch);
+            }
+            builder_close(builder, ']');
+            break;
+        
+        case JSON_TYPE_OBJECT:
+            json_builder_start_object(builder);
+            for (size_t i = 0; i < value->data.object_value.count && !builder->error; i++) {
+                builder_key(builder, value->data.object_value.keys[i]);
+                write_value(builder, value->data.object_value.values[i], patch);
+            }
+            builder_close(builder, '}');
+            break;
     }
-    builder_append(builder, "]");
 }
 
-void json_builder_add_string(JSON_BUILDER *builder, const char *key, const char *value)
+/* Write a top-level value; inside an open container it is one element of it */
+static int write_root(JSON_BUILDER *builder, const JSON_VALUE *value, int patch)
 {
-    char temp[2048];
-    if (key) {
-        snprintf(temp, sizeof(temp), "\"%s\":\"%s\",", key, value ? value : "");
-    } else {
-        snprintf(temp, sizeof(temp), "\"%s\",", value ? value : "");
+    /* Written one level down so every value, containers included, ends with a separator */
+    builder->depth++;
+    write_value(builder, value, patch);
+    builder->depth--;
+    
+    if (builder->depth == 0 && !builder->error && builder->buffer[builder->position - 1] == ',') {
+        builder->buffer[--builder->position] = '\0';
     }
-    builder_append(builder, temp);
+    
+    return builder->error ? -1 : 0;
 }
 
-void json_builder_add_int(JSON_BUILDER *builder, const char *key, int value)
+/*
+ * Propagate JSON_VALUE_FLAG_MODIFIED from edited containers up to every
+ * source node above them. Returns 1 if the value cannot be copied verbatim.
+ */
+static int mark_modified(JSON_VALUE *value)
 {
-    char temp[256];
-    if (key) {
-        snprintf(temp, sizeof(temp), "\"%s\":%d,", key, value);
-    } else {
-        snprintf(temp, sizeof(temp), "%d,", value);
+    int modified = !(value->flags & JSON_VALUE_FLAG_SOURCE) || (value->flags & JSON_VALUE_FLAG_MODIFIED);
+    
+    if (value->type == JSON_TYPE_ARRAY) {
+        for (size_t i = 0; i < value->data.array_value.count; i++) {
+            modified |= mark_modified(value->data.array_value.elements[i]);
+        }
+    } else if (value->type == JSON_TYPE_OBJECT) {
+        for (size_t i = 0; i < value->data.object_value.count; i++) {
+            modified |= mark_modified(value->data.object_value.values[i]);
+        }
     }
-    builder_append(builder, temp);
-}
-
-void json_builder_add_int64(JSON_BUILDER *builder, const char *key, int64_t value)
-{
-    char temp[256];
-    if (key) {
-        snprintf(temp, sizeof(temp), "\"%s\":%lld,", key, (long long)value);
-    } else {
-        snprintf(temp, sizeof(temp), "%lld,", (long long)value);
+    
+    if (modified && (value->flags & JSON_VALUE_FLAG_SOURCE)) {
+        value->flags |= JSON_VALUE_FLAG_MODIFIED;
     }
-    builder_append(builder, temp);
+    return modified;
 }
 
-void json_builder_add_double(JSON_BUILDER *builder, const char *key, double value)
+int json_write(const JSON_VALUE *value, char *buffer, size_t buffer_size)
 {
-    char temp[256];
-    if (key) {
-        snprintf(temp, sizeof(temp), "\"%s\":%.10g,", key, value);
-    } else {
-        snprintf(temp, sizeof(temp), "%.10g,", value);
+    if (!value || !buffer || buffer_size == 0) {
+        return -1;
     }
-    builder_append(builder, temp);
-}
-
-void json_builder_add_bool(JSON_BUILDER *builder, const char *key, int value)
-{
-    char temp[256];
-    if (key) {
-        snprintf(temp, sizeof(temp), "\"%s\":%s,", key, value ? "true" : "false");
-    } else {
-        snprintf(temp, sizeof(temp), "%s,", value ? "true" : "false");
+    
+    JSON_BUILDER builder;
+    json_builder_init_fixed(&builder, buffer, buffer_size);
+    
+    if (write_root(&builder, value, 0) != 0 || builder.position > INT_MAX) {
+        return -1;
     }
-    builder_append(builder, temp);
+    
+    return (int)builder.position;
 }
 
-void json_builder_add_null(JSON_BUILDER *builder, const char *key)
+int json_write_builder(const JSON_VALUE *value, JSON_BUILDER *builder)
 {
-    char temp[256];
-    if (key) {
-        snprintf(temp, sizeof(temp), "\"%s\":null,", key);
-    } else {
-        snprintf(temp, sizeof(temp), "null,");
+    if (!value || !builder) {
+        return -1;
     }
-    builder_append(builder, temp);
+    
+    return write_root(builder, value, 0);
 }
 
-const char* json_builder_get_string(JSON_BUILDER *builder)
+int json_write_patch(JSON_VALUE *value, JSON_BUILDER *builder)
 {
-    if (builder && !builder->error) {
-        return builder->buffer;
+    if (!value || !builder) {
+        return -1;
     }
-    return NULL;
+    
+    mark_modified(value);
+    return write_root(builder, value, 1);
 }
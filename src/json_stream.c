@@ -0,0 +1,749 @@
+#include "json_stream.h"
+#include "json_parser.h"
+#include "json_number.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#define DEFAULT_MAX_DEPTH 1024
+#define DEFAULT_MAX_TOKEN_SIZE (1024 * 1024)
+#define STACK_INITIAL_CAPACITY 32
+#define BUFFER_INITIAL_CAPACITY 256
+
+/* What the grammar accepts next */
+typedef enum {
+    EXPECT_VALUE,
+    EXPECT_VALUE_OR_END,        /* After '[' */
+    EXPECT_KEY_OR_END,          /* After '{' */
+    EXPECT_KEY,                 /* After ',' in an object */
+    EXPECT_COLON,
+    EXPECT_COMMA_OR_END,
+    EXPECT_NOTHING              /* Top-level value complete */
+} EXPECT;
+
+/* Token that may continue in the next chunk */
+typedef enum {
+    TOKEN_NONE,
+    TOKEN_STRING,
+    TOKEN_KEY,
+    TOKEN_NUMBER,
+    TOKEN_LITERAL
+} TOKEN;
+
+/* Position inside an escape sequence */
+typedef enum {
+    ESCAPE_NONE,
+    ESCAPE_BACKSLASH,
+    ESCAPE_UNICODE,
+    ESCAPE_LOW_BACKSLASH,       /* Between the halves of a surrogate pair */
+    ESCAPE_LOW_U
+} ESCAPE;
+
+struct _json_stream_ {
+    JSON_STREAM_CONFIG config;
+    JSON_STREAM_CALLBACKS callbacks;
+    void *user_data;
+    
+    EXPECT expect;
+    TOKEN token;
+    
+    /* '{' or '[' for each open container */
+    unsigned char *stack;
+    size_t depth;
+    size_t stack_capacity;
+    
+    /* Token text split across chunks or holding decoded escapes */
+    char *buffer;
+    size_t buffer_length;
+    size_t buffer_capacity;
+    
+    ESCAPE escape;
+    uint32_t code_point;
+    int hex_digits;
+    uint32_t high_surrogate;
+    
+    const char *literal;
+    size_t literal_matched;
+    
+    size_t offset;              /* Bytes consumed by earlier chunks */
+    int failed;
+    char error[128];
+};
+
+static const char *ERROR_ABORTED = "Stopped by callback";
+
+/* Callbacks are optional; a non-zero return stops the parse */
+#define CALLBACK(stream, name, ...) \
+    ((stream)->callbacks.name ? (stream)->callbacks.name((stream)->user_data, __VA_ARGS__) : 0)
+#define CALLBACK0(stream, name) \
+    ((stream)->callbacks.name ? (stream)->callbacks.name((stream)->user_data) : 0)
+
+/* ==================== Lifecycle ==================== */
+
+void json_stream_config_init(JSON_STREAM_CONFIG *config)
+{
+    if (!config) return;
+    
+    memset(config, 0, sizeof(JSON_STREAM_CONFIG));
+    config->max_depth = DEFAULT_MAX_DEPTH;
+    config->max_token_size = DEFAULT_MAX_TOKEN_SIZE;
+}
+
+JSON_STREAM* json_stream_create(const JSON_STREAM_CONFIG *config,
+                                const JSON_STREAM_CALLBACKS *callbacks, void *user_data)
+{
+    JSON_STREAM *stream = (JSON_STREAM*)calloc(1, sizeof(JSON_STREAM));
+    if (!stream) {
+        return NULL;
+    }
+    
+    if (config) {
+        stream->config = *config;
+    } else {
+        json_stream_config_init(&stream->config);
+    }
+    
+    if (stream->config.max_depth == 0) {
+        stream->config.max_depth = DEFAULT_MAX_DEPTH;
+    }
+    if (stream->config.max_token_size == 0) {
+        stream->config.max_token_size = DEFAULT_MAX_TOKEN_SIZE;
+    }
+    
+    if (callbacks) {
+        stream->callbacks = *callbacks;
+    }
+    stream->user_data = user_data;
+    
+    json_stream_reset(stream);
+    return stream;
+}
+
+void json_stream_destroy(JSON_STREAM *stream)
+{
+    if (!stream) return;
+    
+    free(stream->stack);
+    free(stream->buffer);
+    free(stream);
+}
+
+void json_stream_reset(JSON_STREAM *stream)
+{
+    if (!stream) return;
+    
+    stream->expect = EXPECT_VALUE;
+    stream->token = TOKEN_NONE;
+    stream->depth = 0;
+    stream->buffer_length = 0;
+    stream->escape = ESCAPE_NONE;
+    stream->high_surrogate = 0;
+    stream->offset = 0;
+    stream->failed = 0;
+    stream->error[0] = '\0';
+}
+
+const char* json_stream_error(const JSON_STREAM *stream)
+{
+    return stream ? stream->error : "";
+}
+
+size_t json_stream_offset(const JSON_STREAM *stream)
+{
+    return stream ? stream->offset : 0;
+}
+
+/* ==================== Token Buffer ==================== */
+
+static int buffer_reserve(JSON_STREAM *stream, size_t extra)
+{
+    size_t needed = stream->buffer_length + extra;
+    if (needed <= stream->buffer_capacity) {
+        return 0;
+    }
+    
+    size_t new_capacity = stream->buffer_capacity ? stream->buffer_capacity : BUFFER_INITIAL_CAPACITY;
+    while (new_capacity < needed) {
+        new_capacity *= 2;
+    }
+    
+    char *new_buffer = (char*)realloc(stream->buffer, new_capacity);
+    if (!new_buffer) {
+        return -1;
+    }
+    
+    stream->buffer = new_buffer;
+    stream->buffer_capacity = new_capacity;
+    return 0;
+}
+
+static const char* buffer_append(JSON_STREAM *stream, const char *data, size_t length)
+{
+    if (length == 0) {
+        return NULL;
+    }
+    if (stream->buffer_length + length > stream->config.max_token_size) {
+        return "Token exceeds maximum size";
+    }
+    if (buffer_reserve(stream, length) != 0) {
+        return "Out of memory";
+    }
+    
+    memcpy(stream->buffer + stream->buffer_length, data, length);
+    stream->buffer_length += length;
+    return NULL;
+}
+
+static const char* buffer_append_utf8(JSON_STREAM *stream, uint32_t code_point)
+{
+    char bytes[4];
+    size_t length;
+    
+    if (code_point < 0x80) {
+        bytes[0] = (char)code_point;
+        length = 1;
+    } else if (code_point < 0x800) {
+        bytes[0] = (char)(0xC0 | (code_point >> 6));
+        bytes[1] = (char)(0x80 | (code_point & 0x3F));
+        length = 2;
+    } else if (code_point < 0x10000) {
+        bytes[0] = (char)(0xE0 | (code_point >> 12));
+        bytes[1] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+        bytes[2] = (char)(0x80 | (code_point & 0x3F));
+        length = 3;
+    } else {
+        bytes[0] = (char)(0xF0 | (code_point >> 18));
+        bytes[1] = (char)(0x80 | ((code_point >> 12) & 0x3F));
+        bytes[2] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+        bytes[3] = (char)(0x80 | (code_point & 0x3F));
+        length = 4;
+    }
+    
+    return buffer_append(stream, bytes, length);
+}
+
+/* ==================== Values ==================== */
+
+static const char* value_done(JSON_STREAM *stream)
+{
+    if (stream->depth > 0) {
+        stream->expect = EXPECT_COMMA_OR_END;
+        return NULL;
+    }
+    
+    stream->expect = EXPECT_NOTHING;
+    return CALLBACK0(stream, on_document_end) ? ERROR_ABORTED : NULL;
+}
+
+static const char* open_container(JSON_STREAM *stream, char open)
+{
+    if (stream->depth >= stream->stack_capacity) {
+        size_t new_capacity = stream->stack_capacity ? stream->stack_capacity * 2 : STACK_INITIAL_CAPACITY;
+        unsigned char *new_stack = (unsigned char*)realloc(stream->stack, new_capacity);
+        if (!new_stack) {
+            return "Out of memory";
+        }
+        stream->stack = new_stack;
+        stream->stack_capacity = new_capacity;
+    }
+    
+    stream->stack[stream->depth++] = (unsigned char)open;
+    
+    if (open == '{') {
+        stream->expect = EXPECT_KEY_OR_END;
+        return CALLBACK0(stream, on_start_object) ? ERROR_ABORTED : NULL;
+    }
+    
+    stream->expect = EXPECT_VALUE_OR_END;
+    return CALLBACK0(stream, on_start_array) ? ERROR_ABORTED : NULL;
+}
+
+static const char* close_container(JSON_STREAM *stream, char open)
+{
+    stream->depth--;
+    
+    int stop = (open == '{') ? CALLBACK0(stream, on_end_object) : CALLBACK0(stream, on_end_array);
+    if (stop) {
+        return ERROR_ABORTED;
+    }
+    
+    return value_done(stream);
+}
+
+static const char* string_done(JSON_STREAM *stream, const char *text, size_t length)
+{
+    TOKEN token = stream->token;
+    stream->token = TOKEN_NONE;
+    
+    if (stream->config.validate_utf8 && !json_utf8_valid(text, length)) {
+        return "Invalid UTF-8 in string";
+    }
+    
+    if (token == TOKEN_KEY) {
+        stream->expect = EXPECT_COLON;
+        return CALLBACK(stream, on_key, text, length) ? ERROR_ABORTED : NULL;
+    }
+    
+    if (CALLBACK(stream, on_string, text, length)) {
+        return ERROR_ABORTED;
+    }
+    return value_done(stream);
+}
+
+static int is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+/* Strict JSON number grammar: -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)? */
+static int number_valid(const char *text, size_t length)
+{
+    size_t i = 0;
+    
+    if (i < length && text[i] == '-') i++;
+    
+    if (i < length && text[i] == '0') {
+        i++;
+    } else if (i < length && is_digit(text[i])) {
+        while (i < length && is_digit(text[i])) i++;
+    } else {
+        return 0;
+    }
+    
+    if (i < length && text[i] == '.') {
+        i++;
+        if (i >= length || !is_digit(text[i])) return 0;
+        while (i < length && is_digit(text[i])) i++;
+    }
+    
+    if (i < length && (text[i] == 'e' || text[i] == 'E')) {
+        i++;
+        if (i < length && (text[i] == '+' || text[i] == '-')) i++;
+        if (i >= length || !is_digit(text[i])) return 0;
+        while (i < length && is_digit(text[i])) i++;
+    }
+    
+    return i == length;
+}
+
+static const char* number_done(JSON_STREAM *stream)
+{
+    stream->token = TOKEN_NONE;
+    
+    const char *text = stream->buffer;
+    size_t length = stream->buffer_length;
+    
+    if (!number_valid(text, length)) {
+        return "Invalid number";
+    }
+    
+    JSON_NUMBER number;
+    json_number_parse(text, length, &number);
+    
+    int stop = number.is_double ? CALLBACK(stream, on_double, number.real)
+                                : CALLBACK(stream, on_integer, number.integer);
+    if (stop) {
+        return ERROR_ABORTED;
+    }
+    return value_done(stream);
+}
+
+static const char* literal_done(JSON_STREAM *stream)
+{
+    int stop;
+    
+    stream->token = TOKEN_NONE;
+    
+    if (stream->literal[0] == 'n') {
+        stop = CALLBACK0(stream, on_null);
+    } else {
+        stop = CALLBACK(stream, on_bool, stream->literal[0] == 't');
+    }
+    
+    return stop ? ERROR_ABORTED : value_done(stream);
+}
+
+/* ==================== Tokenizer ==================== */
+
+static void begin_string(JSON_STREAM *stream, TOKEN token)
+{
+    stream->token = token;
+    stream->buffer_length = 0;
+    stream->escape = ESCAPE_NONE;
+    stream->high_surrogate = 0;
+}
+
+static const char* begin_value(JSON_STREAM *stream, char c, size_t *position)
+{
+    switch (c) {
+        case '{':
+        case '[':
+            if (stream->depth >= stream->config.max_depth) {
+                return "Maximum nesting depth exceeded";
+            }
+            (*position)++;
+            return open_container(stream, c);
+        
+        case '"':
+            (*position)++;
+            begin_string(stream, TOKEN_STRING);
+            return NULL;
+        
+        case 't':
+        case 'f':
+        case 'n':
+            /* Matched, including this character, by feed_literal */
+            stream->token = TOKEN_LITERAL;
+            stream->literal = (c == 't') ? "true" : (c == 'f') ? "false" : "null";
+            stream->literal_matched = 0;
+            return NULL;
+        
+        default:
+            if (c == '-' || is_digit(c)) {
+                stream->token = TOKEN_NUMBER;
+                stream->buffer_length = 0;
+                return NULL;
+            }
+            return "Unexpected character";
+    }
+}
+
+/* Whitespace and punctuation between tokens */
+static const char* feed_structure(JSON_STREAM *stream, const char *data, size_t length, size_t *position)
+{
+    size_t i = *position;
+    while (i < length && (data[i] == ' ' || data[i] == '\n' || data[i] == '\r' || data[i] == '\t')) {
+        i++;
+    }
+    
+    *position = i;
+    if (i == length) {
+        return NULL;
+    }
+    
+    char c = data[i];
+    
+    switch (stream->expect) {
+        case EXPECT_NOTHING:
+            if (!stream->config.multiple_values) {
+                return "Unexpected data after document";
+            }
+            return begin_value(stream, c, position);
+        
+        case EXPECT_VALUE_OR_END:
+            if (c == ']') {
+                *position = i + 1;
+                return close_container(stream, '[');
+            }
+            return begin_value(stream, c, position);
+        
+        case EXPECT_VALUE:
+            return begin_value(stream, c, position);
+        
+        case EXPECT_KEY_OR_END:
+            if (c == '}') {
+                *position = i + 1;
+                return close_container(stream, '{');
+            }
+            /* fall through */
+        case EXPECT_KEY:
+            if (c != '"') {
+                return "Expected string key";
+            }
+            *position = i + 1;
+            begin_string(stream, TOKEN_KEY);
+            return NULL;
+        
+        case EXPECT_COLON:
+            if (c != ':') {
+                return "Expected ':'";
+            }
+            *position = i + 1;
+            stream->expect = EXPECT_VALUE;
+            return NULL;
+        
+        case EXPECT_COMMA_OR_END: {
+            char open = (char)stream->stack[stream->depth - 1];
+            if (c == ',') {
+                *position = i + 1;
+                stream->expect = (open == '{') ? EXPECT_KEY : EXPECT_VALUE;
+                return NULL;
+            }
+            if ((c == '}' && open == '{') || (c == ']' && open == '[')) {
+                *position = i + 1;
+                return close_container(stream, open);
+            }
+            return (open == '{') ? "Expected ',' or '}'" : "Expected ',' or ']'";
+        }
+    }
+    
+    return NULL;
+}
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/* One character of an escape sequence */
+static const char* feed_escape(JSON_STREAM *stream, char c)
+{
+    switch (stream->escape) {
+        case ESCAPE_BACKSLASH: {
+            char decoded;
+            switch (c) {
+                case '"': decoded = '"'; break;
+                case '\\': decoded = '\\'; break;
+                case '/': decoded = '/'; break;
+                case 'b': decoded = '\b'; break;
+                case 'f': decoded = '\f'; break;
+                case 'n': decoded = '\n'; break;
+                case 'r': decoded = '\r'; break;
+                case 't': decoded = '\t'; break;
+                case 'u':
+                    stream->escape = ESCAPE_UNICODE;
+                    stream->code_point = 0;
+                    stream->hex_digits = 0;
+                    return NULL;
+                default:
+                    return "Invalid escape sequence";
+            }
+            stream->escape = ESCAPE_NONE;
+            return buffer_append(stream, &decoded, 1);
+        }
+        
+        case ESCAPE_UNICODE: {
+            int digit = hex_value(c);
+            if (digit < 0) {
+                return "Invalid unicode escape";
+            }
+            stream->code_point = stream->code_point * 16 + (uint32_t)digit;
+            if (++stream->hex_digits < 4) {
+                return NULL;
+            }
+            
+            uint32_t code_point = stream->code_point;
+            stream->escape = ESCAPE_NONE;
+            
+            /* Rejected like the other parsers, so every parser accepts the same documents */
+            if (code_point == 0) {
+                return "Escaped NUL in string";
+            }
+            
+            if (stream->high_surrogate) {
+                if (code_point < 0xDC00 || code_point > 0xDFFF) {
+                    return "Invalid surrogate pair";
+                }
+                code_point = 0x10000 + ((stream->high_surrogate - 0xD800) << 10) + (code_point - 0xDC00);
+                stream->high_surrogate = 0;
+            } else if (code_point >= 0xD800 && code_point <= 0xDBFF) {
+                stream->high_surrogate = code_point;
+                stream->escape = ESCAPE_LOW_BACKSLASH;
+                return NULL;
+            } else if (code_point >= 0xDC00 && code_point <= 0xDFFF) {
+                return "Invalid surrogate pair";
+            }
+            
+            return buffer_append_utf8(stream, code_point);
+        }
+        
+        case ESCAPE_LOW_BACKSLASH:
+            if (c != '\\') {
+                return "Invalid surrogate pair";
+            }
+            stream->escape = ESCAPE_LOW_U;
+            return NULL;
+        
+        case ESCAPE_LOW_U:
+            if (c != 'u') {
+                return "Invalid surrogate pair";
+            }
+            stream->escape = ESCAPE_UNICODE;
+            stream->code_point = 0;
+            stream->hex_digits = 0;
+            return NULL;
+        
+        default:
+            return NULL;
+    }
+}
+
+/* String body; strings that start and end in one chunk without escapes are not copied */
+static const char* feed_string(JSON_STREAM *stream, const char *data, size_t length, size_t *position)
+{
+    size_t i = *position;
+    const char *error;
+    
+    while (i < length) {
+        if (stream->escape != ESCAPE_NONE) {
+            if ((error = feed_escape(stream, data[i])) != NULL) {
+                *position = i;
+                return error;
+            }
+            i++;
+            continue;
+        }
+        
+        size_t run = i;
+        while (run < length) {
+            unsigned char c = (unsigned char)data[run];
+            if (c == '"' || c == '\\' || c < 0x20) {
+                break;
+            }
+            run++;
+        }
+        
+        int in_place = run < length && data[run] == '"' && stream->buffer_length == 0;
+        if (!in_place && (error = buffer_append(stream, data + i, run - i)) != NULL) {
+            *position = i;
+            return error;
+        }
+        
+        if (run == length) {
+            break;
+        }
+        
+        char c = data[run];
+        if (c == '"') {
+            *position = run + 1;
+            if (in_place) {
+                return string_done(stream, data + i, run - i);
+            }
+            return string_done(stream, stream->buffer, stream->buffer_length);
+        } else if (c == '\\') {
+            stream->escape = ESCAPE_BACKSLASH;
+            i = run + 1;
+        } else {
+            *position = run;
+            return "Control character in string";
+        }
+    }
+    
+    *position = length;
+    return NULL;
+}
+
+static const char* feed_number(JSON_STREAM *stream, const char *data, size_t length, size_t *position)
+{
+    size_t i = *position;
+    size_t run = i;
+    
+    while (run < length) {
+        char c = data[run];
+        if (!is_digit(c) && c != '-' && c != '+' && c != '.' && c != 'e' && c != 'E') {
+            break;
+        }
+        run++;
+    }
+    
+    const char *error = buffer_append(stream, data + i, run - i);
+    if (error) {
+        return error;
+    }
+    
+    *position = run;
+    
+    /* The number may continue in the next chunk */
+    if (run == length) {
+        return NULL;
+    }
+    
+    return number_done(stream);
+}
+
+static const char* feed_literal(JSON_STREAM *stream, const char *data, size_t length, size_t *position)
+{
+    size_t i = *position;
+    
+    while (i < length && stream->literal[stream->literal_matched] != '\0') {
+        if (data[i] != stream->literal[stream->literal_matched]) {
+            *position = i;
+            return "Invalid literal";
+        }
+        stream->literal_matched++;
+        i++;
+    }
+    
+    *position = i;
+    
+    if (stream->literal[stream->literal_matched] != '\0') {
+        return NULL;
+    }
+    
+    return literal_done(stream);
+}
+
+/* ==================== Public API ==================== */
+
+static int stream_fail(JSON_STREAM *stream, size_t position, const char *error)
+{
+    stream->failed = 1;
+    stream->offset += position;
+    snprintf(stream->error, sizeof(stream->error), "%s", error);
+    return -1;
+}
+
+int json_stream_feed(JSON_STREAM *stream, const char *data, size_t length)
+{
+    if (!stream || (!data && length > 0)) {
+        return -1;
+    }
+    if (stream->failed) {
+        return -1;
+    }
+    
+    size_t position = 0;
+    const char *error = NULL;
+    
+    while (position < length && !error) {
+        switch (stream->token) {
+            case TOKEN_STRING:
+            case TOKEN_KEY:
+                error = feed_string(stream, data, length, &position);
+                break;
+            case TOKEN_NUMBER:
+                error = feed_number(stream, data, length, &position);
+                break;
+            case TOKEN_LITERAL:
+                error = feed_literal(stream, data, length, &position);
+                break;
+            default:
+                error = feed_structure(stream, data, length, &position);
+                break;
+        }
+    }
+    
+    if (error) {
+        return stream_fail(stream, position, error);
+    }
+    
+    stream->offset += length;
+    return 0;
+}
+
+int json_stream_finish(JSON_STREAM *stream)
+{
+    if (!stream || stream->failed) {
+        return -1;
+    }
+    
+    if (stream->token == TOKEN_NUMBER) {
+        const char *error = number_done(stream);
+        if (error) {
+            return stream_fail(stream, 0, error);
+        }
+    }
+    
+    /* An empty sequence is complete; a single document must have been seen */
+    int complete = stream->token == TOKEN_NONE && stream->depth == 0 &&
+                   (stream->expect == EXPECT_NOTHING ||
+                    (stream->config.multiple_values && stream->expect == EXPECT_VALUE));
+    if (!complete) {
+        return stream_fail(stream, 0, "Unexpected end of input");
+    }
+    
+    return 0;
+}
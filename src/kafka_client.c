@@ -1,16 +1,19 @@
 #define _POSIX_C_SOURCE 200809L
 #include "kafka_client.h"
 #include "application.h"
+#include "event_loop.h"
 #include "framework.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <pthread.h>
 #include <unistd.h>
+#include <sys/eventfd.h>
 #include <librdkafka/rdkafka.h>
 
 #define INITIAL_CONSUMER_CAPACITY 10
 #define KAFKA_POLL_TIMEOUT_MS 1000
+#define KAFKA_LOOP_BATCH_LIMIT 256  /* Messages per wakeup before other loop events get a turn */
 
 /* Internal consumer structure */
 struct _kafka_consumer_ {
@@ -22,6 +25,10 @@ struct _kafka_consumer_ {
     void *user_data;
     pthread_t thread;
     int running;
+    
+    /* Event loop mode: queue readiness is signalled on event_fd */
+    rd_kafka_queue_t *queue;
+    int event_fd;
 };
 
 /* Internal producer structure */
@@ -56,6 +63,7 @@ KAFKA_CLIENT* kafka_client_create(void)
     client->running = 0;
     client->app = NULL;
     client->context = NULL;
+    client->loop = NULL;
     
     framework_log(LOG_LEVEL_INFO, "Kafka client created");
     return client;
@@ -107,6 +115,35 @@ void kafka_client_destroy(KAFKA_CLIENT *client)
     framework_log(LOG_LEVEL_INFO, "Kafka client destroyed");
 }
 
+/* Hand one polled message to the consumer's handler */
+static void dispatch_message(KAFKA_CONSUMER *consumer, rd_kafka_message_t *rkmsg)
+{
+    if (rkmsg->err) {
+        if (rkmsg->err != RD_KAFKA_RESP_ERR__PARTITION_EOF) {
+            framework_log(LOG_LEVEL_ERROR, "Kafka consumer error: %s",
+                        rd_kafka_message_errstr(rkmsg));
+        }
+        return;
+    }
+    
+    /* Create message structure for handler */
+    KAFKA_MESSAGE message;
+    message.topic = (char*)rd_kafka_topic_name(rkmsg->rkt);
+    message.partition = rkmsg->partition;
+    message.offset = rkmsg->offset;
+    message.key = (char*)rkmsg->key;
+    message.key_len = rkmsg->key_len;
+    message.payload = (char*)rkmsg->payload;
+    message.payload_len = rkmsg->len;
+    message.timestamp = 0;  /* Timestamp not directly available in older librdkafka */
+    message.user_data = consumer->user_data;
+    
+    /* Call user handler */
+    if (consumer->handler) {
+        consumer->handler(&message, consumer->user_data);
+    }
+}
+
 /* Consumer thread function */
 static void* consumer_thread_fn(void *arg)
 {
@@ -127,32 +164,7 @@ static void* consumer_thread_fn(void *arg)
             continue; /* Timeout, no message */
         }
         
-        if (rkmsg->err) {
-            if (rkmsg->err != RD_KAFKA_RESP_ERR__PARTITION_EOF) {
-                framework_log(LOG_LEVEL_ERROR, "Kafka consumer error: %s",
-                            rd_kafka_message_errstr(rkmsg));
-            }
-            rd_kafka_message_destroy(rkmsg);
-            continue;
-        }
-        
-        /* Create message structure for handler */
-        KAFKA_MESSAGE message;
-        message.topic = (char*)rd_kafka_topic_name(rkmsg->rkt);
-        message.partition = rkmsg->partition;
-        message.offset = rkmsg->offset;
-        message.key = (char*)rkmsg->key;
-        message.key_len = rkmsg->key_len;
-        message.payload = (char*)rkmsg->payload;
-        message.payload_len = rkmsg->len;
-        message.timestamp = 0;  /* Timestamp not directly available in older librdkafka */
-        message.user_data = consumer->user_data;
-        
-        /* Call user handler */
-        if (consumer->handler) {
-            consumer->handler(&message, consumer->user_data);
-        }
-        
+        dispatch_message(consumer, rkmsg);
         rd_kafka_message_destroy(rkmsg);
     }
     
@@ -166,6 +178,96 @@ static void* consumer_thread_fn(void *arg)
     return NULL;
 }
 
+/* Consumer queue became non-empty: drain it on the loop thread */
+static void on_consumer_ready(void *user_data, int fd, int events)
+{
+    (void)events;
+    KAFKA_CONSUMER *consumer = (KAFKA_CONSUMER*)user_data;
+    
+    /* Reset first; librdkafka writes again only when the queue goes from empty to non-empty */
+    uint64_t count;
+    ssize_t bytes = read(fd, &count, sizeof(count));
+    (void)bytes;
+    
+    for (int i = 0; i < KAFKA_LOOP_BATCH_LIMIT; i++) {
+        if (!consumer->running) {
+            return;
+        }
+        rd_kafka_message_t *rkmsg = rd_kafka_consumer_poll(consumer->rk, 0);
+        if (!rkmsg) {
+            return;  /* Drained; the next message signals the eventfd again */
+        }
+        dispatch_message(consumer, rkmsg);
+        rd_kafka_message_destroy(rkmsg);
+    }
+    
+    /* Budget spent with messages left: the queue is not empty, so librdkafka won't signal */
+    uint64_t one = 1;
+    ssize_t written = write(fd, &one, sizeof(one));
+    (void)written;
+}
+
+/* Undo attach_consumer */
+static void detach_consumer(KAFKA_CLIENT *client, KAFKA_CONSUMER *consumer)
+{
+    if (consumer->event_fd >= 0) {
+        event_loop_remove_fd(client->loop, consumer->event_fd);
+    }
+    if (consumer->queue) {
+        rd_kafka_queue_io_event_enable(consumer->queue, -1, NULL, 0);
+        rd_kafka_queue_destroy(consumer->queue);
+        consumer->queue = NULL;
+    }
+    if (consumer->event_fd >= 0) {
+        close(consumer->event_fd);
+        consumer->event_fd = -1;
+    }
+}
+
+/* Signal the consumer queue on an eventfd watched by the client's loop */
+static int attach_consumer(KAFKA_CLIENT *client, KAFKA_CONSUMER *consumer)
+{
+    consumer->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (consumer->event_fd < 0) {
+        framework_log(LOG_LEVEL_ERROR, "Failed to create consumer eventfd");
+        return FRAMEWORK_ERROR_INVALID;
+    }
+    
+    /* Route rebalance and error events through the consumer queue as well */
+    rd_kafka_poll_set_consumer(consumer->rk);
+    consumer->queue = rd_kafka_queue_get_consumer(consumer->rk);
+    if (!consumer->queue) {
+        framework_log(LOG_LEVEL_ERROR, "Failed to get consumer queue");
+        detach_consumer(client, consumer);
+        return FRAMEWORK_ERROR_INVALID;
+    }
+    
+    /* eventfd only accepts 8-byte writes; librdkafka writes this payload as is */
+    static const uint64_t wake = 1;
+    rd_kafka_queue_io_event_enable(consumer->queue, consumer->event_fd, &wake, sizeof(wake));
+    
+    if (event_loop_add_fd(client->loop, consumer->event_fd, EVENT_LOOP_READ,
+                          on_consumer_ready, consumer) != FRAMEWORK_SUCCESS) {
+        detach_consumer(client, consumer);
+        return FRAMEWORK_ERROR_INVALID;
+    }
+    
+    /* Messages queued before the fd was attached produce no write */
+    uint64_t one = 1;
+    ssize_t written = write(consumer->event_fd, &one, sizeof(one));
+    (void)written;
+    return FRAMEWORK_SUCCESS;
+}
+
+int kafka_client_set_event_loop(KAFKA_CLIENT *client, EVENT_LOOP *loop)
+{
+    if (!client) return FRAMEWORK_ERROR_NULL_PTR;
+    if (client->running) return FRAMEWORK_ERROR_STATE;
+    
+    client->loop = loop;
+    return FRAMEWORK_SUCCESS;
+}
+
 int kafka_client_start(KAFKA_CLIENT *client)
 {
     if (!client) return FRAMEWORK_ERROR_NULL_PTR;
@@ -173,11 +275,19 @@ int kafka_client_start(KAFKA_CLIENT *client)
     
     client->running = 1;
     
-    /* Start all consumer threads */
+    /* Start all consumers: on the event loop if attached, otherwise one thread each */
     for (size_t i = 0; i < client->consumer_count; i++) {
         KAFKA_CONSUMER *consumer = client->consumers[i];
         consumer->running = 1;
         
+        if (client->loop) {
+            if (attach_consumer(client, consumer) != FRAMEWORK_SUCCESS) {
+                consumer->running = 0;
+                return FRAMEWORK_ERROR_INVALID;
+            }
+            continue;
+        }
+        
         if (pthread_create(&consumer->thread, NULL, consumer_thread_fn, consumer) != 0) {
             if (consumer->topic_count == 1) {
                 framework_log(LOG_LEVEL_ERROR, "Failed to create consumer thread for topic: %s",
@@ -191,8 +301,8 @@ int kafka_client_start(KAFKA_CLIENT *client)
         }
     }
     
-    framework_log(LOG_LEVEL_INFO, "Kafka client started with %zu consumer(s)", 
-                 client->consumer_count);
+    framework_log(LOG_LEVEL_INFO, "Kafka client started with %zu consumer(s)%s", 
+                 client->consumer_count, client->loop ? " on the event loop" : "");
     return FRAMEWORK_SUCCESS;
 }
 
@@ -203,11 +313,18 @@ int kafka_client_stop(KAFKA_CLIENT *client)
     
     client->running = 0;
     
-    /* Stop all consumer threads */
+    /* Stop all consumers */
     for (size_t i = 0; i < client->consumer_count; i++) {
         KAFKA_CONSUMER *consumer = client->consumers[i];
+        if (!consumer->running) {
+            continue;  /* Never started (start failed part way) */
+        }
         consumer->running = 0;
-        pthread_join(consumer->thread, NULL);
+        if (client->loop) {
+            detach_consumer(client, consumer);
+        } else {
+            pthread_join(consumer->thread, NULL);
+        }
     }
     
     framework_log(LOG_LEVEL_INFO, "Kafka client stopped");
@@ -332,6 +449,8 @@ int kafka_consumer_register_multi(KAFKA_CLIENT *client,
     consumer->handler = handler;
     consumer->user_data = user_data;
     consumer->running = 0;
+    consumer->queue = NULL;
+    consumer->event_fd = -1;
     
     /* Create Kafka configuration */
     rd_kafka_conf_t *conf = rd_kafka_conf_new();
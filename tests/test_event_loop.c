@@ -0,0 +1,456 @@
+/**
+ * Event Loop Tests
+ *
+ * Drives a loop by hand with event_loop_run_once (pipes, edge-triggered
+ * watches, one-shot and periodic timers) and on its own thread with
+ * event_loop_run, stopped from outside. Several producer threads post
+ * tasks while the loop drains them: each must run once, on the loop
+ * thread, in its producer's order. Timing checks only assert that
+ * something happened within a generous deadline, never how fast.
+ *
+ * Usage: test_event_loop
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include "framework.h"
+#include "event_loop.h"
+#include "application.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define DEADLINE_MS 2000
+
+static int g_failures = 0;
+
+#define CHECK(cond, what) do { \
+        if (cond) { \
+            printf("  ok    %s\n", what); \
+        } else { \
+            printf("  FAIL  %s (%s:%d)\n", what, __FILE__, __LINE__); \
+            g_failures++; \
+        } \
+    } while (0)
+
+/* ==================== Helpers ==================== */
+
+static uint64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+/* Dispatch until *counter reaches target or the deadline passes; 0 if it did */
+static int run_until(EVENT_LOOP *loop, const int *counter, int target)
+{
+    uint64_t deadline = now_ms() + DEADLINE_MS;
+    while (*counter < target && now_ms() < deadline) {
+        if (event_loop_run_once(loop, 10) < 0) {
+            return -1;
+        }
+    }
+    return *counter >= target ? 0 : -1;
+}
+
+/* Callbacks dispatched while waiting up to timeout_ms */
+static int run_for(EVENT_LOOP *loop, int timeout_ms)
+{
+    int dispatched = 0;
+    uint64_t deadline = now_ms() + (uint64_t)timeout_ms;
+    while (now_ms() < deadline) {
+        int n = event_loop_run_once(loop, 5);
+        if (n < 0) {
+            return -1;
+        }
+        dispatched += n;
+    }
+    return dispatched;
+}
+
+typedef struct {
+    int calls;
+    int fd;
+    int events;
+    int drain;                  /* Read what is ready, so a level-triggered watch goes quiet */
+} FD_RECORD;
+
+static void on_fd(void *user_data, int fd, int events)
+{
+    FD_RECORD *record = (FD_RECORD*)user_data;
+    record->calls++;
+    record->fd = fd;
+    record->events = events;
+    if (record->drain && (events & EVENT_LOOP_READ)) {
+        char buffer[64];
+        ssize_t bytes = read(fd, buffer, sizeof(buffer));
+        (void)bytes;
+    }
+}
+
+static void write_byte(int fd)
+{
+    ssize_t written = write(fd, "x", 1);
+    (void)written;
+}
+
+/* ==================== File Descriptors ==================== */
+
+static void test_fds(void)
+{
+    printf("file descriptors\n");
+    
+    EVENT_LOOP *loop = event_loop_create();
+    int fds[2];
+    CHECK(loop && pipe(fds) == 0, "loop and pipe are created");
+    
+    FD_RECORD record;
+    memset(&record, 0, sizeof(record));
+    record.drain = 1;
+    CHECK(event_loop_add_fd(loop, fds[0], EVENT_LOOP_READ, on_fd, &record) == FRAMEWORK_SUCCESS,
+          "read end is watched");
+    CHECK(event_loop_add_fd(loop, fds[0], EVENT_LOOP_READ, on_fd, &record) == FRAMEWORK_ERROR_EXISTS,
+          "a second watch on the same descriptor is refused");
+    CHECK(event_loop_run_once(loop, 0) == 0 && record.calls == 0, "nothing is dispatched while idle");
+    
+    write_byte(fds[1]);
+    CHECK(run_until(loop, &record.calls, 1) == 0 && record.fd == fds[0] && record.events == EVENT_LOOP_READ,
+          "readable data dispatches the callback with its descriptor");
+    CHECK(run_for(loop, 30) == 0, "a drained level-triggered watch goes quiet");
+    
+    /* Write readiness on the other end */
+    FD_RECORD writer;
+    memset(&writer, 0, sizeof(writer));
+    CHECK(event_loop_add_fd(loop, fds[1], EVENT_LOOP_READ, on_fd, &writer) == FRAMEWORK_SUCCESS &&
+          event_loop_modify_fd(loop, fds[1], EVENT_LOOP_WRITE) == FRAMEWORK_SUCCESS &&
+          run_until(loop, &writer.calls, 1) == 0 && (writer.events & EVENT_LOOP_WRITE),
+          "modify switches a watch to write readiness");
+    CHECK(event_loop_remove_fd(loop, fds[1]) == FRAMEWORK_SUCCESS, "write end is unwatched");
+    
+    /* Removed watches are not dispatched, even with data pending */
+    CHECK(event_loop_remove_fd(loop, fds[0]) == FRAMEWORK_SUCCESS, "read end is unwatched");
+    int before = record.calls;
+    write_byte(fds[1]);
+    CHECK(run_for(loop, 30) == 0 && record.calls == before, "removed watches are not dispatched");
+    CHECK(event_loop_remove_fd(loop, fds[0]) == FRAMEWORK_ERROR_INVALID &&
+          event_loop_modify_fd(loop, fds[0], EVENT_LOOP_READ) == FRAMEWORK_ERROR_INVALID,
+          "unwatched descriptors cannot be removed or modified");
+    
+    /* Edge-triggered: one dispatch per arrival, even if nothing is read */
+    FD_RECORD edge;
+    memset(&edge, 0, sizeof(edge));
+    CHECK(event_loop_add_fd(loop, fds[0], EVENT_LOOP_READ | EVENT_LOOP_EDGE, on_fd, &edge) == FRAMEWORK_SUCCESS &&
+          run_until(loop, &edge.calls, 1) == 0, "edge watch reports data already waiting");
+    CHECK(run_for(loop, 30) == 0 && edge.calls == 1, "unread data does not fire an edge watch again");
+    write_byte(fds[1]);
+    CHECK(run_until(loop, &edge.calls, 2) == 0, "new data fires it again");
+    
+    /* Hangup is reported as an error event */
+    edge.drain = 1;
+    close(fds[1]);
+    CHECK(run_until(loop, &edge.calls, 3) == 0 && (edge.events & EVENT_LOOP_ERROR),
+          "closing the other end reports EVENT_LOOP_ERROR");
+    
+    event_loop_remove_fd(loop, fds[0]);
+    close(fds[0]);
+    event_loop_destroy(loop);
+}
+
+/* ==================== Timers ==================== */
+
+typedef struct {
+    int calls;
+    int timer;
+} TIMER_RECORD;
+
+static void on_timer(void *user_data, int timer)
+{
+    TIMER_RECORD *record = (TIMER_RECORD*)user_data;
+    record->calls++;
+    record->timer = timer;
+}
+
+static void test_timers(void)
+{
+    printf("timers\n");
+    
+    EVENT_LOOP *loop = event_loop_create();
+    
+    TIMER_RECORD once;
+    memset(&once, 0, sizeof(once));
+    uint64_t start = now_ms();
+    int timer = event_loop_add_timer(loop, 20, 0, on_timer, &once);
+    CHECK(timer >= 0 && run_until(loop, &once.calls, 1) == 0 && once.timer == timer,
+          "one-shot timer fires with its id");
+    CHECK(now_ms() - start >= 19, "not before its delay");
+    CHECK(run_for(loop, 50) == 0 && once.calls == 1, "one-shot timer fires once");
+    CHECK(event_loop_cancel_timer(loop, timer) == FRAMEWORK_SUCCESS, "a fired one-shot timer is cancelled");
+    
+    TIMER_RECORD periodic;
+    memset(&periodic, 0, sizeof(periodic));
+    timer = event_loop_add_timer(loop, 0, 5, on_timer, &periodic);
+    CHECK(timer >= 0 && run_until(loop, &periodic.calls, 5) == 0, "periodic timer keeps firing");
+    CHECK(event_loop_cancel_timer(loop, timer) == FRAMEWORK_SUCCESS, "periodic timer is cancelled");
+    int fired = periodic.calls;
+    CHECK(run_for(loop, 30) == 0 && periodic.calls == fired, "a cancelled timer stops");
+    CHECK(event_loop_cancel_timer(loop, timer) == FRAMEWORK_ERROR_INVALID, "cancelling twice is an error");
+    
+    int fds[2];
+    if (pipe(fds) == 0) {
+        FD_RECORD record;
+        memset(&record, 0, sizeof(record));
+        event_loop_add_fd(loop, fds[0], EVENT_LOOP_READ, on_fd, &record);
+        CHECK(event_loop_cancel_timer(loop, fds[0]) == FRAMEWORK_ERROR_INVALID,
+              "plain descriptors are not cancelled as timers");
+        event_loop_remove_fd(loop, fds[0]);
+        close(fds[0]);
+        close(fds[1]);
+    }
+    
+    /* Timers still armed at destroy are closed by the loop */
+    memset(&once, 0, sizeof(once));
+    CHECK(event_loop_add_timer(loop, 60000, 0, on_timer, &once) >= 0, "a pending timer can be left to destroy");
+    event_loop_destroy(loop);
+}
+
+/* ==================== Run and Stop ==================== */
+
+typedef struct {
+    EVENT_LOOP *loop;
+    int result;
+    int finished;
+    int in_loop;                /* event_loop_in_loop_thread seen from a callback */
+} RUNNER;
+
+static void* run_loop(void *arg)
+{
+    RUNNER *runner = (RUNNER*)arg;
+    runner->result = event_loop_run(runner->loop);
+    __atomic_store_n(&runner->finished, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static void on_loop_timer(void *user_data, int timer)
+{
+    (void)timer;
+    RUNNER *runner = (RUNNER*)user_data;
+    __atomic_store_n(&runner->in_loop, event_loop_in_loop_thread(runner->loop) ? 1 : -1, __ATOMIC_RELEASE);
+}
+
+static void test_run_stop(void)
+{
+    printf("run and stop\n");
+    
+    RUNNER runner;
+    memset(&runner, 0, sizeof(runner));
+    runner.loop = event_loop_create();
+    int timer = event_loop_add_timer(runner.loop, 5, 0, on_loop_timer, &runner);
+    
+    pthread_t thread;
+    CHECK(timer >= 0 && pthread_create(&thread, NULL, run_loop, &runner) == 0, "loop runs on its own thread");
+    
+    uint64_t deadline = now_ms() + DEADLINE_MS;
+    while (!__atomic_load_n(&runner.in_loop, __ATOMIC_ACQUIRE) && now_ms() < deadline) {
+        struct timespec pause = { 0, 1000000 };
+        nanosleep(&pause, NULL);
+    }
+    CHECK(__atomic_load_n(&runner.in_loop, __ATOMIC_ACQUIRE) == 1, "callbacks run on the loop thread");
+    CHECK(!event_loop_in_loop_thread(runner.loop), "other threads are not the loop thread");
+    
+    event_loop_stop(runner.loop);
+    pthread_join(thread, NULL);
+    CHECK(runner.finished && runner.result == FRAMEWORK_SUCCESS, "stop from another thread ends event_loop_run");
+    
+    /* The loop is reusable, and a stop issued before run is honoured */
+    event_loop_stop(runner.loop);
+    CHECK(event_loop_run(runner.loop) == FRAMEWORK_SUCCESS, "a stop before run returns at once");
+    
+    event_loop_cancel_timer(runner.loop, timer);
+    event_loop_destroy(runner.loop);
+}
+
+/* ==================== Posted Tasks ==================== */
+
+#define PRODUCERS 4
+#define TASKS_PER_PRODUCER 50000
+
+typedef struct {
+    EVENT_LOOP *loop;
+    int producer;
+    int sequence;
+    int runs;                   /* Times this task ran */
+    EVENT_LOOP_TASK node;       /* For producers posting without allocation */
+} POSTED;
+
+static POSTED *g_posted;                        /* [producer][sequence] */
+static int g_next_sequence[PRODUCERS];          /* Loop thread only */
+static int g_ran;
+static int g_out_of_order;
+static int g_off_loop;
+
+static void on_posted(void *arg)
+{
+    POSTED *posted = (POSTED*)arg;
+    posted->runs++;
+    g_ran++;
+    g_out_of_order += posted->sequence != g_next_sequence[posted->producer]++;
+    g_off_loop += !event_loop_in_loop_thread(posted->loop);
+}
+
+/* Odd producers use caller-owned nodes, even ones event_loop_post */
+static void* produce(void *arg)
+{
+    POSTED *tasks = (POSTED*)arg;
+    for (int i = 0; i < TASKS_PER_PRODUCER; i++) {
+        POSTED *posted = &tasks[i];
+        int rc;
+        if (posted->producer % 2) {
+            posted->node.fn = on_posted;
+            posted->node.arg = posted;
+            rc = event_loop_post_task(posted->loop, &posted->node);
+        } else {
+            rc = event_loop_post(posted->loop, on_posted, posted);
+        }
+        if (rc != FRAMEWORK_SUCCESS) {
+            return (void*)posted;
+        }
+    }
+    return NULL;
+}
+
+static void stop_loop(void *arg)
+{
+    event_loop_stop((EVENT_LOOP*)arg);
+}
+
+typedef struct {
+    EVENT_LOOP *loop;
+    int first_returned;         /* The first task has returned from posting the second */
+    int nested_saw_return;
+} NESTED;
+
+static void nested_second(void *arg)
+{
+    NESTED *nested = (NESTED*)arg;
+    nested->nested_saw_return = nested->first_returned;
+}
+
+static void nested_first(void *arg)
+{
+    NESTED *nested = (NESTED*)arg;
+    event_loop_post(nested->loop, nested_second, nested);
+    nested->first_returned = 1;
+}
+
+static void count_task(void *arg)
+{
+    (*(int*)arg)++;
+}
+
+static void test_tasks(void)
+{
+    printf("posted tasks\n");
+    
+    RUNNER runner;
+    memset(&runner, 0, sizeof(runner));
+    runner.loop = event_loop_create();
+    g_posted = (POSTED*)calloc((size_t)PRODUCERS * TASKS_PER_PRODUCER, sizeof(POSTED));
+    for (int p = 0; p < PRODUCERS; p++) {
+        for (int i = 0; i < TASKS_PER_PRODUCER; i++) {
+            POSTED *posted = &g_posted[p * TASKS_PER_PRODUCER + i];
+            posted->loop = runner.loop;
+            posted->producer = p;
+            posted->sequence = i;
+        }
+    }
+    
+    /* Producers post while the loop drains on its own thread */
+    pthread_t loop_thread, producers[PRODUCERS];
+    int started = pthread_create(&loop_thread, NULL, run_loop, &runner) == 0;
+    for (int p = 0; p < PRODUCERS; p++) {
+        started &= pthread_create(&producers[p], NULL, produce, &g_posted[p * TASKS_PER_PRODUCER]) == 0;
+    }
+    int posted_all = 1;
+    for (int p = 0; p < PRODUCERS; p++) {
+        void *failed;
+        pthread_join(producers[p], &failed);
+        posted_all &= failed == NULL;
+    }
+    CHECK(started && posted_all, "every producer posts all its tasks");
+    
+    /* Posted after every producer finished, so it runs last */
+    event_loop_post(runner.loop, stop_loop, runner.loop);
+    pthread_join(loop_thread, NULL);
+    
+    int once = 1;
+    for (int i = 0; i < PRODUCERS * TASKS_PER_PRODUCER; i++) {
+        once &= g_posted[i].runs == 1;
+    }
+    CHECK(g_ran == PRODUCERS * TASKS_PER_PRODUCER && once, "every task runs exactly once");
+    CHECK(g_out_of_order == 0, "each producer's tasks run in posting order");
+    CHECK(g_off_loop == 0, "tasks run on the loop thread");
+    free(g_posted);
+    
+    /* A task posted from a task runs after it, not inside it */
+    NESTED nested;
+    memset(&nested, 0, sizeof(nested));
+    nested.loop = runner.loop;
+    event_loop_post(runner.loop, nested_first, &nested);
+    CHECK(run_until(runner.loop, &nested.first_returned, 1) == 0 &&
+          run_until(runner.loop, &nested.nested_saw_return, 1) == 0, "tasks posted from the loop run later");
+    
+    /* A burst larger than one drain's budget still runs completely */
+    int counted = 0;
+    for (int i = 0; i < 5000; i++) {
+        event_loop_post(runner.loop, count_task, &counted);
+    }
+    CHECK(run_until(runner.loop, &counted, 5000) == 0, "a burst beyond one drain's budget is finished");
+    
+    CHECK(event_loop_post(runner.loop, NULL, NULL) == FRAMEWORK_ERROR_NULL_PTR &&
+          event_loop_post_task(runner.loop, NULL) == FRAMEWORK_ERROR_NULL_PTR, "null tasks are refused");
+    
+    /* Tasks still queued at destroy are dropped, not run */
+    counted = 0;
+    event_loop_post(runner.loop, count_task, &counted);
+    event_loop_destroy(runner.loop);
+    CHECK(counted == 0, "destroy drops queued tasks");
+}
+
+static void test_application_post(void)
+{
+    printf("application post\n");
+    
+    APPLICATION *app = application_create("test_event_loop", 1);
+    int counted = 0;
+    CHECK(app && application_post(app, count_task, &counted) == FRAMEWORK_ERROR_STATE,
+          "posting before the loop exists is refused");
+    
+    EVENT_LOOP *loop = application_get_loop(app);
+    CHECK(loop && application_get_loop(app) == loop, "the application creates its loop once");
+    CHECK(application_post(app, count_task, &counted) == FRAMEWORK_SUCCESS && run_until(loop, &counted, 1) == 0,
+          "application_post runs the task on the application's loop");
+    CHECK(application_post(app, NULL, NULL) == FRAMEWORK_ERROR_NULL_PTR, "null task is refused");
+    
+    application_destroy(app);
+}
+
+int main(void)
+{
+    framework_set_log_level(LOG_LEVEL_ERROR);
+    
+    test_fds();
+    test_timers();
+    test_run_stop();
+    test_tasks();
+    test_application_post();
+    
+    if (g_failures) {
+        printf("%d check(s) failed\n", g_failures);
+        return 1;
+    }
+    printf("All checks passed\n");
+    return 0;
+}
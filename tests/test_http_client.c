@@ -0,0 +1,205 @@
+/**
+ * HTTP Client Response Framing Tests
+ *
+ * A raw in-process server answers each connection with a canned response
+ * (Content-Length, chunked, or delimited by closing the connection) and
+ * optionally stalls instead of finishing it. The client must return the
+ * exact body for complete responses and an error, never a short body,
+ * for truncated ones.
+ *
+ * Usage: test_http_client [port]   (default 19210)
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include "framework.h"
+#include "http_client.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+static int g_failures = 0;
+
+#define CHECK(cond, what) do { \
+        if (cond) { \
+            printf("  ok    %s\n", what); \
+        } else { \
+            printf("  FAIL  %s (%s:%d)\n", what, __FILE__, __LINE__); \
+            g_failures++; \
+        } \
+    } while (0)
+
+/* ==================== Canned Server ==================== */
+
+typedef struct {
+    const char *response;       /* Sent after the request head arrives */
+    int stall;                  /* Keep the connection open afterwards */
+} CANNED;
+
+static pthread_mutex_t g_canned_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_canned_ready = PTHREAD_COND_INITIALIZER;
+static CANNED g_canned;
+static int g_canned_pending = 0;
+
+static void* server_thread(void *arg)
+{
+    int listener = *(int*)arg;
+    
+    for (;;) {
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+        
+        pthread_mutex_lock(&g_canned_mutex);
+        while (!g_canned_pending) {
+            pthread_cond_wait(&g_canned_ready, &g_canned_mutex);
+        }
+        CANNED canned = g_canned;
+        g_canned_pending = 0;
+        pthread_mutex_unlock(&g_canned_mutex);
+        
+        char request[4096];
+        size_t used = 0;
+        ssize_t bytes;
+        while (used < sizeof(request) - 1 &&
+               (bytes = recv(fd, request + used, sizeof(request) - 1 - used, 0)) > 0) {
+            used += (size_t)bytes;
+            request[used] = '\0';
+            if (strstr(request, "\r\n\r\n")) {
+                break;
+            }
+        }
+        
+        ssize_t sent = send(fd, canned.response, strlen(canned.response), 0);
+        (void)sent;
+        
+        /* A stalled response stays open until the client gives up */
+        if (canned.stall) {
+            char discard[256];
+            while (recv(fd, discard, sizeof(discard), 0) > 0) {
+            }
+        }
+        close(fd);
+    }
+    return NULL;
+}
+
+static int server_start(int port)
+{
+    static int listener;
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    int opt = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((unsigned short)port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    
+    pthread_t thread;
+    if (bind(listener, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(listener, 16) != 0 ||
+        pthread_create(&thread, NULL, server_thread, &listener) != 0) {
+        return -1;
+    }
+    pthread_detach(thread);
+    return 0;
+}
+
+/* ==================== Helpers ==================== */
+
+static char g_url[64];
+
+/* Serve one canned response to a GET with a 1 second timeout */
+static HTTP_CLIENT_RESPONSE* fetch(const char *response, int stall)
+{
+    pthread_mutex_lock(&g_canned_mutex);
+    g_canned.response = response;
+    g_canned.stall = stall;
+    g_canned_pending = 1;
+    pthread_cond_signal(&g_canned_ready);
+    pthread_mutex_unlock(&g_canned_mutex);
+    
+    HTTP_CLIENT_REQUEST *request = http_client_request_create("GET", g_url);
+    http_client_request_set_timeout(request, 1);
+    HTTP_CLIENT_RESPONSE *result = http_client_execute(request);
+    http_client_request_destroy(request);
+    return result;
+}
+
+static int body_is(const HTTP_CLIENT_RESPONSE *response, const char *expected)
+{
+    return response && !response->error_message && response->status_code == 200 &&
+           response->body_length == strlen(expected) &&
+           memcmp(response->body, expected, response->body_length) == 0;
+}
+
+static int failed_with(const HTTP_CLIENT_RESPONSE *response, const char *message)
+{
+    return response && response->error_message && strcmp(response->error_message, message) == 0;
+}
+
+/* ==================== Tests ==================== */
+
+static void test_complete_bodies(void)
+{
+    printf("complete bodies\n");
+    
+    HTTP_CLIENT_RESPONSE *response = fetch("HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhello", 1);
+    CHECK(body_is(response, "hello"), "Content-Length body ends without waiting for close");
+    http_client_response_destroy(response);
+    
+    response = fetch("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+                     "5\r\nhello\r\n6\r\n world\r\n0\r\n\r\n", 1);
+    CHECK(body_is(response, "hello world"), "chunked body ends at the last chunk");
+    http_client_response_destroy(response);
+    
+    response = fetch("HTTP/1.1 200 OK\r\n\r\nuntil close", 0);
+    CHECK(body_is(response, "until close"), "unframed body ends at an orderly close");
+    http_client_response_destroy(response);
+}
+
+static void test_truncated_bodies(void)
+{
+    printf("truncated bodies\n");
+    
+    HTTP_CLIENT_RESPONSE *response = fetch("HTTP/1.1 200 OK\r\n\r\npartial", 1);
+    CHECK(failed_with(response, "Request timed out"), "stalled unframed body is a timeout, not a response");
+    http_client_response_destroy(response);
+    
+    response = fetch("HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\nshort", 0);
+    CHECK(response && response->error_message, "closed before Content-Length is an error");
+    http_client_response_destroy(response);
+    
+    response = fetch("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhello\r\n", 0);
+    CHECK(response && response->error_message, "closed before the last chunk is an error");
+    http_client_response_destroy(response);
+}
+
+int main(int argc, char *argv[])
+{
+    int port = argc > 1 ? atoi(argv[1]) : 19210;
+    
+    framework_set_log_level(LOG_LEVEL_ERROR);
+    snprintf(g_url, sizeof(g_url), "http://127.0.0.1:%d/test", port);
+    
+    if (server_start(port) != 0) {
+        fprintf(stderr, "Failed to start server on port %d\n", port);
+        return 1;
+    }
+    
+    test_complete_bodies();
+    test_truncated_bodies();
+    
+    if (g_failures) {
+        printf("%d check(s) failed\n", g_failures);
+        return 1;
+    }
+    printf("All checks passed\n");
+    return 0;
+}
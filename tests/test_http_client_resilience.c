@@ -0,0 +1,282 @@
+/**
+ * HTTP Client Circuit Breaking and Retry Tests
+ *
+ * Drives http_client_execute() against an in-process upstream whose
+ * responses are switched between 200 and 500. The breaker clock and the
+ * retry sleep are injected, so state transitions and backoff never wait
+ * on real time and every run takes the same path:
+ *
+ *   breaker  closed -> open -> half-open -> closed
+ *   budget   retries stop once the burst is spent
+ *   reload   policies replaced while requests are in flight
+ *
+ * Usage: test_http_client_resilience [port]   (default 19180)
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include "framework.h"
+#include "http_server.h"
+#include "http_client.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#define RELOAD_THREADS 4
+#define RELOAD_REQUESTS 50
+
+static int g_failures = 0;
+
+#define CHECK(cond, what) do { \
+        if (cond) { \
+            printf("  ok    %s\n", what); \
+        } else { \
+            printf("  FAIL  %s (%s:%d)\n", what, __FILE__, __LINE__); \
+            g_failures++; \
+        } \
+    } while (0)
+
+/* ==================== Upstream ==================== */
+
+static int g_upstream_fail = 0;
+static int g_upstream_hits = 0;
+
+static void handle_test(HTTP_REQUEST *request, HTTP_RESPONSE *response, void *user_data)
+{
+    (void)request;
+    (void)user_data;
+    
+    __atomic_add_fetch(&g_upstream_hits, 1, __ATOMIC_RELAXED);
+    int failed = __atomic_load_n(&g_upstream_fail, __ATOMIC_RELAXED);
+    
+    http_response_set_status(response, failed ? HTTP_STATUS_INTERNAL_ERROR : HTTP_STATUS_OK);
+    http_response_set_body(response, failed ? "fail" : "ok", failed ? 4 : 2);
+}
+
+static void* upstream_thread(void *arg)
+{
+    http_server_run((HTTP_SERVER*)arg);
+    return NULL;
+}
+
+/* The upstream lives until the process exits */
+static int upstream_start(int port)
+{
+    HTTP_SERVER *server = http_server_create("127.0.0.1", port);
+    if (!server) {
+        return -1;
+    }
+    
+    http_server_get(server, "/test", handle_test, NULL);
+    
+    if (http_server_start(server) != FRAMEWORK_SUCCESS) {
+        return -1;
+    }
+    
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, upstream_thread, server) != 0) {
+        return -1;
+    }
+    pthread_detach(thread);
+    return 0;
+}
+
+/* ==================== Fake Clock ==================== */
+
+typedef struct {
+    uint64_t now_ms;
+    uint64_t slept_ms;
+    int sleeps;
+} FAKE_CLOCK;
+
+static uint64_t fake_now(void *user_data)
+{
+    return ((FAKE_CLOCK*)user_data)->now_ms;
+}
+
+/* Retry backoff advances the clock instead of blocking */
+static void fake_sleep(uint64_t ms, void *user_data)
+{
+    FAKE_CLOCK *clock = (FAKE_CLOCK*)user_data;
+    clock->now_ms += ms;
+    clock->slept_ms += ms;
+    clock->sleeps++;
+}
+
+static void fake_policy(HTTP_CLIENT_RESILIENCE *config, FAKE_CLOCK *clock)
+{
+    http_client_resilience_init(config);
+    config->breaker.clock = fake_now;
+    config->breaker.clock_data = clock;
+    config->breaker.slow_call_rate_threshold = 2;   /* Loopback calls are never slow */
+    config->sleep = fake_sleep;
+}
+
+/* ==================== Helpers ==================== */
+
+static char g_url[64];
+
+/* GET the upstream; returns the status code, 0 for "Circuit open", -1 otherwise */
+static int get_status(void)
+{
+    HTTP_CLIENT_RESPONSE *response = http_client_get(g_url);
+    if (!response) {
+        return -1;
+    }
+    
+    int status;
+    if (response->error_message) {
+        status = strcmp(response->error_message, "Circuit open") == 0 ? 0 : -1;
+    } else {
+        status = response->status_code;
+    }
+    
+    http_client_response_destroy(response);
+    return status;
+}
+
+static int hits_since(int *mark)
+{
+    int hits = __atomic_load_n(&g_upstream_hits, __ATOMIC_RELAXED);
+    int delta = hits - *mark;
+    *mark = hits;
+    return delta;
+}
+
+/* ==================== Tests ==================== */
+
+static void test_breaker_transitions(int port)
+{
+    printf("breaker transitions\n");
+    
+    FAKE_CLOCK clock = { 1000, 0, 0 };
+    HTTP_CLIENT_RESILIENCE config;
+    fake_policy(&config, &clock);
+    config.breaker.failure_rate_threshold = 0.5;
+    config.breaker.minimum_calls = 4;
+    config.breaker.open_duration_ms = 5000;
+    config.breaker.half_open_max_calls = 1;
+    config.max_retries = 0;
+    CHECK(http_client_set_resilience(&config) == FRAMEWORK_SUCCESS, "policy installed");
+    
+    int mark = __atomic_load_n(&g_upstream_hits, __ATOMIC_RELAXED);
+    
+    __atomic_store_n(&g_upstream_fail, 1, __ATOMIC_RELAXED);
+    int errors = 0;
+    for (int i = 0; i < 4; i++) {
+        errors += get_status() == 500;
+    }
+    CHECK(errors == 4 && hits_since(&mark) == 4, "four 500s reach the upstream");
+    CHECK(http_client_circuit_state("127.0.0.1", port) == CIRCUIT_OPEN, "circuit opens at minimum_calls");
+    
+    CHECK(get_status() == 0, "open circuit fails fast");
+    CHECK(hits_since(&mark) == 0, "open circuit sends nothing upstream");
+    
+    clock.now_ms += 4999;
+    CHECK(http_client_circuit_state("127.0.0.1", port) == CIRCUIT_OPEN, "still open before open_duration");
+    
+    clock.now_ms += 1;
+    CHECK(http_client_circuit_state("127.0.0.1", port) == CIRCUIT_HALF_OPEN, "half-open after open_duration");
+    
+    __atomic_store_n(&g_upstream_fail, 0, __ATOMIC_RELAXED);
+    CHECK(get_status() == 200 && hits_since(&mark) == 1, "trial call reaches the upstream");
+    CHECK(http_client_circuit_state("127.0.0.1", port) == CIRCUIT_CLOSED, "successful trial closes the circuit");
+    
+    CHECK(clock.sleeps == 0, "no retries without max_retries");
+    http_client_set_resilience(NULL);
+}
+
+static void test_retry_budget(void)
+{
+    printf("retry budget\n");
+    
+    FAKE_CLOCK clock = { 1000, 0, 0 };
+    HTTP_CLIENT_RESILIENCE config;
+    fake_policy(&config, &clock);
+    config.breaker.minimum_calls = 1000;            /* Keep the circuit closed */
+    config.max_retries = 3;
+    config.retry_base_delay_ms = 100;
+    config.retry_max_delay_ms = 1000;
+    config.retry_budget_ratio = 0;                  /* Nothing earned back */
+    config.retry_budget_burst = 2;
+    CHECK(http_client_set_resilience(&config) == FRAMEWORK_SUCCESS, "policy installed");
+    
+    int mark = __atomic_load_n(&g_upstream_hits, __ATOMIC_RELAXED);
+    __atomic_store_n(&g_upstream_fail, 1, __ATOMIC_RELAXED);
+    
+    CHECK(get_status() == 500, "first call reports the last 500");
+    CHECK(hits_since(&mark) == 3, "burst of 2 allows 2 retries, not max_retries");
+    CHECK(clock.sleeps == 2 && clock.slept_ms <= 100 + 200, "retries back off through the sleep hook");
+    
+    CHECK(get_status() == 500 && hits_since(&mark) == 1, "exhausted budget sends no retries");
+    CHECK(clock.sleeps == 2, "exhausted budget does not sleep");
+    
+    __atomic_store_n(&g_upstream_fail, 0, __ATOMIC_RELAXED);
+    CHECK(get_status() == 200 && hits_since(&mark) == 1, "successes pass through");
+    
+    http_client_set_resilience(NULL);
+}
+
+static void* reload_worker(void *arg)
+{
+    int *ok = (int*)arg;
+    for (int i = 0; i < RELOAD_REQUESTS; i++) {
+        *ok += get_status() == 200;
+    }
+    return NULL;
+}
+
+static void test_reload_under_traffic(void)
+{
+    printf("reload under traffic\n");
+    
+    /* Real clock: the fake one is not shared across threads */
+    HTTP_CLIENT_RESILIENCE config;
+    http_client_resilience_init(&config);
+    config.max_retries = 0;
+    
+    __atomic_store_n(&g_upstream_fail, 0, __ATOMIC_RELAXED);
+    pthread_t threads[RELOAD_THREADS];
+    int ok[RELOAD_THREADS] = { 0 };
+    for (int i = 0; i < RELOAD_THREADS; i++) {
+        pthread_create(&threads[i], NULL, reload_worker, &ok[i]);
+    }
+    
+    for (int i = 0; i < RELOAD_REQUESTS; i++) {
+        http_client_set_resilience(i % 2 ? NULL : &config);
+    }
+    
+    int total = 0;
+    for (int i = 0; i < RELOAD_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        total += ok[i];
+    }
+    
+    CHECK(total == RELOAD_THREADS * RELOAD_REQUESTS, "every request completes across reloads");
+    http_client_set_resilience(NULL);
+}
+
+int main(int argc, char *argv[])
+{
+    int port = argc > 1 ? atoi(argv[1]) : 19180;
+    
+    framework_set_log_level(LOG_LEVEL_ERROR);
+    snprintf(g_url, sizeof(g_url), "http://127.0.0.1:%d/test", port);
+    
+    if (upstream_start(port) != 0) {
+        fprintf(stderr, "Failed to start upstream on port %d\n", port);
+        return 1;
+    }
+    
+    test_breaker_transitions(port);
+    test_retry_budget();
+    test_reload_under_traffic();
+    
+    if (g_failures) {
+        printf("%d check(s) failed\n", g_failures);
+        return 1;
+    }
+    printf("All checks passed\n");
+    return 0;
+}
@@ -0,0 +1,269 @@
+/**
+ * HTTP Reverse Proxy Framing Tests
+ *
+ * Sends raw requests through a proxy route to an in-process upstream that
+ * records exactly what arrives. Requests whose body length is ambiguous
+ * must be refused with 400 before anything reaches the upstream, and a
+ * chunked body must be forwarded without a Content-Length next to it.
+ *
+ * Usage: test_http_proxy [port]   (default 19190; the upstream uses port + 1)
+ */
+
+#define _GNU_SOURCE
+#include "framework.h"
+#include "http_server.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+static int g_failures = 0;
+
+#define CHECK(cond, what) do { \
+        if (cond) { \
+            printf("  ok    %s\n", what); \
+        } else { \
+            printf("  FAIL  %s (%s:%d)\n", what, __FILE__, __LINE__); \
+            g_failures++; \
+        } \
+    } while (0)
+
+/* ==================== Recording Upstream ==================== */
+
+static pthread_mutex_t g_upstream_mutex = PTHREAD_MUTEX_INITIALIZER;
+static char g_received[8192];
+static int g_upstream_requests = 0;
+
+static int listen_on(int port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int opt = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((unsigned short)port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 16) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Read one request, framed just enough for these tests */
+static size_t read_request(int fd, char *buffer, size_t size)
+{
+    size_t used = 0;
+    while (used < size - 1) {
+        ssize_t bytes = recv(fd, buffer + used, size - 1 - used, 0);
+        if (bytes <= 0) {
+            break;
+        }
+        used += (size_t)bytes;
+        buffer[used] = '\0';
+        
+        char *body = strstr(buffer, "\r\n\r\n");
+        if (!body) {
+            continue;
+        }
+        body += 4;
+        
+        const char *length = strcasestr(buffer, "\r\nContent-Length:");
+        if (strcasestr(buffer, "\r\nTransfer-Encoding: chunked")) {
+            if (strstr(body, "0\r\n\r\n")) {
+                break;
+            }
+        } else if (!length || length > body ||
+                   (size_t)(buffer + used - body) >= strtoul(length + 17, NULL, 10)) {
+            break;
+        }
+    }
+    return used;
+}
+
+static void* upstream_thread(void *arg)
+{
+    int listener = *(int*)arg;
+    
+    for (;;) {
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+        
+        /* One request per connection keeps the pool out of the picture */
+        char request[sizeof(g_received)];
+        size_t length = read_request(fd, request, sizeof(request));
+        
+        pthread_mutex_lock(&g_upstream_mutex);
+        memcpy(g_received, request, length);
+        g_received[length] = '\0';
+        g_upstream_requests++;
+        pthread_mutex_unlock(&g_upstream_mutex);
+        
+        const char *response = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\nConnection: close\r\n\r\nok";
+        ssize_t sent = send(fd, response, strlen(response), 0);
+        (void)sent;
+        close(fd);
+    }
+    return NULL;
+}
+
+static void* proxy_thread(void *arg)
+{
+    http_server_run((HTTP_SERVER*)arg);
+    return NULL;
+}
+
+/* ==================== Client ==================== */
+
+static int g_proxy_port;
+
+/* Send a raw request through the proxy; returns the response status or -1 */
+static int proxy_exchange(const char *request)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((unsigned short)g_proxy_port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    
+    struct timeval timeout = { 5, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+        send(fd, request, strlen(request), 0) != (ssize_t)strlen(request)) {
+        close(fd);
+        return -1;
+    }
+    
+    /* The proxy closes the client connection after every response */
+    char response[4096];
+    size_t used = 0;
+    ssize_t bytes;
+    while (used < sizeof(response) - 1 &&
+           (bytes = recv(fd, response + used, sizeof(response) - 1 - used, 0)) > 0) {
+        used += (size_t)bytes;
+    }
+    response[used] = '\0';
+    close(fd);
+    
+    return strncmp(response, "HTTP/1.1 ", 9) == 0 ? atoi(response + 9) : -1;
+}
+
+static int upstream_requests(void)
+{
+    pthread_mutex_lock(&g_upstream_mutex);
+    int count = g_upstream_requests;
+    pthread_mutex_unlock(&g_upstream_mutex);
+    return count;
+}
+
+/* Whether the last request the upstream saw contains text (case-insensitive) */
+static int upstream_saw(const char *text)
+{
+    pthread_mutex_lock(&g_upstream_mutex);
+    int found = strcasestr(g_received, text) != NULL;
+    pthread_mutex_unlock(&g_upstream_mutex);
+    return found;
+}
+
+/* ==================== Tests ==================== */
+
+static void expect_refused(const char *request, const char *what)
+{
+    int before = upstream_requests();
+    int status = proxy_exchange(request);
+    char label[160];
+    snprintf(label, sizeof(label), "%s -> 400, nothing forwarded", what);
+    CHECK(status == 400 && upstream_requests() == before, label);
+}
+
+static void test_ambiguous_framing(void)
+{
+    printf("ambiguous framing\n");
+    
+    expect_refused("POST /x HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: chunked\r\nContent-Length: 5\r\n\r\n"
+                   "0\r\n\r\n", "Transfer-Encoding with Content-Length");
+    expect_refused("POST /x HTTP/1.1\r\nHost: a\r\nContent-Length: 5\r\nTransfer-Encoding: chunked\r\n\r\n"
+                   "0\r\n\r\n", "Content-Length before Transfer-Encoding");
+    expect_refused("POST /x HTTP/1.1\r\nHost: a\r\nContent-Length: -1\r\n\r\n", "negative Content-Length");
+    expect_refused("POST /x HTTP/1.1\r\nHost: a\r\nContent-Length: 5x\r\n\r\nhello", "non-numeric Content-Length");
+    expect_refused("POST /x HTTP/1.1\r\nHost: a\r\nContent-Length:\r\n\r\n", "empty Content-Length");
+    expect_refused("POST /x HTTP/1.1\r\nHost: a\r\nContent-Length: 99999999999999999999999\r\n\r\n",
+                   "overflowing Content-Length");
+    expect_refused("POST /x HTTP/1.1\r\nHost: a\r\nContent-Length: 5\r\nContent-Length: 6\r\n\r\nhello!",
+                   "conflicting Content-Length");
+    expect_refused("POST /x HTTP/1.1\r\nHost: a\r\nContent-Length: 5\r\nContent-Length: 5\r\n\r\nhello",
+                   "duplicate Content-Length");
+    expect_refused("POST /x HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: gzip\r\n\r\n",
+                   "Transfer-Encoding without chunked");
+}
+
+static void test_valid_framing(void)
+{
+    printf("valid framing\n");
+    
+    int before = upstream_requests();
+    CHECK(proxy_exchange("POST /x HTTP/1.1\r\nHost: a\r\nContent-Length: 5\r\n\r\nhello") == 200 &&
+          upstream_requests() == before + 1, "Content-Length body is forwarded");
+    CHECK(upstream_saw("Content-Length: 5\r\n") && upstream_saw("\r\n\r\nhello"),
+          "upstream gets the length and the body");
+    
+    CHECK(proxy_exchange("POST /x HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: chunked\r\n\r\n"
+                         "5\r\nhello\r\n0\r\n\r\n") == 200, "chunked body is forwarded");
+    CHECK(upstream_saw("Transfer-Encoding: chunked") && !upstream_saw("Content-Length"),
+          "chunked request carries no Content-Length upstream");
+    CHECK(upstream_saw("5\r\nhello\r\n0\r\n\r\n"), "chunks arrive intact");
+    
+    CHECK(proxy_exchange("GET /x HTTP/1.1\r\nHost: a\r\n\r\n") == 200, "bodiless request is forwarded");
+}
+
+int main(int argc, char *argv[])
+{
+    int port = argc > 1 ? atoi(argv[1]) : 19190;
+    g_proxy_port = port;
+    
+    framework_set_log_level(LOG_LEVEL_ERROR);
+    
+    static int listener;
+    listener = listen_on(port + 1);
+    pthread_t upstream;
+    if (listener < 0 || pthread_create(&upstream, NULL, upstream_thread, &listener) != 0) {
+        fprintf(stderr, "Failed to start upstream on port %d\n", port + 1);
+        return 1;
+    }
+    pthread_detach(upstream);
+    
+    char upstream_url[64];
+    snprintf(upstream_url, sizeof(upstream_url), "http://127.0.0.1:%d", port + 1);
+    
+    HTTP_SERVER *server = http_server_create("127.0.0.1", port);
+    pthread_t proxy;
+    if (!server || http_server_proxy(server, "/*", upstream_url) != FRAMEWORK_SUCCESS ||
+        http_server_start(server) != FRAMEWORK_SUCCESS ||
+        pthread_create(&proxy, NULL, proxy_thread, server) != 0) {
+        fprintf(stderr, "Failed to start proxy on port %d\n", port);
+        return 1;
+    }
+    pthread_detach(proxy);
+    
+    test_ambiguous_framing();
+    test_valid_framing();
+    
+    if (g_failures) {
+        printf("%d check(s) failed\n", g_failures);
+        return 1;
+    }
+    printf("All checks passed\n");
+    return 0;
+}
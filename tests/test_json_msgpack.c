@@ -0,0 +1,280 @@
+/**
+ * MessagePack Encoding Tests
+ *
+ * Single items must use their smallest encoding byte for byte; trees and
+ * schema-described structs must decode back to exactly what was encoded;
+ * malformed input must be rejected rather than half-decoded.
+ *
+ * Usage: test_json_msgpack
+ */
+
+#include "json_msgpack.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define RANDOM_DOUBLES 10000
+
+static int g_failures = 0;
+
+#define CHECK(cond, what) do { \
+        if (cond) { \
+            printf("  ok    %s\n", what); \
+        } else { \
+            printf("  FAIL  %s (%s:%d)\n", what, __FILE__, __LINE__); \
+            g_failures++; \
+        } \
+    } while (0)
+
+/* ==================== Helpers ==================== */
+
+static JSON_MSGPACK_WRITER g_writer;
+
+static int encoded_as(const char *expected, size_t expected_length)
+{
+    int same = !g_writer.error && g_writer.length == expected_length &&
+               memcmp(g_writer.data, expected, expected_length) == 0;
+    json_msgpack_writer_reset(&g_writer);
+    return same;
+}
+
+#define ENCODES(call, bytes, what) do { \
+        call; \
+        CHECK(encoded_as(bytes, sizeof(bytes) - 1), what); \
+    } while (0)
+
+/* Encode a JSON document's tree and decode it back; 1 if both write the same text */
+static int tree_round_trips(const char *json, JSON_ARENA *arena)
+{
+    char before[1024], after[1024];
+    JSON_VALUE *value = json_parse(json);
+    int before_length = value ? json_write(value, before, sizeof(before)) : -1;
+    
+    json_msgpack_writer_reset(&g_writer);
+    int encoded = value && json_msgpack_write_value(&g_writer, value) == 0;
+    json_free(value);
+    
+    JSON_VALUE *decoded = encoded ? json_msgpack_parse(g_writer.data, g_writer.length, arena) : NULL;
+    int after_length = decoded ? json_write(decoded, after, sizeof(after)) : -1;
+    json_free(decoded);
+    json_msgpack_writer_reset(&g_writer);
+    
+    return before_length >= 0 && before_length == after_length &&
+           memcmp(before, after, (size_t)before_length) == 0;
+}
+
+static int rejects(const char *bytes, size_t length)
+{
+    JSON_VALUE *value = json_msgpack_parse(bytes, length, NULL);
+    json_free(value);
+    return value == NULL;
+}
+
+/* ==================== Tests ==================== */
+
+static void test_item_encodings(void)
+{
+    printf("item encodings\n");
+    
+    ENCODES(json_msgpack_write_nil(&g_writer), "\xc0", "nil");
+    ENCODES(json_msgpack_write_bool(&g_writer, 1), "\xc3", "true");
+    ENCODES(json_msgpack_write_bool(&g_writer, 0), "\xc2", "false");
+    ENCODES(json_msgpack_write_int(&g_writer, 0), "\x00", "0 is a positive fixint");
+    ENCODES(json_msgpack_write_int(&g_writer, 127), "\x7f", "127 is a positive fixint");
+    ENCODES(json_msgpack_write_int(&g_writer, -32), "\xe0", "-32 is a negative fixint");
+    ENCODES(json_msgpack_write_int(&g_writer, -33), "\xd0\xdf", "-33 is int8");
+    ENCODES(json_msgpack_write_int(&g_writer, 128), "\xcc\x80", "128 is uint8");
+    ENCODES(json_msgpack_write_int(&g_writer, 65535), "\xcd\xff\xff", "65535 is uint16");
+    ENCODES(json_msgpack_write_int(&g_writer, -129), "\xd1\xff\x7f", "-129 is int16");
+    ENCODES(json_msgpack_write_int(&g_writer, 4294967296LL), "\xcf\x00\x00\x00\x01\x00\x00\x00\x00",
+            "2^32 is uint64");
+    ENCODES(json_msgpack_write_int(&g_writer, INT64_MIN), "\xd3\x80\x00\x00\x00\x00\x00\x00\x00",
+            "INT64_MIN is int64");
+    ENCODES(json_msgpack_write_double(&g_writer, 1.5), "\xca\x3f\xc0\x00\x00", "1.5 fits float32");
+    ENCODES(json_msgpack_write_double(&g_writer, 0.1), "\xcb\x3f\xb9\x99\x99\x99\x99\x99\x9a",
+            "0.1 needs float64");
+    ENCODES(json_msgpack_write_string(&g_writer, "abc", 3), "\xa3" "abc", "short string is fixstr");
+    ENCODES(json_msgpack_write_string(&g_writer, "0123456789012345678901234567890123456789", 32),
+            "\xd9\x20" "01234567890123456789012345678901", "32-byte string is str8");
+    ENCODES(json_msgpack_write_array(&g_writer, 15), "\x9f", "15 elements is fixarray");
+    ENCODES(json_msgpack_write_array(&g_writer, 16), "\xdc\x00\x10", "16 elements is array16");
+    ENCODES(json_msgpack_write_map(&g_writer, 2), "\x82", "2 members is fixmap");
+    
+    uint8_t small[4];
+    JSON_MSGPACK_WRITER fixed;
+    json_msgpack_writer_init_fixed(&fixed, small, sizeof(small));
+    json_msgpack_write_int(&fixed, 1);
+    CHECK(!fixed.error && fixed.length == 1 && small[0] == 1, "fixed buffer is written in place");
+    json_msgpack_write_double(&fixed, 0.1);
+    CHECK(fixed.error, "overflowing a fixed buffer sets error");
+}
+
+static void test_tree_round_trip(void)
+{
+    printf("tree round trip\n");
+    
+    static const char *documents[] = {
+        "null", "true", "-1", "9223372036854775807", "-9223372036854775808", "0.1", "1.5", "-2.5e-300",
+        "\"\"", "\"J\\u00fcrgen \\ud83d\\ude00\"", "[]", "{}",
+        "{\"id\":42,\"tags\":[\"a\",\"b\",[],{}],\"owner\":{\"active\":false,\"manager\":null},\"ratio\":0.25}",
+        "[0,1,127,128,255,256,65535,65536,4294967295,4294967296,-1,-32,-33,-128,-129,-32768,-32769]",
+    };
+    
+    int all = 1;
+    for (size_t i = 0; i < sizeof(documents) / sizeof(documents[0]); i++) {
+        if (!tree_round_trips(documents[i], NULL)) {
+            printf("        differs: %s\n", documents[i]);
+            all = 0;
+        }
+    }
+    CHECK(all, "every value type and integer width decodes to the same tree");
+    
+    /* Containers past the fix sizes switch to 16-bit counts */
+    char wide[4096];
+    size_t used = 0;
+    wide[used++] = '{';
+    for (int i = 0; i < 40; i++) {
+        used += (size_t)snprintf(wide + used, sizeof(wide) - used, "%s\"key%d\":[%d]", i ? "," : "", i, i);
+    }
+    wide[used++] = '}';
+    wide[used] = '\0';
+    JSON_ARENA *arena = json_arena_create(0);
+    CHECK(tree_round_trips(wide, NULL) && tree_round_trips(wide, arena), "map16 round trips, heap and arena");
+    json_arena_destroy(arena);
+    
+    uint64_t seed = 0x2545F4914F6CDD1DULL;
+    int exact = 1;
+    for (int i = 0; i < RANDOM_DOUBLES && exact; i++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        uint64_t bits = seed & 0x7FEFFFFFFFFFFFFFULL;
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+        
+        json_msgpack_write_double(&g_writer, value);
+        JSON_VALUE *decoded = json_msgpack_parse(g_writer.data, g_writer.length, NULL);
+        exact = decoded && decoded->type == JSON_TYPE_DOUBLE &&
+                memcmp(&decoded->data.double_value, &value, sizeof(value)) == 0;
+        json_free(decoded);
+        json_msgpack_writer_reset(&g_writer);
+    }
+    CHECK(exact, "random doubles decode bit for bit");
+}
+
+typedef struct {
+    char sku[8];
+    int quantity;
+} ITEM;
+
+typedef struct {
+    int id;
+    int64_t serial;
+    char note[16];
+    double total;
+    int paid;
+    ITEM items[3];
+    size_t item_count;
+} RECEIPT;
+
+JSON_SCHEMA_DEFINE(item_schema, ITEM,
+    JSON_SCHEMA_FIELD_STRING(ITEM, sku, sizeof(((ITEM*)0)->sku), 0),
+    JSON_SCHEMA_FIELD_INT(ITEM, quantity, 0)
+);
+
+JSON_SCHEMA_DEFINE(receipt_schema, RECEIPT,
+    JSON_SCHEMA_FIELD_INT(RECEIPT, id, SCHEMA_FLAG_REQUIRED),
+    JSON_SCHEMA_FIELD_INT64(RECEIPT, serial, 0),
+    JSON_SCHEMA_FIELD_STRING(RECEIPT, note, sizeof(((RECEIPT*)0)->note), 0),
+    JSON_SCHEMA_FIELD_DOUBLE(RECEIPT, total, 0),
+    JSON_SCHEMA_FIELD_BOOL(RECEIPT, paid, 0),
+    JSON_SCHEMA_FIELD_OBJECT_ARRAY(RECEIPT, items, &item_schema, item_count, 0)
+);
+
+static void test_schema_round_trip(void)
+{
+    printf("schema round trip\n");
+    
+    RECEIPT receipt;
+    memset(&receipt, 0, sizeof(receipt));
+    receipt.id = 9;
+    receipt.serial = -5000000000LL;
+    strcpy(receipt.note, "caf\xC3\xA9 \"x\"");
+    receipt.total = 12.34;
+    receipt.paid = 1;
+    strcpy(receipt.items[0].sku, "A");
+    receipt.items[0].quantity = 2;
+    strcpy(receipt.items[1].sku, "B");
+    receipt.items[1].quantity = 300;
+    receipt.item_count = 2;
+    
+    CHECK(json_msgpack_write_schema(&g_writer, &receipt, &receipt_schema) == 0, "struct encodes");
+    
+    RECEIPT decoded;
+    memset(&decoded, 0, sizeof(decoded));
+    CHECK(json_msgpack_parse_schema(g_writer.data, g_writer.length, &receipt_schema, &decoded, NULL) == 0 &&
+          memcmp(&decoded, &receipt, sizeof(receipt)) == 0, "map decodes back into an identical struct");
+    
+    /* The same struct through JSON: both formats carry the same fields */
+    char json[512];
+    JSON_VALUE *from_msgpack = json_msgpack_parse(g_writer.data, g_writer.length, NULL);
+    char from_tree[512];
+    int tree_length = from_msgpack ? json_write(from_msgpack, from_tree, sizeof(from_tree)) : -1;
+    int json_length = json_serialize(&receipt, &receipt_schema, json, sizeof(json));
+    CHECK(tree_length > 0 && tree_length == json_length && memcmp(from_tree, json, (size_t)json_length) == 0,
+          "decoded map writes the same JSON as json_serialize");
+    json_free(from_msgpack);
+    json_msgpack_writer_reset(&g_writer);
+    
+    JSON_VALIDATION_RESULT result;
+    memset(&result, 0, sizeof(result));
+    json_msgpack_write_map(&g_writer, 1);
+    json_msgpack_write_string(&g_writer, "note", 4);
+    json_msgpack_write_string(&g_writer, "x", 1);
+    CHECK(json_msgpack_parse_schema(g_writer.data, g_writer.length, &receipt_schema, &decoded, &result) != 0 &&
+          result.error_field && strcmp(result.error_field, "id") == 0, "missing required field is reported");
+    json_msgpack_writer_reset(&g_writer);
+}
+
+static void test_malformed(void)
+{
+    printf("malformed input\n");
+    
+    CHECK(rejects("", 0), "empty input");
+    CHECK(rejects("\x92\x01", 2), "array shorter than its count");
+    CHECK(rejects("\xa5" "abc", 4), "string shorter than its length");
+    CHECK(rejects("\xcd\x01", 2), "truncated uint16");
+    CHECK(rejects("\x01\x02", 2), "trailing bytes after the item");
+    CHECK(rejects("\x81\x01\x02", 3), "non-string map key");
+    CHECK(rejects("\xd4\x01\x00", 3), "extension type");
+    CHECK(rejects("\xc1", 1), "reserved byte");
+    CHECK(rejects("\xdd\xff\xff\xff\xff", 5), "huge array count without the data");
+    
+    JSON_VALUE *value = json_msgpack_parse("\xc4\x02hi", 4, NULL);
+    CHECK(value && value->type == JSON_TYPE_STRING && strcmp(value->data.string_value, "hi") == 0,
+          "binary items become strings");
+    json_free(value);
+}
+
+int main(void)
+{
+    if (json_msgpack_writer_init(&g_writer, 0) != 0) {
+        fprintf(stderr, "Failed to create writer\n");
+        return 1;
+    }
+    
+    test_item_encodings();
+    test_tree_round_trip();
+    test_schema_round_trip();
+    test_malformed();
+    
+    json_msgpack_writer_free(&g_writer);
+    
+    if (g_failures) {
+        printf("%d check(s) failed\n", g_failures);
+        return 1;
+    }
+    printf("All checks passed\n");
+    return 0;
+}
@@ -0,0 +1,254 @@
+/**
+ * NDJSON Reader and Writer Tests
+ *
+ * Records written through a small flush size are read back by a
+ * multi-threaded reader fed in chunks that split records at every kind
+ * of boundary. Every record must arrive once, in input order, with its
+ * line number and contents intact, whatever the thread count, batch size
+ * or chunking.
+ *
+ * Usage: test_json_ndjson
+ */
+
+#include "json_ndjson.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define RECORDS 5000
+
+static int g_failures = 0;
+
+#define CHECK(cond, what) do { \
+        if (cond) { \
+            printf("  ok    %s\n", what); \
+        } else { \
+            printf("  FAIL  %s (%s:%d)\n", what, __FILE__, __LINE__); \
+            g_failures++; \
+        } \
+    } while (0)
+
+/* ==================== Records ==================== */
+
+typedef struct {
+    int64_t id;
+    char name[16];
+    double score;
+    int64_t *readings;          /* Decoded into the reader's per-thread arenas */
+    size_t reading_count;
+} EVENT;
+
+JSON_SCHEMA_DEFINE(event_schema, EVENT,
+    JSON_SCHEMA_FIELD_INT64(EVENT, id, SCHEMA_FLAG_REQUIRED),
+    JSON_SCHEMA_FIELD_STRING(EVENT, name, sizeof(((EVENT*)0)->name), 0),
+    JSON_SCHEMA_FIELD_DOUBLE(EVENT, score, 0),
+    JSON_SCHEMA_FIELD_DYNAMIC_ARRAY(EVENT, readings, SCHEMA_TYPE_INT64, reading_count, 0)
+);
+
+static int64_t g_readings[8] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+
+/* Record i, deterministic so the reader can check it */
+static void make_event(EVENT *event, int i)
+{
+    memset(event, 0, sizeof(*event));
+    event->id = (int64_t)i * 1000003;
+    snprintf(event->name, sizeof(event->name), "e\"%d", i);
+    event->score = i / 8.0;
+    event->readings = g_readings;
+    event->reading_count = (size_t)(i % 9);
+}
+
+/* ==================== Output Collection ==================== */
+
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+    int flushes;
+} SINK;
+
+static int collect(void *user_data, const char *data, size_t length)
+{
+    SINK *sink = (SINK*)user_data;
+    if (sink->length + length > sink->capacity) {
+        return -1;
+    }
+    memcpy(sink->data + sink->length, data, length);
+    sink->length += length;
+    sink->flushes++;
+    return 0;
+}
+
+/* ==================== Record Checking ==================== */
+
+typedef struct {
+    int next;                   /* Index of the record expected next */
+    size_t line_offset;         /* Input line of record 0, minus one */
+    int mismatches;
+    int errors;
+    size_t error_line;
+} READ_STATE;
+
+static int on_record(void *user_data, void *record, size_t line)
+{
+    READ_STATE *state = (READ_STATE*)user_data;
+    EVENT *event = (EVENT*)record;
+    EVENT expected;
+    make_event(&expected, state->next);
+    
+    int same = event->id == expected.id && strcmp(event->name, expected.name) == 0 &&
+               event->score == expected.score && event->reading_count == expected.reading_count &&
+               line == state->line_offset + (size_t)state->next + 1;
+    for (size_t i = 0; same && i < event->reading_count; i++) {
+        same = event->readings[i] == (int64_t)i;
+    }
+    if (!same && state->mismatches++ == 0) {
+        printf("        record %d (line %zu) differs\n", state->next, line);
+    }
+    state->next++;
+    return 0;
+}
+
+/* Records of the bad-input test are not make_event records; only count them */
+static int on_any_record(void *user_data, void *record, size_t line)
+{
+    (void)record;
+    (void)line;
+    ((READ_STATE*)user_data)->next++;
+    return 0;
+}
+
+static int on_error(void *user_data, size_t line, const char *message)
+{
+    (void)message;
+    READ_STATE *state = (READ_STATE*)user_data;
+    state->errors++;
+    state->error_line = line;
+    return 0;
+}
+
+/* Feed text in chunks of chunk bytes; 0 if every record arrived intact and in order */
+static int read_back(const char *text, size_t length, size_t threads, size_t batch, size_t chunk)
+{
+    JSON_NDJSON_CONFIG config;
+    json_ndjson_config_init(&config);
+    config.threads = threads;
+    config.batch_size = batch;
+    
+    READ_STATE state;
+    memset(&state, 0, sizeof(state));
+    JSON_NDJSON_CALLBACKS callbacks = { on_record, NULL };
+    JSON_NDJSON_READER *reader = json_ndjson_reader_create(&config, &event_schema, sizeof(EVENT),
+                                                           &callbacks, &state);
+    if (!reader) {
+        return -1;
+    }
+    
+    int rc = 0;
+    for (size_t offset = 0; offset < length && rc == 0; offset += chunk) {
+        size_t size = length - offset < chunk ? length - offset : chunk;
+        rc = json_ndjson_reader_feed(reader, text + offset, size);
+    }
+    if (rc == 0) {
+        rc = json_ndjson_reader_finish(reader);
+    }
+    
+    size_t count = json_ndjson_reader_count(reader);
+    json_ndjson_reader_destroy(reader);
+    return rc == 0 && state.mismatches == 0 && state.next == RECORDS && count == RECORDS ? 0 : -1;
+}
+
+/* ==================== Tests ==================== */
+
+static SINK g_sink;
+
+static void test_writer(void)
+{
+    printf("writer\n");
+    
+    JSON_NDJSON_WRITER writer;
+    CHECK(json_ndjson_writer_init(&writer, 4096, collect, &g_sink) == 0, "writer initializes");
+    
+    EVENT events[RECORDS];
+    for (int i = 0; i < RECORDS; i++) {
+        make_event(&events[i], i);
+    }
+    
+    int rc = json_ndjson_write(&writer, &events[0], &event_schema);
+    rc |= json_ndjson_write_batch(&writer, &events[1], RECORDS - 1, sizeof(EVENT), &event_schema);
+    rc |= json_ndjson_writer_flush(&writer);
+    CHECK(rc == 0 && writer.records == RECORDS, "every record is written");
+    CHECK(g_sink.flushes > 10, "output reaches the sink in several large writes");
+    
+    const char *first_line = "{\"id\":0,\"name\":\"e\\\"0\",\"score\":0,\"readings\":[]}\n";
+    CHECK(strncmp(g_sink.data, first_line, strlen(first_line)) == 0, "one escaped record per line");
+    
+    size_t lines = 0;
+    for (size_t i = 0; i < g_sink.length; i++) {
+        lines += g_sink.data[i] == '\n';
+    }
+    CHECK(lines == RECORDS && g_sink.data[g_sink.length - 1] == '\n', "each record ends with a newline");
+    
+    json_ndjson_writer_free(&writer);
+}
+
+static void test_reader(void)
+{
+    printf("reader\n");
+    
+    CHECK(read_back(g_sink.data, g_sink.length, 1, 4096, g_sink.length) == 0, "single thread, one buffer");
+    CHECK(read_back(g_sink.data, g_sink.length, 4, 64, g_sink.length) == 0, "four threads, small batches");
+    CHECK(read_back(g_sink.data, g_sink.length, 4, 100, 997) == 0, "four threads, records split across chunks");
+    CHECK(read_back(g_sink.data, g_sink.length, 3, 7, 1) == 0, "one byte at a time");
+    
+    /* Without a trailing newline the last record is decoded by finish */
+    CHECK(read_back(g_sink.data, g_sink.length - 1, 2, 50, 4096) == 0, "last record without a newline");
+}
+
+static void test_bad_records(void)
+{
+    printf("bad records\n");
+    
+    const char *text = "{\"id\":1}\n\n  \r\n{\"id\":oops}\n{\"name\":\"no id\"}\r\n{\"id\":4}\n";
+    READ_STATE state;
+    memset(&state, 0, sizeof(state));
+    
+    JSON_NDJSON_CALLBACKS strict = { on_any_record, NULL };
+    JSON_NDJSON_READER *reader = json_ndjson_reader_create(NULL, &event_schema, sizeof(EVENT), &strict, &state);
+    CHECK(json_ndjson_reader_feed(reader, text, strlen(text)) != 0 &&
+          json_ndjson_reader_error(reader)[0] != '\0', "without on_error the first bad record fails");
+    json_ndjson_reader_destroy(reader);
+    
+    /* With on_error, bad records are reported by line and reading goes on */
+    JSON_NDJSON_CALLBACKS lenient = { on_any_record, on_error };
+    memset(&state, 0, sizeof(state));
+    reader = json_ndjson_reader_create(NULL, &event_schema, sizeof(EVENT), &lenient, &state);
+    int rc = json_ndjson_reader_feed(reader, text, strlen(text));
+    rc |= json_ndjson_reader_finish(reader);
+    CHECK(rc == 0 && state.errors == 2 && state.error_line == 5 && state.next == 2,
+          "blank lines are skipped and bad records reported by line");
+    json_ndjson_reader_destroy(reader);
+}
+
+int main(void)
+{
+    g_sink.capacity = 1024 * 1024;
+    g_sink.data = (char*)malloc(g_sink.capacity);
+    if (!g_sink.data) {
+        return 1;
+    }
+    
+    test_writer();
+    test_reader();
+    test_bad_records();
+    
+    free(g_sink.data);
+    
+    if (g_failures) {
+        printf("%d check(s) failed\n", g_failures);
+        return 1;
+    }
+    printf("All checks passed\n");
+    return 0;
+}
@@ -0,0 +1,228 @@
+/**
+ * JSON Number Conversion Tests
+ *
+ * Parsing must give the same bits as strtod for every input, including
+ * the halfway and subnormal cases the fast paths cannot decide alone.
+ * Formatting must read back to the same double with the fewest digits,
+ * checked against libc at increasing precision. Random inputs come from
+ * a fixed seed so every run takes the same path.
+ *
+ * Usage: test_json_number
+ */
+
+#include "json_number.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <math.h>
+
+#define RANDOM_VALUES 200000
+
+static int g_failures = 0;
+
+#define CHECK(cond, what) do { \
+        if (cond) { \
+            printf("  ok    %s\n", what); \
+        } else { \
+            printf("  FAIL  %s (%s:%d)\n", what, __FILE__, __LINE__); \
+            g_failures++; \
+        } \
+    } while (0)
+
+/* ==================== Helpers ==================== */
+
+static uint64_t g_seed = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t next_random(void)
+{
+    g_seed ^= g_seed << 13;
+    g_seed ^= g_seed >> 7;
+    g_seed ^= g_seed << 17;
+    return g_seed;
+}
+
+static uint64_t bits_of(double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static int parses_like_strtod(const char *text)
+{
+    JSON_NUMBER number;
+    size_t length = strlen(text);
+    return json_number_parse(text, length, &number) == length &&
+           bits_of(number.real) == bits_of(strtod(text, NULL));
+}
+
+/* Significant digits of formatted text, leading and trailing zeros dropped */
+static int significant_digits(const char *text, char *digits)
+{
+    int length = 0;
+    for (const char *p = text; *p && *p != 'e'; p++) {
+        if (*p >= '0' && *p <= '9' && (length > 0 || *p != '0')) {
+            digits[length++] = *p;
+        }
+    }
+    while (length > 0 && digits[length - 1] == '0') {
+        length--;
+    }
+    digits[length] = '\0';
+    return length;
+}
+
+/* Shortest correctly rounded digits, by trial through libc */
+static void shortest_digits(double value, char *digits)
+{
+    char text[40];
+    for (int precision = 1; precision <= 17; precision++) {
+        snprintf(text, sizeof(text), "%.*e", precision - 1, value);
+        if (strtod(text, NULL) == value) {
+            break;
+        }
+    }
+    significant_digits(text, digits);
+}
+
+static int formats_as(double value, const char *expected)
+{
+    char buffer[JSON_NUMBER_BUFFER_SIZE];
+    json_number_format_double(value, buffer);
+    return strcmp(buffer, expected) == 0;
+}
+
+/* ==================== Tests ==================== */
+
+static void test_parse_known(void)
+{
+    printf("parse known values\n");
+    
+    static const char *cases[] = {
+        "0", "-0.0", "1", "0.1", "1e23", "8.41e21", "9007199254740993",
+        "2.2250738585072011e-308",                      /* Largest subnormal boundary */
+        "4.9406564584124654e-324", "2.4703282292062328e-324",
+        "1.7976931348623157e308", "1.7976931348623159e308",
+        "0.30000000000000004", "123456789012345678901234567890",
+        "7.038531e-26", "9214843084008499", "1.00000000000000011102230246251565404236316680908203125",
+        "1.00000000000000011102230246251565404236316680908203124",
+        "1.00000000000000011102230246251565404236316680908203126",
+    };
+    
+    int exact = 1;
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        if (!parses_like_strtod(cases[i])) {
+            printf("        mismatch: %s\n", cases[i]);
+            exact = 0;
+        }
+    }
+    CHECK(exact, "halfway, subnormal and overflow cases match strtod bit for bit");
+    
+    JSON_NUMBER number;
+    CHECK(json_number_parse("-42,", 4, &number) == 3 && !number.is_double && number.integer == -42,
+          "integers stay integers and stop at the delimiter");
+    CHECK(json_number_parse("9223372036854775808", 19, &number) == 19 && number.is_double,
+          "integers beyond int64 become doubles");
+    CHECK(json_number_parse("x", 1, &number) == 0, "non-numbers consume nothing");
+}
+
+static void test_parse_random(void)
+{
+    printf("parse random values\n");
+    
+    char text[64];
+    int exact = 1;
+    for (int i = 0; i < RANDOM_VALUES && exact; i++) {
+        /* Up to 19 digits with an exponent spanning the whole double range */
+        uint64_t mantissa = next_random() % 10000000000000000000ULL;
+        int exponent = (int)(next_random() % 680) - 340;
+        snprintf(text, sizeof(text), "%" PRIu64 "e%d", mantissa, exponent);
+        exact = parses_like_strtod(text);
+        if (!exact) {
+            printf("        mismatch: %s\n", text);
+        }
+    }
+    CHECK(exact, "random decimal text matches strtod bit for bit");
+    
+    exact = 1;
+    for (int i = 0; i < RANDOM_VALUES && exact; i++) {
+        /* Full precision text of random doubles, one ulp either side */
+        uint64_t bits = next_random() & 0x7FEFFFFFFFFFFFFFULL;
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+        snprintf(text, sizeof(text), "%.25e", value);
+        exact = parses_like_strtod(text);
+        if (!exact) {
+            printf("        mismatch: %s\n", text);
+        }
+    }
+    CHECK(exact, "25-digit text of random doubles matches strtod bit for bit");
+}
+
+static void test_format_known(void)
+{
+    printf("format known values\n");
+    
+    CHECK(formats_as(0.1, "0.1"), "0.1 is not 0.10000000000000001");
+    CHECK(formats_as(-0.0, "-0"), "negative zero keeps its sign");
+    CHECK(formats_as(1e21, "1e+21"), "1e21 switches to scientific notation");
+    CHECK(formats_as(1e20, "100000000000000000000"), "1e20 stays plain");
+    CHECK(formats_as(1e-7, "1e-7"), "1e-7 switches to scientific notation");
+    CHECK(formats_as(0.000001, "0.000001"), "1e-6 stays plain");
+    CHECK(formats_as(5e-324, "5e-324"), "smallest subnormal");
+    CHECK(formats_as(1.7976931348623157e308, "1.7976931348623157e+308"), "largest double");
+    CHECK(formats_as(30892612233637952.0, "30892612233637950"), "Grisu2's long case gets 16 digits");
+    
+    char buffer[JSON_NUMBER_BUFFER_SIZE];
+    json_number_format_double(NAN, buffer);
+    CHECK(strcmp(buffer, "null") == 0, "NaN is written as null");
+}
+
+static void test_format_random(void)
+{
+    printf("format random values\n");
+    
+    char buffer[JSON_NUMBER_BUFFER_SIZE];
+    char digits[40], expected[40];
+    int round_trip = 1, shortest = 1;
+    for (int i = 0; i < RANDOM_VALUES; i++) {
+        uint64_t bits = next_random();
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+        if (value != value || value - value != 0) {
+            continue;
+        }
+        
+        json_number_format_double(value, buffer);
+        if (round_trip && bits_of(strtod(buffer, NULL)) != bits) {
+            printf("        %s does not read back\n", buffer);
+            round_trip = 0;
+        }
+        
+        significant_digits(buffer, digits);
+        shortest_digits(value, expected);
+        if (shortest && strcmp(digits, expected) != 0) {
+            printf("        %s, expected digits %s\n", buffer, expected);
+            shortest = 0;
+        }
+    }
+    CHECK(round_trip, "random doubles read back bit for bit");
+    CHECK(shortest, "random doubles use the shortest, closest digits");
+}
+
+int main(void)
+{
+    test_parse_known();
+    test_parse_random();
+    test_format_known();
+    test_format_random();
+    
+    if (g_failures) {
+        printf("%d check(s) failed\n", g_failures);
+        return 1;
+    }
+    printf("All checks passed\n");
+    return 0;
+}
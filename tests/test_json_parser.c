@@ -0,0 +1,1375 @@
+/**
+ * JSON Parser Behaviour Tests
+ *
+ * Checks the public JSON API against hand-written documents: every parser
+ * (tree, arena, cursor, stream, validate) must accept the same documents
+ * and decode them to the same values.
+ *
+ * Usage: test_json_parser
+ */
+
+#include "json_parser.h"
+#include "json_stream.h"
+#include "json_index.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+static int g_failures = 0;
+
+#define CHECK(cond, what) do { \
+        if (cond) { \
+            printf("  ok    %s\n", what); \
+        } else { \
+            printf("  FAIL  %s (%s:%d)\n", what, __FILE__, __LINE__); \
+            g_failures++; \
+        } \
+    } while (0)
+
+/* ==================== Helpers ==================== */
+
+/* First element of a parsed one-element string array, or NULL */
+static const char* first_string(JSON_VALUE *array)
+{
+    if (!array || array->type != JSON_TYPE_ARRAY || array->data.array_value.count != 1) {
+        return NULL;
+    }
+    return json_get_string(array->data.array_value.elements[0]);
+}
+
+/* Whether a tree writes back as exactly the expected compact text */
+static int writes_as(const JSON_VALUE *value, const char *expected)
+{
+    char buffer[4096];
+    int length = value ? json_write(value, buffer, sizeof(buffer)) : -1;
+    return length >= 0 && (size_t)length == strlen(expected) && memcmp(buffer, expected, (size_t)length) == 0;
+}
+
+/* Whether the streaming parser accepts the whole text */
+static int stream_accepts(const char *json)
+{
+    JSON_STREAM_CALLBACKS callbacks;
+    memset(&callbacks, 0, sizeof(callbacks));
+    JSON_STREAM *stream = json_stream_create(NULL, &callbacks, NULL);
+    int accepted = json_stream_feed(stream, json, strlen(json)) == 0 && json_stream_finish(stream) == 0;
+    json_stream_destroy(stream);
+    return accepted;
+}
+
+/* Whether the cursor API decodes the string at [0] */
+static int cursor_accepts(const char *json)
+{
+    JSON_DOC *doc = json_doc_open(json, strlen(json));
+    if (!doc) {
+        return 0;
+    }
+    JSON_CURSOR cursor;
+    char buffer[64];
+    int accepted = json_doc_get_path(doc, "[0]", &cursor) == 0 &&
+                   json_cursor_get_string(&cursor, buffer, sizeof(buffer)) >= 0;
+    json_doc_close(doc);
+    return accepted;
+}
+
+/* ==================== Arena ==================== */
+
+static const char *g_document =
+    "{\"id\":42,\"name\":\"widget\",\"price\":9.5,\"tags\":[\"a\",\"b\"],"
+    "\"owner\":{\"active\":true,\"manager\":null}}";
+
+static void test_arena(void)
+{
+    printf("arena\n");
+    
+    JSON_ARENA *arena = json_arena_create(256);
+    JSON_VALUE *value = json_parse_arena(g_document, strlen(g_document), arena);
+    CHECK(writes_as(value, g_document), "arena tree matches the input");
+    CHECK(value && (value->flags & JSON_VALUE_FLAG_ARENA), "nodes are marked as arena-owned");
+    json_free(value);                   /* No-op: must not touch arena memory */
+    
+    size_t used = json_arena_used(arena);
+    CHECK(used > 0, "parsing allocates from the arena");
+    
+    json_arena_reset(arena);
+    CHECK(json_arena_used(arena) == 0, "reset releases everything");
+    
+    value = json_parse_arena(g_document, strlen(g_document), arena);
+    CHECK(writes_as(value, g_document) && json_arena_used(arena) == used,
+          "the same document reparses into the same space after reset");
+    
+    /* Input need not be NUL-terminated: parse a prefix of a longer buffer */
+    json_arena_reset(arena);
+    value = json_parse_arena("[1,2]garbage", 5, arena);
+    CHECK(writes_as(value, "[1,2]"), "length bounds the input");
+    
+    void *first = json_arena_alloc(arena, 3);
+    void *second = json_arena_alloc(arena, 1);
+    CHECK(first && second && ((uintptr_t)second & 7) == 0, "allocations are 8-byte aligned");
+    
+    json_arena_reset(arena);
+    CHECK(json_parse_arena("[1,", 3, arena) == NULL, "truncated input fails");
+    
+    json_arena_destroy(arena);
+}
+
+/* ==================== Schema ==================== */
+
+typedef struct {
+    int active;
+    char role[8];
+} OWNER;
+
+typedef struct {
+    int id;
+    int64_t serial;
+    char name[8];
+    double price;
+    OWNER owner;
+} PRODUCT;
+
+JSON_SCHEMA_DEFINE(owner_schema, OWNER,
+    JSON_SCHEMA_FIELD_BOOL(OWNER, active, 0),
+    JSON_SCHEMA_FIELD_STRING(OWNER, role, sizeof(((OWNER*)0)->role), 0)
+);
+
+JSON_SCHEMA_DEFINE(product_schema, PRODUCT,
+    JSON_SCHEMA_FIELD_INT(PRODUCT, id, SCHEMA_FLAG_REQUIRED),
+    JSON_SCHEMA_FIELD_INT64(PRODUCT, serial, 0),
+    JSON_SCHEMA_FIELD_STRING(PRODUCT, name, sizeof(((PRODUCT*)0)->name), 0),
+    JSON_SCHEMA_FIELD_DOUBLE(PRODUCT, price, 0),
+    JSON_SCHEMA_FIELD_OBJECT(PRODUCT, owner, &owner_schema, SCHEMA_FLAG_NULLABLE)
+);
+
+static void test_schema(void)
+{
+    printf("schema\n");
+    
+    const char *json = "{\"skip\":[{\"id\":7}],\"id\":42,\"serial\":9007199254740993,"
+                       "\"name\":\"w\\u00e9dget\",\"price\":9.5,\"owner\":{\"active\":true,\"role\":\"admin\"}}";
+    PRODUCT product;
+    memset(&product, 0, sizeof(product));
+    JSON_VALIDATION_RESULT result;
+    CHECK(json_parse_schema_buffer(json, strlen(json), &product_schema, &product, &result) == 0,
+          "document parses into the struct");
+    CHECK(product.id == 42 && product.serial == 9007199254740993LL && product.price == 9.5,
+          "numbers land in their fields at full precision");
+    CHECK(strcmp(product.name, "w\xC3\xA9" "dget") == 0, "escapes in strings are decoded");
+    CHECK(product.owner.active == 1 && strcmp(product.owner.role, "admin") == 0, "nested objects fill nested structs");
+    
+    PRODUCT from_string;
+    memset(&from_string, 0, sizeof(from_string));
+    CHECK(json_parse_with_schema(json, &product_schema, &from_string) == 0 &&
+          memcmp(&from_string, &product, sizeof(product)) == 0,
+          "json_parse_with_schema agrees with the buffer parser");
+    
+    const char *truncated_utf8 = "{\"id\":1,\"name\":\"abcdef\xC3\xA9\"}";
+    memset(&product, 0, sizeof(product));
+    CHECK(json_parse_schema_buffer(truncated_utf8, strlen(truncated_utf8), &product_schema, &product, NULL) == 0 &&
+          strcmp(product.name, "abcdef") == 0, "a character that does not fit is dropped whole");
+    
+    const char *missing = "{\"name\":\"x\"}";
+    memset(&result, 0, sizeof(result));
+    CHECK(json_parse_schema_buffer(missing, strlen(missing), &product_schema, &product, &result) != 0 &&
+          !result.valid && result.error_field && strcmp(result.error_field, "id") == 0,
+          "missing required field is reported by name");
+    
+    const char *null_owner = "{\"id\":1,\"owner\":null}";
+    memset(&product, 0, sizeof(product));
+    CHECK(json_parse_schema_buffer(null_owner, strlen(null_owner), &product_schema, &product, NULL) == 0 &&
+          product.owner.active == 0, "nullable object accepts null");
+    
+    const char *bad_owner = "{\"id\":1,\"owner\":5}";
+    CHECK(json_parse_schema_buffer(bad_owner, strlen(bad_owner), &product_schema, &product, NULL) != 0,
+          "non-object for a nested schema is an error");
+    
+    const char *broken = "{\"id\":1,\"name\":\"x}";
+    memset(&result, 0, sizeof(result));
+    CHECK(json_parse_schema_buffer(broken, strlen(broken), &product_schema, &product, &result) != 0 &&
+          result.error_message[0] != '\0', "syntax errors fail with a message");
+}
+
+/* ==================== Structural Index ==================== */
+
+#define INDEXED_ELEMENTS 1000
+
+static uint32_t g_seed = 12345;
+
+static uint32_t next_random(void)
+{
+    g_seed = g_seed * 1103515245 + 12345;
+    return g_seed >> 16;
+}
+
+static size_t append(char *buffer, size_t used, const char *text)
+{
+    size_t length = strlen(text);
+    memcpy(buffer + used, text, length + 1);
+    return used + length;
+}
+
+static size_t append_whitespace(char *buffer, size_t used)
+{
+    static const char spaces[] = " \t\r\n";
+    for (uint32_t n = next_random() % 5; n > 0; n--) {
+        buffer[used++] = spaces[next_random() % 4];
+    }
+    buffer[used] = '\0';
+    return used;
+}
+
+/* String whose backslash runs and quotes land at every offset within a 64-byte block */
+static size_t append_string(char *buffer, size_t used)
+{
+    used = append(buffer, used, "\"");
+    for (uint32_t n = next_random() % 80; n > 0; n--) {
+        switch (next_random() % 8) {
+            case 0: used = append(buffer, used, "\\\""); break;
+            case 1: used = append(buffer, used, "\\\\"); break;
+            case 2: used = append(buffer, used, "\\u00e9"); break;
+            case 3: used = append(buffer, used, "{[:,]}"); break;
+            case 4: used = append(buffer, used, "\\n"); break;
+            default: buffer[used++] = (char)('a' + next_random() % 26); buffer[used] = '\0'; break;
+        }
+    }
+    return append(buffer, used, "\"");
+}
+
+static size_t append_value(char *buffer, size_t used, int depth)
+{
+    char number[32];
+    used = append_whitespace(buffer, used);
+    switch (depth > 3 ? next_random() % 5 : next_random() % 7) {
+        case 0: used = append_string(buffer, used); break;
+        case 1:
+            snprintf(number, sizeof(number), "%d", (int)(next_random() % 200000) - 100000);
+            used = append(buffer, used, number);
+            break;
+        case 2:
+            snprintf(number, sizeof(number), "%d.%de-%u", (int)(next_random() % 1000), (int)(next_random() % 1000),
+                     next_random() % 20);
+            used = append(buffer, used, number);
+            break;
+        case 3: used = append(buffer, used, "true"); break;
+        case 4: used = append(buffer, used, next_random() % 2 ? "false" : "null"); break;
+        case 5:
+            used = append(buffer, used, "[");
+            for (uint32_t n = next_random() % 4; n > 0; n--) {
+                used = append_value(buffer, used, depth + 1);
+                used = append(buffer, used, n > 1 ? "," : "");
+            }
+            used = append(buffer, used, "]");
+            break;
+        default:
+            used = append(buffer, used, "{");
+            for (uint32_t n = next_random() % 4; n > 0; n--) {
+                used = append_whitespace(buffer, used);
+                used = append_string(buffer, used);
+                used = append(buffer, used, ":");
+                used = append_value(buffer, used, depth + 1);
+                used = append(buffer, used, n > 1 ? "," : "");
+            }
+            used = append(buffer, used, "}");
+            break;
+    }
+    return append_whitespace(buffer, used);
+}
+
+/*
+ * Documents of 4KB and more are parsed through the structural index and
+ * smaller ones byte by byte, so a large array must decode exactly as its
+ * elements do one at a time.
+ */
+static void test_structural_index(void)
+{
+    printf("structural index (%s)\n", json_index_backend());
+    
+    size_t size = 1024 * 1024;
+    char *document = (char*)malloc(size);
+    char *expected = (char*)malloc(size);
+    char *element = (char*)malloc(64 * 1024);
+    char *written = (char*)malloc(size);
+    
+    size_t used = append(document, 0, "[");
+    size_t expected_used = append(expected, 0, "[");
+    int small_ok = 1;
+    for (int i = 0; i < INDEXED_ELEMENTS; i++) {
+        size_t start = used;
+        used = append_value(document, used, 0);
+        
+        /* The same element alone, below the index threshold */
+        JSON_VALUE *value = json_parse(document + start);
+        int length = value ? json_write(value, element, 64 * 1024) : -1;
+        json_free(value);
+        if (length < 0 || used - start >= 4096) {
+            small_ok = 0;
+            break;
+        }
+        expected_used = append(expected, expected_used, element);
+        
+        if (i + 1 < INDEXED_ELEMENTS) {
+            used = append(document, used, ",");
+            expected_used = append(expected, expected_used, ",");
+        }
+    }
+    used = append(document, used, "]");
+    expected_used = append(expected, expected_used, "]");
+    CHECK(small_ok, "each element parses on its own, unindexed");
+    CHECK(used >= 64 * 1024, "document is far past the 4KB index threshold");
+    
+    JSON_VALUE *value = json_parse(document);
+    int length = value ? json_write(value, written, size) : -1;
+    CHECK(length >= 0 && (size_t)length == expected_used && memcmp(written, expected, expected_used) == 0,
+          "indexed json_parse equals the unindexed parses");
+    json_free(value);
+    
+    JSON_ARENA *arena = json_arena_create(0);
+    value = json_parse_arena(document, used, arena);
+    length = value ? json_write(value, written, size) : -1;
+    CHECK(length >= 0 && (size_t)length == expected_used && memcmp(written, expected, expected_used) == 0,
+          "indexed json_parse_arena equals the unindexed parses");
+    json_arena_destroy(arena);
+    
+    CHECK(json_validate(document, used, NULL, NULL) == 0, "indexed json_validate accepts it");
+    
+    /* Cursors always use the index; walk every element back out */
+    JSON_DOC *doc = json_doc_open(document, used);
+    JSON_CURSOR root, cursor;
+    JSON_BUILDER *builder = json_builder_create(0);
+    json_builder_start_array(builder);
+    int walked = doc && json_doc_root(doc, &root) == 0 && json_cursor_first(&root, &cursor) == 0;
+    while (walked) {
+        JSON_VALUE *item = json_cursor_to_value(&cursor);
+        walked = item && json_write_builder(item, builder) == 0;
+        json_free(item);
+        if (!walked || json_cursor_next(&cursor) != 0) {
+            break;
+        }
+    }
+    json_builder_end_array(builder);
+    const char *from_cursor = json_builder_get_string(builder);
+    CHECK(walked && strcmp(from_cursor, expected) == 0, "cursor walk equals the unindexed parses");
+    json_builder_destroy(builder);
+    json_doc_close(doc);
+    
+    /* An error deep inside the document is still found */
+    document[used - 1] = ',';
+    value = json_parse(document);
+    CHECK(value == NULL && json_validate(document, used, NULL, NULL) != 0, "missing final bracket is rejected");
+    json_free(value);
+    
+    document[used - 1] = ']';
+    document[used / 2] = '\x01';
+    value = json_parse(document);
+    CHECK(value == NULL, "a stray control byte midway is rejected");
+    json_free(value);
+    
+    free(document);
+    free(expected);
+    free(element);
+    free(written);
+}
+
+/* ==================== Cursor ==================== */
+
+static void test_cursor(void)
+{
+    printf("cursor\n");
+    
+    const char *json = "{\"user\":{\"id\":7,\"score\":2.5,\"admin\":false,\"nick\":null,"
+                       "\"name\":\"J\\u00fcrgen\"},\"items\":[{\"sku\":\"a\"},{\"sku\":\"b\"},{\"sku\":\"c\"}],"
+                       "\"big\":[[[1]],{\"x\":[2,3]}],\"last\":true}";
+    JSON_DOC *doc = json_doc_open(json, strlen(json));
+    CHECK(doc != NULL, "document opens");
+    
+    JSON_CURSOR cursor;
+    int64_t id = 0;
+    double score = 0;
+    int flag = -1;
+    CHECK(json_doc_get_path(doc, "user.id", &cursor) == 0 && json_cursor_get_int64(&cursor, &id) == 0 && id == 7,
+          "integer by path");
+    CHECK(json_doc_get_path(doc, "user.score", &cursor) == 0 && json_cursor_get_double(&cursor, &score) == 0 &&
+          score == 2.5, "double by path");
+    CHECK(json_doc_get_path(doc, "user.admin", &cursor) == 0 && json_cursor_get_bool(&cursor, &flag) == 0 &&
+          flag == 0, "boolean by path");
+    CHECK(json_doc_get_path(doc, "user.nick", &cursor) == 0 && json_cursor_is_null(&cursor), "null by path");
+    
+    char name[16];
+    CHECK(json_doc_get_path(doc, "user.name", &cursor) == 0 &&
+          json_cursor_get_string(&cursor, name, sizeof(name)) == 7 && strcmp(name, "J\xC3\xBCrgen") == 0,
+          "string decoded on read");
+    CHECK(json_cursor_get_string(&cursor, name, 3) == 1 && strcmp(name, "J") == 0,
+          "short buffer never splits a character");
+    
+    const char *raw;
+    size_t raw_length;
+    CHECK(json_cursor_get_raw_string(&cursor, &raw, &raw_length) == 0 && raw_length == 11 &&
+          memcmp(raw, "J\\u00fcrgen", 11) == 0, "raw string points into the text");
+    CHECK(json_cursor_get_int64(&cursor, &id) != 0, "reading a string as a number fails");
+    
+    CHECK(json_doc_get_path(doc, "items[2].sku", &cursor) == 0 &&
+          json_cursor_get_string(&cursor, name, sizeof(name)) == 1 && name[0] == 'c', "array index in a path");
+    CHECK(json_doc_get_path(doc, "items[3]", &cursor) != 0, "index past the end is not found");
+    CHECK(json_doc_get_path(doc, "user.missing", &cursor) != 0, "missing key is not found");
+    
+    /* Containers are skipped whole while iterating */
+    JSON_CURSOR root, member;
+    const char *keys[8];
+    size_t key_lengths[8];
+    int members = 0;
+    json_doc_root(doc, &root);
+    if (json_cursor_first(&root, &member) == 0) {
+        do {
+            json_cursor_get_key(&member, &keys[members], &key_lengths[members]);
+            members++;
+        } while (members < 8 && json_cursor_next(&member) == 0);
+    }
+    CHECK(members == 4 && key_lengths[3] == 4 && memcmp(keys[3], "last", 4) == 0,
+          "iteration visits each member once, skipping nested containers");
+    
+    JSON_TYPE type;
+    CHECK(json_cursor_find_field(&root, "big", &cursor) == 0 && json_cursor_type(&cursor, &type) == 0 &&
+          type == JSON_TYPE_ARRAY, "find_field and type");
+    JSON_CURSOR element;
+    CHECK(json_cursor_get_index(&cursor, 1, &element) == 0 && json_cursor_find_field(&element, "x", &element) == 0 &&
+          json_cursor_get_index(&element, 1, &element) == 0 && json_cursor_get_int64(&element, &id) == 0 && id == 3,
+          "nested index and field lookups compose");
+    
+    JSON_VALUE *value = json_cursor_to_value(&cursor);
+    CHECK(writes_as(value, "[[[1]],{\"x\":[2,3]}]"), "subtree converts to a tree");
+    json_free(value);
+    
+    /* Reopen reuses the document for new text */
+    const char *other = "[10,20]";
+    CHECK(json_doc_reopen(doc, other, strlen(other)) == 0 && json_doc_get_path(doc, "[1]", &cursor) == 0 &&
+          json_cursor_get_int64(&cursor, &id) == 0 && id == 20, "reopen reads new text");
+    json_doc_close(doc);
+    
+    CHECK(json_doc_open("{\"a\":[1,2}", 10) == NULL, "unbalanced brackets fail to open");
+    CHECK(json_doc_open("[\"abc]", 6) == NULL, "unterminated string fails to open");
+}
+
+/* ==================== Stream ==================== */
+
+/* Events recorded as text, e.g. {k"id"i7} */
+typedef struct {
+    char log[1024];
+    size_t used;
+    int stop_after;             /* Abort at this event count (0 = never) */
+    int events;
+} EVENTS;
+
+static int record(EVENTS *events, const char *text, size_t length)
+{
+    if (events->used + length < sizeof(events->log)) {
+        memcpy(events->log + events->used, text, length);
+        events->used += length;
+        events->log[events->used] = '\0';
+    }
+    return events->stop_after && ++events->events >= events->stop_after;
+}
+
+static int on_start_object(void *data) { return record((EVENTS*)data, "{", 1); }
+static int on_end_object(void *data) { return record((EVENTS*)data, "}", 1); }
+static int on_start_array(void *data) { return record((EVENTS*)data, "[", 1); }
+static int on_end_array(void *data) { return record((EVENTS*)data, "]", 1); }
+static int on_null(void *data) { return record((EVENTS*)data, "n", 1); }
+static int on_document_end(void *data) { return record((EVENTS*)data, ";", 1); }
+
+static int on_key(void *data, const char *key, size_t length)
+{
+    record((EVENTS*)data, "k\"", 2);
+    record((EVENTS*)data, key, length);
+    return record((EVENTS*)data, "\"", 1);
+}
+
+static int on_string(void *data, const char *value, size_t length)
+{
+    record((EVENTS*)data, "s\"", 2);
+    record((EVENTS*)data, value, length);
+    return record((EVENTS*)data, "\"", 1);
+}
+
+static int on_integer(void *data, int64_t value)
+{
+    char text[32];
+    return record((EVENTS*)data, text, (size_t)snprintf(text, sizeof(text), "i%lld", (long long)value));
+}
+
+static int on_double(void *data, double value)
+{
+    char text[32];
+    return record((EVENTS*)data, text, (size_t)snprintf(text, sizeof(text), "d%.17g", value));
+}
+
+static int on_bool(void *data, int value)
+{
+    return record((EVENTS*)data, value ? "t" : "f", 1);
+}
+
+static const JSON_STREAM_CALLBACKS g_recorder = {
+    on_start_object, on_end_object, on_start_array, on_end_array, on_key, on_string,
+    on_integer, on_double, on_bool, on_null, on_document_end
+};
+
+/* Feed text split at the given points; returns 0 if every feed and the finish succeed */
+static int stream_events(const JSON_STREAM_CONFIG *config, const char *json, size_t first, size_t second,
+                         EVENTS *events)
+{
+    size_t length = strlen(json);
+    memset(events, 0, sizeof(*events));
+    JSON_STREAM *stream = json_stream_create(config, &g_recorder, events);
+    int rc = json_stream_feed(stream, json, first) == 0 &&
+             json_stream_feed(stream, json + first, second - first) == 0 &&
+             json_stream_feed(stream, json + second, length - second) == 0 &&
+             json_stream_finish(stream) == 0 ? 0 : -1;
+    json_stream_destroy(stream);
+    return rc;
+}
+
+static void test_stream(void)
+{
+    printf("stream\n");
+    
+    const char *json = " {\"id\": 7, \"name\":\"a\\\"b\\u00e9\\ud83d\\ude00\", \"ratio\":-1.25e-2,"
+                       " \"big\":12345678901234567890, \"tags\":[true,false,null,[]], \"n\":{}} ";
+    const char *expected = "{k\"id\"i7k\"name\"s\"a\"b\xC3\xA9\xF0\x9F\x98\x80\"k\"ratio\"d-0.012500000000000001"
+                           "k\"big\"d1.2345678901234567e+19k\"tags\"[tfn[]]k\"n\"{}};";
+    size_t length = strlen(json);
+    
+    EVENTS events;
+    CHECK(stream_events(NULL, json, length, length, &events) == 0 && strcmp(events.log, expected) == 0,
+          "whole document produces the expected events");
+    
+    /* Every split into three chunks, so each token is cut at every offset */
+    int same = 1;
+    for (size_t first = 0; first <= length && same; first++) {
+        for (size_t second = first; second <= length && same; second++) {
+            same = stream_events(NULL, json, first, second, &events) == 0 && strcmp(events.log, expected) == 0;
+            if (!same) {
+                printf("        split at %zu and %zu: %s\n", first, second, events.log);
+            }
+        }
+    }
+    CHECK(same, "every three-way split produces the same events");
+    
+    CHECK(stream_events(NULL, "42", 1, 2, &events) == 0 && strcmp(events.log, "i42;") == 0,
+          "a top-level number completes at finish");
+    CHECK(stream_events(NULL, "[1] [2]", 7, 7, &events) != 0, "a second value needs multiple_values");
+    
+    JSON_STREAM_CONFIG config;
+    json_stream_config_init(&config);
+    config.multiple_values = 1;
+    CHECK(stream_events(&config, "[1]\n{\"a\":2}\n3", 2, 9, &events) == 0 &&
+          strcmp(events.log, "[i1];{k\"a\"i2};i3;") == 0, "multiple_values accepts NDJSON-style input");
+    
+    json_stream_config_init(&config);
+    config.max_depth = 2;
+    CHECK(stream_events(&config, "[[1]]", 5, 5, &events) == 0, "nesting at max_depth is accepted");
+    CHECK(stream_events(&config, "[[[1]]]", 7, 7, &events) != 0, "nesting past max_depth is refused");
+    
+    json_stream_config_init(&config);
+    config.max_token_size = 8;
+    CHECK(stream_events(&config, "[\"12345678\"]", 3, 6, &events) == 0, "token at max_token_size is accepted");
+    CHECK(stream_events(&config, "[\"123456789\"]", 3, 6, &events) != 0, "token past max_token_size is refused");
+    
+    json_stream_config_init(&config);
+    config.validate_utf8 = 1;
+    CHECK(stream_events(&config, "[\"\xC3\"]", 2, 3, &events) != 0, "validate_utf8 rejects a truncated character");
+    
+    /* A callback's non-zero return stops parsing and sticks */
+    memset(&events, 0, sizeof(events));
+    events.stop_after = 2;
+    JSON_STREAM *stream = json_stream_create(NULL, &g_recorder, &events);
+    CHECK(json_stream_feed(stream, "[1,2,3]", 7) != 0 && strcmp(events.log, "[i1") == 0,
+          "callback abort stops at that event");
+    CHECK(json_stream_feed(stream, "", 0) != 0, "the failure is sticky");
+    
+    json_stream_reset(stream);
+    memset(&events, 0, sizeof(events));
+    CHECK(json_stream_feed(stream, "[1]", 3) == 0 && json_stream_finish(stream) == 0 &&
+          strcmp(events.log, "[i1];") == 0, "reset starts a new document");
+    
+    json_stream_reset(stream);
+    CHECK(json_stream_feed(stream, "[1,]", 4) != 0 && json_stream_offset(stream) == 3 &&
+          json_stream_error(stream)[0] != '\0', "syntax error reports the offending offset");
+    json_stream_destroy(stream);
+}
+
+/* ==================== Builder ==================== */
+
+static void build_sample(JSON_BUILDER *builder)
+{
+    json_builder_start_object(builder);
+    json_builder_add_string(builder, "text", "q\"b\\n\n\t\x01/\xC3\xA9");
+    json_builder_add_int(builder, "int", -7);
+    json_builder_add_int64(builder, "int64", INT64_MIN);
+    json_builder_add_double(builder, "double", 0.1);
+    json_builder_add_bool(builder, "bool", 1);
+    json_builder_add_null(builder, "null");
+    json_builder_add_key(builder, "list");
+    json_builder_start_array(builder);
+    json_builder_add_int(builder, NULL, 1);
+    json_builder_start_array(builder);
+    json_builder_end_array(builder);
+    json_builder_start_object(builder);
+    json_builder_end_object(builder);
+    json_builder_add_raw(builder, "{\"raw\":1}", 9);
+    json_builder_end_array(builder);
+    json_builder_add_string(builder, "k\"ey", "");
+    json_builder_end_object(builder);
+}
+
+static void test_builder(void)
+{
+    printf("builder\n");
+    
+    const char *expected = "{\"text\":\"q\\\"b\\\\n\\n\\t\\u0001/\xC3\xA9\",\"int\":-7,"
+                           "\"int64\":-9223372036854775808,\"double\":0.1,\"bool\":true,\"null\":null,"
+                           "\"list\":[1,[],{},{\"raw\":1}],\"k\\\"ey\":\"\"}";
+    
+    JSON_BUILDER *builder = json_builder_create(8);
+    build_sample(builder);
+    const char *text = json_builder_get_string(builder);
+    CHECK(text && strcmp(text, expected) == 0, "values, nesting and escaping are written exactly");
+    
+    JSON_VALUE *value = text ? json_parse(text) : NULL;
+    JSON_VALUE *field = json_get_path(value, "text");
+    CHECK(field && strcmp(json_get_string(field), "q\"b\\n\n\t\x01/\xC3\xA9") == 0,
+          "escaped strings parse back to the original bytes");
+    json_free(value);
+    
+    json_builder_reset(builder);
+    json_builder_start_array(builder);
+    json_builder_end_array(builder);
+    text = json_builder_get_string(builder);
+    CHECK(text && strcmp(text, "[]") == 0, "reset discards earlier output");
+    json_builder_destroy(builder);
+    
+    /* A caller buffer is written in place and never grown */
+    char buffer[256];
+    JSON_BUILDER fixed;
+    json_builder_init_fixed(&fixed, buffer, sizeof(buffer));
+    build_sample(&fixed);
+    CHECK(!fixed.error && json_builder_get_string(&fixed) == buffer && strcmp(buffer, expected) == 0,
+          "fixed buffer holds the same output in place");
+    
+    char small[16];
+    json_builder_init_fixed(&fixed, small, sizeof(small));
+    build_sample(&fixed);
+    CHECK(fixed.error && json_builder_get_string(&fixed) == NULL, "overflowing a fixed buffer is an error");
+}
+
+/* ==================== Serializer ==================== */
+
+typedef struct {
+    char sku[8];
+    int quantity;
+} LINE;
+
+typedef struct {
+    int id;
+    char note[16];
+    double total;
+    int paid;
+    OWNER owner;
+    int64_t codes[4];
+    size_t code_count;
+    char tags[3][8];            /* Ends at the first empty tag */
+    LINE lines[2];
+    size_t line_count;
+} ORDER;
+
+JSON_SCHEMA_DEFINE(line_schema, LINE,
+    JSON_SCHEMA_FIELD_STRING(LINE, sku, sizeof(((LINE*)0)->sku), 0),
+    JSON_SCHEMA_FIELD_INT(LINE, quantity, 0)
+);
+
+JSON_SCHEMA_DEFINE(order_schema, ORDER,
+    JSON_SCHEMA_FIELD_INT(ORDER, id, 0),
+    JSON_SCHEMA_FIELD_STRING(ORDER, note, sizeof(((ORDER*)0)->note), 0),
+    JSON_SCHEMA_FIELD_DOUBLE(ORDER, total, 0),
+    JSON_SCHEMA_FIELD_BOOL(ORDER, paid, 0),
+    JSON_SCHEMA_FIELD_OBJECT(ORDER, owner, &owner_schema, 0),
+    JSON_SCHEMA_FIELD_ARRAY(ORDER, codes, SCHEMA_TYPE_INT64, code_count, 0),
+    JSON_SCHEMA_FIELD_ARRAY_TERMINATED(ORDER, tags, SCHEMA_TYPE_STRING, 0),
+    JSON_SCHEMA_FIELD_OBJECT_ARRAY(ORDER, lines, &line_schema, line_count, 0)
+);
+
+static void test_serializer(void)
+{
+    printf("serializer\n");
+    
+    ORDER order;
+    memset(&order, 0, sizeof(order));
+    order.id = 5;
+    strcpy(order.note, "say \"hi\"\n");
+    order.total = 19.99;
+    order.paid = 1;
+    order.owner.active = 1;
+    strcpy(order.owner.role, "ops");
+    order.codes[0] = -1;
+    order.codes[1] = INT64_MAX;
+    order.code_count = 2;
+    strcpy(order.tags[0], "new");
+    strcpy(order.tags[1], "gift");
+    strcpy(order.lines[0].sku, "A1");
+    order.lines[0].quantity = 3;
+    order.line_count = 1;
+    
+    const char *expected = "{\"id\":5,\"note\":\"say \\\"hi\\\"\\n\",\"total\":19.99,\"paid\":true,"
+                           "\"owner\":{\"active\":true,\"role\":\"ops\"},\"codes\":[-1,9223372036854775807],"
+                           "\"tags\":[\"new\",\"gift\"],\"lines\":[{\"sku\":\"A1\",\"quantity\":3}]}";
+    
+    char buffer[512];
+    int length = json_serialize(&order, &order_schema, buffer, sizeof(buffer));
+    CHECK(length == (int)strlen(expected) && strcmp(buffer, expected) == 0,
+          "scalars, nested objects, counted and terminated arrays are written exactly");
+    
+    ORDER parsed;
+    memset(&parsed, 0, sizeof(parsed));
+    CHECK(json_parse_schema_buffer(buffer, (size_t)length, &order_schema, &parsed, NULL) == 0 &&
+          memcmp(&parsed, &order, sizeof(order)) == 0, "parsing the output restores the struct");
+    
+    /* Counts beyond capacity are clamped rather than read out of bounds */
+    order.code_count = 99;
+    order.codes[2] = 7;
+    order.codes[3] = 8;
+    length = json_serialize(&order, &order_schema, buffer, sizeof(buffer));
+    CHECK(length > 0 && strstr(buffer, "\"codes\":[-1,9223372036854775807,7,8]") != NULL,
+          "count past capacity writes capacity elements");
+    
+    CHECK(json_serialize(&order, &order_schema, buffer, 40) == -1, "too small a buffer fails");
+    
+    JSON_BUILDER *builder = json_builder_create(0);
+    json_builder_start_array(builder);
+    order.code_count = 0;
+    json_serialize_builder(&order, &order_schema, builder);
+    json_serialize_builder(&order, &order_schema, builder);
+    json_builder_end_array(builder);
+    const char *text = json_builder_get_string(builder);
+    JSON_VALUE *value = text ? json_parse(text) : NULL;
+    CHECK(value && value->type == JSON_TYPE_ARRAY && value->data.array_value.count == 2,
+          "structs serialize as elements of a builder array");
+    json_free(value);
+    json_builder_destroy(builder);
+}
+
+/* ==================== Schema Extensions ==================== */
+
+typedef struct {
+    char *key;
+    int value;
+} LABEL;
+
+typedef struct {
+    int state;
+    int history[3];
+    size_t history_count;
+    int64_t *ids;
+    size_t id_count;
+    char **names;
+    size_t name_count;
+    LINE *items;
+    size_t item_count;
+    LABEL *labels;
+    size_t label_count;
+    int retries;
+    char region[8];
+    double ratio;
+    int priority;
+    int64_t stamp;
+} SHIPMENT;
+
+static const char *const g_states[] = { "pending", "paid", "shipped", NULL };
+
+/* Stamps travel as "T<seconds>" strings */
+static int decode_stamp(const char *json, size_t length, void *field)
+{
+    char digits[24];
+    if (length < 4 || length - 3 >= sizeof(digits) || json[0] != '"' || json[1] != 'T' || json[length - 1] != '"') {
+        return -1;
+    }
+    memcpy(digits, json + 2, length - 3);
+    digits[length - 3] = '\0';
+    char *end;
+    *(int64_t*)field = strtoll(digits, &end, 10);
+    return *end == '\0' && end != digits ? 0 : -1;
+}
+
+static int encode_stamp(JSON_BUILDER *builder, const void *field)
+{
+    char text[24];
+    snprintf(text, sizeof(text), "T%lld", (long long)*(const int64_t*)field);
+    json_builder_add_string(builder, NULL, text);
+    return 0;
+}
+
+JSON_SCHEMA_DEFINE(shipment_schema, SHIPMENT,
+    JSON_SCHEMA_FIELD_ENUM(SHIPMENT, state, g_states, SCHEMA_FLAG_REQUIRED),
+    JSON_SCHEMA_FIELD_ENUM_ARRAY(SHIPMENT, history, g_states, history_count, 0),
+    JSON_SCHEMA_FIELD_DYNAMIC_ARRAY(SHIPMENT, ids, SCHEMA_TYPE_INT64, id_count, 0),
+    JSON_SCHEMA_FIELD_DYNAMIC_ARRAY(SHIPMENT, names, SCHEMA_TYPE_STRING, name_count, 0),
+    JSON_SCHEMA_FIELD_OBJECT_DYNAMIC_ARRAY(SHIPMENT, items, &line_schema, item_count, 0),
+    JSON_SCHEMA_FIELD_MAP(SHIPMENT, labels, LABEL, value, SCHEMA_TYPE_INT, label_count, 0),
+    JSON_SCHEMA_FIELD_INT_DEFAULT(SHIPMENT, retries, 3, 0),
+    JSON_SCHEMA_FIELD_STRING_DEFAULT(SHIPMENT, region, sizeof(((SHIPMENT*)0)->region), "eu", 0),
+    JSON_SCHEMA_FIELD_DOUBLE_DEFAULT(SHIPMENT, ratio, 0.5, 0),
+    JSON_SCHEMA_FIELD_ENUM_DEFAULT(SHIPMENT, priority, g_states, 1, 0),
+    JSON_SCHEMA_FIELD_CUSTOM(SHIPMENT, stamp, decode_stamp, encode_stamp, 0)
+);
+
+/* Parse into a zeroed shipment from the arena; 0 on success */
+static int parse_shipment(const char *json, SHIPMENT *shipment, JSON_ARENA *arena, JSON_VALIDATION_RESULT *result)
+{
+    memset(shipment, 0, sizeof(*shipment));
+    return json_parse_schema_arena(json, strlen(json), &shipment_schema, shipment, arena, result);
+}
+
+static void test_schema_extensions(void)
+{
+    printf("schema extensions\n");
+    
+    const char *json = "{\"state\":\"shipped\",\"history\":[\"pending\",\"paid\"],\"ids\":[1,-2,9007199254740993],"
+                       "\"names\":[\"a\",\"b\\u00e9\",\"\"],\"items\":[{\"sku\":\"A1\",\"quantity\":2},{\"sku\":\"B2\"}],"
+                       "\"labels\":{\"x\":1,\"y\\\"\":-5,\"x\":7},\"retries\":0,\"ratio\":null,"
+                       "\"priority\":\"pending\",\"stamp\":\"T1700000000\"}";
+    JSON_ARENA *arena = json_arena_create(0);
+    SHIPMENT shipment;
+    CHECK(parse_shipment(json, &shipment, arena, NULL) == 0, "document parses with dynamic fields in the arena");
+    CHECK(shipment.state == 2 && shipment.history_count == 2 && shipment.history[0] == 0 &&
+          shipment.history[1] == 1 && shipment.priority == 0, "enum strings become their index");
+    CHECK(shipment.id_count == 3 && shipment.ids[2] == 9007199254740993LL && shipment.name_count == 3 &&
+          strcmp(shipment.names[1], "b\xC3\xA9") == 0 && shipment.names[2][0] == '\0',
+          "dynamic arrays hold every element");
+    CHECK(shipment.item_count == 2 && strcmp(shipment.items[1].sku, "B2") == 0 && shipment.items[0].quantity == 2 &&
+          shipment.items[1].quantity == 0, "dynamic object arrays decode each element");
+    CHECK(shipment.label_count == 3 && strcmp(shipment.labels[1].key, "y\"") == 0 &&
+          shipment.labels[1].value == -5 && shipment.labels[2].value == 7,
+          "map entries keep their keys and input order");
+    CHECK(shipment.retries == 0 && shipment.ratio == 0.0 && strcmp(shipment.region, "eu") == 0,
+          "defaults fill absent fields only; present values and null are kept");
+    CHECK(shipment.stamp == 1700000000, "custom hook decodes the raw value");
+    
+    /* The validator is stricter: ratio is not nullable */
+    JSON_VALIDATION_RESULT result;
+    CHECK(json_validate(json, strlen(json), &shipment_schema, &result) != 0 && result.error_field &&
+          strcmp(result.error_field, "ratio") == 0, "json_validate rejects null for a field that is not nullable");
+    const char *strict = "{\"state\":\"paid\",\"labels\":{\"a\":1},\"names\":[\"x\"],\"stamp\":\"T1\"}";
+    CHECK(json_validate(strict, strlen(strict), &shipment_schema, NULL) == 0,
+          "json_validate accepts enums, maps, dynamic arrays and custom values");
+    
+    const char *expected = "{\"state\":\"shipped\",\"history\":[\"pending\",\"paid\"],\"ids\":[1,-2,9007199254740993],"
+                           "\"names\":[\"a\",\"b\xC3\xA9\",\"\"],\"items\":[{\"sku\":\"A1\",\"quantity\":2},"
+                           "{\"sku\":\"B2\",\"quantity\":0}],\"labels\":{\"x\":1,\"y\\\"\":-5,\"x\":7},\"retries\":0,"
+                           "\"region\":\"eu\",\"ratio\":0,\"priority\":\"pending\",\"stamp\":\"T1700000000\"}";
+    char buffer[1024];
+    int length = json_serialize(&shipment, &shipment_schema, buffer, sizeof(buffer));
+    CHECK(length == (int)strlen(expected) && strcmp(buffer, expected) == 0,
+          "enums, maps, dynamic arrays and custom hooks serialize back");
+    
+    SHIPMENT again;
+    CHECK(parse_shipment(buffer, &again, arena, NULL) == 0 && again.label_count == 3 && again.item_count == 2 &&
+          again.stamp == shipment.stamp && again.state == shipment.state && again.ids[1] == -2,
+          "the serialized shipment parses back");
+    
+    /* Absent fields take their defaults */
+    CHECK(parse_shipment("{\"state\":\"pending\"}", &shipment, arena, NULL) == 0 && shipment.retries == 3 &&
+          strcmp(shipment.region, "eu") == 0 && shipment.ratio == 0.5 && shipment.priority == 1 &&
+          shipment.id_count == 0 && shipment.label_count == 0, "absent fields take their defaults");
+    
+    memset(&result, 0, sizeof(result));
+    CHECK(parse_shipment("{\"state\":\"lost\"}", &shipment, arena, &result) != 0 && result.error_field &&
+          strcmp(result.error_field, "state") == 0, "unknown enum name is a schema error");
+    CHECK(parse_shipment("{\"state\":\"paid\",\"stamp\":17}", &shipment, arena, NULL) != 0,
+          "a failing custom hook fails the parse");
+    CHECK(json_schema_find_enum(&shipment_schema, 0, "paid", 4) == 1 &&
+          json_schema_find_enum(&shipment_schema, 0, "pai", 3) == -1, "enum lookup by name");
+    
+    memset(&shipment, 0, sizeof(shipment));
+    CHECK(json_parse_schema_buffer(json, strlen(json), &shipment_schema, &shipment, NULL) != 0,
+          "dynamic fields need an arena");
+    
+    /* Enum values out of range serialize as null */
+    memset(&shipment, 0, sizeof(shipment));
+    shipment.state = 9;
+    length = json_serialize(&shipment, &shipment_schema, buffer, sizeof(buffer));
+    CHECK(length > 0 && strncmp(buffer, "{\"state\":null,", 14) == 0, "out-of-range enum value is written as null");
+    
+    json_arena_destroy(arena);
+}
+
+/* ==================== Paths ==================== */
+
+#define WIDE_KEYS 200
+
+/* The integer stored under "k<i>" in the wide object, or -1 */
+static int64_t wide_member(JSON_VALUE *root, int i)
+{
+    char path[32];
+    snprintf(path, sizeof(path), "wide.k%d", i);
+    JSON_VALUE *member = json_get_path(root, path);
+    return member && member->type == JSON_TYPE_INTEGER ? member->data.integer_value : -1;
+}
+
+static void test_paths(void)
+{
+    printf("paths\n");
+    
+    /* An object wide enough to be looked up through its hash index */
+    char json[8192];
+    size_t used = append(json, 0, "{\"a\":{\"b\":[10,{\"c\":\"deep\"}]},\"wide\":{");
+    for (int i = 0; i < WIDE_KEYS; i++) {
+        char member[32];
+        snprintf(member, sizeof(member), "%s\"k%d\":%d", i ? "," : "", i, i * 3);
+        used = append(json, used, member);
+    }
+    used = append(json, used, "},\"dup\":1,\"dup\":2}");
+    
+    JSON_VALUE *heap = json_parse(json);
+    JSON_ARENA *arena = json_arena_create(0);
+    JSON_VALUE *arena_root = json_parse_arena(json, used, arena);
+    
+    JSON_VALUE *found = json_get_path(heap, "a.b[1].c");
+    CHECK(found && strcmp(json_get_string(found), "deep") == 0, "keys and indices compose");
+    found = json_get_path(heap, "a.b[0]");
+    CHECK(found && found->data.integer_value == 10, "index into an array");
+    
+    int wide_ok = 1;
+    for (int i = 0; i < WIDE_KEYS; i++) {
+        wide_ok &= wide_member(heap, i) == i * 3 && wide_member(arena_root, i) == i * 3;
+    }
+    CHECK(wide_ok, "every member of a wide object is found, heap and arena");
+    CHECK(wide_member(heap, WIDE_KEYS) == -1 && wide_member(arena_root, WIDE_KEYS) == -1,
+          "absent member of a wide object is not found");
+    
+    found = json_get_path(heap, "dup");
+    JSON_VALUE *arena_found = json_get_path(arena_root, "dup");
+    CHECK(found && arena_found && found->data.integer_value == arena_found->data.integer_value,
+          "duplicate keys resolve the same way with and without the index");
+    
+    static const char *malformed[] = {
+        ".a", "a.", "a..b", "a.b[]", "a.b[x]", "a.b[1", "a.b[-1]", "a.b[1]x",
+    };
+    int rejected = 1;
+    for (size_t i = 0; i < sizeof(malformed) / sizeof(malformed[0]); i++) {
+        JSON_PATH *compiled = json_path_compile(malformed[i]);
+        if (compiled || json_get_path(heap, malformed[i])) {
+            printf("        accepted: \"%s\"\n", malformed[i]);
+            rejected = 0;
+        }
+        json_path_free(compiled);
+    }
+    CHECK(rejected, "malformed paths are rejected when compiled and when used");
+    CHECK(json_get_path(heap, "") == heap, "empty path is the value itself");
+    CHECK(json_get_path(heap, "a.b[2]") == NULL && json_get_path(heap, "a.x") == NULL,
+          "well-formed paths to nothing are not found");
+    
+    /* A compiled path agrees with the text path on every representation */
+    JSON_PATH *compiled = json_path_compile("wide.k123");
+    JSON_DOC *doc = json_doc_open(json, used);
+    JSON_CURSOR cursor;
+    int64_t number = 0;
+    CHECK(compiled && json_path_get(compiled, heap) == json_get_path(heap, "wide.k123") &&
+          json_path_get(compiled, arena_root)->data.integer_value == 369 &&
+          json_path_get_doc(compiled, doc, &cursor) == 0 && json_cursor_get_int64(&cursor, &number) == 0 &&
+          number == 369, "compiled path finds the same member in heap, arena and cursor documents");
+    json_doc_close(doc);
+    json_path_free(compiled);
+    
+    json_free(heap);
+    json_arena_destroy(arena);
+}
+
+/* ==================== Patch ==================== */
+
+/* Whether json_write_patch writes exactly the expected text */
+static int patches_as(JSON_VALUE *value, const char *expected)
+{
+    JSON_BUILDER *builder = json_builder_create(0);
+    const char *text = value && json_write_patch(value, builder) == 0 ? json_builder_get_string(builder) : NULL;
+    int same = text && strcmp(text, expected) == 0;
+    if (text && !same) {
+        printf("        wrote %s\n", text);
+    }
+    json_builder_destroy(builder);
+    return same;
+}
+
+static void test_patch(void)
+{
+    printf("patch\n");
+    
+    /* Unedited: whitespace, number spelling and escapes all come back as written */
+    const char *source = "{\n  \"a\" : [ 1 , 2.50 , \"x\\u0041\" ],\n"
+                         "  \"b\" : { \"c\" : true , \"d\" : null },\n  \"e\":1E2 }";
+    JSON_VALUE *value = json_parse_source(source, strlen(source));
+    CHECK(value && (value->flags & JSON_VALUE_FLAG_SOURCE), "source trees are marked");
+    CHECK(patches_as(value, source), "an unedited document is written byte for byte");
+    CHECK(patches_as(value, source), "writing does not change the tree");
+    
+    size_t size = 1024 * 1024;
+    char *document = (char*)malloc(size);
+    size_t used = append(document, 0, "[");
+    for (int i = 0; i < INDEXED_ELEMENTS; i++) {
+        used = append_value(document, used, 0);
+        used = append(document, used, i + 1 < INDEXED_ELEMENTS ? "," : "]");
+    }
+    JSON_VALUE *large = json_parse_source(document, used);
+    CHECK(used >= 4096 && patches_as(large, document), "an unedited indexed document is written byte for byte");
+    json_free(large);
+    free(document);
+    
+    /* Edits rewrite only the containers they touch; everything else is copied */
+    json_object_set(json_get_path(value, "b"), "c", json_create_bool(0));
+    CHECK(patches_as(value, "{\"a\":[ 1 , 2.50 , \"x\\u0041\" ],\"b\":{\"c\":false,\"d\":null},\"e\":1E2}"),
+          "replacing a member rewrites its object and ancestors only");
+    
+    json_array_append(json_get_path(value, "a"), json_create_string("n\""));
+    json_array_insert(json_get_path(value, "a"), 0, json_create_integer(0));
+    CHECK(patches_as(value, "{\"a\":[0,1,2.50,\"x\\u0041\",\"n\\\"\"],\"b\":{\"c\":false,\"d\":null},\"e\":1E2}"),
+          "appended and inserted elements are written, existing ones copied");
+    
+    CHECK(json_remove(value, "e") == 0 && json_remove(value, "a[9]") != 0 && json_remove(value, "z") != 0,
+          "remove succeeds only for paths that exist");
+    json_object_set(value, "new", json_create_double(0.1));
+    CHECK(patches_as(value, "{\"a\":[0,1,2.50,\"x\\u0041\",\"n\\\"\"],\"b\":{\"c\":false,\"d\":null},\"new\":0.1}"),
+          "removed members are gone and new members follow");
+    CHECK(writes_as(value, "{\"a\":[0,1,2.5,\"xA\",\"n\\\"\"],\"b\":{\"c\":false,\"d\":null},\"new\":0.1}"),
+          "json_write normalizes what the patch copies");
+    json_free(value);
+    
+    /* Trees built from scratch or by json_parse have no source to copy */
+    value = json_parse("{ \"k\" : [ 1 ] }");
+    json_array_append(json_get_path(value, "k"), json_create_null());
+    CHECK(patches_as(value, "{\"k\":[1,null]}"), "trees without a source are written compactly");
+    json_free(value);
+    
+    JSON_ARENA *arena = json_arena_create(0);
+    value = json_parse_arena("{\"k\":[1]}", 9, arena);
+    JSON_VALUE *element = json_create_integer(2);
+    CHECK(json_array_append(json_get_path(value, "k"), element) != 0 && json_remove(value, "k") != 0,
+          "arena trees are read-only");
+    json_free(element);
+    json_arena_destroy(arena);
+}
+
+/* ==================== Interning ==================== */
+
+#define INTERN_THREADS 4
+#define INTERN_KEYS 64
+#define INTERN_DOCUMENTS 200
+
+typedef struct {
+    JSON_INTERN *pool;
+    int thread;
+    const char *keys[INTERN_KEYS];  /* Pointer seen for "k<i>", the same in every document */
+    int consistent;
+} INTERN_WORKER;
+
+/* Parse documents whose keys come in a per-thread order, recording each key's pointer */
+static void* intern_worker(void *arg)
+{
+    INTERN_WORKER *worker = (INTERN_WORKER*)arg;
+    char json[4096];
+    worker->consistent = 1;
+    
+    for (int d = 0; d < INTERN_DOCUMENTS; d++) {
+        size_t used = append(json, 0, "{");
+        for (int i = 0; i < INTERN_KEYS; i++) {
+            char member[32];
+            int key = (i * 7 + d + worker->thread * 13) % INTERN_KEYS;
+            snprintf(member, sizeof(member), "%s\"k%d\":%d", i ? "," : "", key, key);
+            used = append(json, used, member);
+        }
+        used = append(json, used, "}");
+        
+        JSON_VALUE *value = json_parse_interned(json, used, worker->pool);
+        for (size_t i = 0; value && i < value->data.object_value.count; i++) {
+            const char *key = value->data.object_value.keys[i];
+            int64_t index = value->data.object_value.values[i]->data.integer_value;
+            if (!worker->keys[index]) {
+                worker->keys[index] = key;
+            }
+            worker->consistent &= worker->keys[index] == key;
+        }
+        worker->consistent &= value != NULL;
+        json_free(value);
+    }
+    return NULL;
+}
+
+static void test_interning(void)
+{
+    printf("interning\n");
+    
+    JSON_INTERN *pool = json_intern_create(0);
+    const char *first_json = "{\"id\":1,\"name\":\"a\",\"nested\":{\"id\":2}}";
+    const char *second_json = "{\"name\":\"b\",\"id\":3}";
+    JSON_VALUE *first = json_parse_interned(first_json, strlen(first_json), pool);
+    JSON_VALUE *second = json_parse_interned(second_json, strlen(second_json), pool);
+    const char *id = json_intern(pool, "id", 2);
+    
+    CHECK(first && second && (first->flags & JSON_VALUE_FLAG_INTERNED), "objects are marked as interned");
+    CHECK(writes_as(first, first_json) && writes_as(second, second_json), "interned trees hold the same values");
+    CHECK(first->data.object_value.keys[0] == id && second->data.object_value.keys[1] == id &&
+          json_get_path(first, "nested")->data.object_value.keys[0] == id &&
+          first->data.object_value.keys[1] == second->data.object_value.keys[0],
+          "equal keys share one pointer across documents and nesting levels");
+    CHECK(json_intern_count(pool) == 3 && json_intern(pool, "name", 4) == second->data.object_value.keys[0],
+          "each distinct key is stored once");
+    
+    JSON_VALUE *found = json_object_get_interned(second, id);
+    CHECK(found && found->data.integer_value == 3, "json_object_get_interned finds by canonical pointer");
+    JSON_VALUE *plain = json_parse(second_json);
+    found = json_object_get_interned(plain, id);
+    CHECK(found && found->data.integer_value == 3, "other objects fall back to a string lookup");
+    json_free(plain);
+    
+    /* Editing switches the object to its own copies; the pool is untouched */
+    CHECK(json_object_set(first, "extra", json_create_null()) == 0 && json_remove(first, "name") == 0 &&
+          writes_as(first, "{\"id\":1,\"nested\":{\"id\":2},\"extra\":null}"), "interned objects can be edited");
+    json_free(first);
+    CHECK(strcmp(second->data.object_value.keys[1], "id") == 0 && json_intern_count(pool) == 3,
+          "freeing an edited tree leaves pooled keys alone");
+    json_free(second);
+    
+    char long_key[100];
+    memset(long_key, 'x', 80);
+    long_key[80] = '\0';
+    char long_json[128];
+    snprintf(long_json, sizeof(long_json), "{\"%s\":1}", long_key);
+    JSON_VALUE *value = json_parse_interned(long_json, strlen(long_json), pool);
+    CHECK(value && json_intern_count(pool) == 3 && json_get_path(value, long_key) != NULL,
+          "keys over 64 bytes are copied, not pooled");
+    json_free(value);
+    json_intern_destroy(pool);
+    
+    /* A full pool stops growing and later keys are copied */
+    pool = json_intern_create(4);
+    const char *wide = "{\"a\":1,\"b\":2,\"c\":3,\"d\":4,\"e\":5,\"f\":6}";
+    value = json_parse_interned(wide, strlen(wide), pool);
+    CHECK(value && writes_as(value, wide) && json_intern_count(pool) == 4 && json_intern(pool, "z", 1) == NULL &&
+          json_intern(pool, "a", 1) != NULL, "a full pool keeps its keys and copies the rest");
+    found = json_get_path(value, "f");
+    CHECK(found && found->data.integer_value == 6, "copied keys are still found");
+    json_free(value);
+    json_intern_destroy(pool);
+    
+    /* Concurrent parsers agree on one pointer per key */
+    pool = json_intern_create(0);
+    INTERN_WORKER workers[INTERN_THREADS];
+    pthread_t threads[INTERN_THREADS];
+    int started = 1;
+    memset(workers, 0, sizeof(workers));
+    for (int t = 0; t < INTERN_THREADS; t++) {
+        workers[t].pool = pool;
+        workers[t].thread = t;
+        started &= pthread_create(&threads[t], NULL, intern_worker, &workers[t]) == 0;
+    }
+    for (int t = 0; t < INTERN_THREADS; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    
+    int agree = started;
+    for (int t = 0; t < INTERN_THREADS; t++) {
+        agree &= workers[t].consistent;
+        for (int i = 0; i < INTERN_KEYS; i++) {
+            char key[8];
+            snprintf(key, sizeof(key), "k%d", i);
+            agree &= workers[t].keys[i] == json_intern(pool, key, strlen(key));
+        }
+    }
+    CHECK(agree && json_intern_count(pool) == INTERN_KEYS, "concurrent parsers share one canonical key each");
+    json_intern_destroy(pool);
+}
+
+/* ==================== Validate ==================== */
+
+/* Whether json_validate accepts the text, and where it stopped if not */
+static int validates(const char *json, const JSON_SCHEMA *schema, size_t *offset)
+{
+    JSON_VALIDATION_RESULT result;
+    int rc = json_validate(json, strlen(json), schema, &result);
+    if (offset) {
+        *offset = rc == 0 ? 0 : result.error_offset;
+    }
+    return rc == 0 && result.valid;
+}
+
+static void test_validate(void)
+{
+    printf("validate\n");
+    
+    /* Syntax only: the validator accepts exactly what the stream parser does */
+    static const struct {
+        const char *json;
+        int valid;
+    } syntax[] = {
+        { "{\"a\":[1,-2.5e+3,true,false,null,\"x\\u00e9\"]}", 1 },
+        { " [ ] ", 1 },
+        { "\"\\ud83d\\ude00\"", 1 },
+        { "01", 0 },
+        { "1.", 0 },
+        { "1e", 0 },
+        { "-", 0 },
+        { "[1,]", 0 },
+        { "{\"a\":1,}", 0 },
+        { "{\"a\" 1}", 0 },
+        { "[1] [2]", 0 },
+        { "[\"a\nb\"]", 0 },
+        { "[\"\\q\"]", 0 },
+        { "[\"\\ud83d\"]", 0 },
+        { "[tru]", 0 },
+        { "", 0 },
+    };
+    int agree = 1;
+    for (size_t i = 0; i < sizeof(syntax) / sizeof(syntax[0]); i++) {
+        int valid = validates(syntax[i].json, NULL, NULL);
+        if (valid != syntax[i].valid || stream_accepts(syntax[i].json) != valid) {
+            printf("        disagree: %s\n", syntax[i].json);
+            agree = 0;
+        }
+    }
+    CHECK(agree, "syntax checks agree with the stream parser");
+    
+    char deep[2100];
+    memset(deep, '[', 1024);
+    memset(deep + 1024, ']', 1024);
+    deep[2048] = '\0';
+    CHECK(validates(deep, NULL, NULL), "1024 levels of nesting pass");
+    memset(deep, '[', 1025);
+    memset(deep + 1025, ']', 1025);
+    deep[2050] = '\0';
+    CHECK(!validates(deep, NULL, NULL), "nesting beyond 1024 levels is rejected");
+    
+    size_t offset;
+    CHECK(!validates("{\"a\":[1,2,x]}", NULL, &offset) && offset == 10, "syntax errors report their offset");
+    
+    /* With a schema, values parsing would skip or truncate are errors */
+    const char *product = "{\"id\":42,\"serial\":9007199254740993,\"name\":\"w\\u00e9dget\",\"price\":9.5,"
+                          "\"owner\":{\"active\":true,\"role\":\"admin\"},\"extra\":[{}]}";
+    CHECK(validates(product, &product_schema, NULL), "a conforming document passes");
+    CHECK(validates("{\"id\":1,\"owner\":null}", &product_schema, NULL), "null is accepted where nullable");
+    
+    JSON_VALIDATION_RESULT result;
+    const char *missing = "{\"name\":\"x\"}";
+    CHECK(json_validate(missing, strlen(missing), &product_schema, &result) != 0 && !result.valid &&
+          result.error_field && strcmp(result.error_field, "id") == 0, "missing required field is reported by name");
+    
+    static const struct {
+        const char *json;
+        size_t offset;
+        const char *what;
+    } violations[] = {
+        { "{\"id\":\"42\"}", 6, "string for an int" },
+        { "{\"id\":1.5}", 6, "fraction for an int" },
+        { "{\"id\":2147483648}", 6, "int out of range" },
+        { "{\"id\":null}", 6, "null where not nullable" },
+        { "{\"id\":1,\"serial\":1e3}", 17, "double for an int64" },
+        { "{\"id\":1,\"name\":\"12345678\"}", 15, "string longer than its buffer" },
+        { "{\"id\":1,\"owner\":{\"active\":1}}", 26, "number for a bool in a nested object" },
+        { "{\"id\":1,\"owner\":[]}", 16, "array for a nested object" },
+        { "[{\"id\":1}]", 0, "array at the top level" },
+    };
+    int rejected = 1;
+    for (size_t i = 0; i < sizeof(violations) / sizeof(violations[0]); i++) {
+        if (validates(violations[i].json, &product_schema, &offset) || offset != violations[i].offset) {
+            printf("        %s: accepted or wrong offset %zu\n", violations[i].what, offset);
+            rejected = 0;
+        }
+    }
+    CHECK(rejected, "type, range, length and nullability violations are reported at the value");
+    CHECK(validates("{\"id\":1,\"name\":\"1234567\"}", &product_schema, NULL), "a string that just fits passes");
+    
+    /* The parser takes the same documents, truncating or skipping instead */
+    PRODUCT parsed;
+    memset(&parsed, 0, sizeof(parsed));
+    const char *long_name = "{\"id\":1,\"name\":\"12345678\"}";
+    CHECK(json_parse_schema_buffer(long_name, strlen(long_name), &product_schema, &parsed, NULL) == 0,
+          "parsing is more lenient than validating");
+    
+    CHECK(validates("{\"codes\":[1,2,3,4],\"tags\":[\"a\",\"b\",\"c\"],\"lines\":[{},{}]}", &order_schema, NULL),
+          "arrays at capacity pass");
+    CHECK(!validates("{\"codes\":[1,2,3,4,5]}", &order_schema, NULL) &&
+          !validates("{\"lines\":[{},{},{}]}", &order_schema, NULL),
+          "arrays beyond capacity fail");
+    CHECK(!validates("{\"codes\":[1,\"2\"]}", &order_schema, NULL), "array elements are type-checked");
+    CHECK(!validates("{\"owner\":null}", &order_schema, NULL), "null object fails where not nullable");
+}
+
+/* ==================== Escapes ==================== */
+
+static void test_escapes(void)
+{
+    printf("escapes\n");
+    
+    JSON_VALUE *value = json_parse("[\"a\\u00e9\\n\\\"\"]");
+    const char *text = first_string(value);
+    CHECK(text && strcmp(text, "a\xC3\xA9\n\"") == 0, "short and \\u escapes decode to UTF-8");
+    json_free(value);
+    
+    value = json_parse("[\"\\ud83d\\ude00\"]");
+    text = first_string(value);
+    CHECK(text && strcmp(text, "\xF0\x9F\x98\x80") == 0, "surrogate pair decodes to one 4-byte character");
+    json_free(value);
+    
+    value = json_parse("[\"\\ud83d\"]");
+    CHECK(value == NULL, "unpaired high surrogate is rejected");
+    json_free(value);
+    
+    value = json_parse("[\"\\ude00\"]");
+    CHECK(value == NULL, "lone low surrogate is rejected");
+    json_free(value);
+    
+    value = json_parse("[\"\\x41\"]");
+    CHECK(value == NULL, "unknown escape is rejected");
+    json_free(value);
+    
+    /* NUL-terminated storage would turn ["\u0000x"] into [""] */
+    const char *nul = "[\"\\u0000x\"]";
+    value = json_parse(nul);
+    CHECK(value == NULL, "\\u0000 is rejected by json_parse");
+    json_free(value);
+    
+    JSON_ARENA *arena = json_arena_create(0);
+    CHECK(json_parse_arena(nul, strlen(nul), arena) == NULL, "\\u0000 is rejected by json_parse_arena");
+    json_arena_destroy(arena);
+    
+    CHECK(json_validate(nul, strlen(nul), NULL, NULL) != 0, "\\u0000 is rejected by json_validate");
+    CHECK(!cursor_accepts(nul), "\\u0000 is rejected by the cursor API");
+    CHECK(!stream_accepts(nul), "\\u0000 is rejected by the stream parser");
+    
+    const char *nul_key = "{\"a\\u0000b\":1}";
+    value = json_parse(nul_key);
+    CHECK(value == NULL, "\\u0000 in a key is rejected");
+    json_free(value);
+    
+    CHECK(cursor_accepts("[\"\\u0001\"]") && stream_accepts("[\"\\u0001\"]"),
+          "other escaped control characters are still accepted");
+}
+
+int main(void)
+{
+    test_arena();
+    test_schema();
+    test_structural_index();
+    test_cursor();
+    test_stream();
+    test_builder();
+    test_serializer();
+    test_schema_extensions();
+    test_paths();
+    test_patch();
+    test_interning();
+    test_validate();
+    test_escapes();
+    
+    if (g_failures) {
+        printf("%d check(s) failed\n", g_failures);
+        return 1;
+    }
+    printf("All checks passed\n");
+    return 0;
+}